@@ -365,7 +365,7 @@ bool GenerateAccumulatorWitness(const PublicCoin &coin, Accumulator& accumulator
     int nZerocoinStartHeight = GetZerocoinStartHeight();
     pindex = chainActive[nZerocoinStartHeight];
     while (pindex->nHeight < nAccStartHeight) {
-        nMintsAdded += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), coin.getDenomination());
+        nMintsAdded += pindex->vZerocoinMints.Get(coin.getDenomination());
         pindex = chainActive[pindex->nHeight + 1];
     }
 
@@ -312,8 +312,8 @@ bool CActiveMasternode::Register(CTxIn vin, CService service, CKey keyCollateral
     if (pmn == NULL) {
         CMasternode mn(mnb);
         mnodeman.Add(mn);
-    } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+    } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        mnodeman.UpdateMasternodeIndex(*pmn);
     }
 
     //send to all peers
@@ -0,0 +1,196 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilereader.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+CBlockFileReader blockFileReader;
+
+/** Size of the magic and length preceding every record */
+static const unsigned int RECORD_HEADER_SIZE = MESSAGE_START_SIZE + sizeof(unsigned int);
+
+/** A block or undo file opened for reading, possibly memory mapped */
+class CBlockFileReader::CBlockFile
+{
+public:
+    FILE* file;
+    //! Serializes the seek and read on file when it is not mapped
+    boost::mutex csFile;
+    const char* pmap;
+    //! Size of the file when it was opened, and of the mapping
+    uint64_t nSize;
+    uint64_t nLastUsed;
+
+    CBlockFile() : file(NULL), pmap(NULL), nSize(0), nLastUsed(0) {}
+
+    ~CBlockFile()
+    {
+#ifndef WIN32
+        if (pmap)
+            munmap(const_cast<char*>(pmap), nSize);
+#endif
+        if (file)
+            fclose(file);
+    }
+
+    bool Open(const boost::filesystem::path& path, bool fMmap)
+    {
+        file = fopen(path.string().c_str(), "rb");
+        if (!file)
+            return false;
+        if (fseek(file, 0, SEEK_END) != 0)
+            return false;
+        long nEnd = ftell(file);
+        if (nEnd < 0)
+            return false;
+        nSize = nEnd;
+#ifndef WIN32
+        if (fMmap && nSize > 0) {
+            void* p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fileno(file), 0);
+            if (p != MAP_FAILED)
+                pmap = (const char*)p;
+            else
+                LogPrintf("%s: cannot map %s, reading it instead\n", __func__, path.string());
+        }
+#endif
+        return true;
+    }
+
+    bool Read(uint64_t nPos, char* pch, size_t nLen)
+    {
+        if (nPos + nLen > nSize)
+            return false;
+        if (pmap) {
+            memcpy(pch, pmap + nPos, nLen);
+            return true;
+        }
+        boost::unique_lock<boost::mutex> lock(csFile);
+        if (fseek(file, nPos, SEEK_SET) != 0)
+            return false;
+        return fread(pch, 1, nLen, file) == nLen;
+    }
+};
+
+CBlockFileReader::CBlockFileReader() : nAccessCounter(0), nMaxFiles(DEFAULT_BLOCK_FILE_HANDLES), fMmap(DEFAULT_BLOCK_MMAP), nReads(0), nOpens(0)
+{
+}
+
+void CBlockFileReader::SetLimits(unsigned int nMaxFilesIn, bool fMmapIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    nMaxFiles = std::max(std::min(nMaxFilesIn, MAX_BLOCK_FILE_HANDLES), 1U);
+    fMmap = fMmapIn;
+    mapFiles.clear();
+}
+
+boost::shared_ptr<CBlockFileReader::CBlockFile> CBlockFileReader::GetFile(const FileKey& key, uint64_t nEnd)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::map<FileKey, boost::shared_ptr<CBlockFile> >::iterator it = mapFiles.find(key);
+    if (it != mapFiles.end()) {
+        // The last block file keeps growing while we have it open, so a
+        // record past its end means it has to be opened again.
+        if (it->second->nSize >= nEnd) {
+            it->second->nLastUsed = ++nAccessCounter;
+            return it->second;
+        }
+        mapFiles.erase(it);
+    }
+
+    while (mapFiles.size() >= nMaxFiles) {
+        std::map<FileKey, boost::shared_ptr<CBlockFile> >::iterator itOldest = mapFiles.begin();
+        for (it = mapFiles.begin(); it != mapFiles.end(); ++it) {
+            if (it->second->nLastUsed < itOldest->second->nLastUsed)
+                itOldest = it;
+        }
+        // Readers still using the file keep it open until they are done
+        mapFiles.erase(itOldest);
+    }
+
+    boost::shared_ptr<CBlockFile> pfile(new CBlockFile());
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(key.second, 0), key.first.c_str());
+    if (!pfile->Open(path, fMmap)) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return boost::shared_ptr<CBlockFile>();
+    }
+    nOpens++;
+    pfile->nLastUsed = ++nAccessCounter;
+    mapFiles[key] = pfile;
+    return pfile;
+}
+
+bool CBlockFileReader::ReadRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nExtra, std::vector<char>& vchRecord)
+{
+    if (pos.IsNull() || pos.nPos < RECORD_HEADER_SIZE)
+        return error("%s : invalid position %s%05u.dat:%u", __func__, prefix, pos.nFile, pos.nPos);
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nReads++;
+    }
+
+    FileKey key(prefix, pos.nFile);
+    boost::shared_ptr<CBlockFile> pfile = GetFile(key, pos.nPos);
+    if (!pfile)
+        return false;
+
+    char pchHeader[RECORD_HEADER_SIZE];
+    if (!pfile->Read(pos.nPos - RECORD_HEADER_SIZE, pchHeader, RECORD_HEADER_SIZE))
+        return error("%s : cannot read header of %s%05u.dat:%u", __func__, prefix, pos.nFile, pos.nPos);
+    CDataStream ssHeader(pchHeader, pchHeader + RECORD_HEADER_SIZE, SER_DISK, CLIENT_VERSION);
+    MessageStartChars pchMessageStart;
+    unsigned int nSize;
+    ssHeader >> FLATDATA(pchMessageStart) >> nSize;
+    if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return error("%s : no record at %s%05u.dat:%u", __func__, prefix, pos.nFile, pos.nPos);
+    if (nSize > MAX_SIZE)
+        return error("%s : record at %s%05u.dat:%u is too large (%u)", __func__, prefix, pos.nFile, pos.nPos, nSize);
+
+    uint64_t nEnd = (uint64_t)pos.nPos + nSize + nExtra;
+    if (pfile->nSize < nEnd) {
+        pfile = GetFile(key, nEnd);
+        if (!pfile)
+            return false;
+    }
+
+    vchRecord.resize(nSize + nExtra);
+    if (vchRecord.empty())
+        return true;
+    if (!pfile->Read(pos.nPos, &vchRecord[0], vchRecord.size()))
+        return error("%s : cannot read %u bytes at %s%05u.dat:%u", __func__, vchRecord.size(), prefix, pos.nFile, pos.nPos);
+    return true;
+}
+
+void CBlockFileReader::Close(int nFile)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    mapFiles.erase(FileKey("blk", nFile));
+    mapFiles.erase(FileKey("rev", nFile));
+}
+
+void CBlockFileReader::CloseAll()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    mapFiles.clear();
+}
+
+void CBlockFileReader::GetStats(uint64_t& nReadsOut, uint64_t& nOpensOut)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    nReadsOut = nReads;
+    nOpensOut = nOpens;
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEREADER_H
+#define BITCOIN_BLOCKFILEREADER_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+struct CDiskBlockPos;
+
+/** Default for -blockfilehandles, the number of block and undo files kept open for reading */
+static const unsigned int DEFAULT_BLOCK_FILE_HANDLES = 16;
+/** Maximum for -blockfilehandles, init reserves the file descriptors on top of MIN_CORE_FILEDESCRIPTORS */
+static const unsigned int MAX_BLOCK_FILE_HANDLES = 64;
+/** Default for -blockmmap, memory mapping needs a 64 bit address space */
+#if !defined(WIN32)
+static const bool DEFAULT_BLOCK_MMAP = sizeof(void*) >= 8;
+#else
+static const bool DEFAULT_BLOCK_MMAP = false;
+#endif
+/** Default for -checkblockreads */
+static const bool DEFAULT_CHECK_BLOCK_READS = false;
+
+/**
+ * Reads records from the block (blk?????.dat) and undo (rev?????.dat) files.
+ *
+ * Every record in these files is preceded by the network magic and its
+ * size. The files a record is read from are kept open, or memory mapped,
+ * in a small LRU cache, so that reading a block no longer opens, seeks and
+ * closes its file each time. Files are only ever opened read-only; writing
+ * still goes through OpenBlockFile and OpenUndoFile.
+ *
+ * All methods are thread-safe.
+ */
+class CBlockFileReader
+{
+private:
+    class CBlockFile;
+    typedef std::pair<std::string, int> FileKey;
+
+    //! Mutex to protect the inner state
+    boost::mutex cs;
+
+    //! Open files by prefix and file number
+    std::map<FileKey, boost::shared_ptr<CBlockFile> > mapFiles;
+
+    //! Access counter used to find the least recently used file
+    uint64_t nAccessCounter;
+
+    unsigned int nMaxFiles;
+    bool fMmap;
+
+    uint64_t nReads;
+    uint64_t nOpens;
+
+    boost::shared_ptr<CBlockFile> GetFile(const FileKey& key, uint64_t nEnd);
+
+public:
+    CBlockFileReader();
+
+    //! Set the number of files kept open and whether they are memory mapped
+    void SetLimits(unsigned int nMaxFilesIn, bool fMmapIn);
+
+    /**
+     * Read the record at pos from the file with the given prefix ("blk" or
+     * "rev"). The record size is taken from the header preceding pos, and
+     * nExtra bytes following the record (e.g. the undo checksum) are read
+     * along with it.
+     */
+    bool ReadRecord(const CDiskBlockPos& pos, const char* prefix, unsigned int nExtra, std::vector<char>& vchRecord);
+
+    //! Forget an open file, e.g. because it was truncated
+    void Close(int nFile);
+
+    //! Close all files
+    void CloseAll();
+
+    //! Number of reads and of file opens since startup
+    void GetStats(uint64_t& nReadsOut, uint64_t& nOpensOut);
+};
+
+extern CBlockFileReader blockFileReader;
+
+#endif // BITCOIN_BLOCKFILEREADER_H
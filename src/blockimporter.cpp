@@ -0,0 +1,388 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimporter.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+CBlockImporter blockImporter;
+
+/**
+ * Whether the network magic starts anywhere after the first byte of a
+ * record, its magic and size included, or at its end where the bytes that
+ * follow may complete it. A block cut short by a crash is followed by the
+ * next record inside the size it claims, so only such a record can hide
+ * others.
+ */
+static bool HasInnerMagic(const unsigned char* pchHeader, unsigned int nHeaderSize, const std::vector<char>& vchBlock)
+{
+    const unsigned char* pchMagic = (const unsigned char*)Params().MessageStart();
+    size_t nLength = nHeaderSize + vchBlock.size();
+    for (size_t i = 1; i < nLength; i++) {
+        size_t j = 0;
+        while (j < MESSAGE_START_SIZE && i + j < nLength) {
+            unsigned char ch = i + j < nHeaderSize ? pchHeader[i + j] : (unsigned char)vchBlock[i + j - nHeaderSize];
+            if (ch != pchMagic[j])
+                break;
+            j++;
+        }
+        if (j == MESSAGE_START_SIZE || i + j == nLength)
+            return true;
+    }
+    return false;
+}
+
+CBlockImporter::CBlockImporter() : nInFlight(0), nRead(0), fReadDone(false), fStop(false), nThreads(1), nOrphanBytes(0)
+{
+}
+
+void CBlockImporter::SetThreads(int nThreadsIn)
+{
+    if (nThreadsIn <= 0)
+        nThreadsIn += boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreadsIn, MAX_IMPORT_THREADS));
+}
+
+void CBlockImporter::ReadThread(FILE* fileIn, CDiskBlockPos posFile)
+{
+    RenameThread("xuez-loadblk-read");
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        while (!blkdat.eof()) {
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (!fStop && nInFlight >= MAX_IMPORT_QUEUE)
+                    condSpace.wait(lock);
+                if (fStop)
+                    break;
+            }
+
+            int64_t nStart = GetTimeMicros();
+            blkdat.SetPos(nRewind);
+            nRewind++;         // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            unsigned char buf[MESSAGE_START_SIZE];
+            try {
+                // locate a header
+                blkdat.FindByte(Params().MessageStart()[0]);
+                nRewind = blkdat.GetPos() + 1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                break;
+            }
+
+            CRecord record;
+            uint64_t nBlockPos = 0;
+            try {
+                // read block, it is deserialized by the parsing threads
+                nBlockPos = blkdat.GetPos();
+                record.pos = posFile;
+                record.pos.nPos = nBlockPos;
+                blkdat.SetLimit(nBlockPos + nSize);
+                blkdat.SetPos(nBlockPos);
+                record.vchBlock.resize(nSize);
+                blkdat.read(&record.vchBlock[0], nSize);
+            } catch (const std::exception& e) {
+                LogPrintf("%s : I/O error - %s\n", __func__, e.what());
+                continue;
+            }
+
+            // Skipping the whole record when it does not deserialize would
+            // skip the records inside it too, so one that may hold others is
+            // parsed here, and if it fails scanning resumes after its magic,
+            // or else after the bytes it was read from.
+            unsigned char vchHeader[MESSAGE_START_SIZE + 4];
+            memcpy(vchHeader, buf, MESSAGE_START_SIZE);
+            for (int i = 0; i < 4; i++)
+                vchHeader[MESSAGE_START_SIZE + i] = (nSize >> (8 * i)) & 0xff;
+            if (HasInnerMagic(vchHeader, sizeof(vchHeader), record.vchBlock)) {
+                try {
+                    CDataStream ss(record.vchBlock, SER_DISK, CLIENT_VERSION);
+                    record.pblock.reset(new CBlock());
+                    ss >> *record.pblock;
+                    nRewind = nBlockPos + nSize - ss.size();
+                } catch (const std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+                    continue;
+                }
+            } else {
+                nRewind = blkdat.GetPos();
+            }
+
+            boost::unique_lock<boost::mutex> lock(cs);
+            stageRead.nBlocks++;
+            stageRead.nMicros += GetTimeMicros() - nStart;
+            record.nSequence = nRead++;
+            nInFlight++;
+            queueRead.push_back(CRecord());
+            std::swap(queueRead.back(), record);
+            condRead.notify_one();
+        }
+    } catch (const std::exception& e) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        strReadError = e.what();
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    fReadDone = true;
+    condRead.notify_all();
+    condParsed.notify_all();
+}
+
+void CBlockImporter::ParseThread()
+{
+    RenameThread("xuez-loadblk-parse");
+    while (true) {
+        CRecord record;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (!fStop && !fReadDone && queueRead.empty())
+                condRead.wait(lock);
+            if (fStop || queueRead.empty())
+                return;
+            std::swap(record, queueRead.front());
+            queueRead.pop_front();
+        }
+
+        int64_t nStart = GetTimeMicros();
+        try {
+            // The reader has parsed the records that may hold others already
+            if (!record.pblock) {
+                CDataStream ss(record.vchBlock, SER_DISK, CLIENT_VERSION);
+                record.pblock.reset(new CBlock());
+                ss >> *record.pblock;
+            }
+            // Hashed here so that validation finds the hash cached
+            record.pblock->GetHash();
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            record.pblock.reset();
+        }
+        std::vector<char>().swap(record.vchBlock);
+
+        boost::unique_lock<boost::mutex> lock(cs);
+        stageParse.nBlocks++;
+        stageParse.nMicros += GetTimeMicros() - nStart;
+        mapParsed[record.nSequence] = record;
+        condParsed.notify_all();
+    }
+}
+
+bool CBlockImporter::NextRecord(uint64_t nSequence, CRecord& record)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::map<uint64_t, CRecord>::iterator it;
+    while ((it = mapParsed.find(nSequence)) == mapParsed.end()) {
+        // Every record read is parsed, so the only way not to get it is when reading ended before it
+        if (fReadDone && nSequence >= nRead)
+            return false;
+        condParsed.wait(lock);
+    }
+    record = it->second;
+    mapParsed.erase(it);
+    nInFlight--;
+    condSpace.notify_one();
+    return true;
+}
+
+void CBlockImporter::AddOrphan(const boost::shared_ptr<CBlock>& pblock, const CDiskBlockPos& pos, bool fHavePos)
+{
+    COrphan orphan;
+    orphan.pos = pos;
+    size_t nSize = pblock->GetSerializeSize(SER_DISK, CLIENT_VERSION);
+    if (nOrphanBytes + nSize <= MAX_IMPORT_ORPHAN_BYTES) {
+        orphan.pblock = pblock;
+        nOrphanBytes += nSize;
+    } else if (!fHavePos) {
+        // Neither in memory nor in the block files, the block can only be found again on the network
+        return;
+    }
+    mapUnknownParent.insert(std::make_pair(pblock->hashPrevBlock, orphan));
+}
+
+int CBlockImporter::ProcessOrphans(const uint256& hash)
+{
+    int nLoaded = 0;
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, COrphan>::iterator, std::multimap<uint256, COrphan>::iterator> range = mapUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, COrphan>::iterator it = range.first;
+            boost::shared_ptr<CBlock> pblock = it->second.pblock;
+            CDiskBlockPos pos = it->second.pos;
+            range.first++;
+            mapUnknownParent.erase(it);
+
+            if (pblock) {
+                nOrphanBytes -= pblock->GetSerializeSize(SER_DISK, CLIENT_VERSION);
+            } else {
+                pblock.reset(new CBlock());
+                if (!ReadBlockFromDisk(*pblock, pos))
+                    continue;
+            }
+            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, pblock->GetHash().ToString(),
+                head.ToString());
+            int64_t nStart = GetTimeMicros();
+            CValidationState dummy;
+            if (ProcessNewBlock(dummy, NULL, pblock.get(), pos.IsNull() ? NULL : &pos)) {
+                nLoaded++;
+                queue.push_back(pblock->GetHash());
+            }
+            boost::unique_lock<boost::mutex> lock(cs);
+            stageValidate.nBlocks++;
+            stageValidate.nMicros += GetTimeMicros() - nStart;
+        }
+    }
+    return nLoaded;
+}
+
+void CBlockImporter::LogRates(const char* strWhen, int64_t nElapsedMicros)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    double dRead = stageRead.GetRate(1);
+    double dParse = stageParse.GetRate(nThreads);
+    double dValidate = stageValidate.GetRate(1);
+    const char* strBound = "validation";
+    if (dRead > 0 && dRead <= dParse && dRead <= dValidate)
+        strBound = "reading";
+    else if (dParse > 0 && dParse <= dValidate)
+        strBound = "parsing";
+    LogPrintf("Block import %s: %u blocks in %ds (%.1f blocks/s), read %.1f blocks/s, parse %.1f blocks/s with %d threads, validate %.1f blocks/s, bound by %s\n",
+        strWhen, stageValidate.nBlocks, nElapsedMicros / 1000000, nElapsedMicros > 0 ? 1000000.0 * stageValidate.nBlocks / nElapsedMicros : 0,
+        dRead, dParse, nThreads, dValidate, strBound);
+}
+
+bool CBlockImporter::Load(FILE* fileIn, CDiskBlockPos* dbp)
+{
+    int64_t nStart = GetTimeMicros();
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        queueRead.clear();
+        mapParsed.clear();
+        nInFlight = 0;
+        nRead = 0;
+        fReadDone = false;
+        fStop = false;
+        strReadError.clear();
+        stageRead = CStage();
+        stageParse = CStage();
+        stageValidate = CStage();
+    }
+
+    CDiskBlockPos posFile;
+    if (dbp)
+        posFile = *dbp;
+
+    int nLoaded = 0;
+    boost::thread_group threads;
+    try {
+        threads.create_thread(boost::bind(&CBlockImporter::ReadThread, this, fileIn, posFile));
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CBlockImporter::ParseThread, this));
+
+        int64_t nLastReport = GetTime();
+        CRecord record;
+        for (uint64_t nSequence = 0; NextRecord(nSequence, record); nSequence++) {
+            boost::this_thread::interruption_point();
+            if (!record.pblock)
+                continue;
+            CBlock& block = *record.pblock;
+            if (dbp)
+                *dbp = record.pos;
+
+            if (GetTime() - nLastReport >= IMPORT_REPORT_INTERVAL) {
+                LogRates("progress", GetTimeMicros() - nStart);
+                nLastReport = GetTime();
+            }
+
+            // detect out of order blocks, and store them for later
+            uint256 hash = block.GetHash();
+            if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+                AddOrphan(record.pblock, record.pos, dbp != NULL);
+                continue;
+            }
+
+            // process in case the block isn't known yet
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                int64_t nStartValidate = GetTimeMicros();
+                CValidationState state;
+                if (ProcessNewBlock(state, NULL, &block, dbp))
+                    nLoaded++;
+                {
+                    boost::unique_lock<boost::mutex> lock(cs);
+                    stageValidate.nBlocks++;
+                    stageValidate.nMicros += GetTimeMicros() - nStartValidate;
+                }
+                if (state.IsError())
+                    break;
+            } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            }
+
+            nLoaded += ProcessOrphans(hash);
+        }
+    } catch (std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    } catch (...) {
+        // Interrupted: stop the other stages before going
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fStop = true;
+            condRead.notify_all();
+            condSpace.notify_all();
+        }
+        threads.join_all();
+        throw;
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStop = true;
+        condRead.notify_all();
+        condSpace.notify_all();
+    }
+    threads.join_all();
+
+    std::string strError;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        strError = strReadError;
+    }
+    if (!strError.empty())
+        AbortNode(std::string("System error: ") + strError);
+
+    if (nLoaded > 0) {
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, (GetTimeMicros() - nStart) / 1000);
+        LogRates("done", GetTimeMicros() - nStart);
+    }
+    return nLoaded > 0;
+}
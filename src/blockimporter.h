@@ -0,0 +1,143 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORTER_H
+#define BITCOIN_BLOCKIMPORTER_H
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Default for -importthreads, 0 means one per core */
+static const int DEFAULT_IMPORT_THREADS = 0;
+/** Maximum number of threads parsing blocks during an import */
+static const int MAX_IMPORT_THREADS = 16;
+/** Blocks read ahead of validation, well below the number of header hashes remembered */
+static const unsigned int MAX_IMPORT_QUEUE = 256;
+/** Bytes of blocks with an unknown parent kept in memory instead of being read again */
+static const size_t MAX_IMPORT_ORPHAN_BYTES = 64 << 20;
+/** Seconds between progress reports of a long import */
+static const int64_t IMPORT_REPORT_INTERVAL = 60;
+
+/**
+ * Imports blocks from a block file (-reindex) or a bootstrap file
+ * (bootstrap.dat, -loadblock) in three stages:
+ *
+ * - one thread reads the file ahead, finds the records by their network
+ *   magic and size, and queues the raw blocks;
+ * - a pool of threads deserializes them and hashes their headers, which is
+ *   most of the cost of a block that does not go through script checks;
+ * - the calling thread takes the parsed blocks in file order and validates
+ *   them with ProcessNewBlock.
+ *
+ * Blocks whose parent is not known yet are set aside by the hash of that
+ * parent, in memory up to MAX_IMPORT_ORPHAN_BYTES and by their position in
+ * the file beyond that, and processed once the parent has been. They are
+ * kept from one file to the next, as -reindex can find a child before its
+ * parent in an earlier file.
+ *
+ * Every stage counts the blocks it handled and the time it was busy, so the
+ * rate each stage can sustain is logged and the slowest one shows what an
+ * import is bound by.
+ */
+class CBlockImporter
+{
+private:
+    struct CRecord {
+        //! Position in the file, in the order read
+        uint64_t nSequence;
+        CDiskBlockPos pos;
+        std::vector<char> vchBlock;
+        //! NULL until parsed, and after if the block did not deserialize
+        boost::shared_ptr<CBlock> pblock;
+
+        CRecord() : nSequence(0) {}
+    };
+
+    struct COrphan {
+        //! NULL if only the position is kept
+        boost::shared_ptr<CBlock> pblock;
+        CDiskBlockPos pos;
+    };
+
+    struct CStage {
+        uint64_t nBlocks;
+        int64_t nMicros;
+
+        CStage() : nBlocks(0), nMicros(0) {}
+        double GetRate(int nThreads) const { return nMicros > 0 ? 1000000.0 * nBlocks * nThreads / nMicros : 0; }
+    };
+
+    //! Mutex to protect the inner state
+    boost::mutex cs;
+
+    //! Signaled when a record was read or reading ended
+    boost::condition_variable condRead;
+    //! Signaled when a record was parsed
+    boost::condition_variable condParsed;
+    //! Signaled when a record was validated and the reader may go on
+    boost::condition_variable condSpace;
+
+    //! Records waiting to be parsed
+    std::deque<CRecord> queueRead;
+    //! Parsed records waiting for validation, by sequence
+    std::map<uint64_t, CRecord> mapParsed;
+    //! Records read and not validated yet
+    size_t nInFlight;
+    //! Number of records read from the current file
+    uint64_t nRead;
+    bool fReadDone;
+    bool fStop;
+    std::string strReadError;
+
+    int nThreads;
+
+    //! Only used by the validating thread
+    std::multimap<uint256, COrphan> mapUnknownParent;
+    size_t nOrphanBytes;
+
+    CStage stageRead;
+    CStage stageParse;
+    CStage stageValidate;
+
+    void ReadThread(FILE* fileIn, CDiskBlockPos posFile);
+    void ParseThread();
+
+    //! Take the record that follows nSequence out of the pipeline; false when there are none left
+    bool NextRecord(uint64_t nSequence, CRecord& record);
+
+    void AddOrphan(const boost::shared_ptr<CBlock>& pblock, const CDiskBlockPos& pos, bool fHavePos);
+    //! Process the blocks set aside that descend from hash; returns the number accepted
+    int ProcessOrphans(const uint256& hash);
+
+    void LogRates(const char* strWhen, int64_t nElapsedMicros);
+
+public:
+    CBlockImporter();
+
+    //! Set the number of parsing threads, 0 for one per core
+    void SetThreads(int nThreadsIn);
+
+    /**
+     * Import the blocks in fileIn, which is closed when done. dbp is the
+     * position of the file for -reindex, or NULL for files outside the block
+     * directory. Returns whether any block was imported.
+     */
+    bool Load(FILE* fileIn, CDiskBlockPos* dbp);
+};
+
+extern CBlockImporter blockImporter;
+
+#endif // BITCOIN_BLOCKIMPORTER_H
@@ -5,8 +5,48 @@
 
 #include "chain.h"
 
+#include <new>
+
+#include <boost/pool/singleton_pool.hpp>
+
 using namespace std;
 
+/**
+ * CBlockIndex allocation
+ *
+ * There is one block index entry per header and they are never freed before
+ * shutdown, so they are carved out of large chunks instead of being
+ * allocated one by one. This saves the per-allocation overhead of the
+ * general purpose allocator and keeps neighbouring entries close together.
+ */
+namespace
+{
+struct CBlockIndexPoolTag {
+};
+typedef boost::singleton_pool<CBlockIndexPoolTag, sizeof(CBlockIndex)> CBlockIndexPool;
+} // anon namespace
+
+void* CBlockIndex::operator new(size_t nSize)
+{
+    // Derived classes such as CDiskBlockIndex do not fit in the pool
+    if (nSize != sizeof(CBlockIndex))
+        return ::operator new(nSize);
+    void* p = CBlockIndexPool::malloc();
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void CBlockIndex::operator delete(void* p, size_t nSize)
+{
+    if (p == NULL)
+        return;
+    if (nSize != sizeof(CBlockIndex))
+        ::operator delete(p);
+    else
+        CBlockIndexPool::free(p);
+}
+
 /**
  * CChain implementation
  */
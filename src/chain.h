@@ -15,10 +15,15 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <map>
+#include <stdexcept>
 #include <vector>
 
+#include <boost/array.hpp>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
 
 struct CDiskBlockPos {
     int nFile;
@@ -101,6 +106,99 @@ enum BlockStatus {
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 };
 
+/** Number of zerocoin denominations, see libzerocoin::zerocoinDenomList */
+static const unsigned int ZEROCOIN_DENOM_COUNT = 8;
+
+/** Position of a denomination in libzerocoin::zerocoinDenomList */
+inline unsigned int ZerocoinDenominationIndex(libzerocoin::CoinDenomination denom)
+{
+    switch (denom) {
+    case libzerocoin::ZQ_ONE: return 0;
+    case libzerocoin::ZQ_FIVE: return 1;
+    case libzerocoin::ZQ_TEN: return 2;
+    case libzerocoin::ZQ_FIFTY: return 3;
+    case libzerocoin::ZQ_ONE_HUNDRED: return 4;
+    case libzerocoin::ZQ_FIVE_HUNDRED: return 5;
+    case libzerocoin::ZQ_ONE_THOUSAND: return 6;
+    case libzerocoin::ZQ_FIVE_THOUSAND: return 7;
+    default: throw std::out_of_range("ZerocoinDenominationIndex() : invalid denomination");
+    }
+}
+
+/**
+ * One value per zerocoin denomination, kept out of line in a fixed-size
+ * array. The array is copy-on-write: copies share it until one of them is
+ * modified, and an all-zero array is not allocated at all. Most blocks do
+ * not touch the zerocoin state, so their entries share the supply array of
+ * their parent and have no mint counts.
+ */
+template <typename T>
+class CDenominationArray
+{
+private:
+    typedef boost::array<T, ZEROCOIN_DENOM_COUNT> array_type;
+    boost::shared_ptr<array_type> pvalues;
+
+    array_type& MakeUnique()
+    {
+        if (!pvalues)
+            pvalues = boost::make_shared<array_type>(); // value-initialized to zero
+        else if (!pvalues.unique())
+            pvalues = boost::make_shared<array_type>(*pvalues);
+        return *pvalues;
+    }
+
+public:
+    T Get(libzerocoin::CoinDenomination denom) const
+    {
+        unsigned int i = ZerocoinDenominationIndex(denom);
+        return pvalues ? (*pvalues)[i] : 0;
+    }
+
+    void Set(libzerocoin::CoinDenomination denom, T value)
+    {
+        unsigned int i = ZerocoinDenominationIndex(denom);
+        if (!pvalues && value == 0)
+            return;
+        MakeUnique()[i] = value;
+    }
+
+    void Add(libzerocoin::CoinDenomination denom, T value)
+    {
+        Set(denom, Get(denom) + value);
+    }
+
+    void SetNull() { pvalues.reset(); }
+
+    bool IsNull() const
+    {
+        if (pvalues) {
+            BOOST_FOREACH (const T& value, *pvalues) {
+                if (value != 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    //! Whether this array shares its storage with other
+    bool SharesWith(const CDenominationArray& other) const { return pvalues == other.pvalues; }
+
+    //! Heap memory owned by this array, counting shared storage in full
+    size_t DynamicMemoryUsage() const { return pvalues ? sizeof(array_type) : 0; }
+
+    friend bool operator==(const CDenominationArray& a, const CDenominationArray& b)
+    {
+        if (a.pvalues == b.pvalues)
+            return true;
+        BOOST_FOREACH (libzerocoin::CoinDenomination denom, libzerocoin::zerocoinDenomList) {
+            if (a.Get(denom) != b.Get(denom))
+                return false;
+        }
+        return true;
+    }
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -179,10 +277,15 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
     
-    //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
-    
+    //! zerocoin specific fields: the supply of each denomination after this
+    //! block and the number of coins of each denomination minted in it
+    CDenominationArray<int64_t> vZerocoinSupply;
+    CDenominationArray<uint32_t> vZerocoinMints;
+
+    //! Block index entries are allocated from a pool, see chain.cpp
+    static void* operator new(size_t nSize);
+    static void operator delete(void* p, size_t nSize);
+
     void SetNull()
     {
         phashBlock = NULL;
@@ -212,11 +315,8 @@ public:
         nBits = 0;
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
-        // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
+        vZerocoinSupply.SetNull();
+        vZerocoinMints.SetNull();
     }
 
     CBlockIndex()
@@ -294,14 +394,14 @@ public:
     {
         int64_t nTotal = 0;
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * mapZerocoinSupply.at(denom);
+            nTotal += libzerocoin::ZerocoinDenominationToAmount(denom) * vZerocoinSupply.Get(denom);
         }
         return nTotal;
     }
 
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return vZerocoinMints.Get(denom) > 0;
     }
 
     uint256 GetBlockHash() const
@@ -433,7 +533,7 @@ public:
         hashNext = uint256();
     }
 
-    explicit CDiskBlockIndex(CBlockIndex* pindex) : CBlockIndex(*pindex)
+    explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
     }
@@ -480,8 +580,28 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 3) {
             READWRITE(nAccumulatorCheckpoint);
+
+            // The zerocoin data is stored as a map of supply per denomination
+            // and a list of the denominations of the mints in the block.
+            std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+            std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+            if (!ser_action.ForRead()) {
+                BOOST_FOREACH (libzerocoin::CoinDenomination denom, libzerocoin::zerocoinDenomList) {
+                    mapZerocoinSupply[denom] = vZerocoinSupply.Get(denom);
+                    vMintDenominationsInBlock.insert(vMintDenominationsInBlock.end(), vZerocoinMints.Get(denom), denom);
+                }
+            }
             READWRITE(mapZerocoinSupply);
             READWRITE(vMintDenominationsInBlock);
+            if (ser_action.ForRead()) {
+                CDiskBlockIndex* pthis = const_cast<CDiskBlockIndex*>(this);
+                pthis->vZerocoinSupply.SetNull();
+                pthis->vZerocoinMints.SetNull();
+                for (std::map<libzerocoin::CoinDenomination, int64_t>::const_iterator it = mapZerocoinSupply.begin(); it != mapZerocoinSupply.end(); ++it)
+                    pthis->vZerocoinSupply.Set(it->first, it->second);
+                BOOST_FOREACH (libzerocoin::CoinDenomination denom, vMintDenominationsInBlock)
+                    pthis->vZerocoinMints.Add(denom, 1);
+            }
         }
 
     }
@@ -154,6 +154,10 @@ public:
         //nZerocoinStartTime = genesis.nTime + 2678400; // 31 days after genesis
         nZerocoinStartTime = genesis.nTime + 600; // 10min after genesis
 		nZerocoinStartHeight = nLastPOWBlock + 1;
+
+        // Default for -assumevalid, the last checkpoint; raise it with every release
+        hashAssumeValid = uint256("0x5f9d81f3bda7a68771fc6610b6899f5e6da9fb1f3dac8cf3fa561b1a1003bbd8");
+        nAssumeValidHeight = 130000;
 		
         vSeeds.push_back(CDNSSeedData("xuez.donkeypool.com", "xuez.donkeypool.com"));
         vSeeds.push_back(CDNSSeedData("xuezeast.donkeypool.com", "xuezeast.donkeypool.com"));
@@ -255,6 +259,9 @@ public:
 		// THIS MUST BE SOMETIME IN THE FUTURE AFTER BLOCK 1
         nZerocoinStartTime = genesis.nTime + 2678400; // 31 days after genesis
 		nZerocoinStartHeight = nLastPOWBlock + 1;
+
+        hashAssumeValid = 0;
+        nAssumeValidHeight = 0;
 		
         vFixedSeeds.clear();
         vSeeds.clear();
@@ -321,6 +328,9 @@ public:
 		// THIS MUST BE SOMETIME IN THE FUTURE AFTER BLOCK 1
         nZerocoinStartTime = genesis.nTime + 2678400; // 31 days after genesis
 		nZerocoinStartHeight = nLastPOWBlock + 1;
+
+        hashAssumeValid = 0;
+        nAssumeValidHeight = 0;
 		
         vFixedSeeds.clear(); //! Testnet mode doesn't have any fixed seeds.
         vSeeds.clear();      //! Testnet mode doesn't have any DNS seeds.
@@ -0,0 +1,204 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsflusher.h"
+
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+CCoinsViewFlusher* pcoinsFlusher = NULL;
+
+CCoinsViewFlusher::CCoinsViewFlusher(CCoinsView* baseIn, CCoinsViewDB* pdbIn) : CCoinsViewBacked(baseIn), pdb(pdbIn), hashSnapshotBlock(0), fPending(false), fHaveStatsNext(false), fHaveStatsSnapshot(false), fFailed(false), fRunning(false)
+{
+}
+
+CCoinsViewFlusher::~CCoinsViewFlusher()
+{
+    Stop();
+}
+
+void CCoinsViewFlusher::Start()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (fRunning)
+        return;
+    fRunning = true;
+    thread = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, "coinsflush",
+        boost::function<void()>(boost::bind(&CCoinsViewFlusher::Thread, this))));
+}
+
+void CCoinsViewFlusher::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fRunning)
+            return;
+        fRunning = false;
+        cond.notify_all();
+    }
+    thread.join();
+}
+
+void CCoinsViewFlusher::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        while (fRunning && !fPending)
+            cond.wait(lock);
+        // A pending snapshot is still written when stopping
+        if (!fPending)
+            break;
+        lock.unlock();
+        WriteSnapshot();
+        lock.lock();
+    }
+}
+
+void CCoinsViewFlusher::WriteSnapshot()
+{
+    // mapSnapshot is not modified while fPending is set, so it can be read
+    // here without cs, concurrently with the lookups.
+    int64_t nStart = GetTimeMicros();
+    size_t nBytes = 0;
+    size_t nCoins = 0;
+    bool fOk = false;
+    for (CCoinsMap::const_iterator it = mapSnapshot.begin(); it != mapSnapshot.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            nCoins++;
+    }
+    try {
+        fOk = pdb->WriteCoins(mapSnapshot, hashSnapshotBlock, fHaveStatsSnapshot ? &statsSnapshot : NULL, &nBytes);
+    } catch (const std::exception& e) {
+        LogPrintf("%s : %s\n", __func__, e.what());
+    }
+    int64_t nDuration = GetTimeMicros() - nStart;
+    LogPrint("coindb", "Wrote %u coins (%u bytes) to the coin database in %.2fms\n", (unsigned int)nCoins, (unsigned int)nBytes, 0.001 * nDuration);
+
+    // Free the snapshot outside the lock
+    CCoinsMap mapFree;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (fOk) {
+            mapSnapshot.swap(mapFree);
+            hashSnapshotBlock = 0;
+        } else {
+            // Keep answering lookups from the snapshot, the database is behind
+            LogPrintf("%s : failed to write to coin database\n", __func__);
+            fFailed = true;
+        }
+        fPending = false;
+        stats.nFlushes++;
+        stats.nLastCoins = nCoins;
+        stats.nLastBytes = nBytes;
+        stats.nLastDuration = nDuration;
+        stats.nTotalBytes += nBytes;
+        stats.nTotalDuration += nDuration;
+        cond.notify_all();
+    }
+}
+
+void CCoinsViewFlusher::WaitForSnapshot(boost::unique_lock<boost::mutex>& lock) const
+{
+    while (fPending)
+        cond.wait(lock);
+}
+
+bool CCoinsViewFlusher::Sync()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    WaitForSnapshot(lock);
+    return !fFailed;
+}
+
+void CCoinsViewFlusher::SetUtxoStats(const CUtxoStats& statsIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    statsNext = statsIn;
+    fHaveStatsNext = true;
+}
+
+bool CCoinsViewFlusher::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (fPending || fFailed) {
+            CCoinsMap::const_iterator it = mapSnapshot.find(outpoint);
+            if (it != mapSnapshot.end()) {
+                // Spent entries hide the unspent coin that may still be on disk
+                if (it->second.coin.IsSpent())
+                    return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewFlusher::HaveCoin(const COutPoint& outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewFlusher::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if ((fPending || fFailed) && hashSnapshotBlock != 0)
+            return hashSnapshotBlock;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlusher::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    int64_t nStart = GetTimeMicros();
+    WaitForSnapshot(lock);
+    stats.nTotalWait += GetTimeMicros() - nStart;
+    if (fFailed)
+        return false;
+
+    // The previous snapshot was released, so mapCoins is left empty
+    assert(mapSnapshot.empty());
+    mapSnapshot.swap(mapCoins);
+    hashSnapshotBlock = hashBlock;
+    fHaveStatsSnapshot = fHaveStatsNext && statsNext.hashBlock == hashBlock;
+    if (fHaveStatsSnapshot)
+        statsSnapshot = statsNext;
+    fHaveStatsNext = false;
+    fPending = true;
+    if (fRunning) {
+        cond.notify_all();
+        return true;
+    }
+
+    lock.unlock();
+    WriteSnapshot();
+    lock.lock();
+    return !fFailed;
+}
+
+bool CCoinsViewFlusher::GetStats(CCoinsStats& statsOut) const
+{
+    {
+        // The statistics are computed from the database
+        boost::unique_lock<boost::mutex> lock(cs);
+        WaitForSnapshot(lock);
+    }
+    return base->GetStats(statsOut);
+}
+
+CCoinsFlushStats CCoinsViewFlusher::GetFlushStats() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    CCoinsFlushStats ret = stats;
+    ret.fPending = fPending;
+    return ret;
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSFLUSHER_H
+#define BITCOIN_COINSFLUSHER_H
+
+#include "coins.h"
+#include "utxostats.h"
+
+#include <stdint.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CCoinsViewDB;
+
+/** Default for -backgroundflush */
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
+
+/** Chainstate flush metrics, reported by getblockchaininfo */
+struct CCoinsFlushStats {
+    //! Number of snapshots written to the coin database
+    uint64_t nFlushes;
+    //! Whether a snapshot is being written right now
+    bool fPending;
+    //! Number of dirty coins and bytes in the last snapshot
+    uint64_t nLastCoins;
+    uint64_t nLastBytes;
+    //! Duration of the last write, in microseconds
+    int64_t nLastDuration;
+    //! Totals over all writes
+    uint64_t nTotalBytes;
+    int64_t nTotalDuration;
+    //! Time spent waiting for a previous snapshot before starting a new one, in microseconds
+    int64_t nTotalWait;
+
+    CCoinsFlushStats() : nFlushes(0), fPending(false), nLastCoins(0), nLastBytes(0), nLastDuration(0), nTotalBytes(0), nTotalDuration(0), nTotalWait(0) {}
+};
+
+/**
+ * CCoinsView between pcoinsTip and the coin database that writes flushed
+ * coins in the background.
+ *
+ * BatchWrite takes the whole map of the flushing cache over as a frozen
+ * snapshot and returns, so the cache is emptied without waiting for the
+ * database. A worker thread then writes the snapshot in one batch. Until
+ * that write is done, lookups are answered from the snapshot first, so the
+ * cache above never sees the older state in the database. A new snapshot
+ * is only taken once the previous one is written, which keeps the writes
+ * in order; the coins cache can therefore briefly use up to twice -dbcache.
+ *
+ * Without a running worker thread, snapshots are written synchronously.
+ */
+class CCoinsViewFlusher : public CCoinsViewBacked
+{
+private:
+    //! Database the snapshots are written to
+    CCoinsViewDB* pdb;
+
+    //! Mutex to protect the inner state
+    mutable boost::mutex cs;
+
+    //! Signalled when a snapshot is taken, written or the thread is stopped
+    mutable boost::condition_variable cond;
+
+    //! Frozen snapshot; only read while fPending is set
+    CCoinsMap mapSnapshot;
+    uint256 hashSnapshotBlock;
+    bool fPending;
+
+    //! UTXO set statistics written with the next snapshot, and with the current one
+    CUtxoStats statsNext;
+    bool fHaveStatsNext;
+    CUtxoStats statsSnapshot;
+    bool fHaveStatsSnapshot;
+
+    //! Set when writing a snapshot failed; later flushes fail too
+    bool fFailed;
+
+    bool fRunning;
+    boost::thread thread;
+
+    CCoinsFlushStats stats;
+
+    void Thread();
+
+    //! Write the snapshot and release it. Called without cs held.
+    void WriteSnapshot();
+
+    //! Wait until no snapshot is pending. Expects cs to be held through lock.
+    void WaitForSnapshot(boost::unique_lock<boost::mutex>& lock) const;
+
+public:
+    CCoinsViewFlusher(CCoinsView* baseIn, CCoinsViewDB* pdbIn);
+    ~CCoinsViewFlusher();
+
+    //! Start the worker thread
+    void Start();
+    //! Write the pending snapshot and stop the worker thread
+    void Stop();
+
+    /**
+     * Wait until the last snapshot is written. Returns false if writing it
+     * failed.
+     */
+    bool Sync();
+
+    /**
+     * Write the UTXO set statistics with the next snapshot, if it is of the
+     * same block, so that they are always on disk together with the coins.
+     */
+    void SetUtxoStats(const CUtxoStats& statsIn);
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool GetStats(CCoinsStats& stats) const;
+
+    CCoinsFlushStats GetFlushStats() const;
+};
+
+extern CCoinsViewFlusher* pcoinsFlusher;
+
+#endif // BITCOIN_COINSFLUSHER_H
@@ -16,25 +16,32 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilereader.h"
+#include "blockimporter.h"
 #include "checkpoints.h"
+#include "coinsflusher.h"
 #include "compat/sanity.h"
 #include "key.h"
 #include "main.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
 #include "masternodeconfig.h"
+#include "masternodedb.h"
 #include "masternodeman.h"
 #include "miner.h"
 #include "net.h"
 #include "rpcserver.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
 #include "torcontrol.h"
+#include "txprevalidator.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxostats.h"
 #include "validationinterface.h"
 #ifdef ENABLE_WALLET
 #include "db.h"
@@ -143,10 +150,10 @@ class CCoinsViewErrorCatcher : public CCoinsViewBacked
 {
 public:
     CCoinsViewErrorCatcher(CCoinsView* view) : CCoinsViewBacked(view) {}
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
         try {
-            return CCoinsViewBacked::GetCoins(txid, coins);
+            return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch (const std::runtime_error& e) {
             uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
             LogPrintf("Error reading from database: %s\n", e.what());
@@ -189,14 +196,20 @@ void PrepareShutdown()
         bitdb.Flush(false);
     GenerateBitcoins(false, NULL, 0);
 #endif
+    txPreValidator.Stop();
     StopNode();
     InterruptTorControl();
     StopTorControl();
     DumpMasternodes();
     DumpBudgets();
     DumpMasternodePayments();
+    delete pMasternodeDB;
+    pMasternodeDB = NULL;
     UnregisterNodeSignals(GetNodeSignals());
 
+    if (mempool.IsLoaded() && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
+
     if (fFeeEstimatesInitialized) {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
         CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
@@ -217,12 +230,15 @@ void PrepareShutdown()
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsFlusher;
+        pcoinsFlusher = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        blockFileReader.CloseAll();
         delete zerocoinDB;
         zerocoinDB = NULL;
         delete pSporkDB;
@@ -318,8 +334,15 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>[:<height>]", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script, coinstake signature and zerocoin proof verification (0 to verify all, default: %s). With a height, the block is only trusted at that height"), Params(CBaseChainParams::MAIN).AssumeValid().GetHex()));
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf(_("Write the coin database cache in the background while validation continues; it can then briefly use up to twice -dbcache (default: %u)"), DEFAULT_BACKGROUND_FLUSH));
+    strUsage += HelpMessageOpt("-blockfilehandles=<n>", strprintf(_("Number of block and undo files kept open for reading (default: %u)"), DEFAULT_BLOCK_FILE_HANDLES));
+#ifndef WIN32
+    strUsage += HelpMessageOpt("-blockmmap", strprintf(_("Memory map block and undo files for reading (default: %u)"), DEFAULT_BLOCK_MMAP));
+#endif
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 1));
+    strUsage += HelpMessageOpt("-checkutxostats", strprintf(_("Recompute the UTXO set statistics from the coin database in the background at startup and compare them to the stored ones (default: %u)"), DEFAULT_CHECK_UTXO_STATS));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "xuez.conf"));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -328,13 +351,20 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-importthreads=<n>", strprintf(_("Set the number of threads that parse blocks during -reindex and -loadblock (up to %d, 0 = one per core, <0 = leave that many cores free, default: %d)"), MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
+    strUsage += HelpMessageOpt("-leveldbopt=<db>:<name>=<n>", _("Override a setting of the profile of a database (chainstate, blockindex, zerocoin, sporks or masternodes). <name> can be: blockcache (percentage of its cache), bloombits, maxopenfiles, blocksize, verifychecksums"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
+    strUsage += HelpMessageOpt("-maxorphanpeersize=<n>", strprintf(_("Keep at most <n> kilobytes of unconnectable transactions per peer in memory (default: %u)"), DEFAULT_MAX_ORPHAN_PEER_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "xuezd.pid"));
 #endif
+    strUsage += HelpMessageOpt("-prevalidationthreads=<n>", strprintf(_("Set the number of threads that verify relayed transactions before they are added to the memory pool (0 to %d, default: %d)"), MAX_PREVALIDATION_THREADS, DEFAULT_PREVALIDATION_THREADS));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexaccumulators", _("Reindex the accumulator database") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexmoneysupply", _("Reindex the XUEZ and zXUEZ money supply statistics") + " " + _("on startup"));
@@ -343,6 +373,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-verifyblockindex", strprintf(_("Recompute the hashes of the block index in the background after loading it (default: %u)"), DEFAULT_VERIFY_BLOCK_INDEX));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -423,6 +454,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkblockreads", strprintf("Hash blocks read from disk again and check their merkle root (default: %u)", DEFAULT_CHECK_BLOCK_READS));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf(_("Only accept block chain matching built-in checkpoints (default: %u)"), 1));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), 100));
@@ -431,11 +463,15 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", _("Randomly drop 1 of every <n> network messages"));
         strUsage += HelpMessageOpt("-fuzzmessagestest=<n>", _("Randomly fuzz 1 of every <n> network messages"));
         strUsage += HelpMessageOpt("-flushwallet", strprintf(_("Run a thread to flush wallet periodically (default: %u)"), 1));
+        strUsage += HelpMessageOpt("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT));
+        strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
+        strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
+        strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-maxreorg", strprintf(_("Use a custom max chain reorganization depth (default: %u)"), 100));
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf(_("Stop running after importing blocks from disk (default: %u)"), 0));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", _("Enable spork administration functionality with the appropriate private key."));
     }
-    string debugCategories = "addrman, alert, bench, coindb, db, lock, rand, rpc, selectcoins, tor, mempool, net, proxy, xuez, (obfuscation, swiftx, masternode, mnpayments, mnbudget, zero)"; // Don't translate these and qt below
+    string debugCategories = "addrman, alert, bench, coindb, db, leveldb, lock, rand, rpc, selectcoins, tor, mempool, net, proxy, xuez, (obfuscation, swiftx, masternode, mnpayments, mnbudget, zero)"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -452,7 +488,8 @@ std::string HelpMessage(HelpMessageMode mode)
     if (GetBoolArg("-help-debug", false)) {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", _("Limit size of signature cache to <n> entries, if -sigcachesize is not set"));
+        strUsage += HelpMessageOpt("-sigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> MiB (default: %u, maximum: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE, MAX_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in XUEZ/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-printtoconsole", strprintf(_("Send trace/debug info to console instead of debug.log file (default: %u)"), 0));
@@ -484,6 +521,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
     strUsage += HelpMessageOpt("-masternodeaddr=<n>", strprintf(_("Set external address:port to get to this masternode (example: %s)"), "128.127.106.235:41798"));
     strUsage += HelpMessageOpt("-budgetvotemode=<mode>", _("Change automatic finalized budget voting behavior. mode=auto: Vote for only exact finalized budget match to my generated budget. (string, default: auto)"));
+    strUsage += HelpMessageOpt("-maxgossipseen=<n>", strprintf(_("Keep up to <n> seen masternode pings, budget votes and finalized budget votes each, evicting the oldest (default: %u)"), DEFAULT_MAX_GOSSIP_SEEN));
+    strUsage += HelpMessageOpt("-gossipfiltersize=<n>", strprintf(_("Remember up to <n> evicted masternode pings and budget votes of each type as seen (default: %u)"), DEFAULT_GOSSIP_FILTER_SIZE));
 
     strUsage += HelpMessageGroup(_("Zerocoin options:"));
     strUsage += HelpMessageOpt("-enablezeromint=<n>", strprintf(_("Enable automatic Zerocoin minting (0-1, default: %u)"), 0));
@@ -625,6 +664,12 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        LoadMempool();
+    }
+    // An interrupted load must not be written back over the complete dump
+    mempool.SetIsLoaded(!ShutdownRequested());
 }
 
 /** Sanity checks
@@ -787,15 +832,22 @@ bool AppInit2(boost::thread_group& threadGroup)
         }
     }
 
-    // Make sure enough file descriptors are available
+    // Make sure enough file descriptors are available, including the block
+    // and undo files the block file reader keeps open
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
+    int nBlockFileHandles = std::max(std::min((int)GetArg("-blockfilehandles", DEFAULT_BLOCK_FILE_HANDLES), (int)MAX_BLOCK_FILE_HANDLES), 1);
+#ifdef WIN32
+    int nCoreFD = MIN_CORE_FILEDESCRIPTORS;
+#else
+    int nCoreFD = MIN_CORE_FILEDESCRIPTORS + nBlockFileHandles;
+#endif
     nMaxConnections = GetArg("-maxconnections", 125);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
-    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - nCoreFD)), 0);
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + nCoreFD);
+    if (nFD < nCoreFD)
         return InitError(_("Not enough file descriptors available."));
-    if (nFD - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
-        nMaxConnections = nFD - MIN_CORE_FILEDESCRIPTORS;
+    if (nFD - nCoreFD < nMaxConnections)
+        nMaxConnections = nFD - nCoreFD;
 
     // ********************************************************* Step 3: parameter-to-internal-flags
 
@@ -821,11 +873,42 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (GetBoolArg("-benchmark", false))
         InitWarning(_("Warning: Unsupported argument -benchmark ignored, use -debug=bench."));
 
+    std::string strLevelDBOption;
+    if (!CheckLevelDBOptions(strLevelDBOption))
+        return InitError(strprintf(_("Invalid database setting -leveldbopt=%s"), strLevelDBOption));
+
     // Checkmempool and checkblockindex default to true in regtest mode
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
+    fCheckBlockReads = GetBoolArg("-checkblockreads", DEFAULT_CHECK_BLOCK_READS);
+#ifndef WIN32
+    blockFileReader.SetLimits(nBlockFileHandles, GetBoolArg("-blockmmap", DEFAULT_BLOCK_MMAP));
+#else
+    blockFileReader.SetLimits(nBlockFileHandles, false);
+#endif
+    blockImporter.SetThreads(GetArg("-importthreads", DEFAULT_IMPORT_THREADS));
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+    // -assumevalid=<hash>[:<height>], the height of the default block is known
+    std::string strAssumeValid = GetArg("-assumevalid", Params().AssumeValid().GetHex());
+    std::string strAssumeValidHeight;
+    size_t nColon = strAssumeValid.find(':');
+    if (nColon != std::string::npos) {
+        strAssumeValidHeight = strAssumeValid.substr(nColon + 1);
+        strAssumeValid.erase(nColon);
+    }
+    hashAssumeValid = uint256(strAssumeValid);
+    if (hashAssumeValid == 0)
+        nAssumeValidHeight = 0;
+    else if (!strAssumeValidHeight.empty())
+        nAssumeValidHeight = std::max(0, atoi(strAssumeValidHeight));
+    else if (hashAssumeValid == Params().AssumeValid())
+        nAssumeValidHeight = Params().AssumeValidHeight();
+    if (hashAssumeValid != 0)
+        LogPrintf("Assuming ancestors of block %s (height %d) have valid signatures and zerocoin proofs\n", hashAssumeValid.GetHex(), nAssumeValidHeight);
+    else
+        LogPrintf("Validating signatures and zerocoin proofs of all blocks\n");
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -853,6 +936,12 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (nConnectTimeout <= 0)
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
 
+    // mempool limits
+    int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    int64_t nMempoolSizeMin = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000 * 40;
+    if (nMempoolSizeMax < 0 || nMempoolSizeMax < nMempoolSizeMin)
+        return InitError(strprintf(_("-maxmempool must be at least %d MB"), std::ceil(nMempoolSizeMin / 1000000.0)));
+
     // Fee-per-kilobyte amount considered the same as "free"
     // If you are mining, be careful setting this:
     // if you set it to zero then
@@ -957,12 +1046,24 @@ bool AppInit2(boost::thread_group& threadGroup)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
+    InitSignatureCache();
+
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    // the signatures of masternode, budget and SwiftX gossip are checked in batches on their own workers
+    int nMessageCheckThreads = std::min(std::max(nScriptCheckThreads, 1), OBFUSCATION_PARALLEL_VERIFY_THREADS);
+    for (int i = 0; i < nMessageCheckThreads - 1; i++)
+        threadGroup.create_thread(&ThreadMessageCheck);
+
+    // masternode scores against a new block are computed on their own workers
+    int nScoreThreads = std::min(std::max(nScriptCheckThreads, 1), MN_PARALLEL_SCORE_THREADS);
+    for (int i = 0; i < nScoreThreads - 1; i++)
+        threadGroup.create_thread(&ThreadMasternodeScore);
+
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
         if (!sporkManager.SetPrivKey(GetArg("-sporkkey", "")))
@@ -1295,7 +1396,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    nCoinCacheUsage = nTotalCache;
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1309,6 +1410,7 @@ bool AppInit2(boost::thread_group& threadGroup)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsFlusher;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -1319,8 +1421,16 @@ bool AppInit2(boost::thread_group& threadGroup)
                 pSporkDB = new CSporkDB(0, false, false);
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
+                uiInterface.InitMessage(_("Upgrading coin database..."));
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading coin database");
+                    break;
+                }
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsFlusher = new CCoinsViewFlusher(pcoinscatcher, pcoinsdbview);
+                if (GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH))
+                    pcoinsFlusher->Start();
+                pcoinsTip = new CCoinsViewCache(pcoinsFlusher);
 
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
@@ -1437,7 +1547,7 @@ bool AppInit2(boost::thread_group& threadGroup)
                 // Zerocoin must check at level 4
                 int nDefaultCheck = ( chainActive.Height() > Params().LAST_POW_BLOCK() ) ? 1 : 10;
                 LogPrintf("Checking last %d blocks at startup.\n", nDefaultCheck);
-				if (!CVerifyDB().VerifyDB(pcoinsdbview, 4, GetArg("-checkblocks", nDefaultCheck))) {
+				if (!CVerifyDB().VerifyDB(pcoinsFlusher, 4, GetArg("-checkblocks", nDefaultCheck))) {
                 //if (!CVerifyDB().VerifyDB(pcoinsdbview, 4, GetArg("-checkblocks", 1))) {
                     strLoadError = _("Corrupted block database detected");
                     fVerifyingBlocks = false;
@@ -1482,6 +1592,26 @@ bool AppInit2(boost::thread_group& threadGroup)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    if (GetBoolArg("-verifyblockindex", DEFAULT_VERIFY_BLOCK_INDEX))
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "verifyidx", &ThreadVerifyBlockIndexHashes));
+
+    // Load the UTXO set statistics stored with the coins, or compute them in
+    // the background if they are missing or of another block
+    bool fComputeUtxoStats = GetBoolArg("-checkutxostats", DEFAULT_CHECK_UTXO_STATS);
+    {
+        LOCK(cs_main);
+        CUtxoStats stats;
+        uint256 hashBest = pcoinsTip->GetBestBlock();
+        if (hashBest == uint256(0))
+            utxoStats.Set(CUtxoStats());
+        else if (pcoinsdbview->ReadUtxoStats(stats) && stats.hashBlock == hashBest)
+            utxoStats.Set(stats);
+        else
+            fComputeUtxoStats = true;
+    }
+    if (fComputeUtxoStats)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "utxostats", &ThreadComputeUtxoStats));
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1644,31 +1774,42 @@ bool AppInit2(boost::thread_group& threadGroup)
     
 	uiInterface.InitMessage(_("Loading masternode cache..."));
 
-    CMasternodeDB mndb;
-    CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman);
-    if (readResult == CMasternodeDB::FileError)
-        LogPrintf("Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrintf("Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
-        else
-            LogPrintf("file format is unknown or invalid, please fix it manually\n");
+    pMasternodeDB = new CMasternodeStateDB(0, false, false);
+
+    // Older versions kept the masternode state in flat files, which are read until the first flush
+    if (mnodeman.Load(*pMasternodeDB)) {
+        mnodeman.CheckAndRemove(true);
+    } else {
+        CMasternodeDB mndb;
+        CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman);
+        if (readResult == CMasternodeDB::FileError)
+            LogPrintf("Missing masternode cache file - mncache.dat, will try to recreate\n");
+        else if (readResult != CMasternodeDB::Ok) {
+            LogPrintf("Error reading mncache.dat: ");
+            if (readResult == CMasternodeDB::IncorrectFormat)
+                LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
+            else
+                LogPrintf("file format is unknown or invalid, please fix it manually\n");
+        }
     }
 
     uiInterface.InitMessage(_("Loading budget cache..."));
 
-    CBudgetDB budgetdb;
-    CBudgetDB::ReadResult readResult2 = budgetdb.Read(budget);
-
-    if (readResult2 == CBudgetDB::FileError)
-        LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
-    else if (readResult2 != CBudgetDB::Ok) {
-        LogPrintf("Error reading budget.dat: ");
-        if (readResult2 == CBudgetDB::IncorrectFormat)
-            LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
-        else
-            LogPrintf("file format is unknown or invalid, please fix it manually\n");
+    if (budget.Load(*pMasternodeDB)) {
+        budget.CheckAndRemove();
+    } else {
+        CBudgetDB budgetdb;
+        CBudgetDB::ReadResult readResult2 = budgetdb.Read(budget);
+
+        if (readResult2 == CBudgetDB::FileError)
+            LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
+        else if (readResult2 != CBudgetDB::Ok) {
+            LogPrintf("Error reading budget.dat: ");
+            if (readResult2 == CBudgetDB::IncorrectFormat)
+                LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
+            else
+                LogPrintf("file format is unknown or invalid, please fix it manually\n");
+        }
     }
 
     //flag our cached items so we send them to our peers
@@ -1678,17 +1819,21 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     uiInterface.InitMessage(_("Loading masternode payment cache..."));
 
-    CMasternodePaymentDB mnpayments;
-    CMasternodePaymentDB::ReadResult readResult3 = mnpayments.Read(masternodePayments);
-
-    if (readResult3 == CMasternodePaymentDB::FileError)
-        LogPrintf("Missing masternode payment cache - mnpayments.dat, will try to recreate\n");
-    else if (readResult3 != CMasternodePaymentDB::Ok) {
-        LogPrintf("Error reading mnpayments.dat: ");
-        if (readResult3 == CMasternodePaymentDB::IncorrectFormat)
-            LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
-        else
-            LogPrintf("file format is unknown or invalid, please fix it manually\n");
+    if (masternodePayments.Load(*pMasternodeDB)) {
+        masternodePayments.CleanPaymentList();
+    } else {
+        CMasternodePaymentDB mnpayments;
+        CMasternodePaymentDB::ReadResult readResult3 = mnpayments.Read(masternodePayments);
+
+        if (readResult3 == CMasternodePaymentDB::FileError)
+            LogPrintf("Missing masternode payment cache - mnpayments.dat, will try to recreate\n");
+        else if (readResult3 != CMasternodePaymentDB::Ok) {
+            LogPrintf("Error reading mnpayments.dat: ");
+            if (readResult3 == CMasternodePaymentDB::IncorrectFormat)
+                LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
+            else
+                LogPrintf("file format is unknown or invalid, please fix it manually\n");
+        }
     }
 
     fMasterNode = GetBoolArg("-masternode", false);
@@ -1732,6 +1877,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     //get the mode of budget voting for this masternode
     strBudgetMode = GetArg("-budgetvotemode", "auto");
 
+    gossipFilter.SetSize(GetArg("-gossipfiltersize", DEFAULT_GOSSIP_FILTER_SIZE));
+    gossipFilter.SetMaxSeen(GetArg("-maxgossipseen", DEFAULT_MAX_GOSSIP_SEEN));
+
     if (GetBoolArg("-mnconflock", true) && pwalletMain) {
         LOCK(pwalletMain->cs_wallet);
         LogPrintf("Locking Masternodes:\n");
@@ -1832,6 +1980,10 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup);
 
+    int nPreValidationThreads = std::max(0, std::min((int)GetArg("-prevalidationthreads", DEFAULT_PREVALIDATION_THREADS), MAX_PREVALIDATION_THREADS));
+    LogPrintf("Using %d threads for transaction pre-validation\n", nPreValidationThreads);
+    txPreValidator.Start(threadGroup, nPreValidationThreads);
+
     StartNode(threadGroup);
 
 #ifdef ENABLE_WALLET
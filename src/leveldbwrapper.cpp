@@ -5,8 +5,16 @@
 #include "leveldbwrapper.h"
 
 #include "util.h"
+#include "utiltime.h"
 
+#include <set>
+#include <stdio.h>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -27,14 +35,126 @@ void HandleError(const leveldb::Status& status) throw(leveldb_error)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/** LRU block cache that counts its hits and misses */
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* base;
+
+public:
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    CCountingCache(size_t nCapacity) : base(leveldb::NewLRUCache(nCapacity)), nHits(0), nMisses(0) {}
+    ~CCountingCache() { delete base; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value))
+    {
+        return base->Insert(key, value, charge, deleter);
+    }
+
+    Handle* Lookup(const leveldb::Slice& key)
+    {
+        Handle* handle = base->Lookup(key);
+        if (handle)
+            nHits++;
+        else
+            nMisses++;
+        return handle;
+    }
+
+    void Release(Handle* handle) { base->Release(handle); }
+    void* Value(Handle* handle) { return base->Value(handle); }
+    void Erase(const leveldb::Slice& key) { base->Erase(key); }
+    uint64_t NewId() { return base->NewId(); }
+};
+
+namespace
+{
+//! The databases that are open, for GetLevelDBStats
+boost::mutex csWrappers;
+std::set<const CLevelDBWrapper*> setWrappers;
+
+CLevelDBProfile GetDefaultProfile(const std::string& strName)
+{
+    CLevelDBProfile profile;
+    profile.strName = strName;
+    if (strName == "chainstate") {
+        // Flushes write many coins at once, and coins are looked up once
+        // before being cached above the database; they are already compressed.
+        profile.nBlockCachePercent = 25;
+        profile.fVerifyChecksums = false;
+    } else if (strName == "blockindex") {
+        // Most transaction index lookups are for transactions that are not there
+        profile.nBloomBits = 14;
+    } else if (strName == "zerocoin") {
+        // Every spend looks up a serial that should not be there yet
+        profile.nBloomBits = 14;
+    } else if (strName == "masternodes") {
+        // Only read by iterating at startup
+        profile.nBloomBits = 0;
+    }
+    return profile;
+}
+
+//! Apply one name=value setting of -leveldbopt
+bool SetProfileOption(CLevelDBProfile& profile, const std::string& strOption, const std::string& strValue)
+{
+    int nValue;
+    try {
+        nValue = boost::lexical_cast<int>(strValue);
+    } catch (const boost::bad_lexical_cast&) {
+        return false;
+    }
+    if (strOption == "blockcache" && nValue >= 0 && nValue <= 100)
+        profile.nBlockCachePercent = nValue;
+    else if (strOption == "bloombits" && nValue >= 0 && nValue <= 64)
+        profile.nBloomBits = nValue;
+    else if (strOption == "maxopenfiles" && nValue > 0)
+        profile.nMaxOpenFiles = nValue;
+    else if (strOption == "blocksize" && nValue >= 1024 && nValue <= (4 << 20))
+        profile.nBlockSize = nValue;
+    else if (strOption == "verifychecksums" && (nValue == 0 || nValue == 1))
+        profile.fVerifyChecksums = nValue != 0;
+    else
+        return false;
+    return true;
+}
+
+//! Apply the -leveldbopt=<db>:<name>=<value> arguments for a database, returns false on the first invalid one
+bool ApplyProfileOptions(CLevelDBProfile& profile, const std::string& strName, std::string& strError)
+{
+    std::map<std::string, std::vector<std::string> >::const_iterator mi = mapMultiArgs.find("-leveldbopt");
+    if (mi == mapMultiArgs.end())
+        return true;
+    const std::vector<std::string>& vOptions = mi->second;
+    for (unsigned int i = 0; i < vOptions.size(); i++) {
+        size_t nColon = vOptions[i].find(':');
+        size_t nEquals = vOptions[i].find('=', nColon);
+        if (nColon == std::string::npos || nEquals == std::string::npos) {
+            strError = vOptions[i];
+            return false;
+        }
+        if (strName.empty() || vOptions[i].substr(0, nColon) == strName) {
+            if (!SetProfileOption(profile, vOptions[i].substr(nColon + 1, nEquals - nColon - 1), vOptions[i].substr(nEquals + 1))) {
+                strError = vOptions[i];
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+leveldb::Options GetOptions(size_t nCacheSize, const CLevelDBProfile& profile, CCountingCache* pcache)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = pcache;
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = nCacheSize / 200 * (100 - profile.nBlockCachePercent);
+    options.filter_policy = profile.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
     options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.max_open_files = profile.nMaxOpenFiles;
+    options.block_size = profile.nBlockSize;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -42,15 +162,32 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     }
     return options;
 }
+} // anon namespace
+
+CLevelDBProfile GetLevelDBProfile(const std::string& strName)
+{
+    CLevelDBProfile profile = GetDefaultProfile(strName);
+    std::string strError;
+    // Invalid options are rejected at startup by CheckLevelDBOptions
+    ApplyProfileOptions(profile, strName, strError);
+    return profile;
+}
+
+bool CheckLevelDBOptions(std::string& strError)
+{
+    CLevelDBProfile profile;
+    return ApplyProfileOptions(profile, "", strError);
+}
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBProfile& profileIn) : strPath(path.string()), profile(profileIn), nReads(0), nReadsNotFound(0), nWrites(0), nWriteBytes(0), nWriteTime(0), nSlowWrites(0)
 {
     penv = NULL;
-    readoptions.verify_checksums = true;
+    readoptions.verify_checksums = profile.fVerifyChecksums;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    pcache = new CCountingCache(nCacheSize / 100 * profile.nBlockCachePercent);
+    options = GetOptions(nCacheSize, profile, pcache);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -63,26 +200,85 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
     }
+    LogPrint("leveldb", "LevelDB profile %s: block cache %u bytes, write buffer %u bytes, bloom bits %d, block size %d, max open files %d\n",
+        profile.strName, (unsigned int)(nCacheSize / 100 * profile.nBlockCachePercent), (unsigned int)options.write_buffer_size,
+        profile.nBloomBits, profile.nBlockSize, profile.nMaxOpenFiles);
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+
+    boost::unique_lock<boost::mutex> lock(csWrappers);
+    setWrappers.insert(this);
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    {
+        boost::unique_lock<boost::mutex> lock(csWrappers);
+        setWrappers.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
     options.filter_policy = NULL;
     delete options.block_cache;
     options.block_cache = NULL;
+    pcache = NULL;
     delete penv;
     options.env = NULL;
 }
 
+CLevelDBStats CLevelDBWrapper::GetStats() const
+{
+    CLevelDBStats stats;
+    stats.strPath = strPath;
+    stats.profile = profile;
+    stats.nReads = nReads;
+    stats.nReadsNotFound = nReadsNotFound;
+    stats.nWrites = nWrites;
+    stats.nWriteBytes = nWriteBytes;
+    stats.nWriteTime = nWriteTime;
+    stats.nSlowWrites = nSlowWrites;
+    stats.nCacheHits = pcache->nHits;
+    stats.nCacheMisses = pcache->nMisses;
+
+    leveldb::Range range("", "\xff\xff\xff\xff");
+    pdb->GetApproximateSizes(&range, 1, &stats.nApproximateSize);
+
+    // Parse the compaction table of leveldb.stats, one line per level in use
+    std::string strStats;
+    if (pdb->GetProperty("leveldb.stats", &strStats)) {
+        std::vector<std::string> vLines;
+        boost::split(vLines, strStats, boost::is_any_of("\n"));
+        for (unsigned int i = 0; i < vLines.size(); i++) {
+            CLevelDBLevelStats level;
+            if (sscanf(vLines[i].c_str(), "%d %d %lf %lf %lf %lf", &level.nLevel, &level.nFiles, &level.dSizeMB,
+                    &level.dCompactionSeconds, &level.dCompactionReadMB, &level.dCompactionWriteMB) == 6)
+                stats.vLevels.push_back(level);
+        }
+    }
+    return stats;
+}
+
+std::vector<CLevelDBStats> GetLevelDBStats()
+{
+    std::vector<CLevelDBStats> vStats;
+    boost::unique_lock<boost::mutex> lock(csWrappers);
+    for (std::set<const CLevelDBWrapper*>::const_iterator it = setWrappers.begin(); it != setWrappers.end(); it++)
+        vStats.push_back((*it)->GetStats());
+    return vStats;
+}
+
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync) throw(leveldb_error)
 {
+    int64_t nStart = GetTimeMicros();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    int64_t nDuration = GetTimeMicros() - nStart;
+    nWrites++;
+    nWriteBytes += batch.SizeEstimate();
+    nWriteTime += nDuration;
+    if (nDuration > LEVELDB_SLOW_WRITE_MICROS)
+        nSlowWrites++;
     HandleError(status);
     return true;
 }
@@ -11,11 +11,17 @@
 #include "util.h"
 #include "version.h"
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+class CCountingCache;
+
 class leveldb_error : public std::runtime_error
 {
 public:
@@ -24,6 +30,69 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(leveldb_error);
 
+/** Writes taking longer than this are counted as stalls, mostly waiting for compactions (microseconds) */
+static const int64_t LEVELDB_SLOW_WRITE_MICROS = 50000;
+
+/**
+ * Tuning of a database for its access pattern. Each database has a named
+ * profile, whose settings can be overridden with -leveldbopt.
+ */
+struct CLevelDBProfile {
+    std::string strName;
+    //! Percentage of the cache size used for the block cache; the rest is
+    //! split over the two write buffers that may be held at the same time
+    int nBlockCachePercent;
+    //! Bits per key of the bloom filters, 0 for none
+    int nBloomBits;
+    int nMaxOpenFiles;
+    //! Uncompressed size of a table block, in bytes
+    int nBlockSize;
+    //! Verify the checksums of point reads; iterating always verifies them
+    bool fVerifyChecksums;
+
+    CLevelDBProfile() : strName("default"), nBlockCachePercent(50), nBloomBits(10), nMaxOpenFiles(64), nBlockSize(4096), fVerifyChecksums(true) {}
+};
+
+/** The profile of a database, with the -leveldbopt overrides applied */
+CLevelDBProfile GetLevelDBProfile(const std::string& strName);
+
+/** Check the -leveldbopt arguments, returns false with strError set if one is invalid */
+bool CheckLevelDBOptions(std::string& strError);
+
+/** Usage of one level of a database, as reported by LevelDB */
+struct CLevelDBLevelStats {
+    int nLevel;
+    int nFiles;
+    double dSizeMB;
+    //! Time spent compacting into this level, and the data read and written doing so
+    double dCompactionSeconds;
+    double dCompactionReadMB;
+    double dCompactionWriteMB;
+};
+
+/** Statistics of an open database, reported by getleveldbstats */
+struct CLevelDBStats {
+    std::string strPath;
+    CLevelDBProfile profile;
+    uint64_t nReads;
+    uint64_t nReadsNotFound;
+    uint64_t nWrites;
+    uint64_t nWriteBytes;
+    //! Total time spent in writes, in microseconds
+    int64_t nWriteTime;
+    //! Writes slower than LEVELDB_SLOW_WRITE_MICROS
+    uint64_t nSlowWrites;
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+    uint64_t nApproximateSize;
+    std::vector<CLevelDBLevelStats> vLevels;
+
+    CLevelDBStats() : nReads(0), nReadsNotFound(0), nWrites(0), nWriteBytes(0), nWriteTime(0), nSlowWrites(0), nCacheHits(0), nCacheMisses(0), nApproximateSize(0) {}
+};
+
+/** Statistics of all open databases */
+std::vector<CLevelDBStats> GetLevelDBStats();
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -32,7 +101,12 @@ class CLevelDBBatch
 private:
     leveldb::WriteBatch batch;
 
+    //! Number of key and value bytes queued
+    size_t nSize;
+
 public:
+    CLevelDBBatch() : nSize(0) {}
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +121,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        nSize += slKey.size() + slValue.size();
     }
 
     template <typename K>
@@ -58,7 +133,11 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        nSize += slKey.size();
     }
+
+    //! Number of key and value bytes queued, which is about what the write adds to the log
+    size_t SizeEstimate() const { return nSize; }
 };
 
 class CLevelDBWrapper
@@ -85,8 +164,31 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    std::string strPath;
+    CLevelDBProfile profile;
+
+    //! block cache, counting hits and misses
+    CCountingCache* pcache;
+
+    mutable std::atomic<uint64_t> nReads;
+    mutable std::atomic<uint64_t> nReadsNotFound;
+    std::atomic<uint64_t> nWrites;
+    std::atomic<uint64_t> nWriteBytes;
+    std::atomic<int64_t> nWriteTime;
+    std::atomic<uint64_t> nSlowWrites;
+
+    //! Look a key up, counting the read
+    leveldb::Status Get(const leveldb::Slice& slKey, std::string* pstrValue) const
+    {
+        leveldb::Status status = pdb->Get(readoptions, slKey, pstrValue);
+        nReads++;
+        if (status.IsNotFound())
+            nReadsNotFound++;
+        return status;
+    }
+
 public:
-    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBProfile& profileIn = CLevelDBProfile());
     ~CLevelDBWrapper();
 
     template <typename K, typename V>
@@ -98,7 +200,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = Get(slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -131,7 +233,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = Get(slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -168,6 +270,8 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    CLevelDBStats GetStats() const;
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
@@ -11,9 +11,12 @@
 #include "accumulators.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilereader.h"
+#include "blockimporter.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsflusher.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
@@ -28,9 +31,11 @@
 #include "swifttx.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txprevalidator.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utxostats.h"
 
 #include "primitives/zerocoin.h"
 #include "libzerocoin/Denominations.h"
@@ -76,8 +81,11 @@ bool fReindex = false;
 bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fCheckBlockReads = DEFAULT_CHECK_BLOCK_READS;
 bool fVerifyingBlocks = false;
-unsigned int nCoinCacheSize = 5000;
+uint256 hashAssumeValid = 0;
+int nAssumeValidHeight = 0;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 
 unsigned int nStakeMinAge = 60 * 60 * 6; // * 6  for lauch, 6hrs;
@@ -94,9 +102,20 @@ CTxMemPool mempool(::minRelayTxFee);
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
 };
 map<uint256, COrphanTx> mapOrphanTransactions;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
+map<COutPoint, set<uint256> > mapOrphanTransactionsByPrev;
+
+/** Orphans received from one peer and the memory they take up */
+struct COrphanPeer {
+    uint64_t nBytes;
+    set<uint256> setOrphans;
+
+    COrphanPeer() : nBytes(0) {}
+};
+map<NodeId, COrphanPeer> mapOrphanPeers;
 map<uint256, int64_t> mapRejectedBlocks;
 
 
@@ -605,6 +624,45 @@ CSporkDB* pSporkDB = NULL;
 // mapOrphanTransactions
 //
 
+void static EraseOrphanTx(uint256 hash)
+{
+    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    if (it == mapOrphanTransactions.end())
+        return;
+    BOOST_FOREACH (const CTxIn& txin, it->second.tx.vin) {
+        map<COutPoint, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
+        if (itPrev == mapOrphanTransactionsByPrev.end())
+            continue;
+        itPrev->second.erase(hash);
+        if (itPrev->second.empty())
+            mapOrphanTransactionsByPrev.erase(itPrev);
+    }
+
+    map<NodeId, COrphanPeer>::iterator itPeer = mapOrphanPeers.find(it->second.fromPeer);
+    if (itPeer != mapOrphanPeers.end()) {
+        itPeer->second.nBytes -= it->second.nTxSize;
+        itPeer->second.setOrphans.erase(hash);
+        if (itPeer->second.setOrphans.empty())
+            mapOrphanPeers.erase(itPeer);
+    }
+    mapOrphanTransactions.erase(it);
+}
+
+/** Evict a random orphan received from peer. Returns false if there is none. */
+bool static EvictOrphanFromPeer(NodeId peer)
+{
+    map<NodeId, COrphanPeer>::iterator itPeer = mapOrphanPeers.find(peer);
+    if (itPeer == mapOrphanPeers.end())
+        return false;
+
+    const set<uint256>& setOrphans = itPeer->second.setOrphans;
+    set<uint256>::const_iterator it = setOrphans.lower_bound(GetRandHash());
+    if (it == setOrphans.end())
+        it = setOrphans.begin();
+    EraseOrphanTx(*it);
+    return true;
+}
+
 bool AddOrphanTx(const CTransaction& tx, NodeId peer)
 {
     uint256 hash = tx.GetHash();
@@ -624,57 +682,85 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer)
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
-    mapOrphanTransactions[hash].fromPeer = peer;
+    COrphanTx& orphan = mapOrphanTransactions[hash];
+    orphan.tx = tx;
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nTxSize = sz;
     BOOST_FOREACH (const CTxIn& txin, tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
+        mapOrphanTransactionsByPrev[txin.prevout].insert(hash);
+
+    COrphanPeer& orphanPeer = mapOrphanPeers[peer];
+    orphanPeer.nBytes += sz;
+    orphanPeer.setOrphans.insert(hash);
+
+    // A peer that goes over its share of the orphan pool only pushes out
+    // its own orphans, never those of other peers.
+    uint64_t nMaxPeerBytes = std::max((int64_t)0, GetArg("-maxorphanpeersize", DEFAULT_MAX_ORPHAN_PEER_SIZE)) * 1000;
+    unsigned int nEvicted = 0;
+    while (mapOrphanPeers.count(peer) && mapOrphanPeers[peer].nBytes > nMaxPeerBytes) {
+        EvictOrphanFromPeer(peer);
+        ++nEvicted;
+    }
+    if (nEvicted > 0)
+        LogPrint("mempool", "peer=%d exceeded its orphan pool share, removed %u tx\n", peer, nEvicted);
+
+    if (!mapOrphanTransactions.count(hash))
+        return false;
 
     LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
         mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
     return true;
 }
 
-void static EraseOrphanTx(uint256 hash)
+void EraseOrphansFor(NodeId peer)
 {
-    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
+    map<NodeId, COrphanPeer>::iterator itPeer = mapOrphanPeers.find(peer);
+    if (itPeer == mapOrphanPeers.end())
         return;
-    BOOST_FOREACH (const CTxIn& txin, it->second.tx.vin) {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(hash);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-    mapOrphanTransactions.erase(it);
-}
 
-void EraseOrphansFor(NodeId peer)
-{
-    int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer) {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
-            ++nErased;
-        }
-    }
-    if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
+    // EraseOrphanTx drops the peer entry along with its last orphan
+    set<uint256> setErase = itPeer->second.setOrphans;
+    BOOST_FOREACH (const uint256& hash, setErase)
+        EraseOrphanTx(hash);
+    LogPrint("mempool", "Erased %d orphan tx from peer %d\n", setErase.size(), peer);
 }
 
 
 unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
 {
+    static int64_t nNextSweep;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        int nErased = 0;
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+        while (iter != mapOrphanTransactions.end()) {
+            map<uint256, COrphanTx>::iterator maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow) {
+                EraseOrphanTx(maybeErase->first);
+                ++nErased;
+            } else {
+                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+            }
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
+        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0)
+            LogPrint("mempool", "Erased %d orphan tx due to expiration\n", nErased);
+    }
+
     unsigned int nEvicted = 0;
     while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+        // Evict a random orphan of the peer that uses the most orphan
+        // memory, so that flooding the pool only hurts the flooder.
+        map<NodeId, COrphanPeer>::iterator itLargest = mapOrphanPeers.begin();
+        for (map<NodeId, COrphanPeer>::iterator it = mapOrphanPeers.begin(); it != mapOrphanPeers.end(); ++it) {
+            if (it->second.nBytes > itLargest->second.nBytes)
+                itLargest = it;
+        }
+        EvictOrphanFromPeer(itLargest->first);
         ++nEvicted;
     }
     return nEvicted;
@@ -886,11 +972,11 @@ int GetInputAge(CTxIn& vin)
         CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
-        const CCoins* coins = view.AccessCoins(vin.prevout.hash);
+        const Coin& coin = view.AccessCoin(vin.prevout);
 
-        if (coins) {
-            if (coins->nHeight < 0) return 0;
-            return (chainActive.Tip()->nHeight + 1) - coins->nHeight;
+        if (!coin.IsSpent()) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) return 0;
+            return (chainActive.Tip()->nHeight + 1) - (int)coin.nHeight;
         } else
             return -1;
     }
@@ -898,15 +984,11 @@ int GetInputAge(CTxIn& vin)
 
 int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 {
-    int sigs = 0;
     int nResult = GetInputAge(vin);
     if (nResult < 0) nResult = 0;
 
     if (nResult < 6) {
-        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-        if (i != mapTxLocks.end()) {
-            sigs = (*i).second.CountSignatures();
-        }
+        int sigs = swiftTxManager.GetLockSignatures(nTXHash);
         if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
             return nSwiftTXDepth + nResult;
         }
@@ -917,12 +999,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 
 int GetIXConfirmations(uint256 nTXHash)
 {
-    int sigs = 0;
-
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()) {
-        sigs = (*i).second.CountSignatures();
-    }
+    int sigs = swiftTxManager.GetLockSignatures(nTXHash);
     if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
         return nSwiftTXDepth;
     }
@@ -1065,7 +1142,7 @@ void FindMints(vector<CZerocoinMint> vMintsToFind, vector<CZerocoinMint>& vMints
             if(i % 1000 == 0)
                 LogPrintf("%s : scanned %d blocks\n", __func__, i - nZerocoinStartHeight);
 
-            if(chainActive[i]->vMintDenominationsInBlock.empty())
+            if(chainActive[i]->vZerocoinMints.IsNull())
                 continue;
 
             CBlock block;
@@ -1314,13 +1391,112 @@ std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock
     return vSpends;
 }
 
+/** Maximum number of entries in the zerocoin proof cache */
+static const unsigned int MAX_ZEROCOIN_PROOF_CACHE_SIZE = 10000;
+
+namespace
+{
+/**
+ * Cache of zerocoin mints and spends whose proofs have been verified, keyed
+ * by the hash of the script that carries them. Validating a public coin and
+ * verifying a spend against its accumulator are by far the most expensive
+ * zerocoin checks, and a transaction passes through them when it is
+ * pre-validated, accepted to the mempool and connected in a block.
+ */
+class CZerocoinProofCache
+{
+private:
+    std::set<uint256> setValid;
+    boost::shared_mutex cs_proofcache;
+
+public:
+    bool Get(const uint256& hash)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_proofcache);
+        return setValid.count(hash) > 0;
+    }
+
+    void Set(const uint256& hash)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_proofcache);
+        while (setValid.size() >= MAX_ZEROCOIN_PROOF_CACHE_SIZE) {
+            // Evict a random entry, see CSignatureCache
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+        setValid.insert(hash);
+    }
+};
+
+CZerocoinProofCache zerocoinProofCache;
+
+bool ValidateZerocoinMint(const CTxOut& txout, const PublicCoin& pubCoin)
+{
+    uint256 hashProof = Hash(txout.scriptPubKey.begin(), txout.scriptPubKey.end());
+    if (zerocoinProofCache.Get(hashProof))
+        return true;
+
+    if (!pubCoin.validate())
+        return false;
+
+    zerocoinProofCache.Set(hashProof);
+    return true;
+}
+
+bool VerifyZerocoinSpend(const CTxIn& txin, const CoinSpend& spend, CValidationState& state)
+{
+    uint256 hashProof = Hash(txin.scriptSig.begin(), txin.scriptSig.end());
+    if (zerocoinProofCache.Get(hashProof))
+        return true;
+
+    //see if we have record of the accumulator used in the spend tx
+    CBigNum bnAccumulatorValue = 0;
+    if(!zerocoinDB->ReadAccumulatorValue(spend.getAccumulatorChecksum(), bnAccumulatorValue))
+        return state.DoS(100, error("Zerocoinspend could not find accumulator associated with checksum"));
+
+    Accumulator accumulator(Params().Zerocoin_Params(), spend.getDenomination(), bnAccumulatorValue);
+
+    //Check that the coin is on the accumulator
+    if(!spend.Verify(accumulator))
+        return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+
+    zerocoinProofCache.Set(hashProof);
+    return true;
+}
+} // anon namespace
+
+bool VerifyZerocoinProofs(const CTransaction& tx)
+{
+    CValidationState state;
+    BOOST_FOREACH (const CTxOut& txout, tx.vout) {
+        if (!txout.scriptPubKey.IsZerocoinMint())
+            continue;
+
+        PublicCoin pubCoin(Params().Zerocoin_Params());
+        if (!TxOutToPublicCoin(txout, pubCoin, state) || !ValidateZerocoinMint(txout, pubCoin))
+            return false;
+    }
+
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (!txin.scriptSig.IsZerocoinSpend())
+            continue;
+
+        CoinSpend spend = TxInToZerocoinSpend(txin);
+        if (!VerifyZerocoinSpend(txin, spend, state))
+            return false;
+    }
+    return true;
+}
+
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly)
 {
     PublicCoin pubCoin(Params().Zerocoin_Params());
     if(!TxOutToPublicCoin(txout, pubCoin, state))
         return state.DoS(100, error("CheckZerocoinMint(): TxOutToPublicCoin() failed"));
 
-    if (!pubCoin.validate())
+    if (!ValidateZerocoinMint(txout, pubCoin))
         return state.DoS(100, error("CheckZerocoinMint() : PubCoin does not validate"));
 
     if(!fCheckOnly && !RecordMintToDB(pubCoin, txHash))
@@ -1398,18 +1574,8 @@ bool CheckZerocoinSpend(const CTransaction tx, bool fVerifySignature, CValidatio
             return state.DoS(100, error("Zerocoinspend does not use the same txout that was used in the SoK"));
 
         // Skip signature verification during initial block download
-        if (fVerifySignature) {
-            //see if we have record of the accumulator used in the spend tx
-            CBigNum bnAccumulatorValue = 0;
-            if(!zerocoinDB->ReadAccumulatorValue(newSpend.getAccumulatorChecksum(), bnAccumulatorValue))
-                return state.DoS(100, error("Zerocoinspend could not find accumulator associated with checksum"));
-
-            Accumulator accumulator(Params().Zerocoin_Params(), newSpend.getDenomination(), bnAccumulatorValue);
-
-            //Check that the coin is on the accumulator
-            if(!newSpend.Verify(accumulator))
-                return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
-        }
+        if (fVerifySignature && !VerifyZerocoinSpend(txin, newSpend, state))
+            return false;
 
         if (serials.count(newSpend.getCoinSerialNumber()))
             return state.DoS(100, error("Zerocoinspend serial is used twice in the same tx"));
@@ -1585,13 +1751,33 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
             nMinFee = 0;
     }
 
+    // While the mempool is full (or recently was), the free area does not apply:
+    // transactions must beat the rolling minimum fee of the packages we evicted.
+    CAmount nMempoolMinFee = mempool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nBytes);
+    if (nMempoolMinFee > nMinFee)
+        nMinFee = nMempoolMinFee;
+
     if (!MoneyRange(nMinFee))
         nMinFee = Params().MaxMoneyOut();
     return nMinFee;
 }
 
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
+void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit);
+}
+
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees, bool fOverrideMempoolLimit, bool fScriptsChecked)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fRejectInsaneFee, ignoreFees, fOverrideMempoolLimit, fScriptsChecked);
+}
+
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectInsaneFee, bool ignoreFees, bool fOverrideMempoolLimit, bool fScriptsChecked)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1629,14 +1815,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 txHashLocked;
+    if (swiftTxManager.FindConflictingLock(tx, txHashLocked)) {
+        return state.DoS(0,
+            error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1686,15 +1869,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
             CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
             view.SetBackend(viewMemPool);
 
-            // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
-
             // do all inputs exist?
             // Note that this does not check for the presence of actual outputs (see the next check for that),
             // only helps filling in pfMissingInputs (to determine missing vs spent).
             for (const CTxIn txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
+                    // Are inputs missing because we already have the tx?
+                    for (size_t out = 0; out < tx.vout.size(); out++) {
+                        // Optimistically just do efficient check of cache for outputs
+                        if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out)))
+                            return false;
+                    }
+                    // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1730,8 +1916,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         // itself can contain sigops MAX_TX_SIGOPS is less than
         // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
         // merely non-standard transaction.
+        unsigned int nSigOps = GetLegacySigOpCount(tx);
         if (!tx.IsZerocoinSpend()) {
-            unsigned int nSigOps = GetLegacySigOpCount(tx);
             unsigned int nMaxSigOps = MAX_TX_SIGOPS_CURRENT;
             nSigOps += GetP2SHSigOpCount(tx, view);
             if(nSigOps > nMaxSigOps)
@@ -1745,9 +1931,9 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = 0;
         if (!tx.IsZerocoinSpend())
-            view.GetPriority(tx, chainActive.Height());
+            dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height(), nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1800,7 +1986,9 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
+        // An outpoint always names the same output, so scripts that passed against a
+        // snapshot of the inputs outside cs_main need not be run again.
+        if (!CheckInputs(tx, state, view, !fScriptsChecked, STANDARD_SCRIPT_VERIFY_FLAGS, true)) {
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1813,12 +2001,33 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
+        if (!fScriptsChecked && !CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)) {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
 
-        // Store transaction in memory
-        pool.addUnchecked(hash, entry);
+        // Calculate in-mempool ancestors, up to a limit.
+        CTxMemPool::setEntries setAncestors;
+        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+        std::string errString;
+        {
+            LOCK(pool.cs);
+            if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+                return state.DoS(0, error("AcceptToMemoryPool : %s", errString), REJECT_NONSTANDARD, "too-long-mempool-chain");
+            }
+
+            // Store transaction in memory
+            pool.addUnchecked(hash, entry, setAncestors);
+        }
+
+        // trim mempool and check if tx was trimmed
+        if (!fOverrideMempoolLimit) {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+            if (!pool.exists(hash))
+                return state.DoS(0, error("AcceptToMemoryPool : mempool full"), REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
 
     SyncWithWallets(tx, NULL);
@@ -1855,14 +2064,11 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 
     // ----------- swiftTX transaction scanning -----------
 
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                return state.DoS(0,
-                    error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                    REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 txHashLocked;
+    if (swiftTxManager.FindConflictingLock(tx, txHashLocked)) {
+        return state.DoS(0,
+            error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+            REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1888,15 +2094,18 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
             CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
             view.SetBackend(viewMemPool);
 
-            // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
-
             // do all inputs exist?
             // Note that this does not check for the presence of actual outputs (see the next check for that),
             // only helps filling in pfMissingInputs (to determine missing vs spent).
             for (const CTxIn txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
+                    // Are inputs missing because we already have the tx?
+                    for (size_t out = 0; out < tx.vout.size(); out++) {
+                        // Optimistically just do efficient check of cache for outputs
+                        if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out)))
+                            return false;
+                    }
+                    // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1946,7 +2155,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
         CAmount nFees = nValueIn - nValueOut;
         double dPriority = view.GetPriority(tx, chainActive.Height());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height());
+        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -2024,6 +2233,128 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+bool LoadMempool()
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t count = 0;
+    int64_t failed = 0;
+    int64_t expired = 0;
+    int64_t nNow = GetTime();
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION) {
+            return false;
+        }
+
+        // Apply the fee and priority deltas first, so that prioritised
+        // transactions pass the fee checks when they are accepted below.
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); ++it) {
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+        }
+
+        uint64_t num;
+        file >> num;
+        int nLastProgress = -1;
+        uiInterface.ShowProgress(_("Loading mempool..."), 0);
+        for (uint64_t i = 0; i < num; i++) {
+            CTransaction tx;
+            int64_t nTime;
+            file >> tx;
+            file >> nTime;
+
+            if (nTime + nExpiryTimeout > nNow) {
+                LOCK(cs_main);
+                CValidationState state;
+                if (AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime))
+                    ++count;
+                else
+                    ++failed;
+            } else {
+                ++expired;
+            }
+
+            int nProgress = (int)(i * 100 / num);
+            if (nProgress != nLastProgress) {
+                uiInterface.ShowProgress(_("Loading mempool..."), nProgress);
+                nLastProgress = nProgress;
+            }
+            if (ShutdownRequested()) {
+                uiInterface.ShowProgress("", 100);
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        uiInterface.ShowProgress("", 100);
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, expired);
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t start = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<std::pair<CTransaction, int64_t> > vTx;
+
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        vTx.reserve(mempool.mapTx.size());
+        for (CTxMemPool::indexed_transaction_set::const_iterator it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+            vTx.push_back(std::make_pair(it->GetTx(), it->GetTime()));
+        }
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        boost::filesystem::path pathTmp = GetDataDir() / "mempool.dat.new";
+        FILE* filestr = fopen(pathTmp.string().c_str(), "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+
+        file << mapDeltas;
+        file << (uint64_t)vTx.size();
+        for (std::vector<std::pair<CTransaction, int64_t> >::const_iterator it = vTx.begin(); it != vTx.end(); ++it) {
+            file << it->first;
+            file << it->second;
+        }
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathTmp, GetDataDir() / "mempool.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid - start) * 0.000001, (last - mid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
@@ -2063,10 +2394,9 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
             int nHeight = -1;
             {
-                CCoinsViewCache& view = *pcoinsTip;
-                const CCoins* coins = view.AccessCoins(hash);
-                if (coins)
-                    nHeight = coins->nHeight;
+                const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+                if (!coin.IsSpent())
+                    nHeight = coin.nHeight;
             }
             if (nHeight > 0)
                 pindexSlow = chainActive[nHeight];
@@ -2120,35 +2450,81 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
     // Read block
+    std::vector<char> vchBlock;
+    if (!blockFileReader.ReadRecord(pos, "blk", 0, vchBlock))
+        return error("ReadBlockFromDisk : ReadRecord failed");
     try {
-        filein >> block;
+        CDataStream ssBlock(vchBlock, SER_DISK, CLIENT_VERSION);
+        ssBlock >> block;
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
-    // Check the header
-    if (block.IsProofOfWork()) {
-        if (!CheckProofOfWork(block.GetHash(), block.nBits))
+    // We only read blocks we have written ourselves, after checking them.
+    // Hashing the header again is expensive, so it is only done on request.
+    if (fCheckBlockReads) {
+        if (block.IsProofOfWork() && !CheckProofOfWork(block.GetHash(), block.nBits))
             return error("ReadBlockFromDisk : Errors in block header");
+        bool fMutated;
+        if (block.BuildMerkleTree(&fMutated) != block.hashMerkleRoot || fMutated)
+            return error("ReadBlockFromDisk : Merkle root mismatch");
     }
 
     return true;
 }
 
+/**
+ * Check that a header read from disk is the one of pindex. The hash of the
+ * index entry was computed from these fields, so comparing them is as good
+ * as comparing the hashes, without running the hash function.
+ */
+static bool CheckHeaderMatchesIndex(const CBlockHeader& block, const CBlockIndex* pindex)
+{
+    CBlockHeader header = pindex->GetBlockHeader();
+    bool fMatch = block.nVersion == header.nVersion && block.hashPrevBlock == header.hashPrevBlock &&
+                  block.hashMerkleRoot == header.hashMerkleRoot && block.nTime == header.nTime &&
+                  block.nBits == header.nBits && block.nNonce == header.nNonce &&
+                  (block.nVersion < 4 || block.nAccumulatorCheckpoint == header.nAccumulatorCheckpoint);
+    if (fMatch && fCheckBlockReads)
+        fMatch = block.GetHash() == pindex->GetBlockHash();
+    if (!fMatch)
+        return error("%s : block=%s index=%s", __func__, block.GetHash().ToString(), pindex->GetBlockHash().ToString());
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash()) {
-        LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().ToString().c_str(), pindex->GetBlockHash().ToString().c_str());
-        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
+    if (!CheckHeaderMatchesIndex(block, pindex))
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : block doesn't match index");
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<char>& vchBlock, const CBlockIndex* pindex)
+{
+    if (!blockFileReader.ReadRecord(pindex->GetBlockPos(), "blk", 0, vchBlock))
+        return error("ReadRawBlockFromDisk : ReadRecord failed");
+
+    // Only the header is checked, the rest is passed on as it is
+    CBlockHeader header;
+    try {
+        CDataStream ssHeader(vchBlock, SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+        if (fCheckBlockReads) {
+            CBlock block;
+            CDataStream ssBlock(vchBlock, SER_DISK, CLIENT_VERSION);
+            ssBlock >> block;
+            bool fMutated;
+            if (block.BuildMerkleTree(&fMutated) != block.hashMerkleRoot || fMutated)
+                return error("ReadRawBlockFromDisk : Merkle root mismatch in %s", pindex->GetBlockHash().ToString());
+        }
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
+    if (!CheckHeaderMatchesIndex(header, pindex))
+        return error("ReadRawBlockFromDisk : block doesn't match index");
     return true;
 }
 
@@ -2221,6 +2597,27 @@ int64_t GetMasternodePayment(int nHeight, int64_t blockValue, int nMasternodeCou
 	return blockValue * 0.6;
 }
 
+bool IsBlockAssumedValid(const uint256& hash, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid == 0)
+        return false;
+
+    // Only once the block is indexed, at the expected height, and on the
+    // best header chain
+    BlockMap::iterator mi = mapBlockIndex.find(hashAssumeValid);
+    if (mi == mapBlockIndex.end())
+        return false;
+    CBlockIndex* pindexAssumeValid = mi->second;
+    if (nAssumeValidHeight > 0 && pindexAssumeValid->nHeight != nAssumeValidHeight)
+        return false;
+    if (pindexBestHeader == NULL || pindexBestHeader->GetAncestor(pindexAssumeValid->nHeight) != pindexAssumeValid)
+        return false;
+
+    CBlockIndex* pindex = pindexAssumeValid->GetAncestor(nHeight);
+    return pindex != NULL && pindex->GetBlockHash() == hash;
+}
+
 bool IsInitialBlockDownload()
 {
     LOCK(cs_main);
@@ -2369,14 +2766,14 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
     if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-            txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
+            txundo.vprevout.push_back(Coin());
+            bool ret = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
             assert(ret);
         }
     }
 
     // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 bool CScriptCheck::operator()()
@@ -2407,12 +2804,12 @@ CAmount GetInvalidUTXOValue()
         const COutPoint out = it.first;
         bool fSpent = false;
         CCoinsViewCache cache(pcoinsTip);
-        const CCoins *coins = cache.AccessCoins(out.hash);
-        if(!coins || !coins->IsAvailable(out.n))
+        const Coin& coin = cache.AccessCoin(out);
+        if(!coin.IsAvailable())
             fSpent = true;
 
         if (!fSpent)
-            nValue += coins->vout[out.n].nValue;
+            nValue += coin.out.nValue;
     }
 
     return nValue;
@@ -2437,20 +2834,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         CAmount nFees = 0;
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             const COutPoint& prevout = tx.vin[i].prevout;
-            const CCoins* coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
-                if (nSpendHeight - coins->nHeight < Params().COINBASE_MATURITY())
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
+                if (nSpendHeight - (int)coin.nHeight < Params().COINBASE_MATURITY())
                     return state.Invalid(
-                        error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - coins->nHeight, coins->IsCoinStake()),
+                        error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - (int)coin.nHeight, coin.IsCoinStake()),
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, error("CheckInputs() : txin values out of range"),
                     REJECT_INVALID, "bad-txns-inputvalues-outofrange");
         }
@@ -2481,11 +2878,11 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(coin.out, tx, i, flags, cacheStore);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2497,7 +2894,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check(*coins, tx, i,
+                        CScriptCheck check(coin.out, tx, i,
                             flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -2518,7 +2915,38 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+/**
+ * Restore the output spent by a transaction input from its undo data.
+ * Returns false if the undo data does not fit the coins in view.
+ */
+static bool ApplyTxInUndo(const Coin& undoIn, CCoinsViewCache& view, const COutPoint& out, CUtxoStats* pstatsDelta)
+{
+    bool fClean = true;
+    Coin undo(undoIn);
+
+    if (view.HaveCoin(out)) {
+        fClean = error("DisconnectBlock() : undo data overwriting existing output");
+        if (pstatsDelta)
+            pstatsDelta->RemoveCoin(out, view.AccessCoin(out));
+    }
+    if (undo.nHeight == 0) {
+        // Undo data written before the chainstate was kept per output only
+        // has the height and coinbase flags for the last spend of a
+        // transaction's outputs, so another output of it must still be there.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("DisconnectBlock() : undo data adding output to missing transaction");
+        undo.nHeight = alternate.nHeight;
+        undo.fCoinBase = alternate.fCoinBase;
+        undo.fCoinStake = alternate.fCoinStake;
+    }
+    view.AddCoin(out, undo, !fClean);
+    if (pstatsDelta && !undo.out.scriptPubKey.IsUnspendable())
+        pstatsDelta->AddCoin(out, undo);
+    return fClean;
+}
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CUtxoStats* pstatsDelta)
 {
 	if (pindex->GetBlockHash() != view.GetBestBlock())
 		LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -2578,25 +3006,18 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         uint256 hash = tx.GetHash();
 
         // Check that all outputs are available and match the outputs in the block itself
-        // exactly. Note that transactions with only provably unspendable outputs won't
-        // have outputs available even in the block itself, so we handle that case
-        // specially with outsEmpty.
-        {
-            CCoins outsEmpty;
-            CCoinsModifier outs = view.ModifyCoins(hash);
-            outs->ClearUnspendable();
-
-            CCoins outsBlock(tx, pindex->nHeight);
-            // The CCoins serialization does not serialize negative numbers.
-            // No network rules currently depend on the version here, so an inconsistency is harmless
-            // but it must be corrected before txout nversion ever influences a network rule.
-            if (outsBlock.nVersion < 0)
-                outs->nVersion = outsBlock.nVersion;
-            if (*outs != outsBlock)
-                fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted, version %d, block %d", outsBlock.nVersion, pindex->nHeight);
-
-            // remove outputs
-            outs->Clear();
+        // exactly.
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (tx.vout[o].scriptPubKey.IsUnspendable())
+                continue;
+            COutPoint out(hash, o);
+            Coin coin;
+            bool fSpent = view.SpendCoin(out, &coin);
+            if (fSpent && pstatsDelta)
+                pstatsDelta->RemoveCoin(out, coin);
+            if (!fSpent || tx.vout[o] != coin.out || (uint32_t)pindex->nHeight != coin.nHeight ||
+                tx.IsCoinBase() != coin.fCoinBase || tx.IsCoinStake() != coin.fCoinStake)
+                fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted, block %d", pindex->nHeight);
         }
 
         // restore inputs
@@ -2605,26 +3026,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock() : transaction and undo data inconsistent - txundo.vprevout.siz=%d tx.vin.siz=%d", txundo.vprevout.size(), tx.vin.size());
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
-                const COutPoint& out = tx.vin[j].prevout;
-                const CTxInUndo& undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
-                }
-                if (coins->IsAvailable(out.n))
-                    fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n + 1)
-                    coins->vout.resize(out.n + 1);
-                coins->vout[out.n] = undo.txout;
+                if (!ApplyTxInUndo(txundo.vprevout[j], view, tx.vin[j].prevout, pstatsDelta))
+                    fClean = false;
             }
         }
     }
@@ -2670,6 +3073,10 @@ void static FlushBlockFile(bool fFinalize = false)
         FileCommit(fileOld);
         fclose(fileOld);
     }
+
+    // Readers still have the files open at their preallocated size
+    if (fFinalize)
+        blockFileReader.Close(nLastBlockFile);
 }
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
@@ -2697,10 +3104,9 @@ void RecalculateZXUEZMinted()
         std::list<CZerocoinMint> listMints;
         BlockToZerocoinMintList(block, listMints, true);
 
-        vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
+        pindex->vZerocoinMints.SetNull();
         for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+            pindex->vZerocoinMints.Add(mint.GetDenomination(), 1);
 
         if (pindex->nHeight < nHeightEnd)
             pindex = chainActive.Next(pindex);
@@ -2723,17 +3129,15 @@ void RecalculateZXUEZSpent()
         list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        pindex->vZerocoinSupply = pindex->pprev->vZerocoinSupply;
 
         //Add mints to zXUEZ supply
-        for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
-        }
+        for (auto denom : libzerocoin::zerocoinDenomList)
+            pindex->vZerocoinSupply.Add(denom, pindex->vZerocoinMints.Get(denom));
 
         //Remove spends from zXUEZ supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->vZerocoinSupply.Add(denom, -1);
 
         //Rewrite money supply
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2809,7 +3213,7 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, CUtxoStats* pstatsDelta)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -2837,7 +3241,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock() : PoW period ended"),
             REJECT_INVALID, "PoW-ended");
 
-    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    bool fAssumedValid = IsBlockAssumedValid(pindex->GetBlockHash(), pindex->nHeight);
+    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate() && !fAssumedValid;
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
@@ -2854,10 +3259,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     bool fEnforceBIP30 = !pindex->phashBlock;
     if (fEnforceBIP30) {
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx.GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
-                    REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx.GetHash(), o)))
+                    return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
+                        REJECT_INVALID, "bad-txns-BIP30");
+            }
         }
     }
 
@@ -2919,6 +3325,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 CoinSpend spend = TxInToZerocoinSpend(txIn);
                 nValueIn += spend.getDenomination() * COIN;
 
+                // CheckTransaction skips the proof during the initial block
+                // download, it is checked here unless the block is assumed valid
+                if (!fAssumedValid && !VerifyZerocoinSpend(txIn, spend, state))
+                    return error("%s : zerocoin spend proof failed in tx %s", __func__, tx.GetHash().GetHex());
+
                 // Make sure that the serial number is in valid range
                 if (!spend.HasValidSerial(Params().Zerocoin_Params())) {
                     string strError = strprintf("%s : txid=%s in block %d contains invalid serial %s\n", __func__, tx.GetHash().GetHex(), pindex->nHeight, spend.getCoinSerialNumber());
@@ -2971,7 +3382,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fJustCheck, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
             control.Add(vChecks);
         }
@@ -2992,35 +3403,33 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     BlockToZerocoinMintList(block, listMints, fFilterInvalid);
     std::list<libzerocoin::CoinDenomination> listSpends = ZerocoinSpendListFromBlock(block, fFilterInvalid);
 
-    // Initialize zerocoin supply to the supply from previous block
-    if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3) {
-        for (auto& denom : zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->mapZerocoinSupply.at(denom);
-        }
-    }
+    // Initialize zerocoin supply to the supply from previous block. The
+    // supply is shared with the previous block until this one changes it.
+    if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3)
+        pindex->vZerocoinSupply = pindex->pprev->vZerocoinSupply;
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
-    pindex->vMintDenominationsInBlock.clear();
+    pindex->vZerocoinMints.SetNull();
     if (pindex->pprev) {
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
-            pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->vZerocoinMints.Add(denom, 1);
+            pindex->vZerocoinSupply.Add(denom, 1);
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->vZerocoinSupply.Add(denom, -1);
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
-            if (pindex->mapZerocoinSupply.at(denom) < 0)
+            if (pindex->vZerocoinSupply.Get(denom) < 0)
                 return state.DoS(100, error("Block contains zerocoins that spend more than are in the available supply to spend"));
         }
     }
 
     for (auto& denom : zerocoinDenomList) {
-        LogPrint("zero" "%s coins for denomination %d pubcoin %s\n", __func__, pindex->mapZerocoinSupply.at(denom), denom);
+        LogPrint("zero" "%s coins for denomination %d pubcoin %s\n", __func__, pindex->vZerocoinSupply.Get(denom), denom);
     }
 
     // track money supply and mint amount info
@@ -3032,8 +3441,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 //              FormatMoney(nValueOut), FormatMoney(nValueIn),
 //              FormatMoney(nFees), FormatMoney(pindex->nMint), FormatMoney(nAmountZerocoinSpent));
 
-    if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)))
-        return error("Connect() : WriteBlockIndex for pindex failed");
+    // The money supply changed, write the entry with the next flush
+    if (!fJustCheck)
+        setDirtyBlockIndex.insert(pindex);
 
     int64_t nTime1 = GetTimeMicros();
     nTimeConnect += nTime1 - nTimeStart;
@@ -3076,6 +3486,24 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    // Record the spent and created coins; outputs created and spent within
+    // the block cancel out
+    if (pstatsDelta) {
+        for (unsigned int i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = block.vtx[i];
+            if (i > 0) {
+                const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+                for (unsigned int j = 0; j < txundo.vprevout.size(); j++)
+                    pstatsDelta->RemoveCoin(tx.vin[j].prevout, txundo.vprevout[j]);
+            }
+            const uint256& hash = tx.GetHash();
+            for (unsigned int o = 0; o < tx.vout.size(); o++) {
+                if (!tx.vout[o].scriptPubKey.IsUnspendable())
+                    pstatsDelta->AddCoin(COutPoint(hash, o), Coin(tx.vout[o], pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake()));
+            }
+        }
+    }
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
@@ -3134,39 +3562,45 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     static int64_t nLastWrite = 0;
     try {
         if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
-            // Typical CCoins structures on disk are around 100 bytes in size.
+            // Typical Coin structures on disk are around 48 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
             // overwrite one. Still, use a conservative safety factor of 2.
-            if (!CheckDiskSpace(100 * 2 * 2 * pcoinsTip->GetCacheSize()))
+            if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
-            // Then update all block file information (which may refer to block and undo files).
-            bool fileschanged = false;
-            for (set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end();) {
-                if (!pblocktree->WriteBlockFileInfo(*it, vinfoBlockFile[*it])) {
-                    return state.Abort("Failed to write to block index");
-                }
-                fileschanged = true;
-                setDirtyFileInfo.erase(it++);
+            // Then update all block file information (which may refer to block and undo files)
+            // and the block index entries in one synced batch.
+            int64_t nStart = GetTimeMicros();
+            std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
+            vFiles.reserve(setDirtyFileInfo.size());
+            for (set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); it++) {
+                vFiles.push_back(make_pair(*it, &vinfoBlockFile[*it]));
             }
-            if (fileschanged && !pblocktree->WriteLastBlockFile(nLastBlockFile)) {
+            std::vector<const CBlockIndex*> vBlocks(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+            size_t nBlockIndexBytes = 0;
+            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, &nBlockIndexBytes)) {
                 return state.Abort("Failed to write to block index");
             }
-            for (set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end();) {
-                if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(*it))) {
-                    return state.Abort("Failed to write to block index");
-                }
-                setDirtyBlockIndex.erase(it++);
-            }
-            pblocktree->Sync();
+            setDirtyFileInfo.clear();
+            setDirtyBlockIndex.clear();
+            int64_t nBlockIndexTime = GetTimeMicros();
             // Finally flush the chainstate (which may refer to block index entries).
+            // The coins flusher writes it in the background, unless we are asked to
+            // make sure everything is on disk.
+            CUtxoStats statsTip;
+            if (pcoinsFlusher != NULL && utxoStats.Get(statsTip))
+                pcoinsFlusher->SetUtxoStats(statsTip);
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            if (mode == FLUSH_STATE_ALWAYS && pcoinsFlusher != NULL && !pcoinsFlusher->Sync())
+                return state.Abort("Failed to write to coin database");
+            LogPrint("bench", "FlushStateToDisk: %u block index entries (%u bytes) in %.2fms, coins in %.2fms\n",
+                (unsigned int)vBlocks.size(), (unsigned int)nBlockIndexBytes, 0.001 * (nBlockIndexTime - nStart), 0.001 * (GetTimeMicros() - nBlockIndexTime));
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 g_signals.SetBestChain(chainActive.GetLocator());
@@ -3198,10 +3632,10 @@ void static UpdateTip(CBlockIndex* pindexNew)
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u unixtime=%d\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utxo) unixtime=%d\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize(), chainActive.Tip()->GetBlockTime());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize(), chainActive.Tip()->GetBlockTime());
 
     cvBlockChange.notify_all();
 
@@ -3240,26 +3674,41 @@ bool static DisconnectTip(CValidationState& state)
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        CUtxoStats statsDelta;
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, &statsDelta))
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
+        statsDelta.hashBlock = pindexDelete->pprev->GetBlockHash();
+        utxoStats.Apply(statsDelta);
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
         return false;
     // Resurrect mempool transactions from the disconnected block.
+    std::vector<uint256> vHashUpdate;
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
         // ignore validation errors in resurrected transactions
         list<CTransaction> removed;
         CValidationState stateDummy;
-        if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL))
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, false, false, true))
             mempool.remove(tx, removed, true);
-    }
+        else if (mempool.exists(tx.GetHash()))
+            vHashUpdate.push_back(tx.GetHash());
+    }
+    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in this
+    // block that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
     mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    if (!fLiteMode)
+        masternodePayments.BlockDisconnected(block, pindexDelete->nHeight);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     BOOST_FOREACH (const CTransaction& tx, block.vtx) {
@@ -3302,7 +3751,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
+        CUtxoStats statsDelta;
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked, &statsDelta);
         g_signals.BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -3314,6 +3764,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
+        statsDelta.hashBlock = pindexNew->GetBlockHash();
+        utxoStats.Apply(statsDelta);
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
@@ -3335,6 +3787,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     mempool.check(pcoinsTip);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    if (!fLiteMode)
+        masternodePayments.BlockConnected(*pblock, pindexNew->nHeight);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     BOOST_FOREACH (const CTransaction& tx, txConflicted) {
@@ -3993,15 +4447,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
             if (!tx.IsCoinBase()) {
                 //only reject blocks when it's based on complete consensus
-                BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                    if (mapLockedInputs.count(in.prevout)) {
-                        if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                            mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
-                            LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString(), tx.GetHash().ToString());
-                            return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
-                                REJECT_INVALID, "conflicting-tx-ix");
-                        }
-                    }
+                uint256 txHashLocked;
+                if (swiftTxManager.FindConflictingLock(tx, txHashLocked)) {
+                    mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
+                    LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", txHashLocked.ToString(), tx.GetHash().ToString());
+                    return state.DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"),
+                        REJECT_INVALID, "conflicting-tx-ix");
                 }
             }
         }
@@ -4097,7 +4548,9 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
         uint256 hashProofOfStake;
         uint256 hash = block.GetHash();
 
-        if(!CheckProofOfStake(block, hashProofOfStake)) {
+        // The kernel is always checked, the coinstake signature only outside -assumevalid
+        bool fCheckSignature = !IsBlockAssumedValid(hash, pindexPrev->nHeight + 1);
+        if(!CheckProofOfStake(block, hashProofOfStake, fCheckSignature)) {
             LogPrintf("WARNING: ProcessBlock(): check proof-of-stake failed for block %s\n", hash.ToString().c_str());
             return false;
         }
@@ -4492,7 +4945,8 @@ FILE* OpenDiskFile(const CDiskBlockPos& pos, const char* prefix, bool fReadOnly)
     if (pos.IsNull())
         return NULL;
     boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
-    boost::filesystem::create_directories(path.parent_path());
+    if (!fReadOnly)
+        boost::filesystem::create_directories(path.parent_path());
     FILE* file = fopen(path.string().c_str(), "rb+");
     if (!file && !fReadOnly)
         file = fopen(path.string().c_str(), "wb+");
@@ -4565,9 +5019,17 @@ bool static LoadBlockIndexDB()
         vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    size_t nZerocoinUsage = 0;
     BOOST_FOREACH (const PAIRTYPE(int, CBlockIndex*) & item, vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        // Blocks without zerocoin transactions have the same supply as their
+        // parent, let them share its copy instead of keeping their own.
+        if (pindex->pprev && pindex->vZerocoinSupply == pindex->pprev->vZerocoinSupply)
+            pindex->vZerocoinSupply = pindex->pprev->vZerocoinSupply;
+        else
+            nZerocoinUsage += pindex->vZerocoinSupply.DynamicMemoryUsage();
+        nZerocoinUsage += pindex->vZerocoinMints.DynamicMemoryUsage();
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
@@ -4589,6 +5051,8 @@ bool static LoadBlockIndexDB()
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    LogPrintf("%s: %u block index entries use %uMiB, of which %ukB zerocoin data\n", __func__, vSortedByHeight.size(),
+        vSortedByHeight.size() * sizeof(CBlockIndex) >> 20, nZerocoinUsage >> 10);
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -4786,7 +5250,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -4839,6 +5303,85 @@ bool LoadBlockIndex()
     return true;
 }
 
+void ThreadVerifyBlockIndexHashes()
+{
+    // The block index is loaded without rehashing the headers, trusting the
+    // hashes stored as database keys. Recompute them here, off the startup
+    // path, to detect a corrupted block index.
+    vector<CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        vIndex.reserve(mapBlockIndex.size());
+        BOOST_FOREACH (const PAIRTYPE(uint256, CBlockIndex*) & item, mapBlockIndex)
+            vIndex.push_back(item.second);
+    }
+
+    int64_t nStart = GetTimeMillis();
+    unsigned int nChecked = 0;
+    const unsigned int nBatchSize = 1000;
+    for (unsigned int nBatchStart = 0; nBatchStart < vIndex.size(); nBatchStart += nBatchSize) {
+        boost::this_thread::interruption_point();
+
+        // Copy the headers under cs_main and hash them without holding it
+        vector<pair<uint256, CBlockHeader> > vHeaders;
+        {
+            LOCK(cs_main);
+            for (unsigned int i = nBatchStart; i < vIndex.size() && i < nBatchStart + nBatchSize; i++) {
+                // Skip placeholders for blocks we only know the hash of
+                if (vIndex[i]->nVersion == 0)
+                    continue;
+                vHeaders.push_back(make_pair(vIndex[i]->GetBlockHash(), vIndex[i]->GetBlockHeader()));
+            }
+        }
+
+        BOOST_FOREACH (const PAIRTYPE(uint256, CBlockHeader) & item, vHeaders) {
+            if (item.second.GetHash() != item.first) {
+                AbortNode(strprintf("Block index entry %s does not match its header", item.first.ToString()),
+                    _("Corrupted block database detected. Please restart with -reindex."));
+                return;
+            }
+        }
+        nChecked += vHeaders.size();
+    }
+    LogPrintf("%s: verified %u block index hashes in %dms\n", __func__, nChecked, GetTimeMillis() - nStart);
+}
+
+void ThreadComputeUtxoStats()
+{
+    // Scan a state that is on disk; the blocks connected from here on are
+    // logged and applied to the result of the scan.
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        utxoStats.StartScan(pcoinsTip->GetBestBlock());
+    }
+
+    int64_t nStart = GetTimeMillis();
+    CCoinsStats stats;
+    bool fOk = false;
+    try {
+        fOk = pcoinsFlusher->GetStats(stats);
+    } catch (const boost::thread_interrupted&) {
+        utxoStats.AbortScan();
+        throw;
+    }
+    if (!fOk) {
+        utxoStats.AbortScan();
+        LogPrintf("%s: failed to read the coin database\n", __func__);
+        return;
+    }
+
+    bool fMismatch = false;
+    if (!utxoStats.FinishScan(CUtxoStats(stats), fMismatch)) {
+        LogPrintf("%s: scanned block %s was not connected during the scan\n", __func__, stats.hashBlock.ToString());
+        return;
+    }
+    if (fMismatch)
+        LogPrintf("ERROR: %s: UTXO set statistics did not match the coin database and were replaced\n", __func__);
+    LogPrintf("%s: computed UTXO set statistics of %u outputs at block %s in %dms\n", __func__,
+        (unsigned int)stats.nTransactionOutputs, stats.hashBlock.ToString(), GetTimeMillis() - nStart);
+}
+
 
 bool InitBlockIndex()
 {
@@ -4882,102 +5425,7 @@ bool InitBlockIndex()
 
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
-
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
-            }
-        }
-    } catch (std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
-    }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
-    return nLoaded > 0;
+    return blockImporter.Load(fileIn, dbp);
 }
 
 void static CheckBlockIndex()
@@ -5181,24 +5629,33 @@ string GetWarnings(string strFor)
 //
 
 
+/** Whether a masternode ping or budget vote is in its store of seen items, or was evicted from it */
+template <typename T>
+static bool AlreadyHaveGossip(const CInv& inv, const std::map<uint256, T>& mapSeen)
+{
+    return mapSeen.count(inv.hash) || gossipFilter.contains(inv);
+}
+
 bool static AlreadyHave(const CInv& inv)
 {
     switch (inv.type) {
     case MSG_TX: {
         bool txInMap = false;
         txInMap = mempool.exists(inv.hash);
+        // Only the cache is checked for outputs of a confirmed transaction,
+        // as looking every output up in the database would be too slow
         return txInMap || mapOrphanTransactions.count(inv.hash) ||
-               pcoinsTip->HaveCoins(inv.hash);
+               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) ||
+               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
     }
     case MSG_DSTX:
         return mapObfuscationBroadcastTxes.count(inv.hash);
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
     case MSG_TXLOCK_REQUEST:
-        return mapTxLockReq.count(inv.hash) ||
-               mapTxLockReqRejected.count(inv.hash);
+        return swiftTxManager.HaveLockRequest(inv.hash);
     case MSG_TXLOCK_VOTE:
-        return mapTxLockVote.count(inv.hash);
+        return swiftTxManager.HaveLockVote(inv.hash);
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
@@ -5208,7 +5665,7 @@ bool static AlreadyHave(const CInv& inv)
         }
         return false;
     case MSG_BUDGET_VOTE:
-        if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
+        if (AlreadyHaveGossip(inv, budget.mapSeenMasternodeBudgetVotes)) {
             masternodeSync.AddedBudgetItem(inv.hash);
             return true;
         }
@@ -5220,7 +5677,7 @@ bool static AlreadyHave(const CInv& inv)
         }
         return false;
     case MSG_BUDGET_FINALIZED_VOTE:
-        if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
+        if (AlreadyHaveGossip(inv, budget.mapSeenFinalizedBudgetVotes)) {
             masternodeSync.AddedBudgetItem(inv.hash);
             return true;
         }
@@ -5238,7 +5695,7 @@ bool static AlreadyHave(const CInv& inv)
         }
         return false;
     case MSG_MASTERNODE_PING:
-        return mnodeman.mapSeenMasternodePing.count(inv.hash);
+        return AlreadyHaveGossip(inv, mnodeman.mapSeenMasternodePing);
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -5282,14 +5739,18 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    // Send block from disk, as it is stored when the peer
+                    // wants all of it
+                    if (inv.type == MSG_BLOCK) {
+                        std::vector<char> vchBlock;
+                        if (!ReadRawBlockFromDisk(vchBlock, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushMessage("block", CFlatData(vchBlock));
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -5343,19 +5804,21 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
+                    CConsensusVote vote;
+                    if (swiftTxManager.GetLockVote(inv.hash, vote)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
+                        ss << vote;
                         pfrom->PushMessage("txlvote", ss);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
+                    CTransaction txLockReq;
+                    if (swiftTxManager.GetLockRequest(inv.hash, txLockReq)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
+                        ss << txLockReq;
                         pfrom->PushMessage("ix", ss);
                         pushed = true;
                     }
@@ -5478,6 +5941,149 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+/**
+ * Try to accept the orphan hash to the mempool. The peer that sent it is
+ * punished if it is invalid, unless it is already in setMisbehaving.
+ * Returns true if it was accepted.
+ */
+bool static AcceptOrphanTransaction(const uint256& hash, bool fScriptsChecked, set<NodeId>& setMisbehaving)
+{
+    AssertLockHeld(cs_main);
+
+    // The orphan may have been resolved, evicted or expired in the meantime
+    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    if (it == mapOrphanTransactions.end())
+        return false;
+    CTransaction orphanTx = it->second.tx;
+    NodeId fromPeer = it->second.fromPeer;
+    if (setMisbehaving.count(fromPeer))
+        return false;
+
+    bool fAccepted = false;
+    bool fMissingInputs = false;
+    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+    // anyone relaying LegitTxX banned)
+    CValidationState stateDummy;
+    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs, false, false, false, fScriptsChecked)) {
+        LogPrint("mempool", "   accepted orphan tx %s\n", hash.ToString());
+        RelayTransaction(orphanTx);
+        EraseOrphanTx(hash);
+        fAccepted = true;
+    } else if (!fMissingInputs) {
+        int nDos = 0;
+        if (stateDummy.IsInvalid(nDos) && nDos > 0) {
+            // Punish peer that gave us an invalid orphan tx
+            Misbehaving(fromPeer, nDos);
+            setMisbehaving.insert(fromPeer);
+            LogPrint("mempool", "   invalid orphan tx %s\n", hash.ToString());
+        }
+        // Has inputs but not accepted to mempool
+        // Probably non-standard or insufficient fee/priority
+        LogPrint("mempool", "   removed orphan tx %s\n", hash.ToString());
+        EraseOrphanTx(hash);
+    }
+    mempool.check(pcoinsTip);
+    return fAccepted;
+}
+
+/**
+ * Reconsider the orphans that spend outputs of the transaction hash, which
+ * was just accepted to the mempool, and in turn those of the orphans that
+ * get accepted. They are handed to the pre-validation threads, or processed
+ * here when those are not running or are backed up.
+ */
+void static ReconsiderOrphans(const uint256& hash, const boost::shared_ptr<set<NodeId> >& psetMisbehaving)
+{
+    AssertLockHeld(cs_main);
+    vector<uint256> vWorkQueue(1, hash);
+    for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
+        set<uint256> setChildren;
+        map<COutPoint, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.lower_bound(COutPoint(vWorkQueue[i], 0));
+        for (; itByPrev != mapOrphanTransactionsByPrev.end() && itByPrev->first.hash == vWorkQueue[i]; ++itByPrev)
+            setChildren.insert(itByPrev->second.begin(), itByPrev->second.end());
+
+        BOOST_FOREACH (const uint256& orphanHash, setChildren) {
+            // Processing an earlier child may have resolved this one already
+            map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(orphanHash);
+            if (it == mapOrphanTransactions.end() || psetMisbehaving->count(it->second.fromPeer))
+                continue;
+            if (txPreValidator.SubmitOrphan(it->second.tx, psetMisbehaving))
+                continue;
+            if (AcceptOrphanTransaction(orphanHash, false, *psetMisbehaving))
+                vWorkQueue.push_back(orphanHash);
+        }
+    }
+}
+
+void ProcessOrphanTransaction(const uint256& hash, bool fScriptsChecked, const boost::shared_ptr<set<NodeId> >& psetMisbehaving)
+{
+    LOCK(cs_main);
+    if (AcceptOrphanTransaction(hash, fScriptsChecked, *psetMisbehaving))
+        ReconsiderOrphans(hash, psetMisbehaving);
+}
+
+void ProcessTransaction(CNode* pfrom, const CTransaction& tx, const std::string& strCommand, bool ignoreFees, bool fScriptsChecked)
+{
+    CInv inv(MSG_TX, tx.GetHash());
+
+    LOCK(cs_main);
+
+    bool fMissingInputs = false;
+    bool fMissingZerocoinInputs = false;
+    CValidationState state;
+
+    mapAlreadyAskedFor.erase(inv);
+
+    if (!tx.IsZerocoinSpend() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees, false, fScriptsChecked)) {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx);
+
+        LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s : accepted %s (poolsz %u)\n",
+                 pfrom->id, pfrom->cleanSubVer,
+                 tx.GetHash().ToString(),
+                 mempool.mapTx.size());
+
+        ReconsiderOrphans(tx.GetHash(), boost::shared_ptr<set<NodeId> >(new set<NodeId>()));
+    } else if (tx.IsZerocoinSpend() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingZerocoinInputs, false, ignoreFees)) {
+        RelayTransaction(tx);
+        LogPrint("mempool", "AcceptToMemoryPool: Zerocoinspend peer=%d %s : accepted %s (poolsz %u)\n",
+                 pfrom->id, pfrom->cleanSubVer,
+                 tx.GetHash().ToString(),
+                 mempool.mapTx.size());
+    } else if (fMissingInputs) {
+        AddOrphanTx(tx, pfrom->GetId());
+
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+        unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+        if (nEvicted > 0)
+            LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+    } else if (pfrom->fWhitelisted) {
+        // Always relay transactions received from whitelisted peers, even
+        // if they are already in the mempool (allowing the node to function
+        // as a gateway for nodes hidden behind it).
+
+        RelayTransaction(tx);
+    }
+
+    if (strCommand == "dstx") {
+        CInv inv(MSG_DSTX, tx.GetHash());
+        RelayInv(inv);
+    }
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS)) {
+        LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+            pfrom->id, pfrom->cleanSubVer,
+            state.GetRejectReason());
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+            state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -5823,8 +6429,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
 
     else if (strCommand == "tx" || strCommand == "dstx") {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
 
         //masternode signed transaction
@@ -5876,105 +6480,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
-        bool fMissingInputs = false;
-        bool fMissingZerocoinInputs = false;
-        CValidationState state;
-
-        mapAlreadyAskedFor.erase(inv);
-
-        if (!tx.IsZerocoinSpend() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees)) {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx);
-            vWorkQueue.push_back(inv.hash);
-
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s : accepted %s (poolsz %u)\n",
-                     pfrom->id, pfrom->cleanSubVer,
-                     tx.GetHash().ToString(),
-                     mempool.mapTx.size());
-
-            // Recursively process any orphan transactions that depended on this one
-            set<NodeId> setMisbehaving;
-            for(unsigned int i = 0; i < vWorkQueue.size(); i++) {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if(itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for(set<uint256>::iterator mi = itByPrev->second.begin();
-                    mi != itByPrev->second.end();
-                    ++mi) {
-                    const uint256 &orphanHash = *mi;
-                    const CTransaction &orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if(setMisbehaving.count(fromPeer))
-                        continue;
-                    if(AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
-                        vWorkQueue.push_back(orphanHash);
-                        vEraseQueue.push_back(orphanHash);
-                    } else if(!fMissingInputs2) {
-                        int nDos = 0;
-                        if(stateDummy.IsInvalid(nDos) && nDos > 0) {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            BOOST_FOREACH (uint256 hash, vEraseQueue)EraseOrphanTx(hash);
-        } else if (tx.IsZerocoinSpend() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingZerocoinInputs, false, ignoreFees)) {
-            RelayTransaction(tx);
-            LogPrint("mempool", "AcceptToMemoryPool: Zerocoinspend peer=%d %s : accepted %s (poolsz %u)\n",
-                     pfrom->id, pfrom->cleanSubVer,
-                     tx.GetHash().ToString(),
-                     mempool.mapTx.size());
-        } else if (fMissingInputs) {
-            AddOrphanTx(tx, pfrom->GetId());
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
-        } else if (pfrom->fWhitelisted) {
-            // Always relay transactions received from whitelisted peers, even
-            // if they are already in the mempool (allowing the node to function
-            // as a gateway for nodes hidden behind it).
-
-            RelayTransaction(tx);
-        }
-
-        if (strCommand == "dstx") {
-            CInv inv(MSG_DSTX, tx.GetHash());
-            RelayInv(inv);
-        }
-
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS)) {
-            LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                pfrom->id, pfrom->cleanSubVer,
-                state.GetRejectReason());
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
-        }
+        // Transactions go through the pre-validation threads, which check their
+        // scripts before taking cs_main and accept them in the order they came in.
+        // If those are not running or are backed up, the transaction is processed inline.
+        if (!txPreValidator.Submit(tx, pfrom, strCommand, ignoreFees))
+            ProcessTransaction(pfrom, tx, strCommand, ignoreFees);
     }
 
 
@@ -6297,7 +6807,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
         budget.ProcessMessage(pfrom, strCommand, vRecv);
         masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageSwiftTX(pfrom, strCommand, vRecv);
+        swiftTxManager.ProcessMessage(pfrom, strCommand, vRecv);
         ProcessSpork(pfrom, strCommand, vRecv);
         masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
     }
@@ -6329,6 +6839,112 @@ int ActiveProtocol()
 }
 
 // requires LOCK(cs_vRecvMsg)
+/**
+ * Check the signatures of the masternode, budget and SwiftX gossip that arrived from a peer
+ * since the last call on the message check workers, before the messages are processed one at
+ * a time. Peers send gossip in bursts while syncing; the checks done when processing the
+ * messages then find the keys in the verified message cache. Each message is read once here.
+ * Messages already seen or from unknown masternodes are skipped, as processing drops them
+ * before checking their signature.
+ */
+static void VerifyQueuedGossip(CNode* pfrom)
+{
+    std::vector<CSignedMessage> vMessages;
+    for (std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin(); it != pfrom->vRecvMsg.end() && it->complete(); ++it) {
+        if (it->fSignatureQueued)
+            continue;
+        it->fSignatureQueued = true;
+
+        std::string strCommand = it->hdr.GetCommand();
+        if (strCommand != "mnb" && strCommand != "mnp" && strCommand != "mnw" && strCommand != "mvote" && strCommand != "fbvote" && strCommand != "txlvote")
+            continue;
+
+        CDataStream vRecv(it->vRecv);
+        try {
+            if (strCommand == "mnb") {
+                CMasternodeBroadcast mnb;
+                vRecv >> mnb;
+                if (mnodeman.HaveSeenBroadcast(mnb.GetHash()))
+                    continue;
+                vMessages.push_back(CSignedMessage(mnb.pubKeyCollateralAddress, mnb.sig, mnb.GetSignatureMessage()));
+                vMessages.push_back(CSignedMessage(mnb.pubKeyMasternode, mnb.lastPing.vchSig, mnb.lastPing.GetSignatureMessage()));
+                continue;
+            }
+
+            CTxIn vin;
+            std::vector<unsigned char> vchSig;
+            std::string strMessage;
+            if (strCommand == "mnp") {
+                CMasternodePing mnp;
+                vRecv >> mnp;
+                if (mnodeman.HaveSeenPing(mnp.GetHash()))
+                    continue;
+                vin = mnp.vin;
+                vchSig = mnp.vchSig;
+                strMessage = mnp.GetSignatureMessage();
+            } else if (strCommand == "mnw") {
+                CMasternodePaymentWinner winner;
+                vRecv >> winner;
+                {
+                    LOCK(cs_mapMasternodePayeeVotes);
+                    if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash()))
+                        continue;
+                }
+                vin = winner.vinMasternode;
+                vchSig = winner.vchSig;
+                strMessage = winner.GetSignatureMessage();
+            } else if (strCommand == "mvote") {
+                CBudgetVote vote;
+                vRecv >> vote;
+                {
+                    LOCK(budget.cs);
+                    if (budget.mapSeenMasternodeBudgetVotes.count(vote.GetHash()))
+                        continue;
+                }
+                vin = vote.vin;
+                vchSig = vote.vchSig;
+                strMessage = vote.GetSignatureMessage();
+            } else if (strCommand == "fbvote") {
+                CFinalizedBudgetVote vote;
+                vRecv >> vote;
+                {
+                    LOCK(budget.cs);
+                    if (budget.mapSeenFinalizedBudgetVotes.count(vote.GetHash()))
+                        continue;
+                }
+                vin = vote.vin;
+                vchSig = vote.vchSig;
+                strMessage = vote.GetSignatureMessage();
+            } else {
+                CConsensusVote ctx;
+                vRecv >> ctx;
+                if (swiftTxManager.HaveLockVote(ctx.GetHash()))
+                    continue;
+                // only the votes of the top masternodes are checked
+                int nRank = swiftTxManager.GetVoterRank(ctx.vinMasternode, ctx.nBlockHeight);
+                if (nRank == -1 || nRank > SWIFTTX_SIGNATURES_TOTAL)
+                    continue;
+                vin = ctx.vinMasternode;
+                vchSig = ctx.vchMasterNodeSignature;
+                strMessage = ctx.GetSignatureMessage();
+            }
+
+            CMasternode* pmn = mnodeman.Find(vin);
+            if (pmn != NULL)
+                vMessages.push_back(CSignedMessage(pmn->pubKeyMasternode, vchSig, strMessage));
+        } catch (const std::exception&) {
+            // left to ProcessMessage to report
+        }
+    }
+
+    if (vMessages.size() < OBFUSCATION_PARALLEL_VERIFY_MIN)
+        return;
+
+    std::vector<char> vValid;
+    int nValid = obfuScationSigner.VerifyMessages(vMessages, vValid);
+    LogPrint("masternode", "VerifyQueuedGossip - checked %u queued signatures from peer=%d, %d valid\n", vMessages.size(), pfrom->id, nValid);
+}
+
 bool ProcessMessages(CNode* pfrom)
 {
     //if (fDebug)
@@ -6350,6 +6966,9 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    if (!fLiteMode)
+        VerifyQueuedGossip(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -6694,16 +7313,16 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+    // Read undo data and the checksum that follows it
+    std::vector<char> vchUndo;
+    if (!blockFileReader.ReadRecord(pos, "rev", sizeof(uint256), vchUndo))
+        return error("CBlockUndo::ReadFromDisk : ReadRecord failed");
 
-    // Read block
     uint256 hashChecksum;
     try {
-        filein >> *this;
-        filein >> hashChecksum;
+        CDataStream ssUndo(vchUndo, SER_DISK, CLIENT_VERSION);
+        ssUndo >> *this;
+        ssUndo >> hashChecksum;
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -6739,5 +7358,6 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        mapOrphanPeers.clear();
     }
 } instance_of_cmaincleanup;
@@ -11,6 +11,7 @@
 #include "masternode-budget.h"
 #include "masternode-sync.h"
 #include "masternode.h"
+#include "masternodedb.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
 #include "util.h"
@@ -251,39 +252,6 @@ CBudgetDB::CBudgetDB()
     strMagicMessage = "MasternodeBudget";
 }
 
-bool CBudgetDB::Write(const CBudgetManager& objToSave)
-{
-    LOCK(objToSave.cs);
-
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint("masternode","Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
-}
-
 CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 {
     LOCK(objToLoad.cs);
@@ -371,29 +339,12 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 
 void DumpBudgets()
 {
-    int64_t nStart = GetTimeMillis();
-
-    CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
-
-    LogPrint("masternode","Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CBudgetDB::FileError)
-        LogPrint("masternode","Missing budgets file - budget.dat, will try to recreate\n");
-    else if (readResult != CBudgetDB::Ok) {
-        LogPrint("masternode","Error reading budget.dat: ");
-        if (readResult == CBudgetDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to budget.dat...\n");
-    budgetdb.Write(budget);
+    if (pMasternodeDB == NULL)
+        return;
 
-    LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+    int64_t nStart = GetTimeMillis();
+    if (budget.Flush(*pMasternodeDB))
+        LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
@@ -423,10 +374,61 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     }
 
     mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    RankProposal(budgetProposal.GetHash());
     LogPrint("masternode","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
     return true;
 }
 
+bool CBudgetManager::Flush(CMasternodeStateDB& db)
+{
+    CMasternodeStateBatch batch;
+    LOCK(cs);
+
+    db.BatchTable(batch, DB_BUDGET_PROPOSALS, mapProposals);
+    db.BatchTable(batch, DB_BUDGET_FINALIZED, mapFinalizedBudgets);
+    db.BatchTable(batch, DB_BUDGET_SEEN_PROPOSALS, mapSeenMasternodeBudgetProposals);
+    db.BatchTable(batch, DB_BUDGET_SEEN_VOTES, mapSeenMasternodeBudgetVotes);
+    db.BatchTable(batch, DB_BUDGET_SEEN_FINALIZED, mapSeenFinalizedBudgets);
+    db.BatchTable(batch, DB_BUDGET_SEEN_FINALIZED_VOTES, mapSeenFinalizedBudgetVotes);
+    db.BatchTable(batch, DB_BUDGET_ORPHAN_VOTES, mapOrphanMasternodeBudgetVotes);
+    db.BatchTable(batch, DB_BUDGET_ORPHAN_FINALIZED_VOTES, mapOrphanFinalizedBudgetVotes);
+    db.BatchEntry(batch, DB_BUDGET_VERSION, 0, CLIENT_VERSION);
+
+    if (!db.CommitBatch(batch))
+        return error("%s : Failed to write the budgets", __func__);
+    return true;
+}
+
+bool CBudgetManager::Load(CMasternodeStateDB& db)
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::map<int, int> mapVersion;
+    if (!db.ReadTable(DB_BUDGET_VERSION, mapVersion) || mapVersion.empty())
+        return false;
+
+    {
+        LOCK(cs);
+        Clear();
+        if (!db.ReadTable(DB_BUDGET_PROPOSALS, mapProposals) ||
+            !db.ReadTable(DB_BUDGET_FINALIZED, mapFinalizedBudgets) ||
+            !db.ReadTable(DB_BUDGET_SEEN_PROPOSALS, mapSeenMasternodeBudgetProposals) ||
+            !db.ReadTable(DB_BUDGET_SEEN_VOTES, mapSeenMasternodeBudgetVotes) ||
+            !db.ReadTable(DB_BUDGET_SEEN_FINALIZED, mapSeenFinalizedBudgets) ||
+            !db.ReadTable(DB_BUDGET_SEEN_FINALIZED_VOTES, mapSeenFinalizedBudgetVotes) ||
+            !db.ReadTable(DB_BUDGET_ORPHAN_VOTES, mapOrphanMasternodeBudgetVotes) ||
+            !db.ReadTable(DB_BUDGET_ORPHAN_FINALIZED_VOTES, mapOrphanFinalizedBudgetVotes)) {
+            Clear();
+            return error("%s : Failed to read the budgets", __func__);
+        }
+        RankAllProposals();
+    }
+
+    LogPrint("masternode","Loaded budgets from the database  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", ToString());
+    return true;
+}
+
 void CBudgetManager::CheckAndRemove()
 {
     LogPrint("mnbudget", "CBudgetManager::CheckAndRemove\n");
@@ -483,6 +485,10 @@ void CBudgetManager::CheckAndRemove()
 
     // LogPrint("mnbudget", "CBudgetManager::CheckAndRemove - mapFinalizedBudgets cleanup - size after: %d\n", mapFinalizedBudgets.size());
     // LogPrint("mnbudget", "CBudgetManager::CheckAndRemove - mapProposals cleanup - size after: %d\n", mapProposals.size());
+
+    // votes inserted outside of ProcessMessage, as by the RPC, are bounded here
+    gossipFilter.Limit(mapSeenMasternodeBudgetVotes, MSG_BUDGET_VOTE, &CBudgetVote::nTime);
+    gossipFilter.Limit(mapSeenFinalizedBudgetVotes, MSG_BUDGET_FINALIZED_VOTE, &CFinalizedBudgetVote::nTime);
     LogPrint("masternode","CBudgetManager::CheckAndRemove - PASSED\n");
 
 }
@@ -671,10 +677,10 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 
     std::vector<CBudgetProposal*> vBudgetProposalRet;
 
+    CleanProposalVotes();
+
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
 
@@ -684,35 +690,53 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
     return vBudgetProposalRet;
 }
 
-//
-// Sort by votes, if there's a tie sort by their feeHash TX
-//
-struct sortProposalsByVotes {
-    bool operator()(const std::pair<CBudgetProposal*, int>& left, const std::pair<CBudgetProposal*, int>& right)
-    {
-        if (left.second != right.second)
-            return (left.second > right.second);
-        return (left.first->nFeeTXHash > right.first->nFeeTXHash);
+void CBudgetManager::RankProposal(const uint256& nHash)
+{
+    std::map<uint256, ProposalRankKey>::iterator mi = mapProposalRanks.find(nHash);
+    if (mi != mapProposalRanks.end()) {
+        setProposalsByRank.erase(mi->second);
+        mapProposalRanks.erase(mi);
     }
-};
 
-//Need to review this function
-std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
-{
-    LOCK(cs);
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.find(nHash);
+    if (it == mapProposals.end()) return;
 
-    // ------- Sort budgets by Yes Count
+    ProposalRankKey key = make_pair((*it).second.GetYeas() - (*it).second.GetNays(), make_pair((*it).second.nFeeTXHash, nHash));
+    setProposalsByRank.insert(key);
+    mapProposalRanks.insert(make_pair(nHash, key));
+}
 
-    std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
+void CBudgetManager::RankAllProposals()
+{
+    setProposalsByRank.clear();
+    mapProposalRanks.clear();
+
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while (it != mapProposals.end()) {
+        RankProposal((*it).first);
+        ++it;
+    }
+}
 
+// Drop the votes of masternodes that left from the tallies, and rank the proposals they changed again
+void CBudgetManager::CleanProposalVotes()
+{
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
-        vBudgetPorposalsSort.push_back(make_pair(&((*it).second), (*it).second.GetYeas() - (*it).second.GetNays()));
+        if ((*it).second.CleanAndRemove(false))
+            RankProposal((*it).first);
         ++it;
     }
+}
+
+//Need to review this function
+std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
+{
+    LOCK(cs);
 
-    std::sort(vBudgetPorposalsSort.begin(), vBudgetPorposalsSort.end(), sortProposalsByVotes());
+    // ------- Budgets are ranked by Yes Count as votes come in
+
+    CleanProposalVotes();
 
     // ------- Grab The Budgets In Order
 
@@ -727,9 +751,9 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
 
 
-    std::vector<std::pair<CBudgetProposal*, int> >::iterator it2 = vBudgetPorposalsSort.begin();
-    while (it2 != vBudgetPorposalsSort.end()) {
-        CBudgetProposal* pbudgetProposal = (*it2).first;
+    std::set<ProposalRankKey, CompareProposalRank>::iterator it2 = setProposalsByRank.begin();
+    while (it2 != setProposalsByRank.end()) {
+        CBudgetProposal* pbudgetProposal = &mapProposals[(*it2).second.second];
 
         LogPrint("masternode","CBudgetManager::GetBudget() - Processing Budget %s\n", pbudgetProposal->strProposalName.c_str());
         //prop start/end should be inside this period
@@ -905,11 +929,7 @@ void CBudgetManager::NewBlock()
     }
 
     LogPrint("masternode","CBudgetManager::NewBlock - mapProposals cleanup - size: %d\n", mapProposals.size());
-    std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
-    while (it2 != mapProposals.end()) {
-        (*it2).second.CleanAndRemove(false);
-        ++it2;
-    }
+    CleanProposalVotes();
 
     LogPrint("masternode","CBudgetManager::NewBlock - mapFinalizedBudgets cleanup - size: %d\n", mapFinalizedBudgets.size());
     std::map<uint256, CFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
@@ -1039,7 +1059,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vote;
         vote.fValid = true;
 
-        if (mapSeenMasternodeBudgetVotes.count(vote.GetHash())) {
+        if (mapSeenMasternodeBudgetVotes.count(vote.GetHash()) || gossipFilter.contains(CInv(MSG_BUDGET_VOTE, vote.GetHash()))) {
             masternodeSync.AddedBudgetItem(vote.GetHash());
             return;
         }
@@ -1053,6 +1073,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
 
         mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        gossipFilter.Limit(mapSeenMasternodeBudgetVotes, MSG_BUDGET_VOTE, &CBudgetVote::nTime);
         if (!vote.SignatureValid(true)) {
             LogPrint("masternode","mvote - signature invalid\n");
             if (masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
@@ -1112,7 +1133,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         vRecv >> vote;
         vote.fValid = true;
 
-        if (mapSeenFinalizedBudgetVotes.count(vote.GetHash())) {
+        if (mapSeenFinalizedBudgetVotes.count(vote.GetHash()) || gossipFilter.contains(CInv(MSG_BUDGET_FINALIZED_VOTE, vote.GetHash()))) {
             masternodeSync.AddedBudgetItem(vote.GetHash());
             return;
         }
@@ -1125,6 +1146,7 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         }
 
         mapSeenFinalizedBudgetVotes.insert(make_pair(vote.GetHash(), vote));
+        gossipFilter.Limit(mapSeenFinalizedBudgetVotes, MSG_BUDGET_FINALIZED_VOTE, &CFinalizedBudgetVote::nTime);
         if (!vote.SignatureValid(true)) {
             LogPrint("masternode","fbvote - signature invalid\n");
             if (masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
@@ -1320,7 +1342,11 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    RankProposal(vote.nProposalHash);
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1357,6 +1383,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    TallyVotes();
 }
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
@@ -1369,6 +1396,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
     fValid = true;
+    TallyVotes();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1383,6 +1411,13 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
     fValid = true;
+    nYeas = other.nYeas;
+    nNays = other.nNays;
+    nAbstains = other.nAbstains;
+    nYeasTotal = other.nYeasTotal;
+    nNaysTotal = other.nNaysTotal;
+    fVotesChecked = other.fVotesChecked;
+    nVotesCheckedListVersion = other.nVotesCheckedListVersion;
 }
 
 bool CBudgetProposal::IsValid(std::string& strError, bool fCheckCollateral)
@@ -1489,78 +1524,91 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
-    mapVotes[hash] = vote;
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.find(hash);
+    if (it != mapVotes.end()) {
+        CountVote(it->second, -1);
+        it->second = vote;
+    } else {
+        it = mapVotes.insert(make_pair(hash, vote)).first;
+    }
+    // counted as CleanAndRemove would have, in case the masternode left since the last check
+    it->second.fValid = it->second.SignatureValid(false);
+    CountVote(it->second, 1);
     LogPrint("mnbudget", "CBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
 }
 
-// If masternode voted for a proposal, but is now invalid -- remove the vote
-void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nSign)
 {
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    if (vote.nVote == VOTE_YES) nYeasTotal += nSign;
+    if (vote.nVote == VOTE_NO) nNaysTotal += nSign;
+    if (!vote.fValid) return;
+    if (vote.nVote == VOTE_YES) nYeas += nSign;
+    if (vote.nVote == VOTE_NO) nNays += nSign;
+    if (vote.nVote == VOTE_ABSTAIN) nAbstains += nSign;
+}
 
+void CBudgetProposal::TallyVotes()
+{
+    nYeas = nNays = nAbstains = nYeasTotal = nNaysTotal = 0;
+    fVotesChecked = false;
+    nVotesCheckedListVersion = 0;
+
+    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
     while (it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        CountVote((*it).second, 1);
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio()
+// If masternode voted for a proposal, but is now invalid -- remove the vote
+bool CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
 {
-    int yeas = 0;
-    int nays = 0;
+    // without a signature check a vote only turns invalid when its masternode leaves the list
+    uint64_t nListVersion = mnodeman.GetListVersion();
+    if (!fSignatureCheck && fVotesChecked && nVotesCheckedListVersion == nListVersion)
+        return false;
 
+    bool fChanged = false;
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        bool fVoteValid = (*it).second.SignatureValid(fSignatureCheck);
+        if (fVoteValid != (*it).second.fValid) {
+            CountVote((*it).second, -1);
+            (*it).second.fValid = fVoteValid;
+            CountVote((*it).second, 1);
+            fChanged = true;
+        }
         ++it;
     }
 
-    if (yeas + nays == 0) return 0.0f;
-
-    return ((double)(yeas) / (double)(yeas + nays));
+    fVotesChecked = true;
+    nVotesCheckedListVersion = nListVersion;
+    return fChanged;
 }
 
-int CBudgetProposal::GetYeas()
+double CBudgetProposal::GetRatio()
 {
-    int ret = 0;
+    if (nYeasTotal + nNaysTotal == 0) return 0.0f;
 
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
+    return ((double)(nYeasTotal) / (double)(nYeasTotal + nNaysTotal));
+}
 
-    return ret;
+int CBudgetProposal::GetYeas()
+{
+    return nYeas;
 }
 
 int CBudgetProposal::GetNays()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nNays;
 }
 
 int CBudgetProposal::GetAbstains()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nAbstains;
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1660,6 +1708,11 @@ void CBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -1685,7 +1738,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2104,6 +2157,11 @@ void CFinalizedBudgetVote::Relay()
     RelayInv(inv);
 }
 
+std::string CFinalizedBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 {
     // Choose coins to use
@@ -2130,7 +2188,7 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
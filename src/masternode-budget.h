@@ -26,6 +26,7 @@ class CFinalizedBudgetBroadcast;
 class CFinalizedBudget;
 class CBudgetProposal;
 class CBudgetProposalBroadcast;
+class CMasternodeStateDB;
 class CTxBudgetPayment;
 
 #define VOTE_ABSTAIN 0
@@ -40,6 +41,7 @@ extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
 extern std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
 
 extern CBudgetManager budget;
+/** Flush the proposals, budgets and votes changed since the last dump to the masternode state database */
 void DumpBudgets();
 
 // Define amount of blocks in budget payment cycle
@@ -69,6 +71,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetSignatureMessage() const;
 
     std::string GetVoteString()
     {
@@ -121,6 +124,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetSignatureMessage() const;
 
     uint256 GetHash()
     {
@@ -143,7 +147,7 @@ public:
     }
 };
 
-/** Save Budget Manager (budget.dat)
+/** Access to budget.dat, where older versions kept the budgets; read once to import them
  */
 class CBudgetDB
 {
@@ -163,7 +167,6 @@ public:
     };
 
     CBudgetDB();
-    bool Write(const CBudgetManager& objToSave);
     ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
 };
 
@@ -174,10 +177,33 @@ public:
 class CBudgetManager
 {
 private:
+    // (yeas - nays, (fee tx hash, proposal hash)) of a proposal
+    typedef std::pair<int, std::pair<uint256, uint256> > ProposalRankKey;
+
+    // highest net yes votes first, ties broken by the highest fee tx hash
+    struct CompareProposalRank {
+        bool operator()(const ProposalRankKey& left, const ProposalRankKey& right) const
+        {
+            if (left.first != right.first)
+                return left.first > right.first;
+            if (left.second.first != right.second.first)
+                return left.second.first > right.second.first;
+            return left.second.second < right.second.second;
+        }
+    };
+
     //hold txes until they mature enough to use
     // XX42    map<uint256, CTransaction> mapCollateral;
     map<uint256, uint256> mapCollateralTxids;
 
+    // proposals in the order GetBudget pays them, kept up to date as votes come and go
+    std::set<ProposalRankKey, CompareProposalRank> setProposalsByRank;
+    std::map<uint256, ProposalRankKey> mapProposalRanks;
+
+    void RankProposal(const uint256& nHash);
+    void RankAllProposals();
+    void CleanProposalVotes();
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -245,6 +271,8 @@ public:
 
         LogPrintf("Budget object cleared\n");
         mapProposals.clear();
+        setProposalsByRank.clear();
+        mapProposalRanks.clear();
         mapFinalizedBudgets.clear();
         mapSeenMasternodeBudgetProposals.clear();
         mapSeenMasternodeBudgetVotes.clear();
@@ -252,10 +280,17 @@ public:
         mapSeenFinalizedBudgetVotes.clear();
         mapOrphanMasternodeBudgetVotes.clear();
         mapOrphanFinalizedBudgetVotes.clear();
+        gossipFilter.clear(MSG_BUDGET_VOTE);
+        gossipFilter.clear(MSG_BUDGET_FINALIZED_VOTE);
     }
     void CheckAndRemove();
     std::string ToString() const;
 
+    /// Write the entries changed since the last flush to db, and erase the ones removed
+    bool Flush(CMasternodeStateDB& db);
+    /// Read the entries written by Flush, without cleaning them up; returns false if db has none
+    bool Load(CMasternodeStateDB& db);
+
 
     ADD_SERIALIZE_METHODS;
 
@@ -271,6 +306,8 @@ public:
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
+        if (ser_action.ForRead())
+            RankAllProposals();
     }
 };
 
@@ -457,6 +494,18 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // running tallies of mapVotes: valid votes by kind, and all yes and no votes for GetRatio
+    int nYeas;
+    int nNays;
+    int nAbstains;
+    int nYeasTotal;
+    int nNaysTotal;
+    // the masternode list the votes were last checked against by CleanAndRemove
+    bool fVotesChecked;
+    uint64_t nVotesCheckedListVersion;
+
+    void CountVote(const CBudgetVote& vote, int nSign);
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -514,7 +563,10 @@ public:
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
 
-    void CleanAndRemove(bool fSignatureCheck);
+    /** Mark the votes of masternodes that are gone as invalid; returns true if the tallies changed */
+    bool CleanAndRemove(bool fSignatureCheck);
+    /** Count mapVotes again, after it was replaced */
+    void TallyVotes();
 
     uint256 GetHash()
     {
@@ -548,6 +600,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            TallyVotes();
     }
 };
 
@@ -576,6 +630,8 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        first.TallyVotes();
+        second.TallyVotes();
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
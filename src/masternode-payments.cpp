@@ -8,6 +8,7 @@
 #include "addrman.h"
 #include "masternode-budget.h"
 #include "masternode-sync.h"
+#include "masternodedb.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
 #include "spork.h"
@@ -34,37 +35,6 @@ CMasternodePaymentDB::CMasternodePaymentDB()
     strMagicMessage = "MasternodePayments";
 }
 
-bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint("masternode","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
-}
-
 CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
@@ -149,29 +119,12 @@ CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments&
 
 void DumpMasternodePayments()
 {
-    int64_t nStart = GetTimeMillis();
-
-    CMasternodePaymentDB paymentdb;
-    CMasternodePayments tempPayments;
-
-    LogPrint("masternode","Verifying mnpayments.dat format...\n");
-    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodePaymentDB::FileError)
-        LogPrint("masternode","Missing budgets file - mnpayments.dat, will try to recreate\n");
-    else if (readResult != CMasternodePaymentDB::Ok) {
-        LogPrint("masternode","Error reading mnpayments.dat: ");
-        if (readResult == CMasternodePaymentDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to mnpayments.dat...\n");
-    paymentdb.Write(masternodePayments);
+    if (pMasternodeDB == NULL)
+        return;
 
-    LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+    int64_t nStart = GetTimeMillis();
+    if (masternodePayments.Flush(*pMasternodeDB))
+        LogPrint("masternode","Masternode payments dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
@@ -508,13 +461,155 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
             CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
             mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
         }
+
+        // GetLastPaid counts a payee as paid once it has two votes
+        if (mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1) == 2)
+            AddPaidHeight(winnerIn.payee, winnerIn.nBlockHeight, PAID_BY_VOTES);
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
+    return true;
+}
+
+void CMasternodePayments::AddPaidHeight(const CScript& payee, int nHeight, int nSource)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    mapPayeeHeights[payee][nHeight] |= nSource;
+}
+
+void CMasternodePayments::RemovePaidHeight(const CScript& payee, int nHeight, int nSource)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+
+    std::map<CScript, std::map<int, int> >::iterator it = mapPayeeHeights.find(payee);
+    if (it == mapPayeeHeights.end())
+        return;
+    std::map<int, int>::iterator itHeight = it->second.find(nHeight);
+    if (itHeight == it->second.end())
+        return;
+    itHeight->second &= ~nSource;
+    if (itHeight->second == 0)
+        it->second.erase(itHeight);
+    if (it->second.empty())
+        mapPayeeHeights.erase(it);
+}
 
+bool CMasternodePayments::Flush(CMasternodeStateDB& db)
+{
+    CMasternodeStateBatch batch;
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+
+    db.BatchTable(batch, DB_PAYMENT_VOTES, mapMasternodePayeeVotes);
+    db.BatchTable(batch, DB_PAYMENT_BLOCKS, mapMasternodeBlocks);
+    db.BatchEntry(batch, DB_PAYMENTS_VERSION, 0, CLIENT_VERSION);
+
+    if (!db.CommitBatch(batch))
+        return error("%s : Failed to write the masternode payments", __func__);
     return true;
 }
 
+bool CMasternodePayments::Load(CMasternodeStateDB& db)
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::map<int, int> mapVersion;
+    if (!db.ReadTable(DB_PAYMENTS_VERSION, mapVersion) || mapVersion.empty())
+        return false;
+
+    {
+        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+        Clear();
+        if (!db.ReadTable(DB_PAYMENT_VOTES, mapMasternodePayeeVotes) ||
+            !db.ReadTable(DB_PAYMENT_BLOCKS, mapMasternodeBlocks)) {
+            Clear();
+            return error("%s : Failed to read the masternode payments", __func__);
+        }
+        IndexPaidHeights();
+    }
+
+    LogPrint("masternode","Loaded masternode payments from the database  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", ToString());
+    return true;
+}
+
+void CMasternodePayments::IndexPaidHeights()
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    mapPayeeHeights.clear();
+    for (std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin(); it != mapMasternodeBlocks.end(); ++it) {
+        BOOST_FOREACH (CMasternodePayee& payee, it->second.vecPayments) {
+            if (payee.nVotes >= 2)
+                AddPaidHeight(payee.scriptPubKey, it->first, PAID_BY_VOTES);
+        }
+    }
+}
+
+/** The output FillBlockPayee adds for the masternode, if the block has one */
+static bool GetBlockMasternodePayee(const CBlock& block, int nBlockHeight, CScript& payee)
+{
+    const CTxOut* pout = NULL;
+    if (block.IsProofOfStake()) {
+        // vout[0] is empty and the stake, split or not, is paid back before the masternode
+        if (block.vtx.size() > 1 && block.vtx[1].vout.size() > 2)
+            pout = &block.vtx[1].vout.back();
+    } else if (!block.vtx.empty() && block.vtx[0].vout.size() == 2) {
+        pout = &block.vtx[0].vout[1];
+    }
+    if (pout == NULL)
+        return false;
+
+    // FillBlockPayee pays exactly this, a split stake only matches it by chance
+    CAmount masternodePayment = GetMasternodePayment(nBlockHeight - 1, GetBlockValue(nBlockHeight - 1));
+    if (masternodePayment <= 0 || pout->nValue != masternodePayment)
+        return false;
+
+    payee = pout->scriptPubKey;
+    return true;
+}
+
+void CMasternodePayments::BlockConnected(const CBlock& block, int nBlockHeight)
+{
+    CScript payee;
+    if (!GetBlockMasternodePayee(block, nBlockHeight, payee))
+        return;
+
+    // a staker paid back to the same kind of script is not a masternode payment
+    if (mnodeman.Find(payee) == NULL)
+        return;
+
+    LOCK(cs_mapMasternodeBlocks);
+    AddPaidHeight(payee, nBlockHeight, PAID_BY_BLOCK);
+}
+
+void CMasternodePayments::BlockDisconnected(const CBlock& block, int nBlockHeight)
+{
+    CScript payee;
+    if (!GetBlockMasternodePayee(block, nBlockHeight, payee))
+        return;
+
+    LOCK(cs_mapMasternodeBlocks);
+    RemovePaidHeight(payee, nBlockHeight, PAID_BY_BLOCK);
+}
+
+/** Highest height in [nMinHeight, nMaxHeight] at which payee was paid, or 0 */
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<CScript, std::map<int, int> >::const_iterator it = mapPayeeHeights.find(payee);
+    if (it == mapPayeeHeights.end())
+        return 0;
+
+    std::map<int, int>::const_iterator itHeight = it->second.upper_bound(nMaxHeight);
+    if (itHeight == it->second.begin())
+        return 0;
+    --itHeight;
+    if (itHeight->first < nMinHeight)
+        return 0;
+
+    return itHeight->first;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
@@ -651,6 +746,15 @@ void CMasternodePayments::CleanPaymentList()
             ++it;
         }
     }
+
+    std::map<CScript, std::map<int, int> >::iterator itPayee = mapPayeeHeights.begin();
+    while (itPayee != mapPayeeHeights.end()) {
+        itPayee->second.erase(itPayee->second.begin(), itPayee->second.lower_bound(nHeight - nLimit));
+        if (itPayee->second.empty())
+            mapPayeeHeights.erase(itPayee++);
+        else
+            ++itPayee;
+    }
 }
 
 bool CMasternodePaymentWinner::IsValid(CNode* pnode, std::string& strError)
@@ -764,14 +868,17 @@ void CMasternodePaymentWinner::Relay()
     RelayInv(inv);
 }
 
+std::string CMasternodePaymentWinner::GetSignatureMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() + boost::lexical_cast<std::string>(nBlockHeight) + payee.ToString();
+}
+
 bool CMasternodePaymentWinner::SignatureValid()
 {
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinMasternode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetSignatureMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
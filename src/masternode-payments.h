@@ -19,6 +19,7 @@ extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
 
 class CMasternodePayments;
+class CMasternodeStateDB;
 class CMasternodePaymentWinner;
 class CMasternodeBlockPayees;
 
@@ -33,9 +34,10 @@ std::string GetRequiredPaymentsString(int nBlockHeight);
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted);
 void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStake);
 
+/** Flush the payment votes changed since the last dump to the masternode state database */
 void DumpMasternodePayments();
 
-/** Save Masternode Payment Data (mnpayments.dat)
+/** Access to mnpayments.dat, where older versions kept the payment votes; read once to import them
  */
 class CMasternodePaymentDB
 {
@@ -55,7 +57,6 @@ public:
     };
 
     CMasternodePaymentDB();
-    bool Write(const CMasternodePayments& objToSave);
     ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
 };
 
@@ -105,19 +106,21 @@ public:
         vecPayments.clear();
     }
 
-    void AddPayee(CScript payeeIn, int nIncrement)
+    // returns the votes the payee has now
+    int AddPayee(CScript payeeIn, int nIncrement)
     {
         LOCK(cs_vecPayments);
 
         BOOST_FOREACH (CMasternodePayee& payee, vecPayments) {
             if (payee.scriptPubKey == payeeIn) {
                 payee.nVotes += nIncrement;
-                return;
+                return payee.nVotes;
             }
         }
 
         CMasternodePayee c(payeeIn, nIncrement);
         vecPayments.push_back(c);
+        return nIncrement;
     }
 
     bool GetPayee(CScript& payee)
@@ -197,6 +200,7 @@ public:
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
     void Relay();
+    std::string GetSignatureMessage() const;
 
     void AddPayee(CScript payeeIn)
     {
@@ -237,11 +241,23 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // heights at which each payee was paid, with the PaidSource flags that say how we know
+    std::map<CScript, std::map<int, int> > mapPayeeHeights;
+
+    void AddPaidHeight(const CScript& payee, int nHeight, int nSource);
+    void RemovePaidHeight(const CScript& payee, int nHeight, int nSource);
+    void IndexPaidHeights();
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
     std::map<uint256, int> mapMasternodesLastVote; //prevout.hash + prevout.n, nBlockHeight
 
+    enum PaidSource {
+        PAID_BY_VOTES = (1 << 0), // a winner for the height has at least 2 votes
+        PAID_BY_BLOCK = (1 << 1), // the connected block at the height pays it
+    };
+
     CMasternodePayments()
     {
         nSyncedFromPeer = 0;
@@ -253,13 +269,21 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeHeights.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
     bool ProcessBlock(int nBlockHeight);
+    void BlockConnected(const CBlock& block, int nBlockHeight);
+    void BlockDisconnected(const CBlock& block, int nBlockHeight);
+    int GetLastPaidHeight(const CScript& payee, int nMinHeight, int nMaxHeight);
 
     void Sync(CNode* node, int nCountNeeded);
     void CleanPaymentList();
+    /// Write the votes changed since the last flush to db, and erase the ones removed
+    bool Flush(CMasternodeStateDB& db);
+    /// Read the votes written by Flush, without cleaning them up; returns false if db has none
+    bool Load(CMasternodeStateDB& db);
     int LastPayment(CMasternode& mn);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
@@ -296,6 +320,8 @@ public:
     {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead())
+            IndexPaidHeights();
     }
 };
 
@@ -63,6 +63,7 @@ bool CMasternodeSync::IsBlockchainSynced()
 
 void CMasternodeSync::Reset()
 {
+    LOCK(cs);
     lastMasternodeList = 0;
     lastMasternodeWinner = 0;
     lastBudgetItem = 0;
@@ -82,11 +83,26 @@ void CMasternodeSync::Reset()
     RequestedMasternodeAssets = MASTERNODE_SYNC_INITIAL;
     RequestedMasternodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    nAssetSyncStartedMillis = GetTimeMillis();
+    mapAssetPeers.clear();
+    setAssetItems.clear();
+    nAssetLastActivity = 0;
+    mapAssetDuration.clear();
+}
+
+void CMasternodeSync::AddedAssetItem(int nAsset, const uint256& hash)
+{
+    if (RequestedMasternodeAssets != nAsset) return;
+    if (setAssetItems.insert(hash).second)
+        nAssetLastActivity = GetTime();
 }
 
 void CMasternodeSync::AddedMasternodeList(uint256 hash)
 {
-    if (mnodeman.mapSeenMasternodeBroadcast.count(hash)) {
+    bool fSeen = mnodeman.mapSeenMasternodeBroadcast.count(hash);
+
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncMNB[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeList = GetTime();
             mapSeenSyncMNB[hash]++;
@@ -95,11 +111,15 @@ void CMasternodeSync::AddedMasternodeList(uint256 hash)
         lastMasternodeList = GetTime();
         mapSeenSyncMNB.insert(make_pair(hash, 1));
     }
+    AddedAssetItem(MASTERNODE_SYNC_LIST, hash);
 }
 
 void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 {
-    if (masternodePayments.mapMasternodePayeeVotes.count(hash)) {
+    bool fSeen = masternodePayments.mapMasternodePayeeVotes.count(hash);
+
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncMNW[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeWinner = GetTime();
             mapSeenSyncMNW[hash]++;
@@ -108,12 +128,16 @@ void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
         lastMasternodeWinner = GetTime();
         mapSeenSyncMNW.insert(make_pair(hash, 1));
     }
+    AddedAssetItem(MASTERNODE_SYNC_MNW, hash);
 }
 
 void CMasternodeSync::AddedBudgetItem(uint256 hash)
 {
-    if (budget.mapSeenMasternodeBudgetProposals.count(hash) || budget.mapSeenMasternodeBudgetVotes.count(hash) ||
-        budget.mapSeenFinalizedBudgets.count(hash) || budget.mapSeenFinalizedBudgetVotes.count(hash)) {
+    bool fSeen = budget.mapSeenMasternodeBudgetProposals.count(hash) || budget.mapSeenMasternodeBudgetVotes.count(hash) ||
+                 budget.mapSeenFinalizedBudgets.count(hash) || budget.mapSeenFinalizedBudgetVotes.count(hash);
+
+    LOCK(cs);
+    if (fSeen) {
         if (mapSeenSyncBudget[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastBudgetItem = GetTime();
             mapSeenSyncBudget[hash]++;
@@ -122,6 +146,7 @@ void CMasternodeSync::AddedBudgetItem(uint256 hash)
         lastBudgetItem = GetTime();
         mapSeenSyncBudget.insert(make_pair(hash, 1));
     }
+    AddedAssetItem(MASTERNODE_SYNC_BUDGET, hash);
 }
 
 bool CMasternodeSync::IsBudgetPropEmpty()
@@ -136,6 +161,10 @@ bool CMasternodeSync::IsBudgetFinEmpty()
 
 void CMasternodeSync::GetNextAsset()
 {
+    LOCK(cs);
+    if (RequestedMasternodeAssets >= MASTERNODE_SYNC_SPORKS && RequestedMasternodeAssets <= MASTERNODE_SYNC_BUDGET)
+        mapAssetDuration[RequestedMasternodeAssets] = GetTimeMillis() - nAssetSyncStartedMillis;
+
     switch (RequestedMasternodeAssets) {
     case (MASTERNODE_SYNC_INITIAL):
     case (MASTERNODE_SYNC_FAILED): // should never be used here actually, use Reset() instead
@@ -158,6 +187,10 @@ void CMasternodeSync::GetNextAsset()
     }
     RequestedMasternodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    nAssetSyncStartedMillis = GetTimeMillis();
+    mapAssetPeers.clear();
+    setAssetItems.clear();
+    nAssetLastActivity = 0;
 }
 
 std::string CMasternodeSync::GetSyncStatus()
@@ -181,6 +214,47 @@ std::string CMasternodeSync::GetSyncStatus()
     return "";
 }
 
+std::string CMasternodeSync::GetAssetName(int nAsset)
+{
+    switch (nAsset) {
+    case MASTERNODE_SYNC_SPORKS:
+        return "sporks";
+    case MASTERNODE_SYNC_LIST:
+        return "list";
+    case MASTERNODE_SYNC_MNW:
+        return "winners";
+    case MASTERNODE_SYNC_BUDGET:
+        return "budget";
+    }
+    return "";
+}
+
+std::map<int, int64_t> CMasternodeSync::GetAssetDurations()
+{
+    LOCK(cs);
+    std::map<int, int64_t> mapDurations = mapAssetDuration;
+    if (RequestedMasternodeAssets >= MASTERNODE_SYNC_SPORKS && RequestedMasternodeAssets <= MASTERNODE_SYNC_BUDGET)
+        mapDurations[RequestedMasternodeAssets] = GetTimeMillis() - nAssetSyncStartedMillis;
+    return mapDurations;
+}
+
+int CMasternodeSync::GetAssetReplies()
+{
+    // the budget comes in two parts, proposals then finalized budgets, each with its count
+    return RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET ? 2 : 1;
+}
+
+int CMasternodeSync::CountPendingPeers()
+{
+    LOCK(cs);
+    int nPending = 0;
+    for (std::map<NodeId, CSyncPeer>::const_iterator it = mapAssetPeers.begin(); it != mapAssetPeers.end(); ++it) {
+        if (it->second.nReplies < GetAssetReplies())
+            nPending++;
+    }
+    return nPending;
+}
+
 void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (strCommand == "ssc") { //Sync status count
@@ -188,6 +262,7 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
         int nCount;
         vRecv >> nItemID >> nCount;
 
+        LOCK(cs);
         if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
 
         //this means we will receive no further communication
@@ -212,9 +287,190 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
             sumBudgetItemFin += nCount;
             countBudgetItemFin++;
             break;
+        default:
+            return;
         }
 
+        // a late answer from a peer that was given up on still counts
+        CSyncPeer& peer = mapAssetPeers[pfrom->GetId()];
+        peer.nReplies++;
+        peer.nCount += nCount;
+        nAssetLastActivity = GetTime();
+
         LogPrint("masternode", "CMasternodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
+    } else if (strCommand == "spork") {
+        // peers answer getsporks with the sporks they know, one message each
+        LOCK(cs);
+        std::map<NodeId, CSyncPeer>::iterator it = mapAssetPeers.find(pfrom->GetId());
+        if (RequestedMasternodeAssets == MASTERNODE_SYNC_SPORKS && it != mapAssetPeers.end() && it->second.nReplies == 0) {
+            it->second.nReplies = 1;
+            nAssetLastActivity = GetTime();
+        }
+    }
+
+    // the items of an asset come in as messages of their own, so any message can complete it
+    CheckAsset();
+}
+
+bool CMasternodeSync::IsAssetComplete(int64_t nNow)
+{
+    int nReplied = 0;
+    int nPending = 0;
+    int nAnnounced = 0;
+    for (std::map<NodeId, CSyncPeer>::const_iterator it = mapAssetPeers.begin(); it != mapAssetPeers.end(); ++it) {
+        if (it->second.nReplies >= GetAssetReplies()) {
+            nReplied++;
+            nAnnounced = std::max(nAnnounced, it->second.nCount);
+        } else {
+            nPending++;
+        }
+    }
+
+    bool fQuiet = nAssetLastActivity < nNow - MASTERNODE_SYNC_TIMEOUT * 2;
+    if (nPending == 0 && nReplied > 0) {
+        // wait for a second peer to confirm the count, unless none turns up to ask
+        if (nReplied >= MASTERNODE_SYNC_THRESHOLD || nNow - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 2) {
+            // the peers may announce items we reject, so stop waiting once they stop coming
+            if ((int)setAssetItems.size() >= nAnnounced || fQuiet)
+                return true;
+        }
+    }
+
+    // items came in, but no peer sent a count for them
+    return nAssetLastActivity > 0 && fQuiet && nNow - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5;
+}
+
+void CMasternodeSync::CheckAsset()
+{
+    if (Params().NetworkID() == CBaseChainParams::REGTEST) return;
+
+    int nAsset;
+    bool fNext = false;
+    {
+        LOCK(cs);
+        nAsset = RequestedMasternodeAssets;
+        if (nAsset < MASTERNODE_SYNC_SPORKS || nAsset > MASTERNODE_SYNC_BUDGET) return;
+
+        // sporks synced but blockchain is not, wait until we're almost at a recent block to continue
+        if (nAsset > MASTERNODE_SYNC_SPORKS && !IsBlockchainSynced()) {
+            nAssetSyncStarted = GetTime();
+            nAssetSyncStartedMillis = GetTimeMillis();
+            return;
+        }
+
+        // give up on peers that do not answer, so that others are asked in their place
+        int64_t nNow = GetTime();
+        std::map<NodeId, CSyncPeer>::iterator it = mapAssetPeers.begin();
+        while (it != mapAssetPeers.end()) {
+            if (it->second.nReplies < GetAssetReplies() && it->second.nTimeAsked < nNow - MASTERNODE_SYNC_TIMEOUT * 2) {
+                LogPrint("masternode", "CMasternodeSync::CheckAsset - peer %d did not answer for %s\n", it->first, GetAssetName(nAsset));
+                mapAssetPeers.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+
+        if (IsAssetComplete(nNow)) {
+            LogPrint("masternode", "CMasternodeSync::CheckAsset - %s complete, %d items from %d peers\n", GetAssetName(nAsset), setAssetItems.size(), mapAssetPeers.size());
+            GetNextAsset();
+            fNext = true;
+        } else if (nAssetLastActivity == 0 && (nNow - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5 ||
+                                                 (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 && mapAssetPeers.empty()))) {
+            // timeout
+            if ((nAsset == MASTERNODE_SYNC_LIST || nAsset == MASTERNODE_SYNC_MNW) && IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+                LogPrintf("CMasternodeSync::CheckAsset - ERROR - Sync has failed, will retry later\n");
+                RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
+                RequestedMasternodeAttempt = 0;
+                lastFailure = GetTime();
+                nCountFailures++;
+                return;
+            }
+            // maybe there is no budgets at all, so just finish syncing
+            GetNextAsset();
+            fNext = true;
+        } else if ((int)mapAssetPeers.size() >= MASTERNODE_SYNC_PEERS || RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) {
+            // nobody else to ask yet
+            return;
+        }
+    }
+
+    // Try to activate our masternode if possible
+    if (fNext && nAsset == MASTERNODE_SYNC_BUDGET)
+        activeMasternode.ManageStatus();
+
+    RequestAsset();
+}
+
+void CMasternodeSync::RequestAsset()
+{
+    int nAsset;
+    {
+        LOCK(cs);
+        nAsset = RequestedMasternodeAssets;
+    }
+
+    std::string strRequest;
+    int nMinProto = 0;
+    switch (nAsset) {
+    case MASTERNODE_SYNC_SPORKS:
+        strRequest = "getspork";
+        break;
+    case MASTERNODE_SYNC_LIST:
+        strRequest = "mnsync";
+        nMinProto = masternodePayments.GetMinMasternodePaymentsProto();
+        break;
+    case MASTERNODE_SYNC_MNW:
+        strRequest = "mnwsync";
+        nMinProto = masternodePayments.GetMinMasternodePaymentsProto();
+        break;
+    case MASTERNODE_SYNC_BUDGET:
+        strRequest = "busync";
+        nMinProto = ActiveProtocol();
+        break;
+    default:
+        return;
+    }
+
+    std::vector<CNode*> vNodesAsked;
+    {
+        LOCK(cs);
+        if (RequestedMasternodeAssets != nAsset) return;
+
+        TRY_LOCK(cs_vNodes, lockRecv);
+        if (!lockRecv) return;
+
+        BOOST_FOREACH (CNode* pnode, vNodes) {
+            if ((int)mapAssetPeers.size() >= MASTERNODE_SYNC_PEERS || RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) break;
+            if (pnode->fDisconnect || pnode->nVersion < nMinProto) continue;
+
+            if (pnode->HasFulfilledRequest(strRequest)) continue;
+            pnode->FulfilledRequest(strRequest);
+
+            mapAssetPeers[pnode->GetId()] = CSyncPeer(GetTime());
+            RequestedMasternodeAttempt++;
+            vNodesAsked.push_back(pnode->AddRef());
+        }
+    }
+
+    // the requests go out without the lock held, DsegUpdate takes the masternode list's
+    BOOST_FOREACH (CNode* pnode, vNodesAsked) {
+        LogPrint("masternode", "CMasternodeSync::RequestAsset - asking peer %d for %s\n", pnode->GetId(), GetAssetName(nAsset));
+        if (nAsset == MASTERNODE_SYNC_SPORKS) {
+            pnode->PushMessage("getsporks"); //get current network sporks
+        } else if (nAsset == MASTERNODE_SYNC_LIST) {
+            if (!mnodeman.DsegUpdate(pnode)) {
+                // asked too recently, it will not answer
+                LOCK(cs);
+                mapAssetPeers.erase(pnode->GetId());
+            }
+        } else if (nAsset == MASTERNODE_SYNC_MNW) {
+            int nMnCount = mnodeman.CountEnabled();
+            pnode->PushMessage("mnget", nMnCount); //sync payees
+        } else if (nAsset == MASTERNODE_SYNC_BUDGET) {
+            uint256 n = 0;
+            pnode->PushMessage("mnvs", n); //sync masternode votes
+        }
+        pnode->Release();
     }
 }
 
@@ -236,9 +492,10 @@ void CMasternodeSync::Process()
     static int tick = 0;
     static int syncCount = 0;
 
-    if (tick++ % MASTERNODE_SYNC_TIMEOUT != 0) return;
+    bool fSlowTick = tick++ % MASTERNODE_SYNC_TIMEOUT == 0;
 
     if (IsSynced()) {
+        if (!fSlowTick) return;
         /* 
             Resync if we lose all masternodes from sleep/wake or failure to sync originally
         */
@@ -258,19 +515,16 @@ void CMasternodeSync::Process()
         return;
     }
 
-    LogPrint("masternode", "CMasternodeSync::Process() - tick %d RequestedMasternodeAssets %d\n", tick, RequestedMasternodeAssets);
-
     if (RequestedMasternodeAssets == MASTERNODE_SYNC_INITIAL) GetNextAsset();
 
-    // sporks synced but blockchain is not, wait until we're almost at a recent block to continue
-    if (Params().NetworkID() != CBaseChainParams::REGTEST &&
-        !IsBlockchainSynced() && RequestedMasternodeAssets > MASTERNODE_SYNC_SPORKS) return;
+    if (Params().NetworkID() == CBaseChainParams::REGTEST) {
+        if (!fSlowTick) return;
+        LogPrint("masternode", "CMasternodeSync::Process() - tick %d RequestedMasternodeAssets %d\n", tick, RequestedMasternodeAssets);
 
-    TRY_LOCK(cs_vNodes, lockRecv);
-    if (!lockRecv) return;
+        TRY_LOCK(cs_vNodes, lockRecv);
+        if (!lockRecv) return;
 
-    BOOST_FOREACH (CNode* pnode, vNodes) {
-        if (Params().NetworkID() == CBaseChainParams::REGTEST) {
+        BOOST_FOREACH (CNode* pnode, vNodes) {
             if (RequestedMasternodeAttempt <= 2) {
                 pnode->PushMessage("getsporks"); //get current network sporks
             } else if (RequestedMasternodeAttempt < 4) {
@@ -286,124 +540,9 @@ void CMasternodeSync::Process()
             RequestedMasternodeAttempt++;
             return;
         }
-
-        //set to synced
-        if (RequestedMasternodeAssets == MASTERNODE_SYNC_SPORKS) {
-            if (pnode->HasFulfilledRequest("getspork")) continue;
-            pnode->FulfilledRequest("getspork");
-
-            pnode->PushMessage("getsporks"); //get current network sporks
-            if (RequestedMasternodeAttempt >= 2) GetNextAsset();
-            RequestedMasternodeAttempt++;
-
-            return;
-        }
-
-        if (pnode->nVersion >= masternodePayments.GetMinMasternodePaymentsProto()) {
-            if (RequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
-                LogPrint("masternode", "CMasternodeSync::Process() - lastMasternodeList %lld (GetTime() - MASTERNODE_SYNC_TIMEOUT) %lld\n", lastMasternodeList, GetTime() - MASTERNODE_SYNC_TIMEOUT);
-                if (lastMasternodeList > 0 && lastMasternodeList < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("mnsync")) continue;
-                pnode->FulfilledRequest("mnsync");
-
-                // timeout
-                if (lastMasternodeList == 0 &&
-                    (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
-                        RequestedMasternodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
-
-                if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
-
-                mnodeman.DsegUpdate(pnode);
-                RequestedMasternodeAttempt++;
-                return;
-            }
-
-            if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
-                if (lastMasternodeWinner > 0 && lastMasternodeWinner < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { //hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("mnwsync")) continue;
-                pnode->FulfilledRequest("mnwsync");
-
-                // timeout
-                if (lastMasternodeWinner == 0 &&
-                    (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-                        LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed, will retry later\n");
-                        RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
-                        RequestedMasternodeAttempt = 0;
-                        lastFailure = GetTime();
-                        nCountFailures++;
-                    } else {
-                        GetNextAsset();
-                    }
-                    return;
-                }
-
-                if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
-
-                CBlockIndex* pindexPrev = chainActive.Tip();
-                if (pindexPrev == NULL) return;
-
-                int nMnCount = mnodeman.CountEnabled();
-                pnode->PushMessage("mnget", nMnCount); //sync payees
-                RequestedMasternodeAttempt++;
-
-                return;
-            }
-        }
-
-        if (pnode->nVersion >= ActiveProtocol()) {
-            if (RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET) {
-                
-                // We'll start rejecting votes if we accidentally get set as synced too soon
-                if (lastBudgetItem > 0 && lastBudgetItem < GetTime() - MASTERNODE_SYNC_TIMEOUT * 2 && RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD) { 
-                    
-                    // Hasn't received a new item in the last five seconds, so we'll move to the
-                    GetNextAsset();
-
-                    // Try to activate our masternode if possible
-                    activeMasternode.ManageStatus();
-
-                    return;
-                }
-
-                // timeout
-                if (lastBudgetItem == 0 &&
-                    (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
-                    // maybe there is no budgets at all, so just finish syncing
-                    GetNextAsset();
-                    activeMasternode.ManageStatus();
-                    return;
-                }
-
-                if (pnode->HasFulfilledRequest("busync")) continue;
-                pnode->FulfilledRequest("busync");
-
-                if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return;
-
-                uint256 n = 0;
-                pnode->PushMessage("mnvs", n); //sync masternode votes
-                RequestedMasternodeAttempt++;
-
-                return;
-            }
-        }
+        return;
     }
-}
\ No newline at end of file
+
+    // answers and items move the sync on as they arrive, this catches the peers and assets that time out
+    CheckAsset();
+}
@@ -7,6 +7,14 @@
 #ifndef MASTERNODE_SYNC_H
 #define MASTERNODE_SYNC_H
 
+#include "net.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <string>
+
 #define MASTERNODE_SYNC_INITIAL 0
 #define MASTERNODE_SYNC_SPORKS 1
 #define MASTERNODE_SYNC_LIST 2
@@ -19,6 +27,7 @@
 
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
+#define MASTERNODE_SYNC_PEERS 3 // peers asked for an asset at the same time
 
 class CMasternodeSync;
 extern CMasternodeSync masternodeSync;
@@ -26,9 +35,44 @@ extern CMasternodeSync masternodeSync;
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
+// Each asset is asked of up to MASTERNODE_SYNC_PEERS peers at once. The sync moves on to
+// the next asset as soon as the peers asked have sent their counts ("ssc") and as many
+// distinct items have arrived as the largest count announced; a peer that does not answer
+// is replaced by another one, and an asset nobody answers for times out.
+//
 
 class CMasternodeSync
 {
+private:
+    mutable CCriticalSection cs;
+
+    /** A peer asked for the current asset */
+    struct CSyncPeer {
+        int64_t nTimeAsked;
+        int nReplies;
+        int nCount; // items announced, over all of its replies
+
+        CSyncPeer(int64_t nTimeAskedIn = 0) : nTimeAsked(nTimeAskedIn), nReplies(0), nCount(0) {}
+    };
+
+    std::map<NodeId, CSyncPeer> mapAssetPeers;
+    // distinct items of the current asset seen since it started
+    std::set<uint256> setAssetItems;
+    // last time an item or a count arrived for the current asset
+    int64_t nAssetLastActivity;
+    int64_t nAssetSyncStartedMillis;
+    // how long each finished asset took, in milliseconds
+    std::map<int, int64_t> mapAssetDuration;
+
+    /** Number of "ssc" messages a peer sends for the current asset */
+    int GetAssetReplies();
+    /** Record an item of an asset, if that asset is the one syncing */
+    void AddedAssetItem(int nAsset, const uint256& hash);
+    /** Whether the peers asked have answered and the items they announced have arrived */
+    bool IsAssetComplete(int64_t nNow);
+    /** Go on to the next asset and ask for it, if the current one is complete or timed out */
+    void CheckAsset();
+
 public:
     std::map<uint256, int> mapSeenSyncMNB;
     std::map<uint256, int> mapSeenSyncMNW;
@@ -64,7 +108,14 @@ public:
     void AddedMasternodeWinner(uint256 hash);
     void AddedBudgetItem(uint256 hash);
     void GetNextAsset();
+    /** Ask peers for the current asset, up to MASTERNODE_SYNC_PEERS waiting for an answer at a time */
+    void RequestAsset();
     std::string GetSyncStatus();
+    static std::string GetAssetName(int nAsset);
+    /** Milliseconds each asset took, the current one so far */
+    std::map<int, int64_t> GetAssetDurations();
+    /** Peers asked for the current asset that have not answered yet */
+    int CountPendingPeers();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     bool IsBudgetFinEmpty();
     bool IsBudgetPropEmpty();
@@ -63,6 +63,7 @@ public:
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     void Relay();
+    std::string GetSignatureMessage() const;
 
     uint256 GetHash()
     {
@@ -192,6 +193,8 @@ public:
     }
 
     uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0);
+    // score of a collateral outpoint against a block; hashBlockHashed is the hash of hashBlock, the same for every masternode
+    static uint256 CalculateScore(const COutPoint& outpoint, const uint256& hashBlock, const uint256& hashBlockHashed);
 
     ADD_SERIALIZE_METHODS;
 
@@ -218,7 +221,8 @@ public:
         READWRITE(nLastScanningErrorBlockHeight);
     }
 
-    int64_t SecondsSincePayment();
+    // nEnabled is mnodeman.CountEnabled(), which callers going over every masternode count once
+    int64_t SecondsSincePayment(int nEnabled = -1);
 
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
@@ -281,7 +285,7 @@ public:
         return strStatus;
     }
 
-    int64_t GetLastPaid();
+    int64_t GetLastPaid(int nEnabled = -1);
     bool IsValidNetAddr();
 };
 
@@ -301,6 +305,7 @@ public:
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(CKey& keyCollateralAddress);
     void Relay();
+    std::string GetSignatureMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -0,0 +1,25 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodedb.h"
+
+CMasternodeStateDB* pMasternodeDB = NULL;
+
+CMasternodeStateDB::CMasternodeStateDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "masternodes", nCacheSize, fMemory, fWipe, GetLevelDBProfile("masternodes")) {}
+
+bool CMasternodeStateDB::CommitBatch(CMasternodeStateBatch& batch)
+{
+    LOCK(cs);
+    try {
+        if (!WriteBatch(batch.batch))
+            return false;
+    } catch (const leveldb_error& e) {
+        return error("%s : %s", __func__, e.what());
+    }
+
+    for (std::map<char, DigestMap>::iterator it = batch.mapPending.begin(); it != batch.mapPending.end(); ++it)
+        mapWritten[it->first].swap(it->second);
+    batch.mapPending.clear();
+    return true;
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODEDB_H
+#define MASTERNODEDB_H
+
+#include "hash.h"
+#include "leveldbwrapper.h"
+#include "sync.h"
+
+#include <map>
+#include <string>
+
+#include <boost/scoped_ptr.hpp>
+
+class CMasternodeStateDB;
+
+extern CMasternodeStateDB* pMasternodeDB;
+
+// Tables of the masternode state database. The version tables tell which managers were flushed
+static const char DB_MN_VERSION = 'M';
+static const char DB_MASTERNODES = 'm';
+static const char DB_MN_SEEN_BROADCASTS = 'b';
+static const char DB_MN_SEEN_PINGS = 'p';
+static const char DB_MN_ASKED_US = 'a';
+static const char DB_MN_WE_ASKED = 'q';
+static const char DB_MN_WE_ASKED_ENTRY = 'e';
+static const char DB_MN_DSQ_COUNT = 'd';
+static const char DB_PAYMENTS_VERSION = 'W';
+static const char DB_PAYMENT_VOTES = 'w';
+static const char DB_PAYMENT_BLOCKS = 'k';
+static const char DB_BUDGET_VERSION = 'B';
+static const char DB_BUDGET_PROPOSALS = 'r';
+static const char DB_BUDGET_FINALIZED = 'g';
+static const char DB_BUDGET_SEEN_PROPOSALS = 'R';
+static const char DB_BUDGET_SEEN_VOTES = 'v';
+static const char DB_BUDGET_SEEN_FINALIZED = 'G';
+static const char DB_BUDGET_SEEN_FINALIZED_VOTES = 'f';
+static const char DB_BUDGET_ORPHAN_VOTES = 'o';
+static const char DB_BUDGET_ORPHAN_FINALIZED_VOTES = 'O';
+
+/** Hash of the value of each entry of a table, by database key */
+typedef std::map<std::string, uint256> MasternodeStateDigestMap;
+
+/** Writes and erases queued for a CMasternodeStateDB, with the entries they flush */
+class CMasternodeStateBatch
+{
+    friend class CMasternodeStateDB;
+
+private:
+    CLevelDBBatch batch;
+    //! entries passed to BatchEntry, by table
+    std::map<char, MasternodeStateDigestMap> mapPending;
+};
+
+/**
+ * Masternode, payment and budget state, one entry per masternode, payment vote, proposal,
+ * finalized budget or budget vote, in place of mncache.dat, mnpayments.dat and budget.dat.
+ * Each manager keeps its entries in tables of their own, named by a character.
+ *
+ * The digest of every entry written is kept, so a flush only writes the entries that
+ * changed since the last one and erases the ones that are gone. A table is flushed by
+ * passing all of its entries to BatchEntry, then calling BatchErased, then CommitBatch;
+ * a table belongs to one manager, which flushes it under its own lock.
+ */
+class CMasternodeStateDB : public CLevelDBWrapper
+{
+private:
+    typedef MasternodeStateDigestMap DigestMap;
+
+    CCriticalSection cs;
+    //! entries as last written, by table
+    std::map<char, DigestMap> mapWritten;
+
+    CMasternodeStateDB(const CMasternodeStateDB&);
+    void operator=(const CMasternodeStateDB&);
+
+public:
+    CMasternodeStateDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Queue writing an entry, unless it is unchanged since it was last written */
+    template <typename K, typename V>
+    void BatchEntry(CMasternodeStateBatch& batch, char chTable, const K& key, const V& value)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << std::make_pair(chTable, key);
+        std::string strKey = ssKey.str();
+        uint256 hashValue = SerializeHash(value, SER_DISK, CLIENT_VERSION);
+
+        LOCK(cs);
+        DigestMap& mapTable = mapWritten[chTable];
+        DigestMap::const_iterator it = mapTable.find(strKey);
+        if (it == mapTable.end() || it->second != hashValue)
+            batch.batch.Write(std::make_pair(chTable, key), value);
+        batch.mapPending[chTable][strKey] = hashValue;
+    }
+
+    /** Queue erasing the entries of a table that were not passed to BatchEntry for this batch */
+    template <typename K>
+    void BatchErased(CMasternodeStateBatch& batch, char chTable)
+    {
+        LOCK(cs);
+        DigestMap& mapTable = mapWritten[chTable];
+        DigestMap& mapTablePending = batch.mapPending[chTable];
+        for (DigestMap::const_iterator it = mapTable.begin(); it != mapTable.end(); ++it) {
+            if (mapTablePending.count(it->first))
+                continue;
+            std::pair<char, K> key;
+            CDataStream ssKey(it->first.data(), it->first.data() + it->first.size(), SER_DISK, CLIENT_VERSION);
+            ssKey >> key;
+            batch.batch.Erase(key);
+        }
+    }
+
+    /** Queue the writes and erases flushing all the entries of a map into a table */
+    template <typename K, typename V>
+    void BatchTable(CMasternodeStateBatch& batch, char chTable, const std::map<K, V>& mapEntries)
+    {
+        for (typename std::map<K, V>::const_iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+            BatchEntry(batch, chTable, it->first, it->second);
+        BatchErased<K>(batch, chTable);
+    }
+
+    /** Write a batch; the entries passed to BatchEntry become the ones last written */
+    bool CommitBatch(CMasternodeStateBatch& batch);
+
+    /** Read all the entries of a table, which become the ones last written. Returns false on a read error */
+    template <typename K, typename V>
+    bool ReadTable(char chTable, std::map<K, V>& mapEntries)
+    {
+        LOCK(cs);
+        DigestMap& mapTable = mapWritten[chTable];
+        mapTable.clear();
+
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+        pcursor->Seek(std::string(1, chTable));
+        for (; pcursor->Valid(); pcursor->Next()) {
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() == 0 || slKey[0] != chTable)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            try {
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                std::pair<char, K> key;
+                ssKey >> key;
+                ssValue >> mapEntries[key.second];
+            } catch (const std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+            mapTable[slKey.ToString()] = Hash(slValue.data(), slValue.data() + slValue.size());
+        }
+        return pcursor->status().ok();
+    }
+};
+
+#endif // MASTERNODEDB_H
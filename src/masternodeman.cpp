@@ -7,7 +7,9 @@
 #include "masternodeman.h"
 #include "activemasternode.h"
 #include "addrman.h"
+#include "checkqueue.h"
 #include "masternode.h"
+#include "masternodedb.h"
 #include "obfuscation.h"
 #include "spork.h"
 #include "util.h"
@@ -15,6 +17,8 @@
 #include <boost/lexical_cast.hpp>
 
 #define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
+#define MN_SCORE_CACHE_BLOCKS 16      // Blocks to keep masternode scores for
+#define MN_RANK_CACHE_TABLES 64       // Rank tables to keep, over all blocks, protocols and filters
 
 /** Masternode manager */
 CMasternodeMan mnodeman;
@@ -53,39 +57,6 @@ CMasternodeDB::CMasternodeDB()
     strMagicMessage = "MasternodeCache";
 }
 
-bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
-
-    LogPrint("masternode","Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", mnodemanToSave.ToString());
-
-    return true;
-}
-
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
@@ -169,34 +140,205 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bo
 
 void DumpMasternodes()
 {
+    if (pMasternodeDB == NULL)
+        return;
+
     int64_t nStart = GetTimeMillis();
+    if (mnodeman.Flush(*pMasternodeDB))
+        LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
+}
+
+SaltedKeyIDHasher::SaltedKeyIDHasher() : salt(GetRandHash()) {}
+
+size_t SaltedKeyIDHasher::operator()(const CKeyID& keyID) const
+{
+    uint256 hash;
+    memcpy(hash.begin(), keyID.begin(), keyID.size());
+    return hash.GetHash(salt);
+}
 
-    CMasternodeDB mndb;
-    CMasternodeMan tempMnodeman;
-
-    LogPrint("masternode","Verifying mncache.dat format...\n");
-    CMasternodeDB::ReadResult readResult = mndb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodeDB::FileError)
-        LogPrint("masternode","Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrint("masternode","Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
+static void EraseKeyIndex(boost::unordered_multimap<CKeyID, COutPoint, SaltedKeyIDHasher>& mapIndex, const CKeyID& keyID, const COutPoint& outpoint)
+{
+    typedef boost::unordered_multimap<CKeyID, COutPoint, SaltedKeyIDHasher>::iterator index_iterator;
+    std::pair<index_iterator, index_iterator> range = mapIndex.equal_range(keyID);
+    for (index_iterator it = range.first; it != range.second; ++it) {
+        if (it->second == outpoint) {
+            mapIndex.erase(it);
             return;
         }
     }
-    LogPrint("masternode","Writting info to mncache.dat...\n");
-    mndb.Write(mnodeman);
+}
+
+namespace
+{
+/** Closure scoring one masternode against a block, for the score queue */
+class CMasternodeScoreCheck
+{
+private:
+    const COutPoint* poutpoint;
+    const uint256* phashBlock;
+    const uint256* phashBlockHashed;
+    uint256* pscore;
+
+public:
+    CMasternodeScoreCheck() : poutpoint(NULL), phashBlock(NULL), phashBlockHashed(NULL), pscore(NULL) {}
+    CMasternodeScoreCheck(const COutPoint& outpointIn, const uint256& hashBlockIn, const uint256& hashBlockHashedIn, uint256& scoreIn) : poutpoint(&outpointIn), phashBlock(&hashBlockIn), phashBlockHashed(&hashBlockHashedIn), pscore(&scoreIn) {}
 
-    LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
+    bool operator()()
+    {
+        *pscore = CMasternode::CalculateScore(*poutpoint, *phashBlock, *phashBlockHashed);
+        return true;
+    }
+
+    void swap(CMasternodeScoreCheck& check)
+    {
+        std::swap(poutpoint, check.poutpoint);
+        std::swap(phashBlock, check.phashBlock);
+        std::swap(phashBlockHashed, check.phashBlockHashed);
+        std::swap(pscore, check.pscore);
+    }
+};
+
+CCheckQueue<CMasternodeScoreCheck> scorecheckqueue(128);
+// the queue takes one batch at a time
+CCriticalSection cs_scorecheckqueue;
+
+}
+
+void ThreadMasternodeScore()
+{
+    RenameThread("xuez-mnscore");
+    scorecheckqueue.Thread();
 }
 
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
+    nScoreCacheUses = 0;
+    nListVersion = 0;
+}
+
+void CMasternodeMan::IndexMasternode(std::list<CMasternode>::iterator it)
+{
+    nListVersion++;
+
+    CMasternodeIndexEntry entry;
+    entry.it = it;
+    entry.keyIDMasternode = it->pubKeyMasternode.GetID();
+    entry.keyIDCollateral = it->pubKeyCollateralAddress.GetID();
+    mapMasternodesByVin[it->vin.prevout] = entry;
+    mapMasternodesByPubKey.insert(std::make_pair(entry.keyIDMasternode, it->vin.prevout));
+    mapMasternodesByPayee.insert(std::make_pair(entry.keyIDCollateral, it->vin.prevout));
+}
+
+std::list<CMasternode>::iterator CMasternodeMan::EraseMasternode(std::list<CMasternode>::iterator it)
+{
+    nListVersion++;
+
+    MasternodeVinMap::iterator mi = mapMasternodesByVin.find(it->vin.prevout);
+    if (mi != mapMasternodesByVin.end() && mi->second.it == it) {
+        EraseKeyIndex(mapMasternodesByPubKey, mi->second.keyIDMasternode, mi->first);
+        EraseKeyIndex(mapMasternodesByPayee, mi->second.keyIDCollateral, mi->first);
+        mapMasternodesByVin.erase(mi);
+    }
+    return listMasternodes.erase(it);
+}
+
+void CMasternodeMan::ReindexAll()
+{
+    mapMasternodesByVin.clear();
+    mapMasternodesByPubKey.clear();
+    mapMasternodesByPayee.clear();
+
+    // an old cache may hold an outpoint twice; keep the first entry, which is the one Find returned
+    std::list<CMasternode>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
+        if (mapMasternodesByVin.count(it->vin.prevout)) {
+            it = listMasternodes.erase(it);
+        } else {
+            IndexMasternode(it);
+            ++it;
+        }
+    }
+}
+
+bool CMasternodeMan::Flush(CMasternodeStateDB& db)
+{
+    CMasternodeStateBatch batch;
+    LOCK(cs);
+
+    for (std::list<CMasternode>::const_iterator it = listMasternodes.begin(); it != listMasternodes.end(); ++it)
+        db.BatchEntry(batch, DB_MASTERNODES, it->vin.prevout, *it);
+    db.BatchErased<COutPoint>(batch, DB_MASTERNODES);
+    db.BatchTable(batch, DB_MN_SEEN_BROADCASTS, mapSeenMasternodeBroadcast);
+    db.BatchTable(batch, DB_MN_SEEN_PINGS, mapSeenMasternodePing);
+    db.BatchTable(batch, DB_MN_ASKED_US, mAskedUsForMasternodeList);
+    db.BatchTable(batch, DB_MN_WE_ASKED, mWeAskedForMasternodeList);
+    db.BatchTable(batch, DB_MN_WE_ASKED_ENTRY, mWeAskedForMasternodeListEntry);
+    db.BatchEntry(batch, DB_MN_DSQ_COUNT, 0, nDsqCount);
+    db.BatchEntry(batch, DB_MN_VERSION, 0, CLIENT_VERSION);
+
+    if (!db.CommitBatch(batch))
+        return error("%s : Failed to write the masternodes", __func__);
+    return true;
+}
+
+bool CMasternodeMan::Load(CMasternodeStateDB& db)
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::map<int, int> mapVersion;
+    if (!db.ReadTable(DB_MN_VERSION, mapVersion) || mapVersion.empty())
+        return false;
+
+    {
+        LOCK(cs);
+        Clear();
+
+        std::map<COutPoint, CMasternode> mapMasternodes;
+        std::map<int, int64_t> mapDsqCount;
+        if (!db.ReadTable(DB_MASTERNODES, mapMasternodes) ||
+            !db.ReadTable(DB_MN_SEEN_BROADCASTS, mapSeenMasternodeBroadcast) ||
+            !db.ReadTable(DB_MN_SEEN_PINGS, mapSeenMasternodePing) ||
+            !db.ReadTable(DB_MN_ASKED_US, mAskedUsForMasternodeList) ||
+            !db.ReadTable(DB_MN_WE_ASKED, mWeAskedForMasternodeList) ||
+            !db.ReadTable(DB_MN_WE_ASKED_ENTRY, mWeAskedForMasternodeListEntry) ||
+            !db.ReadTable(DB_MN_DSQ_COUNT, mapDsqCount)) {
+            Clear();
+            return error("%s : Failed to read the masternodes", __func__);
+        }
+
+        for (std::map<COutPoint, CMasternode>::const_iterator it = mapMasternodes.begin(); it != mapMasternodes.end(); ++it)
+            listMasternodes.push_back(it->second);
+        ReindexAll();
+        nDsqCount = mapDsqCount[0];
+    }
+
+    LogPrint("masternode","Loaded masternodes from the database  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", ToString());
+    return true;
+}
+
+void CMasternodeMan::UpdateMasternodeIndex(const CMasternode& mn)
+{
+    LOCK(cs);
+
+    MasternodeVinMap::iterator mi = mapMasternodesByVin.find(mn.vin.prevout);
+    if (mi == mapMasternodesByVin.end() || &*mi->second.it != &mn)
+        return;
+
+    CKeyID keyIDMasternode = mn.pubKeyMasternode.GetID();
+    if (keyIDMasternode != mi->second.keyIDMasternode) {
+        EraseKeyIndex(mapMasternodesByPubKey, mi->second.keyIDMasternode, mi->first);
+        mapMasternodesByPubKey.insert(std::make_pair(keyIDMasternode, mi->first));
+        mi->second.keyIDMasternode = keyIDMasternode;
+    }
+    CKeyID keyIDCollateral = mn.pubKeyCollateralAddress.GetID();
+    if (keyIDCollateral != mi->second.keyIDCollateral) {
+        EraseKeyIndex(mapMasternodesByPayee, mi->second.keyIDCollateral, mi->first);
+        mapMasternodesByPayee.insert(std::make_pair(keyIDCollateral, mi->first));
+        mi->second.keyIDCollateral = keyIDCollateral;
+    }
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -209,7 +351,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     CMasternode* pmn = Find(mn.vin);
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
-        vMasternodes.push_back(mn);
+        IndexMasternode(listMasternodes.insert(listMasternodes.end(), mn));
         return true;
     }
 
@@ -236,7 +378,7 @@ void CMasternodeMan::Check()
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
         mn.Check();
     }
 }
@@ -248,8 +390,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
     LOCK(cs);
 
     //remove inactive and outdated
-    vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
+    std::list<CMasternode>::iterator it = listMasternodes.begin();
+    while (it != listMasternodes.end()) {
         if ((*it).activeState == CMasternode::MASTERNODE_REMOVE ||
             (*it).activeState == CMasternode::MASTERNODE_VIN_SPENT ||
             (forceExpiredRemoval && (*it).activeState == CMasternode::MASTERNODE_EXPIRED) ||
@@ -279,7 +421,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
-            it = vMasternodes.erase(it);
+            it = EraseMasternode(it);
         } else {
             ++it;
         }
@@ -335,20 +477,184 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             ++it4;
         }
     }
+    // pings inserted outside of ProcessMessage are bounded here
+    gossipFilter.Limit(mapSeenMasternodePing, MSG_MASTERNODE_PING, &CMasternodePing::sigTime);
 }
 
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
-    vMasternodes.clear();
+    listMasternodes.clear();
+    mapMasternodesByVin.clear();
+    mapMasternodesByPubKey.clear();
+    mapMasternodesByPayee.clear();
+    mapRankCache.clear();
+    nListVersion++;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
+    gossipFilter.clear(MSG_MASTERNODE_PING);
     nDsqCount = 0;
 }
 
+/** Scores against the block hashBlock, a new empty entry if there are none. cs must be held. */
+CMasternodeMan::CMasternodeScores& CMasternodeMan::GetScoreCache(const uint256& hashBlock)
+{
+    std::map<uint256, CMasternodeScores>::iterator mi = mapScoreCache.find(hashBlock);
+    if (mi == mapScoreCache.end()) {
+        if (mapScoreCache.size() >= MN_SCORE_CACHE_BLOCKS) {
+            std::map<uint256, CMasternodeScores>::iterator miOldest = mapScoreCache.begin();
+            for (std::map<uint256, CMasternodeScores>::iterator it = mapScoreCache.begin(); it != mapScoreCache.end(); ++it) {
+                if (it->second.nLastUsed < miOldest->second.nLastUsed)
+                    miOldest = it;
+            }
+            mapScoreCache.erase(miOldest);
+        }
+        mi = mapScoreCache.insert(std::make_pair(hashBlock, CMasternodeScores())).first;
+    }
+    mi->second.nLastUsed = ++nScoreCacheUses;
+    return mi->second;
+}
+
+/**
+ * Score the masternodes that have no score yet against the block used for nBlockHeight,
+ * on the score workers when there are at least MN_PARALLEL_SCORE_MIN of them. The block
+ * hash changes every block, so this is all of them once per new block. The outpoints are
+ * taken under cs and scored without it; GetScores scores the few left, if any, under cs.
+ */
+void CMasternodeMan::ScoreMasternodes(int64_t nBlockHeight)
+{
+    uint256 hashBlock;
+    std::vector<COutPoint> vOutpoints;
+    {
+        LOCK(cs);
+        if (chainActive.Tip() == NULL || !GetBlockHash(hashBlock, nBlockHeight))
+            return;
+        std::map<uint256, CMasternodeScores>::const_iterator mi = mapScoreCache.find(hashBlock);
+        if (mi != mapScoreCache.end() && mi->second.nListVersion == nListVersion)
+            return;
+        BOOST_FOREACH (CMasternode& mn, listMasternodes) {
+            if (mi == mapScoreCache.end() || !mi->second.mapScores.count(mn.vin.prevout))
+                vOutpoints.push_back(mn.vin.prevout);
+        }
+    }
+    if (vOutpoints.size() < MN_PARALLEL_SCORE_MIN)
+        return;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    uint256 hashBlockHashed = ss.GetHash();
+
+    std::vector<uint256> vScores(vOutpoints.size());
+    std::vector<CMasternodeScoreCheck> vChecks;
+    vChecks.reserve(vOutpoints.size());
+    for (size_t i = 0; i < vOutpoints.size(); i++)
+        vChecks.push_back(CMasternodeScoreCheck(vOutpoints[i], hashBlock, hashBlockHashed, vScores[i]));
+    {
+        LOCK(cs_scorecheckqueue);
+        CCheckQueueControl<CMasternodeScoreCheck> control(&scorecheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    LOCK(cs);
+    CMasternodeScores& scores = GetScoreCache(hashBlock);
+    for (size_t i = 0; i < vOutpoints.size(); i++)
+        scores.mapScores.insert(std::make_pair(vOutpoints[i], vScores[i]));
+}
+
+/**
+ * Scores of all masternodes against the block CalculateScore uses for nBlockHeight. The
+ * scores of a block do not change, but the block changes with every new block, so all the
+ * masternodes are scored again for each. Callers run ScoreMasternodes before taking cs, so
+ * only what it left is scored here. Returns NULL if the block is unknown.
+ */
+const CMasternodeMan::MasternodeScoreMap* CMasternodeMan::GetScores(int64_t nBlockHeight, uint256& hashBlock)
+{
+    if (chainActive.Tip() == NULL || !GetBlockHash(hashBlock, nBlockHeight))
+        return NULL;
+
+    CMasternodeScores& scores = GetScoreCache(hashBlock);
+    if (scores.nListVersion == nListVersion)
+        return &scores.mapScores;
+    scores.nListVersion = nListVersion;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    uint256 hashBlockHashed = ss.GetHash();
+
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
+        if (!scores.mapScores.count(mn.vin.prevout))
+            scores.mapScores[mn.vin.prevout] = CMasternode::CalculateScore(mn.vin.prevout, hashBlock, hashBlockHashed);
+    }
+
+    return &scores.mapScores;
+}
+
+/**
+ * Masternodes with at least minProtocol, passing nFilter, ordered by score against the block
+ * used for nBlockHeight. A table is reused until a masternode is added or removed, and for at
+ * most MASTERNODE_CHECK_SECONDS, which is how long Check() keeps the state of a masternode.
+ * Returns NULL if the block is unknown.
+ */
+const CMasternodeMan::CMasternodeRankTable* CMasternodeMan::GetRankTable(int64_t nBlockHeight, int minProtocol, int nFilter)
+{
+    uint256 hashBlock;
+    if (chainActive.Tip() == NULL || !GetBlockHash(hashBlock, nBlockHeight))
+        return NULL;
+
+    std::pair<uint256, std::pair<int, int> > key = std::make_pair(hashBlock, std::make_pair(minProtocol, nFilter));
+    std::map<std::pair<uint256, std::pair<int, int> >, CMasternodeRankTable>::iterator mi = mapRankCache.find(key);
+    if (mi != mapRankCache.end() && mi->second.nListVersion == nListVersion && GetTime() - mi->second.nTimeComputed < MASTERNODE_CHECK_SECONDS)
+        return &mi->second;
+
+    const MasternodeScoreMap* pmapScores = GetScores(nBlockHeight, hashBlock);
+    if (pmapScores == NULL)
+        return NULL;
+
+    if (mi == mapRankCache.end()) {
+        if (mapRankCache.size() >= MN_RANK_CACHE_TABLES) {
+            std::map<std::pair<uint256, std::pair<int, int> >, CMasternodeRankTable>::iterator miOldest = mapRankCache.begin();
+            for (mi = mapRankCache.begin(); mi != mapRankCache.end(); ++mi) {
+                if (mi->second.nTimeComputed < miOldest->second.nTimeComputed)
+                    miOldest = mi;
+            }
+            mapRankCache.erase(miOldest);
+        }
+        mi = mapRankCache.insert(std::make_pair(key, CMasternodeRankTable())).first;
+    }
+    CMasternodeRankTable& table = mi->second;
+    table.nTimeComputed = GetTime();
+    table.nListVersion = nListVersion;
+    table.vecScores.clear();
+    table.mapRanks.clear();
+
+    bool fCheckAge = (nFilter & RANK_MIN_AGE) && IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
+        if (mn.protocolVersion < minProtocol) continue;
+
+        if (fCheckAge && GetAdjustedTime() - mn.sigTime < MN_WINNER_MINIMUM_AGE) continue;
+
+        if (nFilter & RANK_ONLY_ACTIVE) {
+            mn.Check();
+            if (!mn.IsEnabled()) continue;
+        }
+
+        MasternodeScoreMap::const_iterator it = pmapScores->find(mn.vin.prevout);
+        if (it == pmapScores->end()) continue;
+        table.vecScores.push_back(make_pair(it->second.GetCompact(false), mn.vin));
+    }
+
+    sort(table.vecScores.rbegin(), table.vecScores.rend(), CompareScoreTxIn());
+
+    for (unsigned int i = 0; i < table.vecScores.size(); i++)
+        table.mapRanks.insert(std::make_pair(table.vecScores[i].second.prevout, i + 1));
+
+    return &table;
+}
+
 int CMasternodeMan::stable_size ()
 {
     int nStable_size = 0;
@@ -356,7 +662,7 @@ int CMasternodeMan::stable_size ()
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
         if (mn.protocolVersion < nMinProtocol) {
             continue; // Skip obsolete versions
         }
@@ -381,7 +687,7 @@ int CMasternodeMan::CountEnabled(int protocolVersion)
     int i = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
         mn.Check();
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         i++;
@@ -394,7 +700,7 @@ void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, in
 {
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
         mn.Check();
         std::string strHost;
         int port;
@@ -415,7 +721,7 @@ void CMasternodeMan::CountNetworks(int protocolVersion, int& ipv4, int& ipv6, in
     }
 }
 
-void CMasternodeMan::DsegUpdate(CNode* pnode)
+bool CMasternodeMan::DsegUpdate(CNode* pnode)
 {
     LOCK(cs);
 
@@ -425,7 +731,7 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
             if (it != mWeAskedForMasternodeList.end()) {
                 if (GetTime() < (*it).second) {
                     LogPrint("masternode", "dseg - we already asked peer %i for the list; skipping...\n", pnode->GetId());
-                    return;
+                    return false;
                 }
             }
         }
@@ -434,30 +740,50 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
     pnode->PushMessage("dseg", CTxIn());
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
+    return true;
 }
 
 CMasternode* CMasternodeMan::Find(const CScript& payee)
 {
+    // Masternodes are only ever paid to the key hash of their collateral key
+    CTxDestination dest;
+    if (!ExtractDestination(payee, dest))
+        return NULL;
+    const CKeyID* keyID = boost::get<CKeyID>(&dest);
+    if (keyID == NULL || payee != GetScriptForDestination(*keyID))
+        return NULL;
+
     LOCK(cs);
-    CScript payee2;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
+    std::pair<MasternodeKeyMap::const_iterator, MasternodeKeyMap::const_iterator> range = mapMasternodesByPayee.equal_range(*keyID);
+    for (MasternodeKeyMap::const_iterator it = range.first; it != range.second; ++it) {
+        CMasternode* pmn = Find(CTxIn(it->second));
+        if (pmn && pmn->pubKeyCollateralAddress.GetID() == *keyID)
+            return pmn;
     }
     return NULL;
 }
 
+bool CMasternodeMan::HaveSeenBroadcast(const uint256& hash)
+{
+    LOCK(cs);
+    return mapSeenMasternodeBroadcast.count(hash);
+}
+
+bool CMasternodeMan::HaveSeenPing(const uint256& hash)
+{
+    LOCK(cs);
+    return mapSeenMasternodePing.count(hash);
+}
+
 CMasternode* CMasternodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    MasternodeVinMap::iterator mi = mapMasternodesByVin.find(vin.prevout);
+    if (mi == mapMasternodesByVin.end())
+        return NULL;
+    return &*mi->second.it;
 }
 
 
@@ -465,9 +791,11 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.pubKeyMasternode == pubKeyMasternode)
-            return &mn;
+    std::pair<MasternodeKeyMap::const_iterator, MasternodeKeyMap::const_iterator> range = mapMasternodesByPubKey.equal_range(pubKeyMasternode.GetID());
+    for (MasternodeKeyMap::const_iterator it = range.first; it != range.second; ++it) {
+        CMasternode* pmn = Find(CTxIn(it->second));
+        if (pmn && pmn->pubKeyMasternode == pubKeyMasternode)
+            return pmn;
     }
     return NULL;
 }
@@ -477,6 +805,7 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 //
 CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount)
 {
+    ScoreMasternodes(nBlockHeight - 100);
     LOCK(cs);
 
     CMasternode* pBestMasternode = NULL;
@@ -487,7 +816,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     */
 
     int nMnCount = CountEnabled();
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
         mn.Check();
         if (!mn.IsEnabled()) continue;
 
@@ -503,7 +832,7 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
         //make sure it has as many confirmations as there are masternodes
         if (mn.GetMasternodeInputAge() < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(), mn.vin));
+        vecMasternodeLastPaid.push_back(make_pair(mn.SecondsSincePayment(nMnCount), mn.vin));
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -521,11 +850,18 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     int nTenthNetwork = CountEnabled() / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
+    uint256 hashBlock;
+    const MasternodeScoreMap* pmapScores = GetScores(nBlockHeight - 100, hashBlock);
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeLastPaid) {
         CMasternode* pmn = Find(s.second);
         if (!pmn) break;
 
-        uint256 n = pmn->CalculateScore(1, nBlockHeight - 100);
+        uint256 n = 0;
+        if (pmapScores) {
+            MasternodeScoreMap::const_iterator it = pmapScores->find(s.second.prevout);
+            if (it != pmapScores->end())
+                n = it->second;
+        }
         if (n > nHigh) {
             nHigh = n;
             pBestMasternode = pmn;
@@ -550,7 +886,7 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     LogPrint("masternode", "CMasternodeMan::FindRandomNotInVec - rand %d\n", rand);
     bool found;
 
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
         found = false;
         BOOST_FOREACH (CTxIn& usedVin, vecToExclude) {
@@ -570,73 +906,30 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
 
 CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
-
-        // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    ScoreMasternodes(nBlockHeight);
+    LOCK(cs);
 
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
-    }
+    // the winner is the enabled Masternode with the highest score
+    const CMasternodeRankTable* ptable = GetRankTable(nBlockHeight, minProtocol, RANK_ONLY_ACTIVE);
+    if (ptable == NULL || ptable->vecScores.empty() || ptable->vecScores[0].first <= 0)
+        return NULL;
 
-    return winner;
+    return Find(ptable->vecScores[0].second);
 }
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMasternode_Age = 0;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) {
-            LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
-            continue;                                                       // Skip obsolete versions
-        }
-
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMasternode_Age) < nMasternode_Min_Age) {
-                if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
-                continue;                                                   // Skip masternodes younger than (default) 1 hour
-            }
-        }
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
+    ScoreMasternodes(nBlockHeight);
+    LOCK(cs);
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    // skips masternodes younger than MN_WINNER_MINIMUM_AGE, unlike GetMasternodeByRank
+    const CMasternodeRankTable* ptable = GetRankTable(nBlockHeight, minProtocol, RANK_MIN_AGE | (fOnlyActive ? RANK_ONLY_ACTIVE : 0));
+    if (ptable == NULL) return -1;
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
-        }
-    }
+    boost::unordered_map<COutPoint, int, SaltedOutpointHasher>::const_iterator it = ptable->mapRanks.find(vin.prevout);
+    if (it == ptable->mapRanks.end()) return -1;
 
-    return -1;
+    return it->second;
 }
 
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
@@ -644,12 +937,16 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
     std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
     std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
+    ScoreMasternodes(nBlockHeight);
+    LOCK(cs);
+
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
+    const MasternodeScoreMap* pmapScores = GetScores(nBlockHeight, hash);
+    if (pmapScores == NULL) return vecMasternodeRanks;
 
     // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    BOOST_FOREACH (CMasternode& mn, listMasternodes) {
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
@@ -659,8 +956,9 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+        MasternodeScoreMap::const_iterator it = pmapScores->find(mn.vin.prevout);
+        if (it == pmapScores->end()) continue;
+        int64_t n2 = it->second.GetCompact(false);
 
         vecMasternodeScores.push_back(make_pair(n2, mn));
     }
@@ -678,33 +976,14 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
-
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
+    ScoreMasternodes(nBlockHeight);
+    LOCK(cs);
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    const CMasternodeRankTable* ptable = GetRankTable(nBlockHeight, minProtocol, fOnlyActive ? RANK_ONLY_ACTIVE : 0);
+    if (ptable == NULL || nRank < 1 || nRank > (int)ptable->vecScores.size())
+        return NULL;
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
-
-    return NULL;
+    return Find(ptable->vecScores[nRank - 1].second);
 }
 
 void CMasternodeMan::ProcessMasternodeConnections()
@@ -777,8 +1056,9 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
         LogPrint("masternode", "mnp - Masternode ping, vin: %s\n", mnp.vin.prevout.hash.ToString());
 
-        if (mapSeenMasternodePing.count(mnp.GetHash())) return; //seen
+        if (mapSeenMasternodePing.count(mnp.GetHash()) || gossipFilter.contains(CInv(MSG_MASTERNODE_PING, mnp.GetHash()))) return; //seen
         mapSeenMasternodePing.insert(make_pair(mnp.GetHash(), mnp));
+        gossipFilter.Limit(mapSeenMasternodePing, MSG_MASTERNODE_PING, &CMasternodePing::sigTime);
 
         int nDoS = 0;
         if (mnp.CheckAndUpdate(nDoS)) return;
@@ -824,7 +1104,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
         int nInvCount = 0;
 
-        BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+        BOOST_FOREACH (CMasternode& mn, listMasternodes) {
             if (mn.addr.IsRFC1918()) continue; //local network
 
             if (mn.IsEnabled()) {
@@ -943,6 +1223,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                     LogPrint("masternode", "dsee - Got updated entry for %s\n", vin.prevout.hash.ToString());
                     if (pmn->protocolVersion < GETHEADERS_VERSION) {
                         pmn->pubKeyMasternode = pubkey2;
+                        UpdateMasternodeIndex(*pmn);
                         pmn->sigTime = sigTime;
                         pmn->sig = vchSig;
                         pmn->protocolVersion = protocolVersion;
@@ -1136,14 +1417,10 @@ void CMasternodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    vector<CMasternode>::iterator it = vMasternodes.begin();
-    while (it != vMasternodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vMasternodes.erase(it);
-            break;
-        }
-        ++it;
+    MasternodeVinMap::iterator mi = mapMasternodesByVin.find(vin.prevout);
+    if (mi != mapMasternodesByVin.end() && mi->second.it->vin == vin) {
+        LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", vin.prevout.hash.ToString(), size() - 1);
+        EraseMasternode(mi->second.it);
     }
 }
 
@@ -1162,6 +1439,7 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
             masternodeSync.AddedMasternodeList(mnb.GetHash());
         }
     } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        UpdateMasternodeIndex(*pmn);
         masternodeSync.AddedMasternodeList(mnb.GetHash());
     }
 }
@@ -1170,7 +1448,7 @@ std::string CMasternodeMan::ToString() const
 {
     std::ostringstream info;
 
-    info << "Masternodes: " << (int)vMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size() << ", nDsqCount: " << (int)nDsqCount;
+    info << "Masternodes: " << (int)listMasternodes.size() << ", peers who asked us for Masternode list: " << (int)mAskedUsForMasternodeList.size() << ", peers we asked for Masternode list: " << (int)mWeAskedForMasternodeList.size() << ", entries in Masternode list we asked for: " << (int)mWeAskedForMasternodeListEntry.size() << ", nDsqCount: " << (int)nDsqCount;
 
     return info.str();
 }
@@ -8,6 +8,7 @@
 #define MASTERNODEMAN_H
 
 #include "base58.h"
+#include "coins.h"
 #include "key.h"
 #include "main.h"
 #include "masternode.h"
@@ -15,17 +16,27 @@
 #include "sync.h"
 #include "util.h"
 
+#include <list>
+
+#include <boost/unordered_map.hpp>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MN_PARALLEL_SCORE_MIN 1000    // Score this many masternodes or more on the score workers
+#define MN_PARALLEL_SCORE_THREADS 8
 
 using namespace std;
 
 class CMasternodeMan;
+class CMasternodeStateDB;
 
 extern CMasternodeMan mnodeman;
+/** Flush the masternodes changed since the last dump to the masternode state database */
 void DumpMasternodes();
+/** Run a worker of the masternode score queue */
+void ThreadMasternodeScore();
 
-/** Access to the MN database (mncache.dat)
+/** Access to mncache.dat, where older versions kept the masternodes; read once to import them
  */
 class CMasternodeDB
 {
@@ -45,21 +56,69 @@ public:
     };
 
     CMasternodeDB();
-    bool Write(const CMasternodeMan& mnodemanToSave);
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+/** Salted hash of a key ID, for the masternode key and payee indexes */
+class SaltedKeyIDHasher
+{
+private:
+    uint256 salt;
+
+public:
+    SaltedKeyIDHasher();
+
+    size_t operator()(const CKeyID& keyID) const;
+};
+
 class CMasternodeMan
 {
 private:
+    /** Position of an entry in listMasternodes and the keys it is indexed under */
+    struct CMasternodeIndexEntry {
+        std::list<CMasternode>::iterator it;
+        CKeyID keyIDMasternode;
+        CKeyID keyIDCollateral;
+    };
+
+    typedef boost::unordered_map<COutPoint, CMasternodeIndexEntry, SaltedOutpointHasher> MasternodeVinMap;
+    typedef boost::unordered_multimap<CKeyID, COutPoint, SaltedKeyIDHasher> MasternodeKeyMap;
+    typedef boost::unordered_map<COutPoint, uint256, SaltedOutpointHasher> MasternodeScoreMap;
+
+    /** Scores of the masternodes against one block, which never change */
+    struct CMasternodeScores {
+        uint64_t nLastUsed;
+        uint64_t nListVersion; // masternodes added after this version have no score yet
+        MasternodeScoreMap mapScores;
+    };
+
+    /** Masternodes ranked by score against one block, for one minimum protocol and set of filters */
+    struct CMasternodeRankTable {
+        int64_t nTimeComputed;
+        uint64_t nListVersion;
+        std::vector<pair<int64_t, CTxIn> > vecScores;
+        boost::unordered_map<COutPoint, int, SaltedOutpointHasher> mapRanks;
+    };
+
+    enum RankFilter {
+        RANK_ONLY_ACTIVE = (1 << 0), // skip masternodes that are not enabled
+        RANK_MIN_AGE = (1 << 1),     // skip masternodes younger than MN_WINNER_MINIMUM_AGE once payments are enforced
+    };
+
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
     // critical section to protect the inner data structures specifically on messaging
     mutable CCriticalSection cs_process_message;
 
-    // map to hold all MNs
-    std::vector<CMasternode> vMasternodes;
+    // list to hold all MNs; entries do not move, so pointers returned by Find stay valid until the entry is removed
+    std::list<CMasternode> listMasternodes;
+    // MNs by collateral outpoint
+    MasternodeVinMap mapMasternodesByVin;
+    // MNs by the ID of pubKeyMasternode
+    MasternodeKeyMap mapMasternodesByPubKey;
+    // MNs by the ID of pubKeyCollateralAddress, which is what a payee script pays to
+    MasternodeKeyMap mapMasternodesByPayee;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
@@ -67,6 +126,23 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    // scores by block hash
+    std::map<uint256, CMasternodeScores> mapScoreCache;
+    uint64_t nScoreCacheUses;
+    // rank tables by block hash, minimum protocol and filters
+    std::map<std::pair<uint256, std::pair<int, int> >, CMasternodeRankTable> mapRankCache;
+    // changes whenever a masternode is added or removed, which invalidates the rank tables
+    uint64_t nListVersion;
+
+    CMasternodeScores& GetScoreCache(const uint256& hashBlock);
+    void ScoreMasternodes(int64_t nBlockHeight);
+    const MasternodeScoreMap* GetScores(int64_t nBlockHeight, uint256& hashBlock);
+    const CMasternodeRankTable* GetRankTable(int64_t nBlockHeight, int minProtocol, int nFilter);
+
+    void IndexMasternode(std::list<CMasternode>::iterator it);
+    std::list<CMasternode>::iterator EraseMasternode(std::list<CMasternode>::iterator it);
+    void ReindexAll();
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -82,7 +158,14 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        std::vector<CMasternode> vMasternodes;
+        if (!ser_action.ForRead())
+            vMasternodes.assign(listMasternodes.begin(), listMasternodes.end());
         READWRITE(vMasternodes);
+        if (ser_action.ForRead()) {
+            listMasternodes.assign(vMasternodes.begin(), vMasternodes.end());
+            ReindexAll();
+        }
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -114,13 +197,18 @@ public:
 
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
 
-    void DsegUpdate(CNode* pnode);
+    /// Ask a peer for the masternode list, unless we asked it too recently
+    bool DsegUpdate(CNode* pnode);
 
     /// Find an entry
     CMasternode* Find(const CScript& payee);
     CMasternode* Find(const CTxIn& vin);
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
+    /// Have we seen this broadcast or ping already
+    bool HaveSeenBroadcast(const uint256& hash);
+    bool HaveSeenPing(const uint256& hash);
+
     /// Find an entry in the masternode list that is next to be paid
     CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount);
 
@@ -133,7 +221,8 @@ public:
     std::vector<CMasternode> GetFullMasternodeVector()
     {
         Check();
-        return vMasternodes;
+        LOCK(cs);
+        return std::vector<CMasternode>(listMasternodes.begin(), listMasternodes.end());
     }
 
     std::vector<pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
@@ -145,7 +234,14 @@ public:
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
     /// Return the number of (unique) Masternodes
-    int size() { return vMasternodes.size(); }
+    int size() { return listMasternodes.size(); }
+
+    /// Return a number that changes whenever a Masternode is added or removed
+    uint64_t GetListVersion()
+    {
+        LOCK(cs);
+        return nListVersion;
+    }
 
     /// Return the number of Masternodes older than (default) 8000 seconds
     int stable_size ();
@@ -154,6 +250,14 @@ public:
 
     void Remove(CTxIn vin);
 
+    /// Write the entries changed since the last flush to db, and erase the ones removed
+    bool Flush(CMasternodeStateDB& db);
+    /// Read the entries written by Flush, without cleaning them up; returns false if db has none
+    bool Load(CMasternodeStateDB& db);
+
+    /// Update the key indexes after the keys of an entry returned by Find changed
+    void UpdateMasternodeIndex(const CMasternode& mn);
+
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
 };
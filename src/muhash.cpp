@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <vector>
+
+namespace
+{
+//! 2^3072 - 1103717, the largest 3072 bit safe prime
+const CBigNum& Prime()
+{
+    static const CBigNum p = (CBigNum(1) << 3072) - CBigNum(1103717);
+    return p;
+}
+} // anon namespace
+
+CMuHash3072::CMuHash3072() : numerator(1), denominator(1)
+{
+}
+
+CBigNum CMuHash3072::ToElement(const unsigned char* data, size_t len)
+{
+    // Expand the SHA256 of the data to ELEMENT_SIZE bytes by hashing it with a counter
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(seed);
+    std::vector<unsigned char> vch(ELEMENT_SIZE + 1, 0);
+    for (uint32_t i = 0; i < ELEMENT_SIZE / CSHA256::OUTPUT_SIZE; i++) {
+        unsigned char counter[4];
+        WriteLE32(counter, i);
+        CSHA256().Write(seed, sizeof(seed)).Write(counter, sizeof(counter)).Finalize(&vch[i * CSHA256::OUTPUT_SIZE]);
+    }
+    // The last byte stays zero, so setvch does not read the top bit as a sign
+    CBigNum bn;
+    bn.setvch(vch);
+    return bn % Prime();
+}
+
+CMuHash3072& CMuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator = numerator.mul_mod(ToElement(data, len), Prime());
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator = denominator.mul_mod(ToElement(data, len), Prime());
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::operator*=(const CMuHash3072& b)
+{
+    numerator = numerator.mul_mod(b.numerator, Prime());
+    denominator = denominator.mul_mod(b.denominator, Prime());
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::operator/=(const CMuHash3072& b)
+{
+    numerator = numerator.mul_mod(b.denominator, Prime());
+    denominator = denominator.mul_mod(b.numerator, Prime());
+    return *this;
+}
+
+uint256 CMuHash3072::Finalize() const
+{
+    CBigNum value = numerator;
+    if (denominator != CBigNum(1))
+        value = numerator.mul_mod(denominator.inverse(Prime()), Prime());
+    // Fixed size little endian encoding; a positive value below the prime
+    // fits, getvch only adds a zero sign byte at the top
+    std::vector<unsigned char> vch = value.getvch();
+    vch.resize(ELEMENT_SIZE, 0);
+    uint256 hash;
+    CSHA256().Write(&vch[0], vch.size()).Finalize((unsigned char*)&hash);
+    return hash;
+}
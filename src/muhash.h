@@ -0,0 +1,61 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MUHASH_H
+#define BITCOIN_MUHASH_H
+
+#include "libzerocoin/bignum.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stddef.h>
+
+/**
+ * Rolling hash of a set of byte strings, the product of a hash of each
+ * element modulo the prime 2^3072 - 1103717 (MuHash).
+ *
+ * Elements can be added and removed in any order, and two hashes can be
+ * combined, so the hash of a set can be kept up to date by applying the
+ * changes to it instead of hashing the whole set again. Removals are
+ * multiplied into a separate denominator, so that only Finalize() needs a
+ * modular inverse.
+ */
+class CMuHash3072
+{
+private:
+    CBigNum numerator;
+    CBigNum denominator;
+
+    //! Map a byte string to a number modulo the prime
+    static CBigNum ToElement(const unsigned char* data, size_t len);
+
+public:
+    //! Size of an element, in bytes
+    static const size_t ELEMENT_SIZE = 384;
+
+    //! The hash of the empty set
+    CMuHash3072();
+
+    CMuHash3072& Insert(const unsigned char* data, size_t len);
+    CMuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! Combine with the hash of another set; the sets must be disjoint
+    CMuHash3072& operator*=(const CMuHash3072& b);
+    //! Remove a set contained in this one
+    CMuHash3072& operator/=(const CMuHash3072& b);
+
+    //! Hash of the current set, the SHA256 of the normalized product
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_MUHASH_H
@@ -93,6 +93,7 @@ map<CInv, CDataStream> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
+CGossipFilter gossipFilter;
 
 static deque<string> vOneShots;
 CCriticalSection cs_vOneShots;
@@ -1750,6 +1751,79 @@ void RelayInv(CInv& inv)
     }
 }
 
+CGossipFilter::CGossipFilter() : nElements(DEFAULT_GOSSIP_FILTER_SIZE), nMaxSeen(DEFAULT_MAX_GOSSIP_SEEN)
+{
+}
+
+bool CGossipFilter::IsFilteredType(int nType)
+{
+    return nType == MSG_BUDGET_VOTE || nType == MSG_BUDGET_FINALIZED_VOTE || nType == MSG_MASTERNODE_PING;
+}
+
+void CGossipFilter::SetSize(unsigned int nElementsIn)
+{
+    LOCK(cs);
+    nElements = std::max(nElementsIn, 1u);
+    mapFilters.clear();
+}
+
+void CGossipFilter::SetMaxSeen(unsigned int nMaxSeenIn)
+{
+    LOCK(cs);
+    nMaxSeen = std::max(nMaxSeenIn, 1u);
+}
+
+unsigned int CGossipFilter::GetMaxSeen() const
+{
+    LOCK(cs);
+    return nMaxSeen;
+}
+
+void CGossipFilter::insert(const CInv& inv)
+{
+    if (!IsFilteredType(inv.type))
+        return;
+
+    LOCK(cs);
+    std::map<int, CRollingBloomFilter>::iterator it = mapFilters.find(inv.type);
+    if (it == mapFilters.end())
+        it = mapFilters.insert(std::make_pair(inv.type, CRollingBloomFilter(nElements, GOSSIP_FILTER_FP_RATE, GetRand(std::numeric_limits<unsigned int>::max())))).first;
+    it->second.insert(inv.hash);
+}
+
+bool CGossipFilter::contains(const CInv& inv) const
+{
+    if (!IsFilteredType(inv.type))
+        return false;
+
+    LOCK(cs);
+    std::map<int, CRollingBloomFilter>::const_iterator it = mapFilters.find(inv.type);
+    return it != mapFilters.end() && it->second.contains(inv.hash);
+}
+
+void CGossipFilter::clear(int nType)
+{
+    LOCK(cs);
+    std::map<int, CRollingBloomFilter>::iterator it = mapFilters.find(nType);
+    if (it != mapFilters.end())
+        it->second.clear();
+}
+
+void CGossipFilter::clear()
+{
+    LOCK(cs);
+    mapFilters.clear();
+}
+
+size_t CGossipFilter::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    size_t nUsage = 0;
+    for (std::map<int, CRollingBloomFilter>::const_iterator it = mapFilters.begin(); it != mapFilters.end(); ++it)
+        nUsage += it->second.DynamicMemoryUsage();
+    return nUsage;
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
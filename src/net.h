@@ -21,6 +21,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
 #include <deque>
 #include <stdint.h>
 
@@ -61,6 +62,12 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** -maxgossipseen default, the number of items kept in each store of seen masternode pings and budget votes */
+static const unsigned int DEFAULT_MAX_GOSSIP_SEEN = 50000;
+/** -gossipfiltersize default, the number of items of each type remembered as seen once evicted from their store */
+static const unsigned int DEFAULT_GOSSIP_FILTER_SIZE = 10000;
+/** The false positive rate of the gossip filters, an item taken for seen is not fetched */
+static const double GOSSIP_FILTER_FP_RATE = 0.000001;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -186,6 +193,8 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
+    bool fSignatureQueued; // gossip signature already sent to be checked ahead of processing
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
@@ -193,6 +202,7 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fSignatureQueued = false;
     }
 
     bool complete() const
@@ -661,6 +671,66 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll = false);
 void RelayInv(CInv& inv);
 
+/**
+ * Keeps the stores of seen masternode pings and budget votes to at most
+ * -maxgossipseen items each, and remembers the items evicted from them in a
+ * rolling bloom filter of each inventory type, so AlreadyHave does not ask
+ * for them again. Only those types are filtered: a false positive there
+ * drops one ping or vote among many, which the next one makes up for. A
+ * spork, broadcast, proposal, finalized budget or winner taken for seen by
+ * mistake would be lost, so their stores are left to the managers.
+ */
+class CGossipFilter
+{
+private:
+    mutable CCriticalSection cs;
+    unsigned int nElements;
+    unsigned int nMaxSeen;
+    std::map<int, CRollingBloomFilter> mapFilters;
+
+public:
+    CGossipFilter();
+
+    static bool IsFilteredType(int nType);
+
+    void SetSize(unsigned int nElementsIn);
+    void SetMaxSeen(unsigned int nMaxSeenIn);
+    unsigned int GetMaxSeen() const;
+    void insert(const CInv& inv);
+    bool contains(const CInv& inv) const;
+    //! Forget every item of a type
+    void clear(int nType);
+    void clear();
+    size_t DynamicMemoryUsage() const;
+
+    /**
+     * Once mapSeen holds more than -maxgossipseen items, evict the oldest by
+     * pTime down to nine tenths of it, remembering them in the filter of
+     * nType. Returns the number of items evicted.
+     */
+    template <typename T>
+    size_t Limit(std::map<uint256, T>& mapSeen, int nType, int64_t T::*pTime)
+    {
+        size_t nMax = GetMaxSeen();
+        if (mapSeen.size() <= nMax)
+            return 0;
+
+        std::vector<std::pair<int64_t, uint256> > vAge;
+        vAge.reserve(mapSeen.size());
+        for (typename std::map<uint256, T>::const_iterator it = mapSeen.begin(); it != mapSeen.end(); ++it)
+            vAge.push_back(std::make_pair(it->second.*pTime, it->first));
+        size_t nEvict = mapSeen.size() - nMax + nMax / 10;
+        std::nth_element(vAge.begin(), vAge.begin() + nEvict, vAge.end());
+        for (size_t i = 0; i < nEvict; i++) {
+            mapSeen.erase(vAge[i].second);
+            insert(CInv(nType, vAge[i].second));
+        }
+        return nEvict;
+    }
+};
+
+extern CGossipFilter gossipFilter;
+
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
 {
@@ -5,10 +5,15 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "obfuscation.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "init.h"
 #include "main.h"
+#include "masternode-budget.h"
 #include "masternodeman.h"
+#include "random.h"
 #include "script/sign.h"
 #include "swifttx.h"
 #include "ui_interface.h"
@@ -17,8 +22,10 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <algorithm>
+#include <deque>
 #include <boost/assign/list_of.hpp>
 #include <openssl/rand.h>
 
@@ -2163,22 +2170,154 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
     return true;
 }
 
-bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+namespace {
+
+/**
+ * Keys recovered from message signatures, by a salted hash of the message hash and the
+ * signature. The same broadcast or vote arrives from several peers and is checked again
+ * when it is revisited; only the first check recovers the key. Signatures no key could be
+ * recovered from are not kept, and the oldest entries are dropped first.
+ */
+class CVerifiedMessageCache
+{
+private:
+    //! entries are already salted hashes
+    struct EntryHasher {
+        size_t operator()(const uint256& entry) const { return ReadLE64(entry.begin()); }
+    };
+
+    CCriticalSection cs;
+    boost::unordered_map<uint256, CKeyID, EntryHasher> mapKeys;
+    std::deque<uint256> dequeEntries;
+    CSHA256 hasherSalted;
+
+public:
+    CVerifiedMessageCache()
+    {
+        uint256 salt = GetRandHash();
+        hasherSalted.Write(salt.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig) const
+    {
+        CSHA256(hasherSalted).Write(hash.begin(), 32).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, CKeyID& keyIDRet)
+    {
+        LOCK(cs);
+        boost::unordered_map<uint256, CKeyID, EntryHasher>::const_iterator it = mapKeys.find(entry);
+        if (it == mapKeys.end())
+            return false;
+        keyIDRet = it->second;
+        return true;
+    }
+
+    void Set(const uint256& entry, const CKeyID& keyID)
+    {
+        LOCK(cs);
+        if (!mapKeys.insert(std::make_pair(entry, keyID)).second)
+            return;
+        dequeEntries.push_back(entry);
+        while (dequeEntries.size() > OBFUSCATION_VERIFY_CACHE_SIZE) {
+            mapKeys.erase(dequeEntries.front());
+            dequeEntries.pop_front();
+        }
+    }
+};
+
+CVerifiedMessageCache verifiedMessageCache;
+
+bool VerifySignedMessage(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const std::string& strMessage, std::string& errorMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    uint256 hash = ss.GetHash();
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
-        errorMessage = _("Error recovering public key.");
-        return false;
+    uint256 entry;
+    verifiedMessageCache.ComputeEntry(entry, hash, vchSig);
+
+    CKeyID keyID;
+    if (!verifiedMessageCache.Get(entry, keyID)) {
+        CPubKey pubkey2;
+        if (!pubkey2.RecoverCompact(hash, vchSig)) {
+            errorMessage = _("Error recovering public key.");
+            return false;
+        }
+        keyID = pubkey2.GetID();
+        verifiedMessageCache.Set(entry, keyID);
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    return (keyID == pubkey.GetID());
+}
+
+/** Closure checking one message of a batch, for the message check queue */
+class CSignedMessageCheck
+{
+private:
+    const CSignedMessage* pmessage;
+    char* pfValid;
+
+public:
+    CSignedMessageCheck() : pmessage(NULL), pfValid(NULL) {}
+    CSignedMessageCheck(const CSignedMessage& messageIn, char& fValidIn) : pmessage(&messageIn), pfValid(&fValidIn) {}
+
+    bool operator()()
+    {
+        std::string errorMessage;
+        *pfValid = VerifySignedMessage(pmessage->pubkey, pmessage->vchSig, pmessage->strMessage, errorMessage);
+        // an invalid message does not stop the others of its batch from being checked
+        return true;
+    }
+
+    void swap(CSignedMessageCheck& check)
+    {
+        std::swap(pmessage, check.pmessage);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
+CCheckQueue<CSignedMessageCheck> messagecheckqueue(128);
+// the queue takes one batch at a time
+CCriticalSection cs_messagecheckqueue;
+
+}
+
+void ThreadMessageCheck()
+{
+    RenameThread("xuez-msgcheck");
+    messagecheckqueue.Thread();
+}
+
+bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    return VerifySignedMessage(pubkey, vchSig, strMessage, errorMessage);
+}
+
+int CObfuScationSigner::VerifyMessages(const std::vector<CSignedMessage>& vMessages, std::vector<char>& vValid)
+{
+    vValid.assign(vMessages.size(), false);
+
+    std::vector<CSignedMessageCheck> vChecks;
+    vChecks.reserve(vMessages.size());
+    for (size_t i = 0; i < vMessages.size(); i++)
+        vChecks.push_back(CSignedMessageCheck(vMessages[i], vValid[i]));
+
+    if (vChecks.size() >= OBFUSCATION_PARALLEL_VERIFY_MIN) {
+        LOCK(cs_messagecheckqueue);
+        CCheckQueueControl<CSignedMessageCheck> control(&messagecheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        BOOST_FOREACH (CSignedMessageCheck& check, vChecks)
+            check();
+    }
+
+    return std::count(vValid.begin(), vValid.end(), true);
 }
 
 bool CObfuscationQueue::Sign()
@@ -2309,10 +2448,14 @@ void ThreadCheckObfuScationPool()
                 mnodeman.CheckAndRemove();
                 mnodeman.ProcessMasternodeConnections();
                 masternodePayments.CleanPaymentList();
-                CleanTransactionLocksList();
+                swiftTxManager.CleanTransactionLocksList();
             }
 
-            //if(c % MASTERNODES_DUMP_SECONDS == 0) DumpMasternodes();
+            if (c % MASTERNODES_DUMP_SECONDS == 0) {
+                DumpMasternodes();
+                DumpBudgets();
+                DumpMasternodePayments();
+            }
 
             obfuScationPool.CheckTimeout();
             obfuScationPool.CheckForCompleteQueue();
@@ -42,6 +42,13 @@ class CActiveMasternode;
 #define OBFUSCATION_QUEUE_TIMEOUT 30
 #define OBFUSCATION_SIGNING_TIMEOUT 15
 
+// verified message signatures kept for CObfuScationSigner::VerifyMessage
+#define OBFUSCATION_VERIFY_CACHE_SIZE 50000
+// batches of message signatures smaller than this are checked on the calling thread
+#define OBFUSCATION_PARALLEL_VERIFY_MIN 16
+// most threads checking message signatures, the message handler thread included
+#define OBFUSCATION_PARALLEL_VERIFY_THREADS 8
+
 // used for anonymous relaying of inputs/outputs/sigs
 #define OBFUSCATION_RELAY_IN 1
 #define OBFUSCATION_RELAY_OUT 2
@@ -245,6 +252,17 @@ public:
 
 /** Helper object for signing and checking signatures
  */
+/** A message signed with a masternode or collateral key, to check in a batch
+ */
+struct CSignedMessage {
+    CPubKey pubkey;
+    std::vector<unsigned char> vchSig;
+    std::string strMessage;
+
+    CSignedMessage() {}
+    CSignedMessage(const CPubKey& pubkeyIn, const std::vector<unsigned char>& vchSigIn, const std::string& strMessageIn) : pubkey(pubkeyIn), vchSig(vchSigIn), strMessage(strMessageIn) {}
+};
+
 class CObfuScationSigner
 {
 public:
@@ -258,6 +276,8 @@ public:
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Verify many messages on the message check workers, setting vValid for each one; the keys found are cached for VerifyMessage. Returns the number of valid messages
+    int VerifyMessages(const std::vector<CSignedMessage>& vMessages, std::vector<char>& vValid);
 };
 
 /** Used to keep track of current status of Obfuscation pool
@@ -513,5 +533,7 @@ public:
 };
 
 void ThreadCheckObfuScationPool();
+/** Run a worker of the queue checking the signatures of CObfuScationSigner::VerifyMessages */
+void ThreadMessageCheck();
 
 #endif
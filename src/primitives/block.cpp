@@ -14,12 +14,100 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <assert.h>
+#include <atomic>
+#include <string.h>
+
+namespace
+{
+/** Number of header hashes remembered, a power of two */
+const unsigned int HEADER_HASH_CACHE_SIZE = 1024;
+/** Size of the hashed part of a version 4 header, in 8 byte words */
+const unsigned int MAX_HASHED_HEADER_WORDS = 14;
+
+/**
+ * XEVAN is slow, and validating and indexing a block hashes its header many
+ * times over. Recent hashes are kept in a direct mapped table keyed by all of
+ * the hashed bytes, so a header that was changed since it was hashed (as when
+ * mining) simply misses.
+ *
+ * Every block import thread hashes headers, so the table takes no lock: each
+ * entry has a sequence number that is odd while it is written, a lookup that
+ * sees it change takes the entry as a miss, and a thread that finds an entry
+ * being written does not cache its hash.
+ */
+class CHeaderHashCache
+{
+private:
+    struct CEntry {
+        std::atomic<uint32_t> nSequence;
+        //! hashed bytes, 0 for an empty entry
+        std::atomic<uint32_t> nSize;
+        std::atomic<uint64_t> vHeader[MAX_HASHED_HEADER_WORDS];
+        std::atomic<uint64_t> vHash[4];
+
+        CEntry() : nSequence(0), nSize(0) {}
+    };
+
+    CEntry vEntries[HEADER_HASH_CACHE_SIZE];
+
+public:
+    uint256 Hash(const CBlockHeader& header, const char* pbegin, const char* pend)
+    {
+        unsigned int nSize = pend - pbegin;
+        assert(nSize <= sizeof(uint64_t) * MAX_HASHED_HEADER_WORDS);
+        uint64_t vHeader[MAX_HASHED_HEADER_WORDS] = {};
+        memcpy(vHeader, pbegin, nSize);
+        CEntry& entry = vEntries[(header.hashMerkleRoot.GetLow64() ^ header.nNonce ^ header.nTime) & (HEADER_HASH_CACHE_SIZE - 1)];
+
+        uint32_t nSequence = entry.nSequence.load(std::memory_order_acquire);
+        if ((nSequence & 1) == 0 && entry.nSize.load(std::memory_order_relaxed) == nSize) {
+            bool fMatch = true;
+            for (unsigned int i = 0; i < MAX_HASHED_HEADER_WORDS && fMatch; i++)
+                fMatch = entry.vHeader[i].load(std::memory_order_relaxed) == vHeader[i];
+            uint64_t vHash[4];
+            for (unsigned int i = 0; i < 4; i++)
+                vHash[i] = entry.vHash[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (fMatch && entry.nSequence.load(std::memory_order_relaxed) == nSequence) {
+                uint256 hash;
+                memcpy(hash.begin(), vHash, 32);
+                return hash;
+            }
+        }
+
+        uint256 hash = XEVAN(pbegin, pend);
+
+        nSequence = entry.nSequence.load(std::memory_order_relaxed);
+        if ((nSequence & 1) == 0 && entry.nSequence.compare_exchange_strong(nSequence, nSequence + 1, std::memory_order_relaxed)) {
+            std::atomic_thread_fence(std::memory_order_release);
+            uint64_t vHash[4];
+            memcpy(vHash, hash.begin(), 32);
+            entry.nSize.store(nSize, std::memory_order_relaxed);
+            for (unsigned int i = 0; i < MAX_HASHED_HEADER_WORDS; i++)
+                entry.vHeader[i].store(vHeader[i], std::memory_order_relaxed);
+            for (unsigned int i = 0; i < 4; i++)
+                entry.vHash[i].store(vHash[i], std::memory_order_relaxed);
+            entry.nSequence.store(nSequence + 2, std::memory_order_release);
+        }
+        return hash;
+    }
+};
+
+//! Constructed on first use, as the genesis blocks are hashed during static initialization
+CHeaderHashCache& GetHeaderHashCache()
+{
+    static CHeaderHashCache cache;
+    return cache;
+}
+} // anon namespace
+
 uint256 CBlockHeader::GetHash() const
 {
 	if(nVersion < 4)
-        return XEVAN(BEGIN(nVersion), END(nNonce));
+        return GetHeaderHashCache().Hash(*this, BEGIN(nVersion), END(nNonce));
 
-    return XEVAN(BEGIN(nVersion), END(nAccumulatorCheckpoint));	
+    return GetHeaderHashCache().Hash(*this, BEGIN(nVersion), END(nAccumulatorCheckpoint));
 }
 
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
@@ -579,7 +579,7 @@ void PrivacyDialog::setBalance(const CAmount& balance, const CAmount& unconfirme
             CBlockIndex *pindex = chainActive[mint.GetHeight() + 1];
             int nMintsAdded = 0;
             while (pindex->nHeight < chainActive.Height() - 30) { // 30 just to make sure that its at least 2 checkpoints from the top block
-                nMintsAdded += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), mint.GetDenomination());
+                nMintsAdded += pindex->vZerocoinMints.Get(mint.GetDenomination());
                 if (nMintsAdded >= Params().Zerocoin_RequiredAccumulation())
                     break;
                 pindex = chainActive[pindex->nHeight + 1];
@@ -96,7 +96,7 @@ void ZXUEZControlDialog::updateList()
         if(mint.GetHeight() != 0 && mint.GetHeight() < chainActive.Height() - 2) {
             CBlockIndex *pindex = chainActive[mint.GetHeight() + 1];
             while(pindex->nHeight < chainActive.Height() - 30) { // 30 just to make sure that its at least 2 checkpoints from the top block
-                nMintsAdded += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), mint.GetDenomination());
+                nMintsAdded += pindex->vZerocoinMints.Get(mint.GetDenomination());
                 if(nMintsAdded >= Params().Zerocoin_RequiredAccumulation())
                     break;
                 pindex = chainActive[pindex->nHeight + 1];
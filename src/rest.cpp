@@ -105,7 +105,7 @@ static bool rest_block(AcceptedConnection* conn,
     if (!ParseHashStr(hashStr, hash))
         throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
+    std::vector<char> vchBlock;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -113,12 +113,12 @@ static bool rest_block(AcceptedConnection* conn,
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
 
         pblockindex = mapBlockIndex[hash];
-        if (!ReadBlockFromDisk(block, pblockindex))
+        if (!ReadRawBlockFromDisk(vchBlock, pblockindex))
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
+    // The block is stored the way it is serialized on the network
+    CDataStream ssBlock(vchBlock, SER_NETWORK, PROTOCOL_VERSION);
 
     switch (rf) {
     case RF_BINARY: {
@@ -134,6 +134,8 @@ static bool rest_block(AcceptedConnection* conn,
     }
 
     case RF_JSON: {
+        CBlock block;
+        ssBlock >> block;
         Object objBlock = blockToJSON(block, pblockindex, showTxDetails);
         string strJSON = write_string(Value(objBlock), false) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
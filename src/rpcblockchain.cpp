@@ -7,10 +7,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "checkpoints.h"
+#include "coinsflusher.h"
 #include "main.h"
 #include "rpcserver.h"
+#include "txdb.h"
 #include "sync.h"
 #include "util.h"
+#include "utxostats.h"
 
 #include <stdint.h>
 
@@ -127,7 +130,7 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDe
 
     Object zXUEZObj;
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zXUEZObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zXUEZObj.push_back(Pair(to_string(denom), ValueFromAmount(blockindex->vZerocoinSupply.Get(denom) * (denom*COIN))));
     }
     zXUEZObj.emplace_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
     result.emplace_back(Pair("zXUEZsupply", zXUEZObj));
@@ -212,10 +215,17 @@ Value getrawmempool(const Array& params, bool fHelp)
             "  \"transactionid\" : {       (json object)\n"
             "    \"size\" : n,             (numeric) transaction size in bytes\n"
             "    \"fee\" : n,              (numeric) transaction fee in xuez\n"
+            "    \"modifiedfee\" : n,      (numeric) transaction fee with fee deltas used for mining priority\n"
             "    \"time\" : n,             (numeric) local time transaction entered pool in seconds since 1 Jan 1970 GMT\n"
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) modified fees (see above) of in-mempool descendants (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) modified fees (see above) of in-mempool ancestors (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -231,16 +241,22 @@ Value getrawmempool(const Array& params, bool fHelp)
     if (fVerbose) {
         LOCK(mempool.cs);
         Object o;
-        BOOST_FOREACH (const PAIRTYPE(uint256, CTxMemPoolEntry) & entry, mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
+        BOOST_FOREACH (const CTxMemPoolEntry& e, mempool.mapTx) {
+            const uint256& hash = e.GetTx().GetHash();
             Object info;
             info.push_back(Pair("size", (int)e.GetTxSize()));
             info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+            info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
             info.push_back(Pair("time", e.GetTime()));
             info.push_back(Pair("height", (int)e.GetHeight()));
             info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
             info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+            info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+            info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+            info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
             const CTransaction& tx = e.GetTx();
             set<string> setDepends;
             BOOST_FOREACH (const CTxIn& txin, tx.vin) {
@@ -345,16 +361,16 @@ Value getblock(const Array& params, bool fHelp)
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (!ReadBlockFromDisk(block, pblockindex))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (!fVerbose) {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        std::vector<char> vchBlock;
+        if (!ReadRawBlockFromDisk(vchBlock, pblockindex))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        return HexStr(vchBlock.begin(), vchBlock.end());
     }
 
+    if (!ReadBlockFromDisk(block, pblockindex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex);
 }
 
@@ -410,35 +426,61 @@ Value getblockheader(const Array& params, bool fHelp)
 
 Value gettxoutsetinfo(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( full )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The statistics are kept up to date as blocks are connected. With full set, or while they\n"
+            "are still being computed at startup, the coin database is scanned, which may take some time.\n"
+            "\nArguments:\n"
+            "1. full    (boolean, optional, default=false) Scan the coin database\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, only for a scan\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, only for a scan\n"
+            "  \"muhash\": \"hash\",   (string) The rolling hash of the unspent outputs\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "true") + HelpExampleRpc("gettxoutsetinfo", ""));
+
+    bool fFull = params.size() > 0 && params[0].get_bool();
 
     Object ret;
 
+    CUtxoStats utxo;
+    if (!fFull && utxoStats.Get(utxo)) {
+        int nHeight = 0;
+        {
+            LOCK(cs_main);
+            BlockMap::const_iterator mi = mapBlockIndex.find(utxo.hashBlock);
+            if (mi != mapBlockIndex.end())
+                nHeight = mi->second->nHeight;
+        }
+        ret.push_back(Pair("height", (int64_t)nHeight));
+        ret.push_back(Pair("bestblock", utxo.hashBlock.GetHex()));
+        ret.push_back(Pair("txouts", utxo.nTransactionOutputs));
+        ret.push_back(Pair("bytes_serialized", utxo.nSerializedSize));
+        ret.push_back(Pair("muhash", utxo.muhash.Finalize().GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(utxo.nTotalAmount)));
+        return ret;
+    }
+
+    // Scan the coin database without holding cs_main
     CCoinsStats stats;
     FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    if (pcoinsFlusher->GetStats(stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
         ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("muhash", stats.muhash.Finalize().GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
@@ -469,7 +511,6 @@ Value gettxout(const Array& params, bool fHelp)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "}\n"
 
@@ -488,33 +529,33 @@ Value gettxout(const Array& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
-    CCoins coins;
+    if (n < 0)
+        return Value::null;
+    COutPoint out(hash, n);
+
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out))
             return Value::null;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin))
             return Value::null;
     }
-    if (n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull())
-        return Value::null;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex* pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+        ret.push_back(Pair("confirmations", pindex->nHeight - (int)coin.nHeight + 1));
+    ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
     Object o;
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
+    ret.push_back(Pair("coinbase", coin.fCoinBase));
 
     return ret;
 }
@@ -555,6 +596,16 @@ Value getblockchaininfo(const Array& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"coinsflush\": {           (object) writes of the coin database cache\n"
+            "     \"flushes\": xxxx,       (numeric) number of writes since startup\n"
+            "     \"pending\": true|false, (boolean) whether a write is in progress\n"
+            "     \"lastcoins\": xxxx,     (numeric) coins in the last write\n"
+            "     \"lastbytes\": xxxx,     (numeric) bytes in the last write\n"
+            "     \"lastduration\": xxxx,  (numeric) duration of the last write in milliseconds\n"
+            "     \"totalbytes\": xxxx,    (numeric) bytes in all writes\n"
+            "     \"totalduration\": xxxx, (numeric) duration of all writes in milliseconds\n"
+            "     \"totalwait\": xxxx      (numeric) milliseconds validation waited for a previous write\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -567,9 +618,106 @@ Value getblockchaininfo(const Array& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    if (pcoinsFlusher != NULL) {
+        CCoinsFlushStats stats = pcoinsFlusher->GetFlushStats();
+        Object flush;
+        flush.push_back(Pair("flushes", (int64_t)stats.nFlushes));
+        flush.push_back(Pair("pending", stats.fPending));
+        flush.push_back(Pair("lastcoins", (int64_t)stats.nLastCoins));
+        flush.push_back(Pair("lastbytes", (int64_t)stats.nLastBytes));
+        flush.push_back(Pair("lastduration", 0.001 * stats.nLastDuration));
+        flush.push_back(Pair("totalbytes", (int64_t)stats.nTotalBytes));
+        flush.push_back(Pair("totalduration", 0.001 * stats.nTotalDuration));
+        flush.push_back(Pair("totalwait", 0.001 * stats.nTotalWait));
+        obj.push_back(Pair("coinsflush", flush));
+    }
     return obj;
 }
 
+Value getleveldbstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getleveldbstats\n"
+            "Returns the settings and statistics of the open LevelDB databases.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",          (string) profile of the database (chainstate, blockindex, zerocoin, sporks)\n"
+            "    \"path\": \"xxxx\",          (string) directory of the database\n"
+            "    \"profile\": {               (object) settings, see -leveldbopt\n"
+            "      \"blockcache\": xx,        (numeric) percentage of the cache used for the block cache\n"
+            "      \"bloombits\": xx,         (numeric) bits per key of the bloom filters\n"
+            "      \"maxopenfiles\": xx,      (numeric) maximum number of open table files\n"
+            "      \"blocksize\": xx,         (numeric) size of a table block in bytes\n"
+            "      \"verifychecksums\": true|false (boolean) whether reads verify checksums\n"
+            "    },\n"
+            "    \"reads\": xxxx,             (numeric) number of lookups since startup\n"
+            "    \"reads_notfound\": xxxx,    (numeric) lookups of keys that are not there\n"
+            "    \"writes\": xxxx,            (numeric) number of batches written\n"
+            "    \"write_bytes\": xxxx,       (numeric) key and value bytes written\n"
+            "    \"write_time\": xxxx,        (numeric) time spent writing in milliseconds\n"
+            "    \"slow_writes\": xxxx,       (numeric) writes that stalled, mostly waiting for compactions\n"
+            "    \"cache_hits\": xxxx,        (numeric) table blocks found in the block cache\n"
+            "    \"cache_misses\": xxxx,      (numeric) table blocks read from disk\n"
+            "    \"cache_hit_rate\": x.xx,    (numeric) fraction of the block cache lookups that hit\n"
+            "    \"approximate_size\": xxxx,  (numeric) approximate size on disk in bytes\n"
+            "    \"levels\": [                (array) levels that have files or compactions\n"
+            "      {\n"
+            "        \"level\": x,            (numeric) the level\n"
+            "        \"files\": xx,           (numeric) number of table files\n"
+            "        \"size_mb\": x.xx,       (numeric) size of the level in MiB\n"
+            "        \"compaction_time\": x.xx, (numeric) seconds spent compacting into the level\n"
+            "        \"compaction_read_mb\": x.xx, (numeric) MiB read by those compactions\n"
+            "        \"compaction_write_mb\": x.xx (numeric) MiB written by those compactions\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getleveldbstats", "") + HelpExampleRpc("getleveldbstats", ""));
+
+    Array ret;
+    std::vector<CLevelDBStats> vStats = GetLevelDBStats();
+    BOOST_FOREACH (const CLevelDBStats& stats, vStats) {
+        Object obj;
+        obj.push_back(Pair("name", stats.profile.strName));
+        obj.push_back(Pair("path", stats.strPath));
+        Object profile;
+        profile.push_back(Pair("blockcache", stats.profile.nBlockCachePercent));
+        profile.push_back(Pair("bloombits", stats.profile.nBloomBits));
+        profile.push_back(Pair("maxopenfiles", stats.profile.nMaxOpenFiles));
+        profile.push_back(Pair("blocksize", stats.profile.nBlockSize));
+        profile.push_back(Pair("verifychecksums", stats.profile.fVerifyChecksums));
+        obj.push_back(Pair("profile", profile));
+        obj.push_back(Pair("reads", (int64_t)stats.nReads));
+        obj.push_back(Pair("reads_notfound", (int64_t)stats.nReadsNotFound));
+        obj.push_back(Pair("writes", (int64_t)stats.nWrites));
+        obj.push_back(Pair("write_bytes", (int64_t)stats.nWriteBytes));
+        obj.push_back(Pair("write_time", stats.nWriteTime / 1000));
+        obj.push_back(Pair("slow_writes", (int64_t)stats.nSlowWrites));
+        obj.push_back(Pair("cache_hits", (int64_t)stats.nCacheHits));
+        obj.push_back(Pair("cache_misses", (int64_t)stats.nCacheMisses));
+        uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+        obj.push_back(Pair("cache_hit_rate", nLookups == 0 ? 0.0 : (double)stats.nCacheHits / nLookups));
+        obj.push_back(Pair("approximate_size", (int64_t)stats.nApproximateSize));
+        Array levels;
+        BOOST_FOREACH (const CLevelDBLevelStats& level, stats.vLevels) {
+            Object objLevel;
+            objLevel.push_back(Pair("level", level.nLevel));
+            objLevel.push_back(Pair("files", level.nFiles));
+            objLevel.push_back(Pair("size_mb", level.dSizeMB));
+            objLevel.push_back(Pair("compaction_time", level.dCompactionSeconds));
+            objLevel.push_back(Pair("compaction_read_mb", level.dCompactionReadMB));
+            objLevel.push_back(Pair("compaction_write_mb", level.dCompactionWriteMB));
+            levels.push_back(objLevel);
+        }
+        obj.push_back(Pair("levels", levels));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 /** Comparison function for sorting the getchaintips heads.  */
 struct CompareBlocksByHeight {
     bool operator()(const CBlockIndex* a, const CBlockIndex* b) const
@@ -678,6 +826,9 @@ Value getmempoolinfo(const Array& params, bool fHelp)
             "{\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
+            "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") + HelpExampleRpc("getmempoolinfo", ""));
@@ -685,10 +836,32 @@ Value getmempoolinfo(const Array& params, bool fHelp)
     Object ret;
     ret.push_back(Pair("size", (int64_t)mempool.size()));
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
+    ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t)maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
     return ret;
 }
 
+Value savemempool(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "savemempool\n"
+            "\nDumps the mempool to disk.\n"
+            "\nExamples:\n" +
+            HelpExampleCli("savemempool", "") + HelpExampleRpc("savemempool", ""));
+
+    if (!mempool.IsLoaded())
+        throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
+
+    if (!DumpMempool())
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
+
+    return Value::null;
+}
+
 Value invalidateblock(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -846,8 +1019,7 @@ Value getinvalid (const Array& params, bool fHelp)
         //Check whether this bad outpoint has been spent
         bool fSpent = false;
         CCoinsViewCache cache(pcoinsTip);
-        const CCoins* coins = cache.AccessCoins(out.hash);
-        if (!coins || !coins->IsAvailable(out.n))
+        if (!cache.AccessCoin(out).IsAvailable())
             fSpent = true;
 
         objTx.emplace_back(Pair("spent", fSpent));
@@ -82,6 +82,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"sendrawtransaction", 1},
         {"gettxout", 1},
         {"gettxout", 2},
+        {"gettxoutsetinfo", 0},
         {"lockunspent", 0},
         {"lockunspent", 1},
         {"importprivkey", 2},
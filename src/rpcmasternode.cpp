@@ -13,6 +13,7 @@
 #include "masternodeconfig.h"
 #include "masternodeman.h"
 #include "rpcserver.h"
+#include "swifttx.h"
 #include "utilmoneystr.h"
 
 #include <boost/tokenizer.hpp>
@@ -128,6 +129,64 @@ Value getpoolinfo(const Array& params, bool fHelp)
     return obj;
 }
 
+Value getswiftxinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getswiftxinfo\n"
+            "\nReturns SwiftX lock statistics, with the time from lock request to complete lock\n"
+            "of the last " + boost::lexical_cast<std::string>(SWIFTTX_LATENCY_SAMPLES) + " locks\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"locks\": n,           (numeric) Number of transaction locks kept\n"
+            "  \"lockedinputs\": n,    (numeric) Number of inputs spent by complete locks\n"
+            "  \"completelocks\": n,   (numeric) Number of wallet transactions locked since startup\n"
+            "  \"samples\": n,         (numeric) Number of lock latencies below\n"
+            "  \"p50\": n,             (numeric) Median lock latency in ms\n"
+            "  \"p99\": n,             (numeric) 99th percentile lock latency in ms\n"
+            "  \"max\": n,             (numeric) Highest lock latency in ms\n"
+            "  \"histogram\": [        (array) Lock latencies by bucket\n"
+            "    {\n"
+            "      \"upto\": n,        (numeric) Upper bound of the bucket in ms, -1 for the last one\n"
+            "      \"count\": n        (numeric) Number of lock latencies in the bucket\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getswiftxinfo", "") + HelpExampleRpc("getswiftxinfo", ""));
+
+    std::vector<int64_t> vLatencies = swiftTxManager.GetLockLatencies();
+
+    Object obj;
+    obj.push_back(Pair("locks", swiftTxManager.CountLocks()));
+    obj.push_back(Pair("lockedinputs", swiftTxManager.CountLockedInputs()));
+    obj.push_back(Pair("completelocks", nCompleteTXLocks));
+    obj.push_back(Pair("samples", (int)vLatencies.size()));
+    obj.push_back(Pair("p50", vLatencies.empty() ? 0 : vLatencies[vLatencies.size() * 50 / 100]));
+    obj.push_back(Pair("p99", vLatencies.empty() ? 0 : vLatencies[vLatencies.size() * 99 / 100]));
+    obj.push_back(Pair("max", vLatencies.empty() ? 0 : vLatencies.back()));
+
+    const int64_t vBuckets[] = {250, 500, 1000, 2000, 5000, 10000, 30000, 60000, -1};
+    Array histogram;
+    std::vector<int64_t>::const_iterator it = vLatencies.begin();
+    for (unsigned int i = 0; i < sizeof(vBuckets) / sizeof(vBuckets[0]); i++) {
+        int nCount = 0;
+        while (it != vLatencies.end() && (vBuckets[i] == -1 || *it <= vBuckets[i])) {
+            nCount++;
+            ++it;
+        }
+        Object bucket;
+        bucket.push_back(Pair("upto", vBuckets[i]));
+        bucket.push_back(Pair("count", nCount));
+        histogram.push_back(bucket);
+    }
+    obj.push_back(Pair("histogram", histogram));
+    return obj;
+}
+
 // This command is retained for backwards compatibility, but is depreciated.
 // Future removal of this command is planned to keep things clean.
 Value masternode(const Array& params, bool fHelp)
@@ -278,6 +337,7 @@ Value listmasternodes(const Array& params, bool fHelp)
         nHeight = pindex->nHeight;
     }
     std::vector<pair<int, CMasternode> > vMasternodeRanks = mnodeman.GetMasternodeRanks(nHeight);
+    int nEnabled = mnodeman.CountEnabled();
     BOOST_FOREACH (PAIRTYPE(int, CMasternode) & s, vMasternodeRanks) {
         Object obj;
         std::string strVin = s.second.vin.prevout.ToStringShort();
@@ -308,7 +368,7 @@ Value listmasternodes(const Array& params, bool fHelp)
             obj.push_back(Pair("version", mn->protocolVersion));
             obj.push_back(Pair("lastseen", (int64_t)mn->lastPing.sigTime));
             obj.push_back(Pair("activetime", (int64_t)(mn->lastPing.sigTime - mn->sigTime)));
-            obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid()));
+            obj.push_back(Pair("lastpaid", (int64_t)mn->GetLastPaid(nEnabled)));
 
             ret.push_back(obj);
         }
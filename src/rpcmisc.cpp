@@ -111,7 +111,7 @@ Value getinfo(const Array& params, bool fHelp)
     obj.push_back(Pair("moneysupply",ValueFromAmount(chainActive.Tip()->nMoneySupply)));
     Object zXUEZObj;
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zXUEZObj.push_back(Pair(to_string(denom), ValueFromAmount(chainActive.Tip()->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zXUEZObj.push_back(Pair(to_string(denom), ValueFromAmount(chainActive.Tip()->vZerocoinSupply.Get(denom) * (denom*COIN))));
     }
     zXUEZObj.emplace_back(Pair("total", ValueFromAmount(chainActive.Tip()->GetZerocoinSupply())));
     obj.emplace_back(Pair("zXUEZsupply", zXUEZObj));
@@ -168,6 +168,11 @@ Value mnsync(const Array& params, bool fHelp)
             "  \"countBudgetItemFin\": n,       (numeric) Number of MN budget finalization messages (local)\n"
             "  \"RequestedMasternodeAssets\": n, (numeric) Status code of last sync phase\n"
             "  \"RequestedMasternodeAttempt\": n, (numeric) Status code of last sync attempt\n"
+            "  \"pendingPeers\": n,             (numeric) Peers asked for the current sync phase that have not answered yet\n"
+            "  \"phases\": {                    (object) Milliseconds each sync phase took, the current one so far\n"
+            "    \"name\": n,                   (numeric) Duration of the phase (sporks, list, winners or budget)\n"
+            "    ,...\n"
+            "  }\n"
             "}\n"
 
             "\nResult ('reset' mode):\n"
@@ -195,6 +200,13 @@ Value mnsync(const Array& params, bool fHelp)
         obj.push_back(Pair("countBudgetItemFin", masternodeSync.countBudgetItemFin));
         obj.push_back(Pair("RequestedMasternodeAssets", masternodeSync.RequestedMasternodeAssets));
         obj.push_back(Pair("RequestedMasternodeAttempt", masternodeSync.RequestedMasternodeAttempt));
+        obj.push_back(Pair("pendingPeers", masternodeSync.CountPendingPeers()));
+
+        Object phases;
+        std::map<int, int64_t> mapDurations = masternodeSync.GetAssetDurations();
+        for (std::map<int, int64_t>::const_iterator it = mapDurations.begin(); it != mapDurations.end(); ++it)
+            phases.push_back(Pair(CMasternodeSync::GetAssetName(it->first), it->second));
+        obj.push_back(Pair("phases", phases));
 
         return obj;
     }
@@ -274,11 +274,13 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockhash", &getblockhash, true, false, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
+        {"blockchain", "getleveldbstats", &getleveldbstats, true, true, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
         {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
+        {"blockchain", "savemempool", &savemempool, true, true, false},
         {"blockchain", "gettxout", &gettxout, true, false, false},
-        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
+        {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, true, false},
         {"blockchain", "verifychain", &verifychain, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
@@ -348,6 +350,7 @@ static const CRPCCommand vRPCCommands[] =
         {"xuez", "mnsync", &mnsync, true, true, false},
         {"xuez", "spork", &spork, true, true, false},
         {"xuez", "getpoolinfo", &getpoolinfo, true, true, false},
+        {"xuez", "getswiftxinfo", &getswiftxinfo, true, true, false},
 #ifdef ENABLE_WALLET
         {"xuez", "obfuscation", &obfuscation, false, false, true}, /* not threadSafe because of SendMoney */
 
@@ -6,87 +6,64 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "sigcache.h"
+#include "sigcachetable.h"
 
 #include "pubkey.h"
-#include "random.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
-
 namespace {
 
 /**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
+ * Size of the cache in bytes. -sigcachesize is in MiB; -maxsigcachesize
+ * keeps its old meaning of a number of entries, so existing configurations
+ * get about the cache they asked for.
  */
-class CSignatureCache
+size_t GetSignatureCacheBytes()
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    int64_t nBytes;
+    if (mapArgs.count("-sigcachesize")) {
+        nBytes = std::min(std::max(GetArg("-sigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), (int64_t)0), (int64_t)MAX_MAX_SIG_CACHE_SIZE) << 20;
+    } else if (mapArgs.count("-maxsigcachesize")) {
+        int64_t nEntries = std::min(std::max(GetArg("-maxsigcachesize", 0), (int64_t)0), ((int64_t)MAX_MAX_SIG_CACHE_SIZE << 20) / (int64_t)CSignatureCache::GetEntrySize());
+        nBytes = nEntries * CSignatureCache::GetEntrySize();
+    } else {
+        nBytes = (int64_t)DEFAULT_MAX_SIG_CACHE_SIZE << 20;
     }
+    return (size_t)nBytes;
+}
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache(GetSignatureCacheBytes());
+    return signatureCache;
+}
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
-    }
-};
+}
 
+void InitSignatureCache()
+{
+    CSignatureCache& signatureCache = GetSignatureCache();
+    LogPrintf("Using %u MiB for the signature cache, able to store %u entries\n",
+        (unsigned int)(signatureCache.GetMemoryUsage() >> 20), (unsigned int)signatureCache.GetCapacity());
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
+
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // Signatures checked while connecting a block are not needed again, while
+    // a block that is only checked, such as a new template, leaves them cached
+    if (signatureCache.Get(entry, !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
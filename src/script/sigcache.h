@@ -14,6 +14,11 @@
 
 class CPubKey;
 
+/** Default for -sigcachesize, in MiB */
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Maximum for -sigcachesize, in MiB */
+static const unsigned int MAX_MAX_SIG_CACHE_SIZE = 256;
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -25,4 +30,7 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Allocate the signature cache at startup rather than on first use, sized by -sigcachesize, or by the legacy entry count of -maxsigcachesize */
+void InitSignatureCache();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,234 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2014 The Bitcoin developers
+// Copyright (c) 2017 The PIVX developers
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SCRIPT_SIGCACHETABLE_H
+#define BITCOIN_SCRIPT_SIGCACHETABLE_H
+
+#include "crypto/sha256.h"
+#include "pubkey.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+/** Number of independently locked parts of the cache, a power of two */
+static const unsigned int SIG_CACHE_SHARDS = 16;
+/** Number of slots an entry can be stored in */
+static const unsigned int SIG_CACHE_WAYS = 4;
+/** Longest chain of entries moved to make room for a new one */
+static const unsigned int SIG_CACHE_MAX_DEPTH = 8;
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain)
+ *
+ * Entries are a salted SHA256 of the (signature hash, public key, signature)
+ * triple, in a table of fixed size split in shards. An entry can be in one
+ * of SIG_CACHE_WAYS slots of its shard. Lookups take no lock: every slot
+ * has a sequence number that is odd while the slot is written, and a lookup
+ * that sees it change takes the slot as a miss. Inserts are serialized per
+ * shard.
+ *
+ * Eviction is by generation: a shard starts a new generation every time it
+ * has taken half as many entries as it has slots. Empty slots and those of
+ * entries two generations old are reused first. When all the slots of a new
+ * entry are recent, the entry in one of them is moved to another of its own
+ * slots, cuckoo style, and the last entry moved is dropped, never the new
+ * one. Entries found while connecting a block are removed, as they are not
+ * needed again.
+ */
+class CSignatureCache
+{
+private:
+    struct Slot {
+        //! odd while the slot is written
+        std::atomic<uint32_t> nSequence;
+        //! generation the entry was inserted in, 0 for an empty slot
+        std::atomic<uint32_t> nGeneration;
+        std::atomic<uint64_t> vKey[4];
+    };
+
+    struct Shard {
+        boost::mutex cs;
+        uint32_t nGeneration;
+        //! entries inserted in the current generation
+        size_t nInserted;
+
+        Shard() : nGeneration(1), nInserted(0) {}
+    };
+
+    //! SIG_CACHE_SHARDS runs of nSlotsPerShard slots
+    Slot* pSlots;
+    size_t nSlotsPerShard;
+    Shard vShards[SIG_CACHE_SHARDS];
+
+    //! hasher with the salt already written
+    CSHA256 hasherSalted;
+
+    static unsigned int GetShard(const uint64_t* pKey)
+    {
+        return pKey[0] & (SIG_CACHE_SHARDS - 1);
+    }
+
+    //! Slot of an entry in its shard for one of its ways, mapped to the range without a division
+    size_t GetSlot(const uint64_t* pKey, unsigned int nWay) const
+    {
+        return (size_t)(((pKey[nWay] >> 32) * (uint64_t)nSlotsPerShard) >> 32);
+    }
+
+    static bool Matches(const Slot& slot, const uint64_t* pKey)
+    {
+        return slot.vKey[0].load(std::memory_order_relaxed) == pKey[0] &&
+               slot.vKey[1].load(std::memory_order_relaxed) == pKey[1] &&
+               slot.vKey[2].load(std::memory_order_relaxed) == pKey[2] &&
+               slot.vKey[3].load(std::memory_order_relaxed) == pKey[3];
+    }
+
+    //! Store an entry in a slot. The shard lock must be held.
+    static void Write(Slot& slot, const uint64_t* pKey, uint32_t nGeneration)
+    {
+        uint32_t nSequence = slot.nSequence.load(std::memory_order_relaxed);
+        slot.nSequence.store(nSequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (unsigned int i = 0; i < 4; i++)
+            slot.vKey[i].store(pKey[i], std::memory_order_relaxed);
+        slot.nGeneration.store(nGeneration, std::memory_order_relaxed);
+        slot.nSequence.store(nSequence + 2, std::memory_order_release);
+    }
+
+public:
+    CSignatureCache(size_t nBytes) : pSlots(NULL), nSlotsPerShard(nBytes / sizeof(Slot) / SIG_CACHE_SHARDS)
+    {
+        if (nSlotsPerShard < SIG_CACHE_WAYS)
+            nSlotsPerShard = 0;
+        if (nSlotsPerShard > 0)
+            pSlots = new Slot[nSlotsPerShard * SIG_CACHE_SHARDS]();
+        uint256 salt = GetRandHash();
+        hasherSalted.Write(salt.begin(), 32);
+    }
+
+    ~CSignatureCache()
+    {
+        delete[] pSlots;
+    }
+
+    static size_t GetEntrySize()
+    {
+        return sizeof(Slot);
+    }
+
+    size_t GetCapacity() const
+    {
+        return nSlotsPerShard * SIG_CACHE_SHARDS;
+    }
+
+    size_t GetMemoryUsage() const
+    {
+        return GetCapacity() * sizeof(Slot);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+    {
+        // The length of a public key follows from its first byte, so the
+        // concatenation is unambiguous
+        CSHA256(hasherSalted).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, bool fErase)
+    {
+        if (nSlotsPerShard == 0)
+            return false;
+        uint64_t vKey[4];
+        memcpy(vKey, entry.begin(), 32);
+        Slot* pShard = pSlots + GetShard(vKey) * nSlotsPerShard;
+        for (unsigned int nWay = 0; nWay < SIG_CACHE_WAYS; nWay++) {
+            Slot& slot = pShard[GetSlot(vKey, nWay)];
+            uint32_t nSequence = slot.nSequence.load(std::memory_order_acquire);
+            if (nSequence & 1)
+                continue;
+            bool fMatch = slot.nGeneration.load(std::memory_order_relaxed) != 0 && Matches(slot, vKey);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!fMatch || slot.nSequence.load(std::memory_order_relaxed) != nSequence)
+                continue;
+            // Racing with a write to the slot at worst drops the new entry
+            if (fErase)
+                slot.nGeneration.store(0, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void Set(const uint256& entry)
+    {
+        if (nSlotsPerShard == 0)
+            return;
+        uint64_t vKey[4];
+        memcpy(vKey, entry.begin(), 32);
+        Shard& shard = vShards[GetShard(vKey)];
+        Slot* pShard = pSlots + GetShard(vKey) * nSlotsPerShard;
+
+        boost::unique_lock<boost::mutex> lock(shard.cs);
+        if (++shard.nInserted > nSlotsPerShard / 2) {
+            shard.nInserted = 0;
+            if (++shard.nGeneration == 0)
+                shard.nGeneration = 1;
+        }
+
+        // Another thread may have verified the same signature
+        for (unsigned int nWay = 0; nWay < SIG_CACHE_WAYS; nWay++) {
+            Slot& slot = pShard[GetSlot(vKey, nWay)];
+            if (slot.nGeneration.load(std::memory_order_relaxed) != 0 && Matches(slot, vKey)) {
+                slot.nGeneration.store(shard.nGeneration, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        uint32_t nGeneration = shard.nGeneration;
+        //! slot the new entry went to, which the chain must not take back
+        Slot* pSlotNew = NULL;
+        for (unsigned int nDepth = 0; nDepth < SIG_CACHE_MAX_DEPTH; nDepth++) {
+            for (unsigned int nWay = 0; nWay < SIG_CACHE_WAYS; nWay++) {
+                Slot& slot = pShard[GetSlot(vKey, nWay)];
+                uint32_t nSlotGeneration = slot.nGeneration.load(std::memory_order_relaxed);
+                if (&slot != pSlotNew && (nSlotGeneration == 0 || (uint32_t)(shard.nGeneration - nSlotGeneration) >= 2)) {
+                    Write(slot, vKey, nGeneration);
+                    return;
+                }
+            }
+
+            // Take the place of the entry in one of the slots, and find
+            // another one for that entry
+            Slot* pSlot = NULL;
+            for (unsigned int i = 0; i < SIG_CACHE_WAYS && pSlot == NULL; i++) {
+                Slot& slot = pShard[GetSlot(vKey, (vKey[1] + nDepth + i) % SIG_CACHE_WAYS)];
+                if (&slot != pSlotNew)
+                    pSlot = &slot;
+            }
+            if (pSlot == NULL)
+                break;
+            uint64_t vKeyMoved[4];
+            for (unsigned int i = 0; i < 4; i++)
+                vKeyMoved[i] = pSlot->vKey[i].load(std::memory_order_relaxed);
+            uint32_t nGenerationMoved = pSlot->nGeneration.load(std::memory_order_relaxed);
+            Write(*pSlot, vKey, nGeneration);
+            if (pSlotNew == NULL)
+                pSlotNew = pSlot;
+            memcpy(vKey, vKeyMoved, sizeof(vKey));
+            nGeneration = nGenerationMoved;
+        }
+        // The entry moved last found no room and is dropped, never the new
+        // one, which is the most likely to be looked up again
+    }
+};
+
+#endif // BITCOIN_SCRIPT_SIGCACHETABLE_H
@@ -15,17 +15,13 @@
 #include "spork.h"
 #include "sync.h"
 #include "util.h"
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 
 using namespace std;
 using namespace boost;
 
-std::map<uint256, CTransaction> mapTxLockReq;
-std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
-std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
+CSwiftTXManager swiftTxManager;
 int nCompleteTXLocks;
 
 //txlock - Locks transaction
@@ -35,7 +31,7 @@ int nCompleteTXLocks;
 //         Send "txvote", CTransaction, Signature, Approve
 //step 3.) Top 1 masternode, waits for SWIFTTX_SIGNATURES_REQUIRED messages. Upon success, sends "txlock'
 
-void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
+void CSwiftTXManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all obfuscation/masternode related functionality
     if (!IsSporkActive(SPORK_2_SWIFTTX)) return;
@@ -50,7 +46,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+        if (HaveLockRequest(tx.GetHash())) {
             return;
         }
 
@@ -82,7 +78,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            AddLockRequest(tx);
 
             LogPrintf("ProcessMessageSwiftTX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -91,7 +87,10 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            {
+                LOCK(cs);
+                mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            }
 
             // can we get the conflicting transaction as proof?
 
@@ -99,24 +98,17 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
                 tx.GetHash().ToString().c_str());
 
-            BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                if (!mapLockedInputs.count(in.prevout)) {
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
-                }
-            }
+            LockInputs(tx);
 
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()) {
-                //we only care if we have a complete tx lock
-                if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-                    if (!CheckForConflictingLocks(tx)) {
-                        LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
-                    }
+            //we only care if we have a complete tx lock
+            if (GetLockSignatures(tx.GetHash()) >= SWIFTTX_SIGNATURES_REQUIRED) {
+                if (!CheckForConflictingLocks(tx)) {
+                    LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
+
+                    //reprocess the last 15 blocks
+                    ReprocessBlocks(15);
+                    AddLockRequest(tx);
                 }
             }
 
@@ -130,12 +122,13 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
-            return;
+        {
+            LOCK(cs);
+            if (!mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx)).second) {
+                return;
+            }
         }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
-
         if (ProcessConsensusVote(pfrom, ctx)) {
             //Spam/Dos protection
             /*
@@ -143,19 +136,22 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 This tracks those messages and allows it at the same rate of the rest of the network, if
                 a peer violates it, it will simply be ignored
             */
-            if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
-                if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
-                }
+            {
+                LOCK(cs);
+                if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
+                    if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    }
 
-                if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
-                    LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
-                        ctx.vinMasternode.ToString().c_str(),
-                        ctx.txHash.ToString().c_str());
-                    return;
-                } else {
-                    mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    if (mapUnknownVotes[ctx.vinMasternode.prevout.hash] > GetTime() &&
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] - GetAverageVoteTime() > 60 * 10) {
+                        LogPrintf("ProcessMessageSwiftTX::ix - masternode is spamming transaction votes: %s %s\n",
+                            ctx.vinMasternode.ToString().c_str(),
+                            ctx.txHash.ToString().c_str());
+                        return;
+                    } else {
+                        mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
+                    }
                 }
             }
             RelayInv(inv);
@@ -212,7 +208,7 @@ bool IsIXTXValid(const CTransaction& txCollateral)
     return true;
 }
 
-int64_t CreateNewLock(CTransaction tx)
+int64_t CSwiftTXManager::CreateNewLock(CTransaction tx)
 {
     int64_t nTxAge = 0;
     BOOST_REVERSE_FOREACH (CTxIn i, tx.vin) {
@@ -231,30 +227,64 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
 
+    LOCK(cs);
     if (!mapTxLocks.count(tx.GetHash())) {
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
+    } else {
+        LogPrint("swiftx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
+    }
+    InsertLock(tx.GetHash(), nBlockHeight);
+
+    return nBlockHeight;
+}
+
+void CSwiftTXManager::AddLock(const uint256& txHash, int nBlockHeight)
+{
+    LOCK(cs);
+    InsertLock(txHash, nBlockHeight);
+}
+
+std::map<uint256, CTransactionLock>::iterator CSwiftTXManager::InsertLock(const uint256& txHash, int nBlockHeight)
+{
+    AssertLockHeld(cs);
 
+    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(txHash);
+    if (i == mapTxLocks.end()) {
         CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
+        newLock.txHash = txHash;
         newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
-    } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
-        LogPrint("swiftx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
+        i = mapTxLocks.insert(make_pair(txHash, newLock)).first;
+        SetLockExpiration((*i).second, GetTime() + (60 * 60)); //locks expire after 60 minutes (24 confirmations)
     }
 
+    if (nBlockHeight != 0) {
+        (*i).second.nBlockHeight = nBlockHeight;
+        if ((*i).second.nTimeRequested == 0)
+            (*i).second.nTimeRequested = GetTimeMillis();
+    }
 
-    return nBlockHeight;
+    return i;
+}
+
+void CSwiftTXManager::AddLockRequest(const CTransaction& tx)
+{
+    LOCK(cs);
+    mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+}
+
+void CSwiftTXManager::SetLockExpiration(CTransactionLock& lock, int64_t nExpiration)
+{
+    setLocksByExpiration.erase(make_pair((int64_t)lock.nExpiration, lock.txHash));
+    lock.nExpiration = nExpiration;
+    setLocksByExpiration.insert(make_pair(nExpiration, lock.txHash));
 }
 
 // check if we need to vote on this transaction
-void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
+void CSwiftTXManager::DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetVoterRank(activeMasternode.vin, nBlockHeight);
 
     if (n == -1) {
         LogPrint("swiftx", "SwiftX::DoConsensusVote - Unknown Masternode\n");
@@ -284,16 +314,19 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    {
+        LOCK(cs);
+        mapTxLockVote[ctx.GetHash()] = ctx;
+    }
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
 }
 
 //received a consensus vote
-bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
+bool CSwiftTXManager::ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetVoterRank(ctx.vinMasternode, ctx.nBlockHeight);
 
     CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
     if (pmn != NULL)
@@ -311,6 +344,7 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
+    // usually found in the signature cache, checked with the rest of the queued gossip on worker threads
     if (!ctx.SignatureValid()) {
         LogPrintf("SwiftX::ProcessConsensusVote - Signature invalid\n");
         // don't ban, it could just be a non-synced masternode
@@ -318,71 +352,166 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)) {
-        LogPrintf("SwiftX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
-    } else
-        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
-
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()) {
-        (*i).second.AddSignature(ctx);
+    int nSignatures;
+    {
+        LOCK(cs);
+        if (!mapTxLocks.count(ctx.txHash))
+            LogPrintf("SwiftX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+        else
+            LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
+
+        CTransactionLock& lock = InsertLock(ctx.txHash, 0)->second;
+        lock.AddSignature(ctx);
+        nSignatures = lock.CountSignatures();
+        if (nSignatures >= SWIFTTX_SIGNATURES_REQUIRED)
+            LockCompleted(lock);
+    }
 
 #ifdef ENABLE_WALLET
-        if (pwalletMain) {
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if (pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
+    if (pwalletMain) {
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if (pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
-        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+    LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
 
-        if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-            LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+    if (nSignatures >= SWIFTTX_SIGNATURES_REQUIRED) {
+        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if (!CheckForConflictingLocks(tx)) {
+        CTransaction tx;
+        bool fHaveRequest = GetLockRequest(ctx.txHash, tx);
+        if (!CheckForConflictingLocks(tx)) {
 #ifdef ENABLE_WALLET
-                if (pwalletMain) {
-                    if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
-                        nCompleteTXLocks++;
-                    }
+            if (pwalletMain) {
+                if (pwalletMain->UpdatedTransaction(ctx.txHash)) {
+                    nCompleteTXLocks++;
                 }
+            }
 #endif
 
-                if (mapTxLockReq.count(ctx.txHash)) {
-                    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-                        if (!mapLockedInputs.count(in.prevout)) {
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
-                }
+            if (fHaveRequest)
+                LockInputs(tx);
 
-                // resolve conflicts
+            // resolve conflicts
 
-                //if this tx lock was rejected, we need to remove the conflicting blocks
-                if (mapTxLockReqRejected.count((*i).second.txHash)) {
-                    //reprocess the last 15 blocks
-                    ReprocessBlocks(15);
-                }
+            //if this tx lock was rejected, we need to remove the conflicting blocks
+            bool fRejected;
+            {
+                LOCK(cs);
+                fRejected = mapTxLockReqRejected.count(ctx.txHash);
+            }
+            if (fRejected) {
+                //reprocess the last 15 blocks
+                ReprocessBlocks(15);
             }
         }
-        return true;
     }
 
+    return true;
+}
+
+bool CSwiftTXManager::HaveLockRequest(const uint256& txHash)
+{
+    LOCK(cs);
+    return mapTxLockReq.count(txHash) || mapTxLockReqRejected.count(txHash);
+}
+
+bool CSwiftTXManager::GetLockRequest(const uint256& txHash, CTransaction& tx)
+{
+    LOCK(cs);
+    std::map<uint256, CTransaction>::const_iterator it = mapTxLockReq.find(txHash);
+    if (it == mapTxLockReq.end())
+        return false;
+    tx = it->second;
+    return true;
+}
+
+bool CSwiftTXManager::HaveLockVote(const uint256& hash)
+{
+    LOCK(cs);
+    return mapTxLockVote.count(hash);
+}
+
+bool CSwiftTXManager::GetLockVote(const uint256& hash, CConsensusVote& vote)
+{
+    LOCK(cs);
+    std::map<uint256, CConsensusVote>::const_iterator it = mapTxLockVote.find(hash);
+    if (it == mapTxLockVote.end())
+        return false;
+    vote = it->second;
+    return true;
+}
+
+int CSwiftTXManager::GetLockSignatures(const uint256& txHash)
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(txHash);
+    if (it == mapTxLocks.end())
+        return -1;
+    return it->second.CountSignatures();
+}
+
+bool CSwiftTXManager::IsLockTimedOut(const uint256& txHash)
+{
+    LOCK(cs);
+    std::map<uint256, CTransactionLock>::const_iterator it = mapTxLocks.find(txHash);
+    return it != mapTxLocks.end() && GetTime() > it->second.nTimeout;
+}
+
+int CSwiftTXManager::GetVoterRank(const CTxIn& vin, int nBlockHeight)
+{
+    // the rank tables are kept per block by mnodeman, so the votes for a lock share one
+    return mnodeman.GetMasternodeRank(vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+}
+
+void CSwiftTXManager::LockInputs(const CTransaction& tx)
+{
+    LOCK(cs);
+
+    BOOST_FOREACH (const CTxIn& in, tx.vin) {
+        if (!mapLockedInputs.count(in.prevout)) {
+            mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
+        }
+    }
+}
+
+void CSwiftTXManager::LockCompleted(CTransactionLock& lock)
+{
+    LOCK(cs);
+
+    if (lock.fCompleted) return;
+    lock.fCompleted = true;
+
+    // locks we only heard votes for have no request time
+    if (lock.nTimeRequested == 0) return;
+
+    int64_t nLatency = GetTimeMillis() - lock.nTimeRequested;
+    deqLockLatencies.push_back(nLatency);
+    if (deqLockLatencies.size() > SWIFTTX_LATENCY_SAMPLES)
+        deqLockLatencies.pop_front();
+
+    LogPrint("swiftx", "SwiftX::LockCompleted - %s locked in %d ms\n", lock.txHash.ToString(), nLatency);
+}
+
+bool CSwiftTXManager::FindConflictingLock(const CTransaction& tx, uint256& txHashLocked)
+{
+    LOCK(cs);
+
+    BOOST_FOREACH (const CTxIn& in, tx.vin) {
+        std::map<COutPoint, uint256>::const_iterator it = mapLockedInputs.find(in.prevout);
+        if (it != mapLockedInputs.end() && it->second != tx.GetHash()) {
+            txHashLocked = it->second;
+            return true;
+        }
+    }
 
     return false;
 }
 
-bool CheckForConflictingLocks(CTransaction& tx)
+bool CSwiftTXManager::CheckForConflictingLocks(CTransaction& tx)
 {
     /*
         It's possible (very unlikely though) to get 2 conflicting transaction locks approved by the network.
@@ -391,22 +520,23 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
-    BOOST_FOREACH (const CTxIn& in, tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
-        }
-    }
+    LOCK(cs);
+    uint256 txHashLocked;
+    if (!FindConflictingLock(tx, txHashLocked))
+        return false;
 
-    return false;
+    LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), txHashLocked.ToString().c_str());
+
+    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
+    if (i != mapTxLocks.end()) SetLockExpiration((*i).second, GetTime());
+    i = mapTxLocks.find(txHashLocked);
+    if (i != mapTxLocks.end()) SetLockExpiration((*i).second, GetTime());
+    return true;
 }
 
-int64_t GetAverageVoteTime()
+int64_t CSwiftTXManager::GetAverageVoteTime()
 {
+    LOCK(cs);
     std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
     int64_t total = 0;
     int64_t count = 0;
@@ -420,36 +550,75 @@ int64_t GetAverageVoteTime()
     return total / count;
 }
 
-void CleanTransactionLocksList()
+void CSwiftTXManager::CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    LOCK(cs);
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    std::set<std::pair<int64_t, uint256> >::iterator it = setLocksByExpiration.begin();
+    while (it != setLocksByExpiration.end() && GetTime() > it->first) { //keep them for an hour
+        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(it->second);
+        if (i != mapTxLocks.end()) {
+            LogPrintf("Removing old transaction lock %s\n", (*i).second.txHash.ToString().c_str());
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+            if (mapTxLockReq.count((*i).second.txHash)) {
+                CTransaction& tx = mapTxLockReq[(*i).second.txHash];
 
-                BOOST_FOREACH (const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+                BOOST_FOREACH (const CTxIn& in, tx.vin) {
+                    std::map<COutPoint, uint256>::iterator itLocked = mapLockedInputs.find(in.prevout);
+                    if (itLocked != mapLockedInputs.end() && itLocked->second == tx.GetHash())
+                        mapLockedInputs.erase(itLocked);
+                }
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+                mapTxLockReq.erase((*i).second.txHash);
+                mapTxLockReqRejected.erase((*i).second.txHash);
 
-                BOOST_FOREACH (CConsensusVote& v, it->second.vecConsensusVotes)
+                BOOST_FOREACH (CConsensusVote& v, (*i).second.vecConsensusVotes)
                     mapTxLockVote.erase(v.GetHash());
             }
 
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
+            mapTxLocks.erase(i);
         }
+        setLocksByExpiration.erase(it++);
     }
 }
 
+std::vector<int64_t> CSwiftTXManager::GetLockLatencies()
+{
+    LOCK(cs);
+
+    std::vector<int64_t> vLatencies(deqLockLatencies.begin(), deqLockLatencies.end());
+    std::sort(vLatencies.begin(), vLatencies.end());
+    return vLatencies;
+}
+
+int CSwiftTXManager::CountLocks()
+{
+    LOCK(cs);
+    return (int)mapTxLocks.size();
+}
+
+int CSwiftTXManager::CountLockedInputs()
+{
+    LOCK(cs);
+    return (int)mapLockedInputs.size();
+}
+
+void CSwiftTXManager::Clear()
+{
+    LOCK(cs);
+
+    mapTxLockReq.clear();
+    mapTxLockReqRejected.clear();
+    mapTxLockVote.clear();
+    mapTxLocks.clear();
+    mapLockedInputs.clear();
+    setLocksByExpiration.clear();
+    mapUnknownVotes.clear();
+    deqLockLatencies.clear();
+}
+
 uint256 CConsensusVote::GetHash() const
 {
     return vinMasternode.prevout.hash + vinMasternode.prevout.n + txHash;
@@ -459,7 +628,7 @@ uint256 CConsensusVote::GetHash() const
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetSignatureMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
     CMasternode* pmn = mnodeman.Find(vinMasternode);
@@ -477,6 +646,11 @@ bool CConsensusVote::SignatureValid()
     return true;
 }
 
+std::string CConsensusVote::GetSignatureMessage() const
+{
+    return txHash.ToString() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 bool CConsensusVote::Sign()
 {
     std::string errorMessage;
@@ -508,8 +682,9 @@ bool CConsensusVote::Sign()
 
 bool CTransactionLock::SignaturesValid()
 {
-    BOOST_FOREACH (CConsensusVote vote, vecConsensusVotes) {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    std::vector<CSignedMessage> vMessages;
+    BOOST_FOREACH (CConsensusVote& vote, vecConsensusVotes) {
+        int n = swiftTxManager.GetVoterRank(vote.vinMasternode, vote.nBlockHeight);
 
         if (n == -1) {
             LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
@@ -521,10 +696,19 @@ bool CTransactionLock::SignaturesValid()
             return false;
         }
 
-        if (!vote.SignatureValid()) {
-            LogPrintf("CTransactionLock::SignaturesValid() - Signature not valid\n");
+        CMasternode* pmn = mnodeman.Find(vote.vinMasternode);
+        if (pmn == NULL) {
+            LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
             return false;
         }
+        vMessages.push_back(CSignedMessage(pmn->pubKeyMasternode, vote.vchMasterNodeSignature, vote.GetSignatureMessage()));
+    }
+
+    // the signatures of a lock are checked together, on worker threads when there are enough of them
+    std::vector<char> vValid;
+    if (obfuScationSigner.VerifyMessages(vMessages, vValid) != (int)vMessages.size()) {
+        LogPrintf("CTransactionLock::SignaturesValid() - Signature not valid\n");
+        return false;
     }
 
     return true;
@@ -15,6 +15,9 @@
 #include "sync.h"
 #include "util.h"
 
+#include <deque>
+#include <set>
+
 /*
     At 15 signatures, 1/2 of the masternode network can be owned by
     one party without comprimising the security of SwiftX
@@ -27,43 +30,25 @@
 #define SWIFTTX_SIGNATURES_REQUIRED 6
 #define SWIFTTX_SIGNATURES_TOTAL 10
 
+// how many of the most recent lock latencies are kept for getswiftxinfo
+#define SWIFTTX_LATENCY_SAMPLES 1000
+
 using namespace std;
 using namespace boost;
 
 class CConsensusVote;
+class CSwiftTXManager;
 class CTransaction;
 class CTransactionLock;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
 
-extern map<uint256, CTransaction> mapTxLockReq;
-extern map<uint256, CTransaction> mapTxLockReqRejected;
-extern map<uint256, CConsensusVote> mapTxLockVote;
-extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
+extern CSwiftTXManager swiftTxManager;
 extern int nCompleteTXLocks;
 
 
-int64_t CreateNewLock(CTransaction tx);
-
 bool IsIXTXValid(const CTransaction& txCollateral);
 
-// if two conflicting locks are approved by the network, they will cancel out
-bool CheckForConflictingLocks(CTransaction& tx);
-
-void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
-
-//check if we need to vote on this transaction
-void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
-
-//process consensus vote message
-bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
-
-// keep transaction locks in memory for an hour
-void CleanTransactionLocksList();
-
-int64_t GetAverageVoteTime();
-
 class CConsensusVote
 {
 public:
@@ -76,6 +61,7 @@ public:
 
     bool SignatureValid();
     bool Sign();
+    std::string GetSignatureMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -97,6 +83,17 @@ public:
     std::vector<CConsensusVote> vecConsensusVotes;
     int nExpiration;
     int nTimeout;
+    int64_t nTimeRequested; // ms, when the lock request was first seen, or 0
+    bool fCompleted;        // if SWIFTTX_SIGNATURES_REQUIRED votes were counted once already
+
+    CTransactionLock()
+    {
+        nBlockHeight = 0;
+        nExpiration = 0;
+        nTimeout = 0;
+        nTimeRequested = 0;
+        fCompleted = false;
+    }
 
     bool SignaturesValid();
     int CountSignatures();
@@ -108,5 +105,99 @@ public:
     }
 };
 
+//
+// SwiftX Lock Manager : the lock requests, votes and locks of SwiftX transactions
+//
+class CSwiftTXManager
+{
+private:
+    // critical section to protect the inner data structures
+    mutable CCriticalSection cs;
+
+    // inputs of complete locks, by outpoint, so conflicts cost one lookup per input
+    std::map<COutPoint, uint256> mapLockedInputs;
+    // locks by expiration time, so cleaning up only visits the expired ones
+    std::set<std::pair<int64_t, uint256> > setLocksByExpiration;
+    // track votes with no tx for DOS
+    std::map<uint256, int64_t> mapUnknownVotes;
+    // time from lock request to complete lock, in ms, oldest first
+    std::deque<int64_t> deqLockLatencies;
+
+    // lock requests by transaction, accepted to the mempool or not
+    std::map<uint256, CTransaction> mapTxLockReq;
+    std::map<uint256, CTransaction> mapTxLockReqRejected;
+    // lock votes by vote hash
+    std::map<uint256, CConsensusVote> mapTxLockVote;
+    // locks by transaction
+    std::map<uint256, CTransactionLock> mapTxLocks;
+
+    /// Add the lock of a transaction, or move an existing one to nBlockHeight if that is set. cs must be held.
+    std::map<uint256, CTransactionLock>::iterator InsertLock(const uint256& txHash, int nBlockHeight);
+    void SetLockExpiration(CTransactionLock& lock, int64_t nExpiration);
+    void LockCompleted(CTransactionLock& lock);
+
+public:
+    void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+
+    int64_t CreateNewLock(CTransaction tx);
+
+    /// Add the lock of a transaction, or move an existing one to nBlockHeight if that is set
+    void AddLock(const uint256& txHash, int nBlockHeight);
+
+    /// Remember a lock request of our own, to relay it
+    void AddLockRequest(const CTransaction& tx);
+
+    //check if we need to vote on this transaction
+    void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
+
+    //process consensus vote message
+    bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx);
+
+    /// Have we seen this lock request already, accepted or rejected
+    bool HaveLockRequest(const uint256& txHash);
+
+    /// Copy of an accepted lock request, false if there is none
+    bool GetLockRequest(const uint256& txHash, CTransaction& tx);
+
+    /// Have we seen this lock vote already
+    bool HaveLockVote(const uint256& hash);
+
+    /// Copy of a lock vote, false if there is none
+    bool GetLockVote(const uint256& hash, CConsensusVote& vote);
+
+    /// Number of signatures of the lock of a transaction, -1 if there is no lock
+    int GetLockSignatures(const uint256& txHash);
+
+    /// Whether the lock of a transaction did not complete in time
+    bool IsLockTimedOut(const uint256& txHash);
+
+    /// Rank of a voter among the masternodes that may vote on locks at nBlockHeight, -1 if unknown
+    int GetVoterRank(const CTxIn& vin, int nBlockHeight);
+
+    // if two conflicting locks are approved by the network, they will cancel out
+    bool CheckForConflictingLocks(CTransaction& tx);
+
+    /// Record the inputs of a transaction with a complete lock, unless another lock has them
+    void LockInputs(const CTransaction& tx);
+
+    /// Find an input of tx that a complete lock of another transaction spends
+    bool FindConflictingLock(const CTransaction& tx, uint256& txHashLocked);
+
+    // keep transaction locks in memory for an hour
+    void CleanTransactionLocksList();
+
+    int64_t GetAverageVoteTime();
+
+    /// Latencies of the last SWIFTTX_LATENCY_SAMPLES complete locks, sorted
+    std::vector<int64_t> GetLockLatencies();
+
+    int CountLocks();
+
+    int CountLockedInputs();
+
+    void Clear();
+};
+
+
 
 #endif
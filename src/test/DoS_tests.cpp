@@ -15,7 +15,9 @@
 #include "net.h"
 #include "pow.h"
 #include "script/sign.h"
+#include "script/standard.h"
 #include "serialize.h"
+#include "txmempool.h"
 #include "util.h"
 
 #include <stdint.h>
@@ -32,9 +34,11 @@ extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
 struct COrphanTx {
     CTransaction tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern std::map<COutPoint, std::set<uint256> > mapOrphanTransactionsByPrev;
 
 CService ip(uint32_t i)
 {
@@ -198,4 +202,147 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
 }
 
+static CTransaction OrphanSpending(const uint256& hashPrev, uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vin[0].scriptSig << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1*CENT;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+static uint64_t OrphanBytesFor(NodeId peer)
+{
+    uint64_t nBytes = 0;
+    BOOST_FOREACH (const PAIRTYPE(uint256, COrphanTx)& item, mapOrphanTransactions) {
+        if (item.second.fromPeer == peer)
+            nBytes += item.second.nTxSize;
+    }
+    return nBytes;
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_peerlimits)
+{
+    int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+    mapArgs["-maxorphanpeersize"] = "2";
+
+    // Orphans are indexed by the outpoint they are missing
+    uint256 hashParent = GetRandHash();
+    CTransaction txVictim = OrphanSpending(hashParent, 1);
+    BOOST_CHECK(AddOrphanTx(txVictim, 1));
+    BOOST_CHECK(mapOrphanTransactionsByPrev.count(COutPoint(hashParent, 1)));
+    BOOST_CHECK(!mapOrphanTransactionsByPrev.count(COutPoint(hashParent, 0)));
+
+    // A flooding peer stays within its 2 kB share by evicting its own
+    // orphans, and leaves the orphans of other peers alone
+    for (int i = 0; i < 100; i++)
+        AddOrphanTx(OrphanSpending(GetRandHash(), 0), 0);
+    BOOST_CHECK(OrphanBytesFor(0) > 0);
+    BOOST_CHECK(OrphanBytesFor(0) <= 2000);
+    BOOST_CHECK(mapOrphanTransactions.count(txVictim.GetHash()));
+
+    // The global limit evicts from the peer using the most memory
+    size_t nFlood = mapOrphanTransactions.size() - 1;
+    BOOST_CHECK(nFlood > 2);
+    LimitOrphanTxSize(2);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 2U);
+    BOOST_CHECK(mapOrphanTransactions.count(txVictim.GetHash()));
+
+    // Orphans expire
+    SetMockTime(nStartTime + ORPHAN_TX_EXPIRE_TIME + 1);
+    LimitOrphanTxSize(100);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+
+    mapArgs.erase("-maxorphanpeersize");
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_resolution)
+{
+    CNode::ClearBanned();
+    mapArgs["-banscore"] = "150";
+
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txFrom;
+    txFrom.vin.resize(1);
+    txFrom.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFrom.vout.resize(1);
+    txFrom.vout[0].scriptPubKey = scriptPubKey;
+    txFrom.vout[0].nValue = 10 * COIN;
+    {
+        LOCK(cs_main);
+        AddCoins(*pcoinsTip, txFrom, 1);
+    }
+
+    // A chain of transactions, the first of which has two more outputs
+    std::vector<CMutableTransaction> vChain;
+    CMutableTransaction txPrev = txFrom;
+    for (int i = 0; i < 20; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+        tx.vout.resize(i == 0 ? 3 : 1);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].scriptPubKey = scriptPubKey;
+            tx.vout[j].nValue = COIN;
+        }
+        tx.vout[0].nValue = txPrev.vout[0].nValue - (tx.vout.size() - 1) * COIN - CENT;
+        BOOST_REQUIRE(SignSignature(keystore, txPrev, tx, 0));
+        vChain.push_back(tx);
+        txPrev = tx;
+    }
+
+    // Another peer spends the two extra outputs with bad signatures
+    CAddress addrBad(ip(0xa0b0c010));
+    CNode dummyNodeBad(INVALID_SOCKET, addrBad, "", true);
+    dummyNodeBad.nVersion = 1;
+    std::vector<uint256> vBad;
+    for (uint32_t n = 1; n <= 2; n++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(vChain[0].GetHash(), n);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << ToByteVector(key.GetPubKey());
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        tx.vout[0].nValue = COIN - CENT;
+        ProcessTransaction(&dummyNodeBad, tx, "tx", false);
+        vBad.push_back(tx.GetHash());
+    }
+
+    // The descendants arrive first, in reverse order
+    CAddress addr(ip(0xa0b0c011));
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+    dummyNode.nVersion = 1;
+    for (int i = vChain.size() - 1; i > 0; i--)
+        ProcessTransaction(&dummyNode, vChain[i], "tx", false);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), vChain.size() - 1 + vBad.size());
+
+    // The pre-validation threads are not running, so the whole chain is resolved inline
+    size_t nPoolSize = mempool.size();
+    ProcessTransaction(&dummyNode, vChain[0], "tx", false);
+    BOOST_CHECK_EQUAL(mempool.size(), nPoolSize + vChain.size());
+
+    // The bad peer was punished for one of its orphans only, the other one is left alone
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 1U);
+    BOOST_CHECK(mapOrphanTransactions.count(vBad[0]) + mapOrphanTransactions.count(vBad[1]) == 1);
+    SendMessages(&dummyNodeBad, false);
+    BOOST_CHECK(!CNode::IsBanned(addrBad));
+
+    LOCK(cs_main);
+    EraseOrphansFor(dummyNodeBad.GetId());
+    pcoinsTip->SpendCoin(COutPoint(txFrom.GetHash(), 0));
+    mempool.clear();
+    mapArgs.erase("-banscore");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures what -assumevalid saves when connecting blocks: the inputs of a
+// block's transactions are checked as ConnectBlock does, once with the mode
+// off and once with the tip as the assumed-valid block. The amount and
+// maturity checks run in both cases.
+//
+
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "utiltime.h"
+
+#include <iostream>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_assumevalid)
+
+static const unsigned int TX_COUNT = 500;
+static const unsigned int INPUTS_PER_TX = 2;
+
+static int64_t TimeCheckInputs(const vector<CTransaction>& vTx, const CCoinsViewCache& view, const uint256& hashAssumeValidIn)
+{
+    hashAssumeValid = hashAssumeValidIn;
+    int64_t nStart = GetTimeMicros();
+    bool fScriptChecks = !IsBlockAssumedValid(chainActive.Tip()->GetBlockHash(), chainActive.Height());
+    BOOST_FOREACH (const CTransaction& tx, vTx) {
+        CValidationState state;
+        BOOST_CHECK(CheckInputs(tx, state, view, fScriptChecks, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+    }
+    return GetTimeMicros() - nStart;
+}
+
+BOOST_AUTO_TEST_CASE(assumevalid_check_inputs)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // One transaction funds all the inputs
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFund.vout.resize(TX_COUNT * INPUTS_PER_TX);
+    for (unsigned int i = 0; i < txFund.vout.size(); i++) {
+        txFund.vout[i].nValue = COIN;
+        txFund.vout[i].scriptPubKey = scriptPubKey;
+    }
+    CTransaction txFundConst(txFund);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    AddCoins(view, txFundConst, 0);
+
+    vector<CTransaction> vTx;
+    for (unsigned int i = 0; i < TX_COUNT; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(INPUTS_PER_TX);
+        for (unsigned int n = 0; n < INPUTS_PER_TX; n++)
+            tx.vin[n].prevout = COutPoint(txFundConst.GetHash(), i * INPUTS_PER_TX + n);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = INPUTS_PER_TX * COIN - 1000;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        for (unsigned int n = 0; n < INPUTS_PER_TX; n++)
+            BOOST_REQUIRE(SignSignature(keystore, txFundConst, tx, n));
+        vTx.push_back(tx);
+    }
+
+    LOCK(cs_main);
+    view.SetBestBlock(chainActive.Tip()->GetBlockHash());
+    CBlockIndex* pindexBestHeaderOld = pindexBestHeader;
+    uint256 hashAssumeValidOld = hashAssumeValid;
+    int nAssumeValidHeightOld = nAssumeValidHeight;
+    pindexBestHeader = chainActive.Tip();
+    nAssumeValidHeight = 0;
+
+    int64_t nChecked = TimeCheckInputs(vTx, view, 0);
+    int64_t nSkipped = TimeCheckInputs(vTx, view, chainActive.Tip()->GetBlockHash());
+    pindexBestHeader = pindexBestHeaderOld;
+    hashAssumeValid = hashAssumeValidOld;
+    nAssumeValidHeight = nAssumeValidHeightOld;
+
+    unsigned int nInputs = TX_COUNT * INPUTS_PER_TX;
+    cout << nInputs << " inputs: -assumevalid off " << nChecked / 1000 << " ms (" << nChecked / nInputs << " us/input), on "
+         << nSkipped / 1000 << " ms (" << nSkipped / nInputs << " us/input), "
+         << (nSkipped > 0 ? (double)nChecked / nSkipped : 0) << "x faster" << endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
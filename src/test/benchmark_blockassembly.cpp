@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures how long it takes to choose the transactions for a block
+// template from mempools of various sizes. The mempool is filled with a
+// mix of independent transactions and chains of unconfirmed descendants,
+// so that the package bookkeeping is exercised as well.
+//
+
+#include "main.h"
+#include "miner.h"
+#include "random.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <iostream>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_blockassembly)
+
+static void FillMempool(CTxMemPool& pool, unsigned int nTransactions)
+{
+    seed_insecure_rand(true);
+    vector<uint256> vParents;
+    unsigned int nChainLength = 0;
+    for (unsigned int i = 0; i < nTransactions; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        // Three quarters of the transactions start a new chain, the others
+        // extend the previous one up to the default ancestor limit.
+        if (!vParents.empty() && nChainLength < DEFAULT_ANCESTOR_LIMIT - 1 && insecure_rand() % 4 == 0) {
+            tx.vin[0].prevout = COutPoint(vParents.back(), 0);
+            nChainLength++;
+        } else {
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            nChainLength = 0;
+        }
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx.vout[1].nValue = i;
+
+        uint256 hash = tx.GetHash();
+        CAmount nFee = 1000 + insecure_rand() % 100000;
+        pool.addUnchecked(hash, CTxMemPoolEntry(tx, nFee, GetTime(), 0.0, 1, GetLegacySigOpCount(tx)));
+        vParents.push_back(hash);
+    }
+}
+
+static void BenchSelection(unsigned int nTransactions)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    FillMempool(pool, nTransactions);
+    BOOST_CHECK_EQUAL(pool.size(), nTransactions);
+
+    LOCK(pool.cs);
+    vector<CTxMemPool::txiter> vSelected;
+    int64_t nStart = GetTimeMicros();
+    SelectMempoolTransactions(pool, 2, DEFAULT_BLOCK_MAX_SIZE, DEFAULT_BLOCK_PRIORITY_SIZE, DEFAULT_BLOCK_MIN_SIZE, vSelected);
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    cout << "Selected " << vSelected.size() << " of " << nTransactions << " mempool transactions in "
+         << nElapsed / 1000.0 << " ms" << endl;
+
+    // The selection has to be valid as block order: every in-mempool parent
+    // is selected before its children, and the block size is respected.
+    CTxMemPool::setEntries setSelected;
+    uint64_t nTotalSize = 0;
+    BOOST_FOREACH (CTxMemPool::txiter it, vSelected) {
+        BOOST_FOREACH (CTxMemPool::txiter parent, pool.GetMemPoolParents(it)) {
+            BOOST_CHECK(setSelected.count(parent));
+        }
+        BOOST_CHECK(setSelected.insert(it).second);
+        nTotalSize += it->GetTxSize();
+    }
+    BOOST_CHECK(nTotalSize < DEFAULT_BLOCK_MAX_SIZE);
+    BOOST_CHECK(!vSelected.empty());
+}
+
+BOOST_AUTO_TEST_CASE(blockassembly_10k)
+{
+    BenchSelection(10000);
+}
+
+BOOST_AUTO_TEST_CASE(blockassembly_50k)
+{
+    BenchSelection(50000);
+}
+
+BOOST_AUTO_TEST_CASE(blockassembly_100k)
+{
+    BenchSelection(100000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,163 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures how fast blocks are read back from the blocks directory, in
+// chain order as a rescan does and in random order as peers and RPC
+// clients do. The reads that open, seek and hash the header again for
+// every block are compared with the cached file reader, with and without
+// memory mapping, and with raw reads that skip deserialization.
+//
+
+#include "blockfilereader.h"
+#include "clientversion.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_blockread)
+
+static const unsigned int BLOCK_COUNT = 2000;
+static const unsigned int BLOCKS_PER_FILE = 500;
+static const unsigned int TXS_PER_BLOCK = 100;
+//! Files are numbered from here, away from the blocks of the test chain
+static const int FIRST_FILE = 1000;
+
+static void WriteBlocks(vector<CDiskBlockPos>& vPos, vector<uint256>& vMerkleRoot)
+{
+    seed_insecure_rand(true);
+    CDiskBlockPos posNext(FIRST_FILE, 0);
+    for (unsigned int i = 0; i < BLOCK_COUNT; i++) {
+        if (i > 0 && i % BLOCKS_PER_FILE == 0)
+            posNext = CDiskBlockPos(posNext.nFile + 1, 0);
+
+        CBlock block;
+        block.nVersion = 4;
+        block.nTime = i;
+        block.nAccumulatorCheckpoint = GetRandHash();
+        for (unsigned int j = 0; j < TXS_PER_BLOCK; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(GetRandHash(), insecure_rand() % 4);
+            tx.vin[0].scriptSig = CScript() << vector<unsigned char>(72, j) << vector<unsigned char>(33, i);
+            tx.vout.resize(2);
+            tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx.vout[0].nValue = insecure_rand();
+            tx.vout[1] = tx.vout[0];
+            block.vtx.push_back(tx);
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+
+        CDiskBlockPos pos = posNext;
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+        posNext.nPos = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        vPos.push_back(pos);
+        vMerkleRoot.push_back(block.hashMerkleRoot);
+    }
+}
+
+static void RemoveBlocks(const vector<CDiskBlockPos>& vPos)
+{
+    blockFileReader.CloseAll();
+    for (int nFile = FIRST_FILE; nFile <= vPos.back().nFile; nFile++)
+        boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+}
+
+//! Read the way ReadBlockFromDisk used to: open, seek and hash the header
+static bool ReadBlockUncached(CBlock& block, const CDiskBlockPos& pos)
+{
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+    filein >> block;
+    return block.GetHash() != uint256();
+}
+
+enum ReadMode {
+    READ_UNCACHED,
+    READ_CACHED,
+    READ_RAW,
+};
+
+static void BenchRead(const char* strName, ReadMode mode, const vector<CDiskBlockPos>& vPos, const vector<uint256>& vMerkleRoot, const vector<unsigned int>& vOrder)
+{
+    uint64_t nReadsBefore, nOpensBefore;
+    blockFileReader.GetStats(nReadsBefore, nOpensBefore);
+
+    uint64_t nBytes = 0;
+    int64_t nStart = GetTimeMicros();
+    BOOST_FOREACH (unsigned int i, vOrder) {
+        if (mode == READ_RAW) {
+            vector<char> vchBlock;
+            BOOST_REQUIRE(blockFileReader.ReadRecord(vPos[i], "blk", 0, vchBlock));
+            nBytes += vchBlock.size();
+            continue;
+        }
+
+        CBlock block;
+        if (mode == READ_UNCACHED)
+            BOOST_REQUIRE(ReadBlockUncached(block, vPos[i]));
+        else
+            BOOST_REQUIRE(ReadBlockFromDisk(block, vPos[i]));
+        BOOST_CHECK(block.hashMerkleRoot == vMerkleRoot[i]);
+        BOOST_CHECK_EQUAL(block.vtx.size(), TXS_PER_BLOCK);
+        nBytes += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    uint64_t nReads, nOpens;
+    blockFileReader.GetStats(nReads, nOpens);
+    cout << strName << ": " << vOrder.size() << " blocks (" << (nBytes >> 20) << " MiB) in " << nElapsed / 1000.0 << " ms, "
+         << (nElapsed > 0 ? vOrder.size() * 1000000 / nElapsed : 0) << " blocks/s, " << nOpens - nOpensBefore << " file opens" << endl;
+}
+
+BOOST_AUTO_TEST_CASE(blockread)
+{
+    vector<CDiskBlockPos> vPos;
+    vector<uint256> vMerkleRoot;
+    WriteBlocks(vPos, vMerkleRoot);
+
+    vector<unsigned int> vSequential, vRandom;
+    for (unsigned int i = 0; i < BLOCK_COUNT; i++)
+        vSequential.push_back(i);
+    vRandom = vSequential;
+    random_shuffle(vRandom.begin(), vRandom.end(), GetRandInt);
+
+    // Warm the page cache, so that every run reads from memory
+    BenchRead("warm up", READ_UNCACHED, vPos, vMerkleRoot, vSequential);
+
+    BenchRead("sequential, open and hash", READ_UNCACHED, vPos, vMerkleRoot, vSequential);
+    BenchRead("random, open and hash", READ_UNCACHED, vPos, vMerkleRoot, vRandom);
+
+    blockFileReader.SetLimits(DEFAULT_BLOCK_FILE_HANDLES, false);
+    BenchRead("sequential, cached handles", READ_CACHED, vPos, vMerkleRoot, vSequential);
+    BenchRead("random, cached handles", READ_CACHED, vPos, vMerkleRoot, vRandom);
+
+#ifndef WIN32
+    blockFileReader.SetLimits(DEFAULT_BLOCK_FILE_HANDLES, true);
+    BenchRead("sequential, mmap", READ_CACHED, vPos, vMerkleRoot, vSequential);
+    BenchRead("random, mmap", READ_CACHED, vPos, vMerkleRoot, vRandom);
+#endif
+
+    BenchRead("sequential, raw", READ_RAW, vPos, vMerkleRoot, vSequential);
+    BenchRead("random, raw", READ_RAW, vPos, vMerkleRoot, vRandom);
+
+    // With a single handle, random reads keep switching files
+    blockFileReader.SetLimits(1, DEFAULT_BLOCK_MMAP);
+    BenchRead("random, one handle", READ_CACHED, vPos, vMerkleRoot, vRandom);
+
+    blockFileReader.SetLimits(DEFAULT_BLOCK_FILE_HANDLES, DEFAULT_BLOCK_MMAP);
+    RemoveBlocks(vPos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,174 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Casts 100k budget votes, 2000 masternodes voting on 50 proposals, then
+// has a tenth of the masternodes leave. Prints the time per vote, and the
+// time to tally every proposal the way getbudgetinfo does, by walking the
+// votes as before next to the running tallies.
+//
+
+#include "clientversion.h"
+#include "masternode-budget.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_budgetvotes)
+
+static const int MASTERNODE_COUNT = 2000;
+static const int PROPOSAL_COUNT = 50;
+
+struct CVoteTally {
+    int nYeas;
+    int nNays;
+    int nAbstains;
+    double dRatio;
+};
+
+static void AddMasternodes(vector<CTxIn>& vVins, int nCount)
+{
+    vVins.resize(nCount);
+    for (int i = 0; i < nCount; i++) {
+        CMasternode mn;
+        mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+        BOOST_REQUIRE(mnodeman.Add(mn));
+        vVins[i] = mn.vin;
+    }
+}
+
+/** The proposals come from the database, which ranks them as they are read back */
+static void AddProposals(CBudgetManager& man, vector<uint256>& vHashes, int nCount)
+{
+    CBudgetManager manSource;
+    vHashes.resize(nCount);
+    for (int i = 0; i < nCount; i++) {
+        CBudgetProposal proposal("proposal" + boost::lexical_cast<std::string>(i), "https://xuezcoin.com", 1000, 2000, CScript() << OP_TRUE, 100 * COIN, GetRandHash());
+        vHashes[i] = proposal.GetHash();
+        manSource.mapProposals.insert(make_pair(vHashes[i], proposal));
+    }
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << manSource;
+    ss >> man;
+}
+
+/** GetYeas, GetNays, GetAbstains and GetRatio after CleanAndRemove, before the running tallies */
+static CVoteTally TallyLinear(CBudgetProposal& proposal)
+{
+    CVoteTally tally = {0, 0, 0, 0.0};
+    int nYeasTotal = 0;
+    int nNaysTotal = 0;
+    std::map<uint256, CBudgetVote>::iterator it = proposal.mapVotes.begin();
+    while (it != proposal.mapVotes.end()) {
+        CBudgetVote& vote = (*it).second;
+        bool fValid = mnodeman.Find(vote.vin) != NULL;
+        if (vote.nVote == VOTE_YES) nYeasTotal++;
+        if (vote.nVote == VOTE_NO) nNaysTotal++;
+        if (fValid && vote.nVote == VOTE_YES) tally.nYeas++;
+        if (fValid && vote.nVote == VOTE_NO) tally.nNays++;
+        if (fValid && vote.nVote == VOTE_ABSTAIN) tally.nAbstains++;
+        ++it;
+    }
+    if (nYeasTotal + nNaysTotal > 0)
+        tally.dRatio = (double)nYeasTotal / (double)(nYeasTotal + nNaysTotal);
+    return tally;
+}
+
+static void CheckTallies(CBudgetManager& man)
+{
+    std::vector<CBudgetProposal*> vProposals = man.GetAllProposals();
+    BOOST_CHECK_EQUAL(vProposals.size(), (size_t)PROPOSAL_COUNT);
+    for (unsigned int i = 0; i < vProposals.size(); i++) {
+        CVoteTally tally = TallyLinear(*vProposals[i]);
+        BOOST_CHECK_EQUAL(vProposals[i]->GetYeas(), tally.nYeas);
+        BOOST_CHECK_EQUAL(vProposals[i]->GetNays(), tally.nNays);
+        BOOST_CHECK_EQUAL(vProposals[i]->GetAbstains(), tally.nAbstains);
+        BOOST_CHECK_EQUAL(vProposals[i]->GetRatio(), tally.dRatio);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(budgetvotes_tally)
+{
+    mnodeman.Clear();
+    vector<CTxIn> vVins;
+    AddMasternodes(vVins, MASTERNODE_COUNT);
+
+    CBudgetManager man;
+    vector<uint256> vHashes;
+    AddProposals(man, vHashes, PROPOSAL_COUNT);
+
+    std::string strError;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < MASTERNODE_COUNT; i++) {
+        for (int j = 0; j < PROPOSAL_COUNT; j++) {
+            CBudgetVote vote(vVins[i], vHashes[j], GetRandInt(3));
+            BOOST_CHECK(man.UpdateProposal(vote, NULL, strError));
+        }
+    }
+    int64_t nVotes = GetTimeMicros() - nStart;
+    CheckTallies(man);
+
+    // A changed vote replaces the one it updates
+    CBudgetProposal* pproposal = man.FindProposal(vHashes[0]);
+    BOOST_REQUIRE(pproposal != NULL);
+    CBudgetVote voteChanged = pproposal->mapVotes[vVins[0].prevout.GetHash()];
+    voteChanged.nVote = voteChanged.nVote == VOTE_YES ? VOTE_NO : VOTE_YES;
+    voteChanged.nTime += BUDGET_VOTE_UPDATE_MIN;
+    BOOST_CHECK(man.UpdateProposal(voteChanged, NULL, strError));
+    CheckTallies(man);
+
+    // Votes stop counting when their masternodes leave, and count again when they come back
+    std::vector<CMasternode> vLeft;
+    for (int i = 0; i < MASTERNODE_COUNT; i += 10) {
+        vLeft.push_back(*mnodeman.Find(vVins[i]));
+        mnodeman.Remove(vVins[i]);
+    }
+    CheckTallies(man);
+    for (unsigned int i = 0; i < vLeft.size(); i++)
+        BOOST_CHECK(mnodeman.Add(vLeft[i]));
+    CheckTallies(man);
+
+    // The tallies are counted again when the proposals are read back
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << man;
+    CBudgetManager manRead;
+    ss >> manRead;
+    CheckTallies(manRead);
+
+    // getbudgetinfo
+    nStart = GetTimeMicros();
+    std::vector<CBudgetProposal*> vProposals = man.GetAllProposals();
+    int nYeas = 0;
+    for (unsigned int i = 0; i < vProposals.size(); i++) {
+        CVoteTally tally = TallyLinear(*vProposals[i]);
+        nYeas += tally.nYeas;
+    }
+    int64_t nLinear = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    vProposals = man.GetAllProposals();
+    int nYeasRunning = 0;
+    for (unsigned int i = 0; i < vProposals.size(); i++) {
+        nYeasRunning += vProposals[i]->GetYeas();
+        vProposals[i]->GetNays();
+        vProposals[i]->GetAbstains();
+        vProposals[i]->GetRatio();
+    }
+    int64_t nRunning = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nYeas, nYeasRunning);
+
+    cout << MASTERNODE_COUNT * PROPOSAL_COUNT << " votes: " << nVotes * 1000 / (MASTERNODE_COUNT * PROPOSAL_COUNT) << " ns per vote, "
+         << "tallying " << PROPOSAL_COUNT << " proposals: walking the votes " << nLinear << " us, running tallies " << nRunning << " us" << endl;
+
+    mnodeman.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Denominates 20k outputs of a mixing wallet, then mixes a quarter of them
+// once and an eighth twice, in sessions where half the inputs and outputs
+// are another wallet's. Prints the time to work out the average rounds the
+// obfuscation thread reports, walking every output of the wallet as
+// before next to walking the denomination buckets.
+//
+
+#include "main.h"
+#include "random.h"
+#include "utiltime.h"
+#include "wallet.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_denominations)
+
+static const int DENOMINATE_TXS = 100;
+static const int DENOMINATE_OUTPUTS = 200;
+static const int MIX_INPUTS = 10;
+static const int REPORT_COUNT = 100;
+
+static CAmount DenominationOf(int i)
+{
+    return obfuScationDenominations[i % obfuScationDenominations.size()];
+}
+
+/** Outputs of all denominations, from an input that is not ours */
+static void AddDenominateTx(CWallet& wallet, const CScript& scriptMine, vector<COutPoint>& vOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    for (int i = 0; i < DENOMINATE_OUTPUTS; i++)
+        tx.vout.push_back(CTxOut(DenominationOf(i), scriptMine));
+    CWalletTx wtx(&wallet, tx);
+    LOCK2(cs_main, wallet.cs_wallet);
+    BOOST_REQUIRE(wallet.AddToWallet(wtx));
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        vOutputs.push_back(COutPoint(wtx.GetHash(), i));
+}
+
+/** A mixing session spending some of our outputs and as many of another wallet's */
+static void AddMixTx(CWallet& wallet, const CScript& scriptMine, const vector<COutPoint>& vInputs, vector<COutPoint>& vOutputs)
+{
+    CScript scriptOther = CScript() << OP_TRUE;
+    CMutableTransaction tx;
+    BOOST_FOREACH (const COutPoint& prevout, vInputs) {
+        tx.vin.push_back(CTxIn(prevout));
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+        CAmount nValue = wallet.mapWallet[prevout.hash].vout[prevout.n].nValue;
+        tx.vout.push_back(CTxOut(nValue, scriptMine));
+        tx.vout.push_back(CTxOut(nValue, scriptOther));
+    }
+    CWalletTx wtx(&wallet, tx);
+    LOCK2(cs_main, wallet.cs_wallet);
+    BOOST_REQUIRE(wallet.AddToWallet(wtx));
+    for (unsigned int i = 0; i < tx.vout.size(); i += 2)
+        vOutputs.push_back(COutPoint(wtx.GetHash(), i));
+}
+
+static void Mix(CWallet& wallet, const CScript& scriptMine, const vector<COutPoint>& vInputs, vector<COutPoint>& vOutputs)
+{
+    for (unsigned int i = 0; i + MIX_INPUTS <= vInputs.size(); i += MIX_INPUTS)
+        AddMixTx(wallet, scriptMine, vector<COutPoint>(vInputs.begin() + i, vInputs.begin() + i + MIX_INPUTS), vOutputs);
+}
+
+/** GetAverageAnonymizedRounds before the denomination buckets */
+static double AverageRoundsWalk(CWallet& wallet)
+{
+    double fTotal = 0;
+    double fCount = 0;
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    for (map<uint256, CWalletTx>::const_iterator it = wallet.mapWallet.begin(); it != wallet.mapWallet.end(); ++it) {
+        const CWalletTx* pcoin = &(*it).second;
+        uint256 hash = (*it).first;
+        for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            CTxIn vin = CTxIn(hash, i);
+            if (wallet.IsSpent(hash, i) || wallet.IsMine(pcoin->vout[i]) != ISMINE_SPENDABLE || !wallet.IsDenominated(vin)) continue;
+            fTotal += (float)wallet.GetInputObfuscationRounds(vin);
+            fCount += 1;
+        }
+    }
+    return fCount == 0 ? 0 : fTotal / fCount;
+}
+
+BOOST_AUTO_TEST_CASE(denominations_rounds)
+{
+    vector<int64_t> vDenominationsSaved = obfuScationDenominations;
+    if (obfuScationDenominations.empty()) {
+        obfuScationDenominations.push_back((10000 * COIN) + 10000000);
+        obfuScationDenominations.push_back((1000 * COIN) + 1000000);
+        obfuScationDenominations.push_back((100 * COIN) + 100000);
+        obfuScationDenominations.push_back((10 * COIN) + 10000);
+        obfuScationDenominations.push_back((1 * COIN) + 1000);
+        obfuScationDenominations.push_back((.1 * COIN) + 100);
+    }
+
+    CWallet wallet("wallet_denominations.dat");
+    bool fFirstRun;
+    BOOST_REQUIRE_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_REQUIRE(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+
+    vector<COutPoint> vRound0, vRound1, vRound2;
+    for (int i = 0; i < DENOMINATE_TXS; i++)
+        AddDenominateTx(wallet, scriptMine, vRound0);
+    BOOST_CHECK_EQUAL(wallet.GetAverageAnonymizedRounds(), 0.0);
+
+    // the buckets are filled now, and follow the mixing sessions as they come in
+    Mix(wallet, scriptMine, vector<COutPoint>(vRound0.begin(), vRound0.begin() + vRound0.size() / 4), vRound1);
+    Mix(wallet, scriptMine, vector<COutPoint>(vRound1.begin(), vRound1.begin() + vRound1.size() / 2), vRound2);
+    BOOST_CHECK_EQUAL(wallet.GetInputObfuscationRounds(CTxIn(vRound0.back())), 0);
+    BOOST_CHECK_EQUAL(wallet.GetInputObfuscationRounds(CTxIn(vRound1.back())), 1);
+    BOOST_CHECK_EQUAL(wallet.GetInputObfuscationRounds(CTxIn(vRound2.back())), 2);
+
+    // a quarter of the outputs were mixed once, and half of those once more
+    int nUnspent0 = vRound0.size() - vRound1.size();
+    int nUnspent1 = vRound1.size() - vRound2.size();
+    double fExpected = (double)(nUnspent1 + 2 * vRound2.size()) / (nUnspent0 + nUnspent1 + vRound2.size());
+    BOOST_CHECK_CLOSE(wallet.GetAverageAnonymizedRounds(), fExpected, 0.0001);
+    BOOST_CHECK_CLOSE(AverageRoundsWalk(wallet), fExpected, 0.0001);
+
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < REPORT_COUNT; i++)
+        AverageRoundsWalk(wallet);
+    int64_t nTimeWalk = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < REPORT_COUNT; i++)
+        wallet.GetAverageAnonymizedRounds();
+    int64_t nTimeBuckets = GetTimeMicros() - nStart;
+
+    cout << vRound0.size() << " denominated outputs, " << wallet.mapWallet.size() << " transactions: average rounds walking the wallet "
+         << nTimeWalk / REPORT_COUNT << " us, walking the buckets " << nTimeBuckets / REPORT_COUNT << " us" << endl;
+
+    obfuScationDenominations = vDenominationsSaved;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
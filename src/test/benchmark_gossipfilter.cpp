@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Receives 200k budget votes, each announced again by seven more peers
+// soon after, into a store of seen votes as before, which only the budget
+// clean up shrinks, and into one kept to -maxgossipseen with the evicted
+// votes in the gossip filter. Prints the memory of each store and of the
+// filter, and the time per announcement AlreadyHave spends on each.
+//
+
+#include "masternode-budget.h"
+#include "memusage.h"
+#include "net.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_gossipfilter)
+
+static const int VOTE_COUNT = 200000;
+static const int PEER_COUNT = 8;
+static const int WINDOW = 1000;
+
+static size_t StoreUsage(const map<uint256, CBudgetVote>& mapSeen)
+{
+    size_t nUsage = memusage::DynamicUsage(mapSeen);
+    for (map<uint256, CBudgetVote>::const_iterator it = mapSeen.begin(); it != mapSeen.end(); ++it)
+        nUsage += memusage::DynamicUsage(it->second.vchSig) + memusage::DynamicUsage(it->second.vin.scriptSig);
+    return nUsage;
+}
+
+BOOST_AUTO_TEST_CASE(gossipfilter_capped_store)
+{
+    gossipFilter.SetSize(DEFAULT_GOSSIP_FILTER_SIZE);
+    gossipFilter.SetMaxSeen(DEFAULT_MAX_GOSSIP_SEEN);
+    map<uint256, CBudgetVote> mapSeenBefore;
+    map<uint256, CBudgetVote> mapSeenAfter;
+    vector<uint256> vHashes;
+    vHashes.reserve(VOTE_COUNT);
+
+    int64_t nTimeBefore = 0;
+    int64_t nTimeAfter = 0;
+    int nHaveBefore = 0;
+    int nHaveAfter = 0;
+    for (int nStart = 0; nStart < VOTE_COUNT; nStart += WINDOW) {
+        // the votes are accepted as the first peer sends them
+        for (int i = nStart; i < nStart + WINDOW; i++) {
+            CBudgetVote vote;
+            vote.nTime = 1000000 + i;
+            vote.vchSig.resize(65);
+            vHashes.push_back(GetRandHash());
+            mapSeenBefore.insert(make_pair(vHashes.back(), vote));
+            mapSeenAfter.insert(make_pair(vHashes.back(), vote));
+            gossipFilter.Limit(mapSeenAfter, MSG_BUDGET_VOTE, &CBudgetVote::nTime);
+        }
+
+        int64_t nTime = GetTimeMicros();
+        for (int nPeer = 1; nPeer < PEER_COUNT; nPeer++) {
+            for (int i = nStart; i < nStart + WINDOW; i++) {
+                if (mapSeenBefore.count(vHashes[i]))
+                    nHaveBefore++;
+            }
+        }
+        nTimeBefore += GetTimeMicros() - nTime;
+
+        nTime = GetTimeMicros();
+        for (int nPeer = 1; nPeer < PEER_COUNT; nPeer++) {
+            for (int i = nStart; i < nStart + WINDOW; i++) {
+                if (mapSeenAfter.count(vHashes[i]) || gossipFilter.contains(CInv(MSG_BUDGET_VOTE, vHashes[i])))
+                    nHaveAfter++;
+            }
+        }
+        nTimeAfter += GetTimeMicros() - nTime;
+    }
+
+    int nAnnouncements = VOTE_COUNT * (PEER_COUNT - 1);
+    BOOST_CHECK_EQUAL(nHaveBefore, nAnnouncements);
+    BOOST_CHECK_EQUAL(nHaveAfter, nAnnouncements);
+    BOOST_CHECK(mapSeenAfter.size() <= DEFAULT_MAX_GOSSIP_SEEN);
+
+    // the evicted votes still in the filter are not asked for again
+    int nRemembered = 0;
+    for (int i = 0; i < VOTE_COUNT; i++) {
+        if (!mapSeenAfter.count(vHashes[i]) && gossipFilter.contains(CInv(MSG_BUDGET_VOTE, vHashes[i])))
+            nRemembered++;
+    }
+    BOOST_CHECK(nRemembered >= (int)DEFAULT_GOSSIP_FILTER_SIZE);
+
+    size_t nUsageBefore = StoreUsage(mapSeenBefore);
+    size_t nUsageAfter = StoreUsage(mapSeenAfter);
+    size_t nFilterUsage = gossipFilter.DynamicMemoryUsage();
+    cout << VOTE_COUNT << " votes announced by " << PEER_COUNT << " peers: uncapped store " << mapSeenBefore.size() << " votes, "
+         << nUsageBefore / 1000 << " kB, " << nTimeBefore * 1000 / nAnnouncements << " ns per announcement; capped store "
+         << mapSeenAfter.size() << " votes, " << nUsageAfter / 1000 << " kB, filter " << nFilterUsage / 1000 << " kB, "
+         << nTimeAfter * 1000 / nAnnouncements << " ns per announcement, " << nRemembered << " evicted votes still seen" << endl;
+
+    gossipFilter.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures the last paid lookup that payment queue selection does for
+// every enabled masternode on every block, at 1k, 3k and 5k masternodes.
+// Each block of the last cycle has a winner with two votes, paying the
+// masternodes in turn, and a tenth of the masternodes are never paid.
+// Prints the time per block for the walk back over the chain that
+// GetLastPaid did before, next to the payee index.
+//
+
+#include "main.h"
+#include "masternode-payments.h"
+#include "masternode.h"
+#include "random.h"
+#include "script/standard.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_lastpaid)
+
+/** GetLastPaid before the payee index */
+static int64_t GetLastPaidWalk(CMasternode& mn, int nEnabled)
+{
+    CScript mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mn.vin;
+    ss << mn.sigTime;
+    uint256 hash = ss.GetHash();
+    int64_t nOffset = hash.GetCompact(false) % 150;
+
+    const CBlockIndex* BlockReading = chainActive.Tip();
+    int nMnCount = nEnabled * 1.25;
+    int n = 0;
+    while (BlockReading && BlockReading->nHeight > 0) {
+        if (n >= nMnCount)
+            return 0;
+        n++;
+
+        if (masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)) {
+            if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2))
+                return BlockReading->nTime + nOffset;
+        }
+        BlockReading = BlockReading->pprev;
+    }
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE(lastpaid_queue)
+{
+    CBlockIndex* pindexTipOld = chainActive.Tip();
+
+    const int vSizes[] = {1000, 3000, 5000};
+    for (unsigned int n = 0; n < sizeof(vSizes) / sizeof(vSizes[0]); n++) {
+        int nMasternodes = vSizes[n];
+        int nBlocks = nMasternodes * 2 + 200;
+
+        vector<uint256> vHashes(nBlocks);
+        vector<CBlockIndex> vIndex(nBlocks);
+        for (int i = 0; i < nBlocks; i++) {
+            vHashes[i] = GetRandHash();
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].nHeight = i;
+            vIndex[i].nTime = 1500000000 + i * 60;
+            vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+            vIndex[i].BuildSkip();
+        }
+        chainActive.SetTip(&vIndex.back());
+        mapCacheBlockHashes.clear();
+
+        vector<CMasternode> vMasternodes(nMasternodes);
+        for (int i = 0; i < nMasternodes; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            vMasternodes[i].vin = CTxIn(COutPoint(GetRandHash(), 0));
+            vMasternodes[i].pubKeyCollateralAddress = key.GetPubKey();
+        }
+
+        // two votes for each block of the last cycle
+        int nPaid = nMasternodes * 9 / 10;
+        for (int nHeight = nBlocks - nMasternodes * 5 / 4; nHeight < nBlocks; nHeight++) {
+            CScript payee = GetScriptForDestination(vMasternodes[nHeight % nPaid].pubKeyCollateralAddress.GetID());
+            for (int nVote = 0; nVote < 2; nVote++) {
+                CMasternodePaymentWinner winner(CTxIn(COutPoint(GetRandHash(), 0)));
+                winner.nBlockHeight = nHeight;
+                winner.AddPayee(payee);
+                BOOST_CHECK(masternodePayments.AddWinningMasternode(winner));
+            }
+        }
+
+        vector<int64_t> vWalk(nMasternodes);
+        int64_t nStart = GetTimeMicros();
+        for (int i = 0; i < nMasternodes; i++)
+            vWalk[i] = GetLastPaidWalk(vMasternodes[i], nMasternodes);
+        int64_t nTimeWalk = GetTimeMicros() - nStart;
+
+        vector<int64_t> vIndexed(nMasternodes);
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nMasternodes; i++)
+            vIndexed[i] = vMasternodes[i].GetLastPaid(nMasternodes);
+        int64_t nTimeIndexed = GetTimeMicros() - nStart;
+
+        int nUnpaid = 0;
+        for (int i = 0; i < nMasternodes; i++) {
+            BOOST_CHECK_EQUAL(vWalk[i], vIndexed[i]);
+            if (vIndexed[i] == 0)
+                nUnpaid++;
+        }
+        BOOST_CHECK_EQUAL(nUnpaid, nMasternodes - nPaid);
+
+        cout << nMasternodes << " masternodes: chain walk " << nTimeWalk / 1000 << " ms per block, payee index "
+             << nTimeIndexed / 1000 << " ms per block" << endl;
+
+        masternodePayments.Clear();
+        mapCacheBlockHashes.clear();
+        chainActive.SetTip(pindexTipOld);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
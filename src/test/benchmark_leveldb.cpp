@@ -0,0 +1,111 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures the database profiles on the same workload: records the size of
+// a coin written in batches as a flush does, looked up at random, both keys
+// that are there and keys that are not, and iterated in order. Prints the
+// time of each phase and the statistics getleveldbstats reports.
+//
+
+#include "hash.h"
+#include "leveldbwrapper.h"
+#include "random.h"
+#include "uint256.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_leveldb)
+
+static const unsigned int RECORD_COUNT = 100000;
+static const unsigned int BATCH_SIZE = 10000;
+static const unsigned int LOOKUP_COUNT = 20000;
+static const size_t CACHE_SIZE = 8 << 20;
+
+static uint256 RecordHash(unsigned int i)
+{
+    return Hash(BEGIN(i), END(i));
+}
+
+static vector<unsigned char> RecordValue(unsigned int i)
+{
+    // A height, a compressed amount and a pay to pubkey hash script
+    vector<unsigned char> vch(4, 0);
+    vch[0] = i & 0xff;
+    vch[1] = (i >> 8) & 0xff;
+    vch.push_back(0);
+    uint256 hash = RecordHash(~i);
+    vch.insert(vch.end(), hash.begin(), hash.begin() + 20);
+    return vch;
+}
+
+static void BenchProfile(const CLevelDBProfile& profile)
+{
+    boost::filesystem::path path = GetDataDir() / "benchleveldb" / profile.strName;
+    boost::scoped_ptr<CLevelDBWrapper> pdb(new CLevelDBWrapper(path, CACHE_SIZE, false, true, profile));
+
+    int64_t nStart = GetTimeMicros();
+    for (unsigned int nBatch = 0; nBatch < RECORD_COUNT; nBatch += BATCH_SIZE) {
+        CLevelDBBatch batch;
+        for (unsigned int i = nBatch; i < nBatch + BATCH_SIZE; i++)
+            batch.Write(make_pair('C', RecordHash(i)), RecordValue(i));
+        BOOST_REQUIRE(pdb->WriteBatch(batch));
+    }
+    BOOST_REQUIRE(pdb->Sync());
+    int64_t nWrite = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    unsigned int nFound = 0;
+    for (unsigned int i = 0; i < LOOKUP_COUNT; i++) {
+        vector<unsigned char> vch;
+        if (pdb->Read(make_pair('C', RecordHash(insecure_rand() % RECORD_COUNT)), vch))
+            nFound++;
+    }
+    int64_t nReadHit = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nFound, LOOKUP_COUNT);
+
+    nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < LOOKUP_COUNT; i++)
+        BOOST_CHECK(!pdb->Exists(make_pair('C', GetRandHash())));
+    int64_t nReadMiss = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    unsigned int nIterated = 0;
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(pdb->NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+            nIterated++;
+    }
+    int64_t nIterate = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nIterated, RECORD_COUNT);
+
+    CLevelDBStats stats = pdb->GetStats();
+    uint64_t nLookups = stats.nCacheHits + stats.nCacheMisses;
+    cout << profile.strName << ": write " << nWrite / 1000 << " ms, " << LOOKUP_COUNT << " hits " << nReadHit / 1000
+         << " ms, " << LOOKUP_COUNT << " misses " << nReadMiss / 1000 << " ms, iterate " << nIterate / 1000 << " ms, "
+         << (stats.nApproximateSize >> 10) << " KiB on disk, block cache hit rate "
+         << (nLookups == 0 ? 0 : 100 * stats.nCacheHits / nLookups) << "%, " << stats.nSlowWrites << " slow writes" << endl;
+
+    pdb.reset();
+    boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(leveldb_profiles)
+{
+    seed_insecure_rand(true);
+    const char* vNames[] = {"default", "chainstate", "blockindex", "zerocoin"};
+    for (unsigned int i = 0; i < sizeof(vNames) / sizeof(vNames[0]); i++)
+        BenchProfile(GetLevelDBProfile(vNames[i]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,258 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Replays a stream of masternode gossip against the masternode registry
+// with 1k, 5k and 20k masternodes. Pings, winner votes and budget votes
+// look masternodes up by collateral outpoint, payments by payee script and
+// the old dsee/dseep and obfuscation messages by masternode key; a few
+// broadcasts change keys and a few masternodes leave and rejoin. Prints the
+// time per message next to the linear scans the registry replaced.
+//
+
+#include "clientversion.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "script/standard.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_mnregistry)
+
+static const unsigned int MESSAGE_COUNT = 200000;
+static const unsigned int LINEAR_MESSAGE_COUNT = 2000;
+
+enum GossipType {
+    GOSSIP_PING,
+    GOSSIP_WINNER,
+    GOSSIP_VOTE,
+    GOSSIP_DSEEP,
+    GOSSIP_BROADCAST,
+    GOSSIP_REJOIN
+};
+
+struct CGossipMessage {
+    GossipType type;
+    unsigned int nMasternode;
+};
+
+static CPubKey RandomPubKey()
+{
+    vector<unsigned char> vch(33);
+    GetRandBytes(&vch[0], vch.size());
+    vch[0] = 0x02;
+    return CPubKey(vch);
+}
+
+static void MakeMasternodes(vector<CMasternode>& vMasternodes, unsigned int nCount)
+{
+    vMasternodes.resize(nCount);
+    for (unsigned int i = 0; i < nCount; i++) {
+        vMasternodes[i].vin = CTxIn(COutPoint(GetRandHash(), i % 4));
+        vMasternodes[i].pubKeyMasternode = RandomPubKey();
+        vMasternodes[i].pubKeyCollateralAddress = RandomPubKey();
+    }
+}
+
+/** Roughly the mix a node sees: mostly pings, a vote per masternode per block, rare key changes and restarts */
+static void MakeGossip(vector<CGossipMessage>& vGossip, unsigned int nMessages, unsigned int nMasternodes)
+{
+    vGossip.resize(nMessages);
+    for (unsigned int i = 0; i < nMessages; i++) {
+        int n = GetRandInt(1000);
+        vGossip[i].nMasternode = GetRandInt(nMasternodes);
+        if (n < 500)
+            vGossip[i].type = GOSSIP_PING;
+        else if (n < 750)
+            vGossip[i].type = GOSSIP_WINNER;
+        else if (n < 900)
+            vGossip[i].type = GOSSIP_VOTE;
+        else if (n < 990)
+            vGossip[i].type = GOSSIP_DSEEP;
+        else if (n < 995)
+            vGossip[i].type = GOSSIP_BROADCAST;
+        else
+            vGossip[i].type = GOSSIP_REJOIN;
+    }
+}
+
+static unsigned int ReplayRegistry(CMasternodeMan& man, vector<CMasternode>& vMasternodes, const vector<CGossipMessage>& vGossip, unsigned int nMessages)
+{
+    unsigned int nFound = 0;
+    for (unsigned int i = 0; i < nMessages; i++) {
+        CMasternode& mn = vMasternodes[vGossip[i].nMasternode];
+        CMasternode* pmn = NULL;
+        switch (vGossip[i].type) {
+        case GOSSIP_PING:
+        case GOSSIP_VOTE:
+            pmn = man.Find(mn.vin);
+            break;
+        case GOSSIP_WINNER:
+            pmn = man.Find(mn.vin);
+            if (pmn)
+                pmn = man.Find(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+            break;
+        case GOSSIP_DSEEP:
+            pmn = man.Find(mn.pubKeyMasternode);
+            break;
+        case GOSSIP_BROADCAST:
+            pmn = man.Find(mn.vin);
+            if (pmn) {
+                mn.pubKeyMasternode = RandomPubKey();
+                pmn->pubKeyMasternode = mn.pubKeyMasternode;
+                man.UpdateMasternodeIndex(*pmn);
+            }
+            break;
+        case GOSSIP_REJOIN:
+            man.Remove(mn.vin);
+            man.Add(mn);
+            pmn = man.Find(mn.vin);
+            break;
+        }
+        if (pmn && pmn->vin.prevout == mn.vin.prevout)
+            nFound++;
+    }
+    return nFound;
+}
+
+/** The scans CMasternodeMan::Find did before it had indexes */
+static CMasternode* FindLinear(vector<CMasternode>& vList, const CTxIn& vin)
+{
+    BOOST_FOREACH (CMasternode& mn, vList) {
+        if (mn.vin.prevout == vin.prevout)
+            return &mn;
+    }
+    return NULL;
+}
+
+static CMasternode* FindLinear(vector<CMasternode>& vList, const CScript& payee)
+{
+    CScript payee2;
+    BOOST_FOREACH (CMasternode& mn, vList) {
+        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+        if (payee2 == payee)
+            return &mn;
+    }
+    return NULL;
+}
+
+static CMasternode* FindLinear(vector<CMasternode>& vList, const CPubKey& pubKeyMasternode)
+{
+    BOOST_FOREACH (CMasternode& mn, vList) {
+        if (mn.pubKeyMasternode == pubKeyMasternode)
+            return &mn;
+    }
+    return NULL;
+}
+
+static unsigned int ReplayLinear(vector<CMasternode> vList, const vector<CMasternode>& vMasternodes, const vector<CGossipMessage>& vGossip, unsigned int nMessages)
+{
+    unsigned int nFound = 0;
+    for (unsigned int i = 0; i < nMessages; i++) {
+        const CMasternode& mn = vMasternodes[vGossip[i].nMasternode];
+        CMasternode* pmn = NULL;
+        switch (vGossip[i].type) {
+        case GOSSIP_PING:
+        case GOSSIP_VOTE:
+        case GOSSIP_BROADCAST:
+        case GOSSIP_REJOIN:
+            pmn = FindLinear(vList, mn.vin);
+            break;
+        case GOSSIP_WINNER:
+            pmn = FindLinear(vList, mn.vin);
+            if (pmn)
+                pmn = FindLinear(vList, GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+            break;
+        case GOSSIP_DSEEP:
+            pmn = FindLinear(vList, mn.pubKeyMasternode);
+            break;
+        }
+        if (pmn)
+            nFound++;
+    }
+    return nFound;
+}
+
+BOOST_AUTO_TEST_CASE(mnregistry_indexes)
+{
+    CMasternodeMan man;
+    vector<CMasternode> vMasternodes;
+    MakeMasternodes(vMasternodes, 3);
+    // the second masternode shares its collateral key with the first
+    vMasternodes[1].pubKeyCollateralAddress = vMasternodes[0].pubKeyCollateralAddress;
+    for (unsigned int i = 0; i < vMasternodes.size(); i++)
+        BOOST_CHECK(man.Add(vMasternodes[i]));
+    BOOST_CHECK(!man.Add(vMasternodes[0]));
+    BOOST_CHECK_EQUAL(man.size(), 3);
+
+    CMasternode* pmn = man.Find(vMasternodes[2].vin);
+    BOOST_REQUIRE(pmn != NULL);
+    BOOST_CHECK(man.Find(vMasternodes[2].pubKeyMasternode) == pmn);
+    BOOST_CHECK(man.Find(GetScriptForDestination(vMasternodes[2].pubKeyCollateralAddress.GetID())) == pmn);
+
+    // Only the pay to key hash script of the collateral key is a payee
+    BOOST_CHECK(man.Find(CScript() << ToByteVector(vMasternodes[2].pubKeyCollateralAddress) << OP_CHECKSIG) == NULL);
+
+    // A key change is found under the new key only, and the entry does not move
+    CPubKey pubKeyOld = pmn->pubKeyMasternode;
+    pmn->pubKeyMasternode = RandomPubKey();
+    man.UpdateMasternodeIndex(*pmn);
+    BOOST_CHECK(man.Find(pubKeyOld) == NULL);
+    BOOST_CHECK(man.Find(pmn->pubKeyMasternode) == pmn);
+    BOOST_CHECK(man.Find(vMasternodes[2].vin) == pmn);
+
+    // A shared payee is still found after one of its masternodes leaves
+    CScript payeeShared = GetScriptForDestination(vMasternodes[0].pubKeyCollateralAddress.GetID());
+    BOOST_CHECK(man.Find(payeeShared) != NULL);
+    man.Remove(vMasternodes[0].vin);
+    BOOST_CHECK(man.Find(vMasternodes[0].vin) == NULL);
+    BOOST_CHECK(man.Find(vMasternodes[0].pubKeyMasternode) == NULL);
+    BOOST_CHECK(man.Find(payeeShared) == man.Find(vMasternodes[1].vin));
+    BOOST_CHECK(man.Find(vMasternodes[2].vin) == pmn);
+
+    // The indexes are rebuilt when the registry is read back
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << man;
+    CMasternodeMan manRead;
+    ss >> manRead;
+    BOOST_CHECK_EQUAL(manRead.size(), 2);
+    BOOST_CHECK(manRead.Find(vMasternodes[1].pubKeyMasternode) != NULL);
+    BOOST_CHECK(manRead.Find(payeeShared) != NULL);
+}
+
+BOOST_AUTO_TEST_CASE(mnregistry_gossip_replay)
+{
+    const unsigned int vSizes[] = {1000, 5000, 20000};
+    for (unsigned int n = 0; n < sizeof(vSizes) / sizeof(vSizes[0]); n++) {
+        vector<CMasternode> vMasternodes;
+        MakeMasternodes(vMasternodes, vSizes[n]);
+        vector<CGossipMessage> vGossip;
+        MakeGossip(vGossip, MESSAGE_COUNT, vSizes[n]);
+
+        int64_t nStart = GetTimeMicros();
+        unsigned int nFound = ReplayLinear(vMasternodes, vMasternodes, vGossip, LINEAR_MESSAGE_COUNT);
+        int64_t nLinear = GetTimeMicros() - nStart;
+        BOOST_CHECK_EQUAL(nFound, LINEAR_MESSAGE_COUNT);
+
+        CMasternodeMan man;
+        for (unsigned int i = 0; i < vMasternodes.size(); i++)
+            man.Add(vMasternodes[i]);
+        nStart = GetTimeMicros();
+        nFound = ReplayRegistry(man, vMasternodes, vGossip, MESSAGE_COUNT);
+        int64_t nIndexed = GetTimeMicros() - nStart;
+        BOOST_CHECK_EQUAL(nFound, MESSAGE_COUNT);
+        BOOST_CHECK_EQUAL(man.size(), (int)vSizes[n]);
+
+        cout << vSizes[n] << " masternodes: linear " << nLinear * 1000 / LINEAR_MESSAGE_COUNT << " ns per message, indexed "
+             << nIndexed * 1000 / MESSAGE_COUNT << " ns per message" << endl;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
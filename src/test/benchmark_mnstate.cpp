@@ -0,0 +1,110 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Dumps a masternode list of 1k, 5k and 20k masternodes after a tenth of
+// them pinged, the way the periodic dump sees it. Prints the time of a
+// dump that serializes and hashes the whole manager, as mncache.dat was
+// written, next to a flush of the masternode state database, and the time
+// to load the list back.
+//
+
+#include "clientversion.h"
+#include "hash.h"
+#include "masternodedb.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_mnstate)
+
+static CPubKey RandomPubKey()
+{
+    vector<unsigned char> vch(33);
+    GetRandBytes(&vch[0], vch.size());
+    vch[0] = 0x02;
+    return CPubKey(vch);
+}
+
+static void AddMasternodes(CMasternodeMan& man, vector<CMasternode>& vMasternodes, unsigned int nCount)
+{
+    vMasternodes.resize(nCount);
+    for (unsigned int i = 0; i < nCount; i++) {
+        vMasternodes[i].vin = CTxIn(COutPoint(GetRandHash(), 0));
+        vMasternodes[i].pubKeyMasternode = RandomPubKey();
+        vMasternodes[i].pubKeyCollateralAddress = RandomPubKey();
+        vMasternodes[i].sigTime = GetTime();
+        man.Add(vMasternodes[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mnstate_flush_load)
+{
+    CMasternodeStateDB db(1 << 20, true);
+    CMasternodeMan man;
+    vector<CMasternode> vMasternodes;
+    AddMasternodes(man, vMasternodes, 3);
+    BOOST_CHECK(man.Flush(db));
+
+    // Changes and removals are written by the next flush
+    man.Find(vMasternodes[0].vin)->sigTime++;
+    man.Remove(vMasternodes[1].vin);
+    BOOST_CHECK(man.Flush(db));
+
+    CMasternodeMan manRead;
+    BOOST_CHECK(manRead.Load(db));
+    BOOST_CHECK_EQUAL(manRead.size(), 2);
+    BOOST_CHECK(manRead.Find(vMasternodes[1].vin) == NULL);
+    BOOST_REQUIRE(manRead.Find(vMasternodes[0].vin) != NULL);
+    BOOST_CHECK_EQUAL(manRead.Find(vMasternodes[0].vin)->sigTime, vMasternodes[0].sigTime + 1);
+    BOOST_CHECK(manRead.Find(vMasternodes[2].pubKeyMasternode) != NULL);
+
+    // A database nothing was flushed to has no state to load
+    CMasternodeStateDB dbEmpty(1 << 20, true);
+    BOOST_CHECK(!manRead.Load(dbEmpty));
+}
+
+BOOST_AUTO_TEST_CASE(mnstate_periodic_dump)
+{
+    const unsigned int vSizes[] = {1000, 5000, 20000};
+    for (unsigned int n = 0; n < sizeof(vSizes) / sizeof(vSizes[0]); n++) {
+        CMasternodeStateDB db(8 << 20, true);
+        CMasternodeMan man;
+        vector<CMasternode> vMasternodes;
+        AddMasternodes(man, vMasternodes, vSizes[n]);
+        BOOST_CHECK(man.Flush(db));
+
+        for (unsigned int i = 0; i < vSizes[n]; i += 10)
+            man.Find(vMasternodes[i].vin)->lastPing.sigTime = GetTime();
+
+        int64_t nStart = GetTimeMicros();
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << man;
+        uint256 hash = Hash(ss.begin(), ss.end());
+        int64_t nFile = GetTimeMicros() - nStart;
+        BOOST_CHECK(hash != 0);
+
+        nStart = GetTimeMicros();
+        BOOST_CHECK(man.Flush(db));
+        int64_t nFlush = GetTimeMicros() - nStart;
+
+        CMasternodeMan manRead;
+        nStart = GetTimeMicros();
+        BOOST_CHECK(manRead.Load(db));
+        int64_t nLoad = GetTimeMicros() - nStart;
+        BOOST_CHECK_EQUAL(manRead.size(), (int)vSizes[n]);
+
+        cout << vSizes[n] << " masternodes: whole file " << nFile / 1000 << " ms, incremental flush "
+             << nFlush / 1000 << " ms (" << ss.size() / 1024 << " KiB in the file), load " << nLoad / 1000 << " ms" << endl;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,180 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Syncs the masternode list from three peers asked at once, then a
+// budget of 50k items each announced by all three peers. Checks that a
+// phase ends as soon as the last count or item is in rather than on a
+// timer, that peers which do not answer are replaced, and prints the time
+// spent per item seen, de-duplication and completion check included.
+//
+
+#include "main.h"
+#include "masternode-sync.h"
+#include "random.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_mnsync)
+
+static const int PEER_COUNT = 5;
+static const int LIST_COUNT = 1000;
+static const int BUDGET_COUNT = 50000;
+
+static void AddPeers(vector<CNode*>& vPeers)
+{
+    LOCK(cs_vNodes);
+    for (int i = 0; i < PEER_COUNT; i++) {
+        CAddress addr(CService(CNetAddr("10.0.0." + boost::lexical_cast<std::string>(i + 1)), 18333));
+        CNode* pnode = new CNode(INVALID_SOCKET, addr, "", true);
+        pnode->nVersion = PROTOCOL_VERSION;
+        vNodes.push_back(pnode);
+        vPeers.push_back(pnode);
+    }
+}
+
+static void RemovePeers(vector<CNode*>& vPeers)
+{
+    LOCK(cs_vNodes);
+    BOOST_FOREACH (CNode* pnode, vPeers) {
+        vNodes.erase(std::find(vNodes.begin(), vNodes.end(), pnode));
+        delete pnode;
+    }
+    vPeers.clear();
+}
+
+/** The peers have no socket, so the first message sent to one disconnects it */
+static void KeepConnected(vector<CNode*>& vPeers)
+{
+    BOOST_FOREACH (CNode* pnode, vPeers)
+        pnode->fDisconnect = false;
+}
+
+static int CountAsked(const vector<CNode*>& vPeers, const std::string& strRequest)
+{
+    int nAsked = 0;
+    BOOST_FOREACH (CNode* pnode, vPeers) {
+        if (pnode->HasFulfilledRequest(strRequest))
+            nAsked++;
+    }
+    return nAsked;
+}
+
+static void SendCount(CNode* pnode, int nItemID, int nCount)
+{
+    std::string strCommand = "ssc";
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << nItemID << nCount;
+    masternodeSync.ProcessMessage(pnode, strCommand, ss);
+}
+
+/** An item arriving in a message of its own, which is checked against the sync after it is processed */
+static void SendItem(CNode* pnode)
+{
+    std::string strCommand = "mvote";
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    masternodeSync.ProcessMessage(pnode, strCommand, ss);
+}
+
+BOOST_AUTO_TEST_CASE(mnsync_parallel_peers)
+{
+    // the blockchain is synced when its tip is recent
+    int64_t nNow = chainActive.Tip()->GetBlockTime() + 60;
+    SetMockTime(nNow);
+    BOOST_REQUIRE(masternodeSync.IsBlockchainSynced());
+
+    vector<CNode*> vPeers;
+    AddPeers(vPeers);
+    masternodeSync.Reset();
+    masternodeSync.GetNextAsset();
+    masternodeSync.GetNextAsset();
+    BOOST_REQUIRE_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+
+    masternodeSync.RequestAsset();
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), MASTERNODE_SYNC_PEERS);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "mnsync"), MASTERNODE_SYNC_PEERS);
+
+    // every peer announces the whole list, which counts once
+    vector<uint256> vList;
+    for (int i = 0; i < LIST_COUNT; i++)
+        vList.push_back(GetRandHash());
+    SendCount(vPeers[0], MASTERNODE_SYNC_LIST, LIST_COUNT);
+    SendCount(vPeers[1], MASTERNODE_SYNC_LIST, LIST_COUNT);
+    for (int nPeer = 0; nPeer < 2; nPeer++) {
+        BOOST_FOREACH (const uint256& hash, vList) {
+            masternodeSync.AddedMasternodeList(hash);
+            SendItem(vPeers[nPeer]);
+        }
+    }
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), 1);
+
+    // the last count completes the list, and the winners are asked for straight away
+    KeepConnected(vPeers);
+    SendCount(vPeers[2], MASTERNODE_SYNC_LIST, LIST_COUNT);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_MNW);
+    BOOST_CHECK(masternodeSync.GetAssetDurations().count(MASTERNODE_SYNC_LIST));
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), MASTERNODE_SYNC_PEERS);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "mnwsync"), MASTERNODE_SYNC_PEERS);
+
+    // peers that do not answer are replaced by the ones left
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 2 + 1);
+    KeepConnected(vPeers);
+    masternodeSync.Process();
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), PEER_COUNT - MASTERNODE_SYNC_PEERS);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "mnwsync"), PEER_COUNT);
+
+    // nobody answers, and without payment enforcement the sync moves on
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 6);
+    KeepConnected(vPeers);
+    masternodeSync.Process();
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_BUDGET);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "busync"), MASTERNODE_SYNC_PEERS);
+
+    // the budget comes in two counts per peer
+    vector<uint256> vBudget;
+    for (int i = 0; i < BUDGET_COUNT; i++)
+        vBudget.push_back(GetRandHash());
+    for (int nPeer = 0; nPeer < MASTERNODE_SYNC_PEERS; nPeer++) {
+        SendCount(vPeers[nPeer], MASTERNODE_SYNC_BUDGET_PROP, BUDGET_COUNT / 2);
+        SendCount(vPeers[nPeer], MASTERNODE_SYNC_BUDGET_FIN, BUDGET_COUNT / 2);
+    }
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), 0);
+
+    int64_t nStart = GetTimeMicros();
+    int nItems = 0;
+    for (int nPeer = 0; nPeer < MASTERNODE_SYNC_PEERS && masternodeSync.RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET; nPeer++) {
+        for (int i = 0; i < BUDGET_COUNT && masternodeSync.RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET; i++) {
+            masternodeSync.AddedBudgetItem(vBudget[(i * 7919 + nPeer) % BUDGET_COUNT]);
+            SendItem(vPeers[nPeer]);
+            nItems++;
+        }
+    }
+    int64_t nTimeItems = GetTimeMicros() - nStart;
+
+    // complete with the last distinct item, before the other peers' copies
+    BOOST_CHECK_EQUAL(nItems, BUDGET_COUNT);
+    BOOST_CHECK(masternodeSync.IsSynced());
+    std::map<int, int64_t> mapDurations = masternodeSync.GetAssetDurations();
+    BOOST_CHECK_EQUAL(mapDurations.size(), (size_t)4);
+
+    cout << BUDGET_COUNT << " budget items from " << MASTERNODE_SYNC_PEERS << " peers: " << nTimeItems * 1000 / nItems << " ns per item, phases";
+    for (std::map<int, int64_t>::const_iterator it = mapDurations.begin(); it != mapDurations.end(); ++it)
+        cout << " " << CMasternodeSync::GetAssetName(it->first) << " " << it->second << " ms";
+    cout << endl;
+
+    RemovePeers(vPeers);
+    masternodeSync.Reset();
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Checks the signatures of a burst of masternode gossip the way a syncing
+// node sees it: every message arrives from three peers. Prints the time per
+// message for checking each copy on the message thread, for the same with
+// the verified message cache, and for checking the burst in a batch on
+// worker threads before processing it.
+//
+
+#include "obfuscation.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_msgsig)
+
+static const unsigned int MESSAGE_COUNT = 2000;
+static const unsigned int PEER_COUNT = 3;
+
+static void MakeMessages(vector<CSignedMessage>& vMessages, unsigned int nCount)
+{
+    vector<CKey> vKeys(50);
+    for (unsigned int i = 0; i < vKeys.size(); i++)
+        vKeys[i].MakeNewKey(true);
+
+    string errorMessage;
+    vMessages.resize(nCount);
+    for (unsigned int i = 0; i < nCount; i++) {
+        const CKey& key = vKeys[i % vKeys.size()];
+        vMessages[i].pubkey = key.GetPubKey();
+        vMessages[i].strMessage = GetRandHash().ToString() + boost::lexical_cast<string>(i);
+        BOOST_CHECK(obfuScationSigner.SignMessage(vMessages[i].strMessage, errorMessage, vMessages[i].vchSig, key));
+    }
+}
+
+/** VerifyMessage without the cache */
+static bool VerifyUncached(const CSignedMessage& message)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << strMessageMagic;
+    ss << message.strMessage;
+
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(ss.GetHash(), message.vchSig))
+        return false;
+    return pubkey.GetID() == message.pubkey.GetID();
+}
+
+BOOST_AUTO_TEST_CASE(msgsig_cache)
+{
+    vector<CSignedMessage> vMessages;
+    MakeMessages(vMessages, 2);
+    string errorMessage;
+
+    // A cached key is still compared with the key of the masternode
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(obfuScationSigner.VerifyMessage(vMessages[0].pubkey, vMessages[0].vchSig, vMessages[0].strMessage, errorMessage));
+        BOOST_CHECK(!obfuScationSigner.VerifyMessage(vMessages[1].pubkey, vMessages[0].vchSig, vMessages[0].strMessage, errorMessage));
+    }
+
+    // The signature of one message does not verify another
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(vMessages[0].pubkey, vMessages[0].vchSig, vMessages[1].strMessage, errorMessage));
+
+    // A signature no key can be recovered from
+    vector<unsigned char> vchSigBad(65, 0);
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(vMessages[0].pubkey, vchSigBad, vMessages[0].strMessage, errorMessage));
+
+    // Batches give the same results on worker threads
+    vector<CSignedMessage> vBatch;
+    MakeMessages(vBatch, OBFUSCATION_PARALLEL_VERIFY_MIN * 4);
+    vBatch[5].strMessage += "x";
+    vBatch[9].vchSig = vchSigBad;
+    vector<char> vValid;
+    BOOST_CHECK_EQUAL(obfuScationSigner.VerifyMessages(vBatch, vValid), (int)vBatch.size() - 2);
+    BOOST_REQUIRE_EQUAL(vValid.size(), vBatch.size());
+    for (unsigned int i = 0; i < vBatch.size(); i++) {
+        BOOST_CHECK_EQUAL((bool)vValid[i], i != 5 && i != 9);
+        BOOST_CHECK_EQUAL(obfuScationSigner.VerifyMessage(vBatch[i].pubkey, vBatch[i].vchSig, vBatch[i].strMessage, errorMessage), i != 5 && i != 9);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(msgsig_gossip_burst)
+{
+    vector<CSignedMessage> vMessages;
+    string errorMessage;
+
+    MakeMessages(vMessages, MESSAGE_COUNT);
+    int64_t nStart = GetTimeMicros();
+    for (unsigned int n = 0; n < PEER_COUNT; n++)
+        for (unsigned int i = 0; i < vMessages.size(); i++)
+            BOOST_CHECK(VerifyUncached(vMessages[i]));
+    int64_t nUncached = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (unsigned int n = 0; n < PEER_COUNT; n++)
+        for (unsigned int i = 0; i < vMessages.size(); i++)
+            BOOST_CHECK(obfuScationSigner.VerifyMessage(vMessages[i].pubkey, vMessages[i].vchSig, vMessages[i].strMessage, errorMessage));
+    int64_t nCached = GetTimeMicros() - nStart;
+
+    MakeMessages(vMessages, MESSAGE_COUNT);
+    nStart = GetTimeMicros();
+    vector<char> vValid;
+    BOOST_CHECK_EQUAL(obfuScationSigner.VerifyMessages(vMessages, vValid), (int)MESSAGE_COUNT);
+    for (unsigned int n = 0; n < PEER_COUNT; n++)
+        for (unsigned int i = 0; i < vMessages.size(); i++)
+            BOOST_CHECK(obfuScationSigner.VerifyMessage(vMessages[i].pubkey, vMessages[i].vchSig, vMessages[i].strMessage, errorMessage));
+    int64_t nBatched = GetTimeMicros() - nStart;
+
+    cout << MESSAGE_COUNT << " messages from " << PEER_COUNT << " peers: uncached " << nUncached / MESSAGE_COUNT
+         << " us per message, cached " << nCached / MESSAGE_COUNT << " us per message, batched "
+         << nBatched / MESSAGE_COUNT << " us per message" << endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
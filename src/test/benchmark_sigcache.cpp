@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures the signature cache under contention: a number of threads look
+// up the same signatures at once, as script check threads do when a block
+// arrives whose transactions were in the memory pool. Prints the time per
+// lookup for each number of threads, next to verifying without the cache.
+//
+
+#include "key.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "uint256.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_sigcache)
+
+static const unsigned int SIGNATURE_COUNT = 2000;
+static const unsigned int LOOKUP_ROUNDS = 20;
+
+struct CSignedHash {
+    uint256 hash;
+    vector<unsigned char> vchSig;
+    CPubKey pubkey;
+};
+
+static void MakeSignatures(vector<CSignedHash>& vSigned, unsigned int nCount)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    vSigned.resize(nCount);
+    for (unsigned int i = 0; i < nCount; i++) {
+        vSigned[i].hash = GetRandHash();
+        BOOST_REQUIRE(key.Sign(vSigned[i].hash, vSigned[i].vchSig));
+        vSigned[i].pubkey = key.GetPubKey();
+    }
+}
+
+static void LookupThread(const vector<CSignedHash>* pvSigned, unsigned int nOffset, atomic<unsigned int>* pnFailed)
+{
+    CachingTransactionSignatureChecker checker(NULL, 0, true);
+    unsigned int nSize = pvSigned->size();
+    for (unsigned int nRound = 0; nRound < LOOKUP_ROUNDS; nRound++) {
+        for (unsigned int i = 0; i < nSize; i++) {
+            const CSignedHash& signedHash = (*pvSigned)[(i + nOffset) % nSize];
+            if (!checker.VerifySignature(signedHash.vchSig, signedHash.pubkey, signedHash.hash))
+                (*pnFailed)++;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_hit_and_erase)
+{
+    InitSignatureCache();
+    vector<CSignedHash> vSigned;
+    MakeSignatures(vSigned, 2);
+    CachingTransactionSignatureChecker checkerStore(NULL, 0, true);
+    CachingTransactionSignatureChecker checkerBlock(NULL, 0, false);
+
+    // A signature for another hash is not taken from the cache
+    BOOST_CHECK(checkerStore.VerifySignature(vSigned[0].vchSig, vSigned[0].pubkey, vSigned[0].hash));
+    BOOST_CHECK(!checkerStore.VerifySignature(vSigned[0].vchSig, vSigned[0].pubkey, vSigned[1].hash));
+
+    // Found while connecting a block, the entry is removed, which the
+    // result does not show; verifying again stores it again
+    BOOST_CHECK(checkerBlock.VerifySignature(vSigned[0].vchSig, vSigned[0].pubkey, vSigned[0].hash));
+    BOOST_CHECK(checkerBlock.VerifySignature(vSigned[0].vchSig, vSigned[0].pubkey, vSigned[0].hash));
+    BOOST_CHECK(checkerStore.VerifySignature(vSigned[1].vchSig, vSigned[1].pubkey, vSigned[1].hash));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_contention)
+{
+    vector<CSignedHash> vSigned;
+    MakeSignatures(vSigned, SIGNATURE_COUNT);
+
+    int64_t nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < SIGNATURE_COUNT; i++)
+        BOOST_CHECK(vSigned[i].pubkey.Verify(vSigned[i].hash, vSigned[i].vchSig));
+    int64_t nUncached = GetTimeMicros() - nStart;
+    cout << "uncached: " << nUncached * 1000 / SIGNATURE_COUNT << " ns per signature" << endl;
+
+    // Fill the cache
+    atomic<unsigned int> nFailed(0);
+    LookupThread(&vSigned, 0, &nFailed);
+
+    const unsigned int vThreads[] = {1, 2, 4, 8, 16};
+    for (unsigned int n = 0; n < sizeof(vThreads) / sizeof(vThreads[0]); n++) {
+        boost::thread_group threads;
+        nStart = GetTimeMicros();
+        for (unsigned int i = 0; i < vThreads[n]; i++)
+            threads.create_thread(boost::bind(&LookupThread, &vSigned, i * SIGNATURE_COUNT / vThreads[n], &nFailed));
+        threads.join_all();
+        int64_t nElapsed = GetTimeMicros() - nStart;
+        uint64_t nLookups = (uint64_t)vThreads[n] * LOOKUP_ROUNDS * SIGNATURE_COUNT;
+        cout << vThreads[n] << " threads: " << nElapsed * 1000 / nLookups << " ns per lookup, "
+             << nLookups * 1000000 / (nElapsed > 0 ? nElapsed : 1) << " lookups per second" << endl;
+    }
+    BOOST_CHECK_EQUAL(nFailed.load(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
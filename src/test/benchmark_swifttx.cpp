@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Keeps 50k SwiftX locks of two inputs each, then checks 100k
+// transactions for conflicts with them and cleans the locks up 100 times
+// before any expire, as the obfuscation thread does once a minute. Prints
+// the time per clean up for the walk over every lock
+// CleanTransactionLocksList did before, next to the expiration index, and
+// the time per conflict check.
+//
+
+#include "primitives/transaction.h"
+#include "random.h"
+#include "swifttx.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_swifttx)
+
+static const int LOCK_COUNT = 50000;
+static const int CONFLICT_CHECKS = 100000;
+static const int CLEAN_COUNT = 100;
+
+static CTransaction MakeLockedTx(const COutPoint& prevout1, const COutPoint& prevout2)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout1));
+    tx.vin.push_back(CTxIn(prevout2));
+    tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    return CTransaction(tx);
+}
+
+static void AddCompleteLock(const CTransaction& tx)
+{
+    swiftTxManager.AddLock(tx.GetHash(), 100);
+    swiftTxManager.AddLockRequest(tx);
+    swiftTxManager.LockInputs(tx);
+}
+
+/** CleanTransactionLocksList before the expiration index, without the erasing, over a copy of the locks */
+static int CountExpiredLocksWalk(std::map<uint256, CTransactionLock>& mapTxLocks)
+{
+    int nExpired = 0;
+    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    while (it != mapTxLocks.end()) {
+        if (GetTime() > it->second.nExpiration)
+            nExpired++;
+        it++;
+    }
+    return nExpired;
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_locks_cleanup)
+{
+    swiftTxManager.Clear();
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+
+    vector<CTransaction> vLocked;
+    vLocked.reserve(LOCK_COUNT);
+    for (int i = 0; i < LOCK_COUNT; i++) {
+        vLocked.push_back(MakeLockedTx(COutPoint(GetRandHash(), 0), COutPoint(GetRandHash(), 1)));
+        AddCompleteLock(vLocked.back());
+    }
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLockedInputs(), LOCK_COUNT * 2);
+
+    std::map<uint256, CTransactionLock> mapTxLocks;
+    for (int i = 0; i < LOCK_COUNT; i++) {
+        CTransactionLock& lock = mapTxLocks[vLocked[i].GetHash()];
+        lock.txHash = vLocked[i].GetHash();
+        lock.nExpiration = nNow + 60 * 60;
+    }
+
+    // half of the transactions checked spend an input of a lock
+    vector<CTransaction> vChecked;
+    vChecked.reserve(CONFLICT_CHECKS);
+    for (int i = 0; i < CONFLICT_CHECKS; i++) {
+        COutPoint prevout = (i % 2) ? vLocked[GetRandInt(LOCK_COUNT)].vin[1].prevout : COutPoint(GetRandHash(), 0);
+        vChecked.push_back(MakeLockedTx(COutPoint(GetRandHash(), 0), prevout));
+    }
+
+    int64_t nStart = GetTimeMicros();
+    int nConflicts = 0;
+    uint256 txHashLocked;
+    for (int i = 0; i < CONFLICT_CHECKS; i++) {
+        if (swiftTxManager.FindConflictingLock(vChecked[i], txHashLocked))
+            nConflicts++;
+    }
+    int64_t nTimeConflicts = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(nConflicts, CONFLICT_CHECKS / 2);
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < CLEAN_COUNT; i++)
+        BOOST_CHECK_EQUAL(CountExpiredLocksWalk(mapTxLocks), 0);
+    int64_t nTimeWalk = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < CLEAN_COUNT; i++)
+        swiftTxManager.CleanTransactionLocksList();
+    int64_t nTimeIndexed = GetTimeMicros() - nStart;
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLocks(), LOCK_COUNT);
+
+    // every lock expires an hour after it was made
+    SetMockTime(nNow + 60 * 60 + 1);
+    swiftTxManager.CleanTransactionLocksList();
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLocks(), 0);
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLockedInputs(), 0);
+
+    cout << LOCK_COUNT << " locks: conflict check " << nTimeConflicts * 1000 / CONFLICT_CHECKS << " ns per transaction, "
+         << "clean up walking the locks " << nTimeWalk / CLEAN_COUNT << " us, by expiration " << nTimeIndexed / CLEAN_COUNT << " us" << endl;
+
+    SetMockTime(0);
+    swiftTxManager.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
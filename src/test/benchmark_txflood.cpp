@@ -0,0 +1,120 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures how many relayed transactions per second make it into the
+// mempool, once when they are processed one by one the way the message
+// handler used to do it, and once when they go through the pre-validation
+// threads first.
+//
+
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "net.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "txprevalidator.h"
+#include "utiltime.h"
+
+#include <iostream>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_txflood)
+
+static const unsigned int FLOOD_SIZE = 4000;
+
+static void CreateFlood(CBasicKeyStore& keystore, const CScript& scriptPubKey, vector<CTransaction>& vFlood)
+{
+    LOCK(cs_main);
+    for (unsigned int i = 0; i < FLOOD_SIZE; i++) {
+        CMutableTransaction txFrom;
+        txFrom.vin.resize(1);
+        txFrom.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        txFrom.vout.resize(1);
+        txFrom.vout[0].scriptPubKey = scriptPubKey;
+        txFrom.vout[0].nValue = COIN;
+        AddCoins(*pcoinsTip, txFrom, 1);
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        tx.vout[0].nValue = COIN - CENT;
+        BOOST_CHECK(SignSignature(keystore, txFrom, tx, 0));
+        vFlood.push_back(tx);
+    }
+}
+
+static void RemoveFlood(const vector<CTransaction>& vFlood)
+{
+    LOCK(cs_main);
+    BOOST_FOREACH (const CTransaction& tx, vFlood) {
+        pcoinsTip->SpendCoin(tx.vin[0].prevout);
+        pcoinsTip->SpendCoin(COutPoint(tx.GetHash(), 0));
+    }
+    mempool.clear();
+}
+
+static void Report(const char* strName, int64_t nElapsed)
+{
+    cout << strName << ": accepted " << FLOOD_SIZE << " transactions in " << nElapsed / 1000.0 << " ms ("
+         << (nElapsed > 0 ? FLOOD_SIZE * 1000000 / nElapsed : 0) << " tx/s)" << endl;
+}
+
+BOOST_AUTO_TEST_CASE(txflood)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // The two runs use different transactions, so that the second one does
+    // not find the signatures of the first in the signature cache.
+    vector<CTransaction> vInline, vPreValidated;
+    CreateFlood(keystore, scriptPubKey, vInline);
+    CreateFlood(keystore, scriptPubKey, vPreValidated);
+
+    CAddress addr;
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+
+    int64_t nStart = GetTimeMicros();
+    BOOST_FOREACH (const CTransaction& tx, vInline)
+        ProcessTransaction(&dummyNode, tx, "tx", false);
+    Report("inline", GetTimeMicros() - nStart);
+    BOOST_CHECK_EQUAL(mempool.size(), FLOOD_SIZE);
+
+    boost::thread_group threadGroup;
+    CTxPreValidator preValidator;
+    // Room for the whole flood, so that none of it is processed inline
+    preValidator.Start(threadGroup, 4, FLOOD_SIZE);
+
+    nStart = GetTimeMicros();
+    BOOST_FOREACH (const CTransaction& tx, vPreValidated) {
+        if (!preValidator.Submit(tx, &dummyNode, "tx", false))
+            ProcessTransaction(&dummyNode, tx, "tx", false);
+    }
+    int64_t nDeadline = GetTimeMillis() + 60 * 1000;
+    while (mempool.size() < 2 * FLOOD_SIZE && GetTimeMillis() < nDeadline)
+        MilliSleep(1);
+    Report("pre-validated", GetTimeMicros() - nStart);
+    BOOST_CHECK_EQUAL(mempool.size(), 2 * FLOOD_SIZE);
+
+    preValidator.Stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    BOOST_CHECK_EQUAL(dummyNode.GetRefCount(), 0);
+
+    RemoveFlood(vInline);
+    RemoveFlood(vPreValidated);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,137 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Measures how fast blocks are connected to a coins cache that is too small
+// to hold the whole UTXO set, and how often the cache has to go to the
+// database. The blocks spend single outputs of large transactions, like
+// exchange and masternode payouts, which with the per output records no
+// longer pull in or write back every other output of the transaction.
+//
+
+#include "coins.h"
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "undo.h"
+#include "utiltime.h"
+
+#include <iostream>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(benchmark_utxo)
+
+static const unsigned int PAYOUT_COUNT = 2000;
+static const unsigned int OUTPUTS_PER_PAYOUT = 100;
+static const unsigned int BLOCK_COUNT = 500;
+static const unsigned int TXS_PER_BLOCK = 100;
+
+/** Counts the lookups that missed the cache and the writes that reach the database */
+class CCoinsViewCounting : public CCoinsViewBacked
+{
+public:
+    mutable uint64_t nLookups;
+    uint64_t nWrites;
+    uint64_t nFlushes;
+
+    CCoinsViewCounting(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), nLookups(0), nWrites(0), nFlushes(0) {}
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
+    {
+        nLookups++;
+        return CCoinsViewBacked::GetCoin(outpoint, coin);
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                nWrites++;
+        }
+        nFlushes++;
+        return CCoinsViewBacked::BatchWrite(mapCoins, hashBlock);
+    }
+};
+
+static CTransaction MakePayout(unsigned int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        uint256 hash = GetRandHash();
+        tx.vout[i].nValue = 1 + insecure_rand() % COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(utxo_connect)
+{
+    seed_insecure_rand(true);
+    CCoinsViewDB viewDB(1 << 23, true, true);
+    CCoinsViewCounting viewCounting(&viewDB);
+
+    // The payouts whose outputs the blocks spend, on disk
+    vector<COutPoint> vUnspent;
+    {
+        CCoinsViewCache viewSetup(&viewCounting);
+        for (unsigned int i = 0; i < PAYOUT_COUNT; i++) {
+            CTransaction tx = MakePayout(OUTPUTS_PER_PAYOUT);
+            AddCoins(viewSetup, tx, 1);
+            for (unsigned int n = 0; n < tx.vout.size(); n++)
+                vUnspent.push_back(COutPoint(tx.GetHash(), n));
+        }
+        viewSetup.SetBestBlock(GetRandHash());
+        BOOST_REQUIRE(viewSetup.Flush());
+    }
+    viewCounting.nWrites = 0;
+    viewCounting.nFlushes = 0;
+
+    // Keep about a tenth of the payouts in memory
+    CCoinsViewCache view(&viewCounting);
+    const size_t nCacheUsage = PAYOUT_COUNT * OUTPUTS_PER_PAYOUT / 10 * 150;
+
+    uint64_t nAccesses = 0;
+    int64_t nStart = GetTimeMicros();
+    for (unsigned int nBlock = 0; nBlock < BLOCK_COUNT; nBlock++) {
+        for (unsigned int i = 0; i < TXS_PER_BLOCK; i++) {
+            // Spend a random output and pay it to two new ones
+            unsigned int nIndex = insecure_rand() % vUnspent.size();
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = vUnspent[nIndex];
+            vUnspent[nIndex] = vUnspent.back();
+            vUnspent.pop_back();
+            tx.vout = MakePayout(2).vout;
+
+            CTransaction txConst(tx);
+            BOOST_REQUIRE(view.HaveInputs(txConst));
+            CValidationState state;
+            CTxUndo undo;
+            UpdateCoins(txConst, state, view, undo, 2 + nBlock);
+            BOOST_CHECK_EQUAL(undo.vprevout.size(), 1U);
+            nAccesses++;
+            for (unsigned int n = 0; n < txConst.vout.size(); n++)
+                vUnspent.push_back(COutPoint(txConst.GetHash(), n));
+        }
+        view.SetBestBlock(GetRandHash());
+        if (view.DynamicMemoryUsage() > nCacheUsage)
+            BOOST_REQUIRE(view.Flush());
+    }
+    BOOST_REQUIRE(view.Flush());
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    cout << "connected " << BLOCK_COUNT << " blocks of " << TXS_PER_BLOCK << " transactions in " << nElapsed / 1000.0 << " ms ("
+         << (nElapsed > 0 ? (uint64_t)BLOCK_COUNT * 1000000 / nElapsed : 0) << " blocks/s)" << endl;
+    cout << "cache hit rate " << (nAccesses > 0 ? 100.0 * (nAccesses - min(viewCounting.nLookups, nAccesses)) / nAccesses : 0) << "% ("
+         << viewCounting.nLookups << " database lookups), " << viewCounting.nWrites << " coins written in "
+         << viewCounting.nFlushes << " flushes" << endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
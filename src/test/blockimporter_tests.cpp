@@ -0,0 +1,145 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimporter.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+namespace
+{
+uint256 HashHeaderBytes(const CBlockHeader& header)
+{
+    if (header.nVersion < 4)
+        return XEVAN(BEGIN(header.nVersion), END(header.nNonce));
+    return XEVAN(BEGIN(header.nVersion), END(header.nAccumulatorCheckpoint));
+}
+
+void HashHeaders(const vector<CBlockHeader>* pvHeader, const vector<uint256>* pvHash, std::atomic<int>* pnMismatch)
+{
+    for (int nRound = 0; nRound < 4; nRound++) {
+        for (unsigned int i = 0; i < pvHeader->size(); i++) {
+            if ((*pvHeader)[i].GetHash() != (*pvHash)[i])
+                (*pnMismatch)++;
+        }
+    }
+}
+
+//! Append a record as found in the block files, returning the position of the block
+unsigned int WriteRecord(CDataStream& ss, const CBlock& block)
+{
+    unsigned int nSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    ss << FLATDATA(Params().MessageStart()) << nSize;
+    unsigned int nPos = ss.size();
+    ss << block;
+    return nPos;
+}
+
+FILE* OpenImportFile(const CDataStream& ss)
+{
+    FILE* file = fopen((GetDataDir() / "import.dat").string().c_str(), "w+b");
+    BOOST_REQUIRE(file != NULL);
+    BOOST_REQUIRE_EQUAL(fwrite(&ss[0], 1, ss.size(), file), ss.size());
+    rewind(file);
+    return file;
+}
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(blockimporter_tests)
+
+BOOST_AUTO_TEST_CASE(header_hash_cache_test)
+{
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    BOOST_CHECK(header.GetHash() == HashHeaderBytes(header));
+    BOOST_CHECK(header.GetHash() == Params().HashGenesisBlock());
+
+    // A header changed since it was hashed misses, also when only bytes
+    // outside of the index of its entry changed
+    header.nNonce++;
+    BOOST_CHECK(header.GetHash() == HashHeaderBytes(header));
+    header.nVersion = 4;
+    header.nAccumulatorCheckpoint = GetRandHash();
+    uint256 hash = HashHeaderBytes(header);
+    BOOST_CHECK(header.GetHash() == hash);
+    header.nAccumulatorCheckpoint = GetRandHash();
+    BOOST_CHECK(header.GetHash() != hash);
+    BOOST_CHECK(header.GetHash() == HashHeaderBytes(header));
+}
+
+BOOST_AUTO_TEST_CASE(header_hash_cache_threads_test)
+{
+    // Half of the headers share a single entry, so that threads keep
+    // replacing it while others read it
+    vector<CBlockHeader> vHeader;
+    vector<uint256> vHash;
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    for (unsigned int i = 0; i < 64; i++) {
+        header.nNonce = i;
+        vHeader.push_back(header);
+        header.nNonce = i << 10;
+        vHeader.push_back(header);
+    }
+    for (unsigned int i = 0; i < vHeader.size(); i++)
+        vHash.push_back(HashHeaderBytes(vHeader[i]));
+
+    std::atomic<int> nMismatch(0);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&HashHeaders, &vHeader, &vHash, &nMismatch));
+    threads.join_all();
+    BOOST_CHECK_EQUAL(nMismatch.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(import_records_test)
+{
+    CBlockImporter importer;
+    importer.SetThreads(2);
+
+    const CBlock& genesis = Params().GenesisBlock();
+    CBlock orphan = genesis;
+    orphan.hashPrevBlock = GetRandHash();
+    orphan.nNonce++;
+
+    // Garbage holding the first byte of the magic, a block, a record cut
+    // short by the end of the file that hides the records after it, and
+    // another block
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (unsigned char)0 << (unsigned char)Params().MessageStart()[0] << (unsigned char)0;
+    WriteRecord(ss, genesis);
+    unsigned int nSizeCut = MAX_BLOCK_SIZE_CURRENT;
+    ss << FLATDATA(Params().MessageStart()) << nSizeCut;
+    unsigned int nPos = WriteRecord(ss, genesis);
+
+    // The genesis block is known already, so nothing is imported, but the
+    // last record found is the one after the cut record
+    CDiskBlockPos pos(0, 0);
+    BOOST_CHECK(!importer.Load(OpenImportFile(ss), &pos));
+    BOOST_CHECK_EQUAL(pos.nPos, nPos);
+
+    // A block with an unknown parent is set aside, not indexed
+    nPos = WriteRecord(ss, orphan);
+    pos = CDiskBlockPos(0, 0);
+    BOOST_CHECK(!importer.Load(OpenImportFile(ss), &pos));
+    BOOST_CHECK_EQUAL(pos.nPos, nPos);
+    BOOST_CHECK(mapBlockIndex.count(genesis.GetHash()));
+    BOOST_CHECK(!mapBlockIndex.count(orphan.GetHash()));
+
+    boost::filesystem::remove(GetDataDir() / "import.dat");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
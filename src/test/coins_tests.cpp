@@ -1,12 +1,18 @@
 // Copyright (c) 2014 The Bitcoin Core developers
-// Copyright (c) 2017 The PIVX developers     
+// Copyright (c) 2017 The PIVX developers
 // Copyright (c) 2018 The Xuez developers
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "coinsflusher.h"
+#include "memusage.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
+#include "undo.h"
+#include "utilstrencodings.h"
+#include "utxostats.h"
 
 #include <vector>
 #include <map>
@@ -18,27 +24,27 @@ namespace
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
-    std::map<uint256, CCoins> map_;
+    std::map<COutPoint, Coin> map_;
 
 public:
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
-        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
             return false;
         }
-        coins = it->second;
-        if (coins.IsPruned() && insecure_rand() % 2 == 0) {
+        coin = it->second;
+        if (coin.IsSpent() && insecure_rand() % 2 == 0) {
             // Randomly return false in case of an empty entry.
             return false;
         }
         return true;
     }
 
-    bool HaveCoins(const uint256& txid) const
+    bool HaveCoin(const COutPoint& outpoint) const
     {
-        CCoins coins;
-        return GetCoins(txid, coins);
+        Coin coin;
+        return GetCoin(outpoint, coin);
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
@@ -46,20 +52,126 @@ public:
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
-            map_[it->first] = it->second.coins;
-            if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
-                // Randomly delete empty entries on write.
-                map_.erase(it->first);
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                // Same optimization used in CCoinsViewDB is to only write dirty entries.
+                map_[it->first] = it->second.coin;
+                if (it->second.coin.IsSpent() && insecure_rand() % 3 == 0) {
+                    // Randomly delete empty entries on write.
+                    map_.erase(it->first);
+                }
             }
             mapCoins.erase(it++);
         }
-        mapCoins.clear();
-        hashBestBlock_ = hashBlock;
+        if (hashBlock != uint256(0))
+            hashBestBlock_ = hashBlock;
         return true;
     }
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewCacheTest : public CCoinsViewCache
+{
+public:
+    CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+
+    void SelfTest() const
+    {
+        // Manually recompute the dynamic usage of the whole data, and compare it.
+        size_t ret = memusage::DynamicUsage(cacheCoins);
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+            ret += it->second.coin.DynamicMemoryUsage();
+        }
+        BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
+    }
+};
+
+/** Gives access to the database under a CCoinsViewDB, to write old records */
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true, true) {}
+    CLevelDBWrapper& GetDB() { return db; }
+};
+
+/** Counts the lookups that miss a cache and the coins written back */
+class CCoinsViewCounting : public CCoinsViewBacked
+{
+public:
+    mutable uint64_t nLookups;
+    uint64_t nWrites;
+
+    CCoinsViewCounting(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), nLookups(0), nWrites(0) {}
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
+    {
+        nLookups++;
+        return CCoinsViewBacked::GetCoin(outpoint, coin);
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                nWrites++;
+        }
+        return CCoinsViewBacked::BatchWrite(mapCoins, hashBlock);
+    }
+};
+
+/** Serializes outputs the way the per transaction chainstate records did */
+class CLegacyCoins
+{
+public:
+    bool fCoinBase;
+    bool fCoinStake;
+    std::vector<CTxOut> vout; // spent outputs are null
+    int nHeight;
+    int nVersion;
+
+    CLegacyCoins() : fCoinBase(false), fCoinStake(false), nHeight(0), nVersion(1) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersionIn) const
+    {
+        CDataStream ss(nType, nVersionIn);
+        ss << *this;
+        return ss.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersionIn) const
+    {
+        unsigned int nMaskSize = 0, nMaskCode = 0;
+        for (unsigned int b = 0; 2 + b * 8 < vout.size(); b++) {
+            bool fZero = true;
+            for (unsigned int i = 0; i < 8 && 2 + b * 8 + i < vout.size(); i++) {
+                if (!vout[2 + b * 8 + i].IsNull())
+                    fZero = false;
+            }
+            if (!fZero) {
+                nMaskSize = b + 1;
+                nMaskCode++;
+            }
+        }
+        bool fFirst = vout.size() > 0 && !vout[0].IsNull();
+        bool fSecond = vout.size() > 1 && !vout[1].IsNull();
+        unsigned int nCode = 16 * (nMaskCode - (fFirst || fSecond ? 0 : 1)) + (fCoinBase ? 1 : 0) + (fCoinStake ? 2 : 0) + (fFirst ? 4 : 0) + (fSecond ? 8 : 0);
+        ::Serialize(s, VARINT(nVersion), nType, nVersionIn);
+        ::Serialize(s, VARINT(nCode), nType, nVersionIn);
+        for (unsigned int b = 0; b < nMaskSize; b++) {
+            unsigned char chAvail = 0;
+            for (unsigned int i = 0; i < 8 && 2 + b * 8 + i < vout.size(); i++)
+                if (!vout[2 + b * 8 + i].IsNull())
+                    chAvail |= (1 << i);
+            ::Serialize(s, chAvail, nType, nVersionIn);
+        }
+        for (unsigned int i = 0; i < vout.size(); i++) {
+            if (!vout[i].IsNull())
+                ::Serialize(s, CTxOutCompressor(REF(vout[i])), nType, nVersionIn);
+        }
+        ::Serialize(s, VARINT(nHeight), nType, nVersionIn);
+    }
+};
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -69,7 +181,7 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // This is a large randomized insert/remove simulation test on a variable-size
 // stack of caches on top of CCoinsViewTest.
 //
-// It will randomly create/update/delete CCoins entries to a tip of caches, with
+// It will randomly create/update/delete Coin entries to a tip of caches, with
 // txids picked from a limited list of random 256-bit hashes. Occasionally, a
 // new tip is added to the stack of caches, or the tip is flushed and removed.
 //
@@ -81,18 +193,20 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool removed_all_caches = false;
     bool reached_4_caches = false;
     bool added_an_entry = false;
+    bool added_an_unspendable_entry = false;
     bool removed_an_entry = false;
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool uncached_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
-    std::vector<CCoinsViewCache*> stack; // A stack of CCoinsViewCaches on top.
-    stack.push_back(new CCoinsViewCache(&base)); // Start with one cache.
+    std::vector<CCoinsViewCacheTest*> stack; // A stack of CCoinsViewCaches on top.
+    stack.push_back(new CCoinsViewCacheTest(&base)); // Start with one cache.
 
     // Use a limited set of random transaction ids, so we do test overwriting entries.
     std::vector<uint256> txids;
@@ -105,55 +219,90 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         // Do a random modification.
         {
             uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
-            CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
-                    added_an_entry = true;
+            Coin& coin = result[COutPoint(txid, 0)];
+            // Looking up a missing txid walks all possible outputs, so only
+            // look up the ones we know by txid
+            const Coin& entry = (insecure_rand() % 500 == 0 && !coin.IsSpent()) ? AccessByTxid(*stack.back(), txid) : stack.back()->AccessCoin(COutPoint(txid, 0));
+            BOOST_CHECK(coin == entry);
+
+            if (insecure_rand() % 5 == 0 || coin.IsSpent()) {
+                Coin newcoin;
+                newcoin.out.nValue = insecure_rand();
+                newcoin.nHeight = 1;
+                newcoin.fCoinStake = insecure_rand() % 2;
+                bool fOverwrite = !coin.IsSpent() || insecure_rand() % 2;
+                if (insecure_rand() % 16 == 0 && coin.IsSpent()) {
+                    newcoin.out.scriptPubKey.assign(1 + (insecure_rand() & 0x3F), OP_RETURN);
+                    BOOST_CHECK(newcoin.out.scriptPubKey.IsUnspendable());
+                    added_an_unspendable_entry = true;
                 } else {
-                    updated_an_entry = true;
+                    // Random sizes so we can test memory usage accounting
+                    newcoin.out.scriptPubKey.assign(insecure_rand() & 0x3F, 0);
+                    if (coin.IsSpent())
+                        added_an_entry = true;
+                    else
+                        updated_an_entry = true;
+                    coin = newcoin;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
+                stack.back()->AddCoin(COutPoint(txid, 0), newcoin, fOverwrite);
             } else {
-                coins.Clear();
-                entry->Clear();
                 removed_an_entry = true;
+                coin.Clear();
+                stack.back()->SpendCoin(COutPoint(txid, 0));
             }
         }
 
+        // Once every 10 iterations, remove a random entry from the cache
+        if (insecure_rand() % 10 == 0) {
+            COutPoint out(txids[insecure_rand() % txids.size()], 0);
+            int cacheid = insecure_rand() % stack.size();
+            stack[cacheid]->Uncache(out);
+            uncached_an_entry |= !stack[cacheid]->HaveCoinInCache(out);
+        }
+
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                    found_an_entry = true;
-                } else {
-                    BOOST_CHECK(it->second.IsPruned());
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                bool have = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(have == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
+                if (coin.IsSpent()) {
                     missed_an_entry = true;
+                } else {
+                    BOOST_CHECK(stack.back()->HaveCoinInCache(it->first));
+                    found_an_entry = true;
                 }
             }
+            for (unsigned int j = 0; j < stack.size(); j++) {
+                stack[j]->SelfTest();
+            }
         }
 
+        if (insecure_rand() % 100 == 0) {
+            // Every 100 iterations, flush an intermediate cache
+            if (stack.size() > 1 && insecure_rand() % 2 == 0) {
+                unsigned int flushIndex = insecure_rand() % (stack.size() - 1);
+                stack[flushIndex]->Flush();
+            }
+        }
         if (insecure_rand() % 100 == 0) {
             // Every 100 iterations, change the cache stack.
             if (stack.size() > 0 && insecure_rand() % 2 == 0) {
+                //Remove the top cache
                 stack.back()->Flush();
                 delete stack.back();
                 stack.pop_back();
             }
             if (stack.size() == 0 || (stack.size() < 4 && insecure_rand() % 2)) {
+                //Add a new cache
                 CCoinsView* tip = &base;
                 if (stack.size() > 0) {
                     tip = stack.back();
                 } else {
                     removed_all_caches = true;
                 }
-                stack.push_back(new CCoinsViewCache(tip));
+                stack.push_back(new CCoinsViewCacheTest(tip));
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -171,10 +320,282 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(removed_all_caches);
     BOOST_CHECK(reached_4_caches);
     BOOST_CHECK(added_an_entry);
+    BOOST_CHECK(added_an_unspendable_entry);
     BOOST_CHECK(removed_an_entry);
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(uncached_an_entry);
+}
+
+BOOST_AUTO_TEST_CASE(coin_serialization_test)
+{
+    // Unspent output of a transaction at height 313710
+    CDataStream ss1(ParseHex("cbca38835800816115944e077fe7c803cfa57f29b36bf87c1d35"), SER_DISK, CLIENT_VERSION);
+    Coin c1;
+    ss1 >> c1;
+    BOOST_CHECK_EQUAL(c1.IsCoinBase(), false);
+    BOOST_CHECK_EQUAL(c1.IsCoinStake(), false);
+    BOOST_CHECK_EQUAL(c1.nHeight, 313710U);
+    BOOST_CHECK_EQUAL(c1.out.nValue, 60000000000LL);
+    BOOST_CHECK(c1.out.scriptPubKey == CScript() << OP_DUP << OP_HASH160 << ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35") << OP_EQUALVERIFY << OP_CHECKSIG);
+
+    // The coinbase and coinstake flags survive a round trip
+    Coin c2(c1.out, 120891, true, false);
+    Coin c3(c1.out, 120891, false, true);
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss2 << c2 << c3;
+    BOOST_CHECK_EQUAL(ss2.size(), 2 * ::GetSerializeSize(c2, SER_DISK, CLIENT_VERSION));
+    Coin c4, c5;
+    ss2 >> c4 >> c5;
+    BOOST_CHECK(c4 == c2);
+    BOOST_CHECK(c4.IsCoinBase() && !c4.IsCoinStake());
+    BOOST_CHECK(c5 == c3);
+    BOOST_CHECK(!c5.IsCoinBase() && c5.IsCoinStake());
+    BOOST_CHECK(c2 != c3);
+}
+
+BOOST_AUTO_TEST_CASE(undo_serialization_test)
+{
+    CTxOut out(50 * COIN, CScript() << OP_TRUE);
+
+    // Undo data of older versions: the last spend of a transaction carries
+    // its height, flags and version, other spends only the output.
+    CDataStream ssOld(SER_DISK, CLIENT_VERSION);
+    WriteCompactSize(ssOld, 2);
+    unsigned int nCode = 1000 * 4 + 1;
+    int nVersion = 1;
+    ssOld << VARINT(nCode) << VARINT(nVersion) << CTxOutCompressor(out);
+    nCode = 0;
+    ssOld << VARINT(nCode) << CTxOutCompressor(out);
+    std::string strOld = ssOld.str();
+
+    CTxUndo undo;
+    ssOld >> undo;
+    BOOST_CHECK(ssOld.empty());
+    BOOST_REQUIRE_EQUAL(undo.vprevout.size(), 2U);
+    BOOST_CHECK_EQUAL(undo.vprevout[0].nHeight, 1000U);
+    BOOST_CHECK(undo.vprevout[0].IsCoinStake() && !undo.vprevout[0].IsCoinBase());
+    BOOST_CHECK(undo.vprevout[0].out == out);
+    BOOST_CHECK_EQUAL(undo.vprevout[1].nHeight, 0U);
+    BOOST_CHECK(undo.vprevout[1].out == out);
+
+    // Written back, the records are the same as before
+    CDataStream ssNew(SER_DISK, CLIENT_VERSION);
+    ssNew << undo;
+    BOOST_CHECK_EQUAL(ssNew.size(), ::GetSerializeSize(undo, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK_EQUAL(ssNew.size(), strOld.size());
+}
+
+BOOST_AUTO_TEST_CASE(coins_upgrade_test)
+{
+    CCoinsViewDBTest view;
+    std::map<COutPoint, Coin> expected;
+
+    for (int i = 0; i < 100; i++) {
+        CLegacyCoins coins;
+        coins.fCoinBase = i % 10 == 0;
+        coins.fCoinStake = i % 10 == 1;
+        coins.nHeight = 1 + i;
+        uint256 txid = GetRandHash();
+        for (int n = 0; n < 1 + i % 20; n++) {
+            CTxOut out(insecure_rand() % COIN, CScript() << std::vector<unsigned char>(20, n) << OP_CHECKSIG);
+            if (n % 3 == 1) {
+                out.SetNull();
+            } else if (n == 5) {
+                out.scriptPubKey = CScript() << OP_RETURN;
+            } else {
+                expected[COutPoint(txid, n)] = Coin(out, coins.nHeight, coins.fCoinBase, coins.fCoinStake);
+            }
+            coins.vout.push_back(out);
+        }
+        BOOST_CHECK(view.GetDB().Write(std::make_pair('c', txid), coins));
+    }
+
+    BOOST_CHECK(view.Upgrade());
+    for (std::map<COutPoint, Coin>::iterator it = expected.begin(); it != expected.end(); it++) {
+        Coin coin;
+        BOOST_CHECK(view.GetCoin(it->first, coin));
+        BOOST_CHECK(coin == it->second);
+        BOOST_CHECK_EQUAL(coin.IsCoinBase(), it->second.IsCoinBase());
+        BOOST_CHECK_EQUAL(coin.IsCoinStake(), it->second.IsCoinStake());
+        BOOST_CHECK(!view.HaveCoin(COutPoint(it->first.hash, 1)));
+        BOOST_CHECK(!view.HaveCoin(COutPoint(it->first.hash, 5)));
+        BOOST_CHECK(!view.GetDB().Exists(std::make_pair('c', it->first.hash)));
+    }
+
+    // Upgrading again finds nothing left to do
+    BOOST_CHECK(view.Upgrade());
+    BOOST_CHECK(view.HaveCoin(expected.begin()->first));
+}
+
+
+BOOST_AUTO_TEST_CASE(coins_flusher_test)
+{
+    for (int nMode = 0; nMode < 2; nMode++) {
+        CCoinsViewDBTest db;
+        CCoinsViewFlusher flusher(&db, &db);
+        if (nMode == 1)
+            flusher.Start();
+        CCoinsViewCache cache(&flusher);
+
+        std::vector<COutPoint> vOutpoints;
+        for (int i = 0; i < 200; i++) {
+            COutPoint outpoint(GetRandHash(), i % 3);
+            Coin coin(CTxOut(1 + i, CScript() << OP_TRUE), 1 + i, false, false);
+            cache.AddCoin(outpoint, coin, false);
+            vOutpoints.push_back(outpoint);
+        }
+        uint256 hashFirst = GetRandHash();
+        cache.SetBestBlock(hashFirst);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+        // Whether or not the snapshot is on disk yet, the flusher has the coins
+        BOOST_CHECK(flusher.GetBestBlock() == hashFirst);
+        for (unsigned int i = 0; i < vOutpoints.size(); i++) {
+            BOOST_CHECK(flusher.HaveCoin(vOutpoints[i]));
+        }
+
+        // Spend half of them while the first snapshot may still be written
+        for (unsigned int i = 0; i < vOutpoints.size(); i += 2) {
+            BOOST_CHECK(cache.SpendCoin(vOutpoints[i]));
+        }
+        uint256 hashSecond = GetRandHash();
+        cache.SetBestBlock(hashSecond);
+        BOOST_CHECK(cache.Flush());
+        for (unsigned int i = 0; i < vOutpoints.size(); i++) {
+            BOOST_CHECK_EQUAL(flusher.HaveCoin(vOutpoints[i]), i % 2 == 1);
+        }
+
+        BOOST_CHECK(flusher.Sync());
+        BOOST_CHECK(db.GetBestBlock() == hashSecond);
+        for (unsigned int i = 0; i < vOutpoints.size(); i++) {
+            BOOST_CHECK_EQUAL(db.HaveCoin(vOutpoints[i]), i % 2 == 1);
+        }
+
+        CCoinsFlushStats stats = flusher.GetFlushStats();
+        BOOST_CHECK_EQUAL(stats.nFlushes, 2U);
+        BOOST_CHECK(!stats.fPending);
+        BOOST_CHECK_EQUAL(stats.nLastCoins, vOutpoints.size() / 2);
+        BOOST_CHECK(stats.nTotalBytes > stats.nLastBytes);
+        flusher.Stop();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(utxo_stats_test)
+{
+    // The MuHash of a set does not depend on the order of the changes
+    CMuHash3072 hashForward, hashBackward, hashEmpty;
+    std::vector<uint256> vElements;
+    for (int i = 0; i < 10; i++)
+        vElements.push_back(GetRandHash());
+    for (unsigned int i = 0; i < vElements.size(); i++) {
+        hashForward.Insert(vElements[i].begin(), 32);
+        hashBackward.Insert(vElements[vElements.size() - 1 - i].begin(), 32);
+    }
+    BOOST_CHECK(hashForward.Finalize() == hashBackward.Finalize());
+    BOOST_CHECK(hashForward.Finalize() != hashEmpty.Finalize());
+    hashBackward /= hashForward;
+    BOOST_CHECK(hashBackward.Finalize() == hashEmpty.Finalize());
+    for (unsigned int i = 0; i < vElements.size(); i++)
+        hashForward.Remove(vElements[i].begin(), 32);
+    BOOST_CHECK(hashForward.Finalize() == hashEmpty.Finalize());
+
+    // Statistics kept up to date coin by coin match a scan of the database,
+    // and are written together with the coins
+    CCoinsViewDBTest db;
+    CCoinsViewFlusher flusher(&db, &db);
+    CCoinsViewCache cache(&flusher);
+    CUtxoStats stats;
+    std::vector<std::pair<COutPoint, Coin> > vCoins;
+    for (int i = 0; i < 100; i++) {
+        COutPoint outpoint(GetRandHash(), i % 300);
+        Coin coin(CTxOut(insecure_rand() % COIN, CScript() << std::vector<unsigned char>(1 + i % 40, i) << OP_CHECKSIG), 1 + i, i % 10 == 0, i % 10 == 1);
+        cache.AddCoin(outpoint, coin, false);
+        stats.AddCoin(outpoint, coin);
+        vCoins.push_back(std::make_pair(outpoint, coin));
+    }
+    stats.hashBlock = GetRandHash();
+    cache.SetBestBlock(stats.hashBlock);
+    flusher.SetUtxoStats(stats);
+    BOOST_CHECK(cache.Flush());
+
+    CCoinsStats scan;
+    BOOST_CHECK(db.GetStats(scan));
+    BOOST_CHECK(CUtxoStats(scan).Matches(stats));
+    BOOST_CHECK(scan.hashBlock == stats.hashBlock);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 100);
+    BOOST_CHECK_EQUAL((uint64_t)stats.nSerializedSize, scan.nSerializedSize);
+
+    CUtxoStats stored;
+    BOOST_CHECK(db.ReadUtxoStats(stored));
+    BOOST_CHECK(stored.hashBlock == stats.hashBlock);
+    BOOST_CHECK(stored.Matches(stats));
+
+    // Apply the changes of a block that spends some coins and creates one
+    CUtxoStats delta;
+    for (unsigned int i = 0; i < vCoins.size(); i += 3) {
+        BOOST_CHECK(cache.SpendCoin(vCoins[i].first));
+        delta.RemoveCoin(vCoins[i].first, vCoins[i].second);
+    }
+    COutPoint outpointNew(GetRandHash(), 0);
+    Coin coinNew(CTxOut(COIN, CScript() << OP_TRUE), 200, false, true);
+    cache.AddCoin(outpointNew, coinNew, false);
+    delta.AddCoin(outpointNew, coinNew);
+    delta.hashBlock = GetRandHash();
+    stats.Apply(delta);
+    cache.SetBestBlock(stats.hashBlock);
+    BOOST_CHECK(cache.Flush());
+
+    BOOST_CHECK(db.GetStats(scan));
+    BOOST_CHECK(CUtxoStats(scan).Matches(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 100 - 34 + 1);
+
+    // Without new statistics, the stored ones stay behind and are not used
+    BOOST_CHECK(db.ReadUtxoStats(stored));
+    BOOST_CHECK(stored.hashBlock != db.GetBestBlock());
+}
+
+BOOST_AUTO_TEST_CASE(coins_single_output_spend_test)
+{
+    // Spending one output of a large payout reads and writes that output
+    // only, not the record of the whole transaction
+    CCoinsViewDBTest db;
+    CCoinsViewCounting viewCounting(&db);
+
+    CMutableTransaction txPayout;
+    txPayout.vin.resize(1);
+    txPayout.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txPayout.vout.resize(100);
+    for (unsigned int i = 0; i < txPayout.vout.size(); i++) {
+        txPayout.vout[i].nValue = 1 + i;
+        txPayout.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    CTransaction txPayoutConst(txPayout);
+    {
+        CCoinsViewCache cache(&viewCounting);
+        AddCoins(cache, txPayoutConst, 1);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK_EQUAL(viewCounting.nWrites, txPayout.vout.size());
+    viewCounting.nLookups = 0;
+    viewCounting.nWrites = 0;
+
+    CCoinsViewCache cache(&viewCounting);
+    COutPoint outpointSpent(txPayoutConst.GetHash(), 42);
+    Coin coinSpent;
+    BOOST_CHECK(cache.SpendCoin(outpointSpent, &coinSpent));
+    BOOST_CHECK_EQUAL(coinSpent.out.nValue, 43);
+    BOOST_CHECK_EQUAL(viewCounting.nLookups, 1U);
+    cache.SetBestBlock(GetRandHash());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(viewCounting.nWrites, 1U);
+
+    BOOST_CHECK(!db.HaveCoin(outpointSpent));
+    BOOST_CHECK(db.HaveCoin(COutPoint(txPayoutConst.GetHash(), 41)));
+    BOOST_CHECK(db.HaveCoin(COutPoint(txPayoutConst.GetHash(), 43)));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
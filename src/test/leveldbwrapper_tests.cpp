@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "leveldbwrapper.h"
+#include "random.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(leveldbwrapper_tests)
+
+static uint256 RecordHash(unsigned int i)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << i;
+    return ss.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(leveldbwrapper_profiles)
+{
+    const unsigned int nRecords = 1000;
+    const unsigned int nBatchSize = 100;
+    const char* vNames[] = {"default", "chainstate", "blockindex", "zerocoin"};
+    for (unsigned int n = 0; n < sizeof(vNames) / sizeof(vNames[0]); n++) {
+        CLevelDBProfile profile = GetLevelDBProfile(vNames[n]);
+        BOOST_CHECK_EQUAL(profile.strName, vNames[n]);
+
+        boost::filesystem::path path = GetDataDir() / "leveldbwrapper_tests" / profile.strName;
+        boost::scoped_ptr<CLevelDBWrapper> pdb(new CLevelDBWrapper(path, 1 << 20, false, true, profile));
+
+        for (unsigned int nBatch = 0; nBatch < nRecords; nBatch += nBatchSize) {
+            CLevelDBBatch batch;
+            for (unsigned int i = nBatch; i < nBatch + nBatchSize; i++)
+                batch.Write(make_pair('C', RecordHash(i)), i);
+            BOOST_REQUIRE(pdb->WriteBatch(batch));
+        }
+        BOOST_REQUIRE(pdb->Sync());
+
+        for (unsigned int i = 0; i < nRecords; i++) {
+            unsigned int nValue = 0;
+            BOOST_CHECK(pdb->Read(make_pair('C', RecordHash(i)), nValue));
+            BOOST_CHECK_EQUAL(nValue, i);
+        }
+        BOOST_CHECK(!pdb->Exists(make_pair('C', GetRandHash())));
+
+        unsigned int nIterated = 0;
+        {
+            boost::scoped_ptr<leveldb::Iterator> pcursor(pdb->NewIterator());
+            for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next())
+                nIterated++;
+        }
+        BOOST_CHECK_EQUAL(nIterated, nRecords);
+
+        // The statistics getleveldbstats reports count the reads and writes above
+        CLevelDBStats stats = pdb->GetStats();
+        BOOST_CHECK_EQUAL(stats.profile.strName, profile.strName);
+        BOOST_CHECK_EQUAL(stats.nReads, nRecords + 1);
+        BOOST_CHECK_EQUAL(stats.nReadsNotFound, 1U);
+        BOOST_CHECK(stats.nWrites >= nRecords / nBatchSize);
+
+        pdb.reset();
+        boost::filesystem::remove_all(path);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,10 +6,28 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/transaction.h"
+#include "blockfilereader.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "init.h"
+#include "key.h"
+#include "keystore.h"
 #include "main.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
+using namespace std;
+
+extern volatile bool fRequestShutdown;
+
 BOOST_AUTO_TEST_SUITE(main_tests)
 
 BOOST_AUTO_TEST_CASE(subsidy_limit_test)
@@ -25,4 +43,250 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 2099999997690000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(check_inputs_without_scripts_test)
+{
+    // Below an assumed valid block the inputs are checked without their
+    // scripts, but the amount and maturity checks still run
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFund.vout.resize(3);
+    for (unsigned int i = 0; i < txFund.vout.size(); i++) {
+        txFund.vout[i].nValue = COIN;
+        txFund.vout[i].scriptPubKey = scriptPubKey;
+    }
+    CTransaction txFundConst(txFund);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    AddCoins(view, txFundConst, 0);
+
+    CMutableTransaction txSigned;
+    txSigned.vin.resize(1);
+    txSigned.vin[0].prevout = COutPoint(txFundConst.GetHash(), 0);
+    txSigned.vout.resize(1);
+    txSigned.vout[0].nValue = COIN - 1000;
+    txSigned.vout[0].scriptPubKey = scriptPubKey;
+    BOOST_REQUIRE(SignSignature(keystore, txFundConst, txSigned, 0));
+
+    CMutableTransaction txUnsigned = txSigned;
+    txUnsigned.vin[0].prevout = COutPoint(txFundConst.GetHash(), 1);
+    txUnsigned.vin[0].scriptSig = CScript();
+
+    CMutableTransaction txOverspend = txSigned;
+    txOverspend.vin[0].prevout = COutPoint(txFundConst.GetHash(), 2);
+    txOverspend.vout[0].nValue = COIN + 1;
+    BOOST_REQUIRE(SignSignature(keystore, txFundConst, txOverspend, 0));
+
+    LOCK(cs_main);
+    view.SetBestBlock(chainActive.Tip()->GetBlockHash());
+
+    CValidationState state;
+    BOOST_CHECK(CheckInputs(txSigned, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+    BOOST_CHECK(CheckInputs(txSigned, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+    BOOST_CHECK(!CheckInputs(txUnsigned, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+    BOOST_CHECK(CheckInputs(txUnsigned, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+    BOOST_CHECK(!CheckInputs(txOverspend, state, view, false, STANDARD_SCRIPT_VERIFY_FLAGS, false));
+}
+
+BOOST_AUTO_TEST_CASE(assume_valid_ancestors_test)
+{
+    // A chain of four blocks and a fork from its second block
+    uint256 vHash[6];
+    CBlockIndex vIndex[6];
+    for (int i = 0; i < 6; i++) {
+        vHash[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].pprev = i == 0 ? NULL : &vIndex[i == 4 ? 1 : i - 1];
+        vIndex[i].nHeight = vIndex[i].pprev ? vIndex[i].pprev->nHeight + 1 : 0;
+        vIndex[i].BuildSkip();
+    }
+
+    LOCK(cs_main);
+    CBlockIndex* pindexBestHeaderOld = pindexBestHeader;
+    uint256 hashAssumeValidOld = hashAssumeValid;
+    int nAssumeValidHeightOld = nAssumeValidHeight;
+    hashAssumeValid = vHash[2];
+    nAssumeValidHeight = 0;
+    pindexBestHeader = &vIndex[3];
+
+    // Nothing is trusted before the block is indexed
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[1], 1));
+
+    for (int i = 0; i < 6; i++)
+        mapBlockIndex[vHash[i]] = &vIndex[i];
+    BOOST_CHECK(IsBlockAssumedValid(vHash[0], 0));
+    BOOST_CHECK(IsBlockAssumedValid(vHash[2], 2));
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[3], 3));
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[4], 2));
+    BOOST_CHECK(!IsBlockAssumedValid(GetRandHash(), 1));
+
+    // Not when the block is off the best header chain or at another height
+    pindexBestHeader = &vIndex[5];
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[1], 1));
+    pindexBestHeader = &vIndex[3];
+    nAssumeValidHeight = 3;
+    BOOST_CHECK(!IsBlockAssumedValid(vHash[1], 1));
+    nAssumeValidHeight = 2;
+    BOOST_CHECK(IsBlockAssumedValid(vHash[1], 1));
+
+    for (int i = 0; i < 6; i++)
+        mapBlockIndex.erase(vHash[i]);
+    pindexBestHeader = pindexBestHeaderOld;
+    hashAssumeValid = hashAssumeValidOld;
+    nAssumeValidHeight = nAssumeValidHeightOld;
+}
+
+BOOST_AUTO_TEST_CASE(read_block_from_disk_test)
+{
+    // Files are numbered away from the blocks of the test chain
+    const int nFirstFile = 1000;
+    const unsigned int nBlocks = 20;
+    const unsigned int nBlocksPerFile = 5;
+
+    vector<CDiskBlockPos> vPos;
+    vector<uint256> vHash;
+    CDiskBlockPos posNext(nFirstFile, 0);
+    for (unsigned int i = 0; i < nBlocks; i++) {
+        if (i > 0 && i % nBlocksPerFile == 0)
+            posNext = CDiskBlockPos(posNext.nFile + 1, 0);
+
+        CBlock block;
+        block.nVersion = 4;
+        block.nTime = i;
+        block.nAccumulatorCheckpoint = GetRandHash();
+        for (unsigned int j = 0; j < 10; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(GetRandHash(), j);
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+            tx.vout[0].nValue = i;
+            block.vtx.push_back(tx);
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+
+        CDiskBlockPos pos = posNext;
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+        posNext.nPos = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        vPos.push_back(pos);
+        vHash.push_back(block.GetHash());
+    }
+
+    // Read back out of order with cached handles, memory mapped files and a
+    // single handle that keeps switching files
+    const bool vMmap[] = {false, true, DEFAULT_BLOCK_MMAP};
+    const unsigned int vHandles[] = {DEFAULT_BLOCK_FILE_HANDLES, DEFAULT_BLOCK_FILE_HANDLES, 1};
+    for (unsigned int n = 0; n < 3; n++) {
+        blockFileReader.SetLimits(vHandles[n], vMmap[n]);
+        for (unsigned int i = 0; i < nBlocks; i++) {
+            unsigned int nIndex = (i * 7) % nBlocks;
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, vPos[nIndex]));
+            BOOST_CHECK(block.GetHash() == vHash[nIndex]);
+
+            // A raw read returns the record as it was serialized
+            vector<char> vchBlock;
+            BOOST_REQUIRE(blockFileReader.ReadRecord(vPos[nIndex], "blk", 0, vchBlock));
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << block;
+            BOOST_CHECK(vector<char>(ss.begin(), ss.end()) == vchBlock);
+        }
+    }
+
+    blockFileReader.SetLimits(DEFAULT_BLOCK_FILE_HANDLES, DEFAULT_BLOCK_MMAP);
+    blockFileReader.CloseAll();
+    for (int nFile = nFirstFile; nFile <= vPos.back().nFile; nFile++)
+        boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+}
+
+/** Describe a loaded block index entry, with its links as hashes */
+static string DescribeBlockIndex(const CBlockIndex* pindex)
+{
+    return strprintf("%d %d %s %u %u %u %s %s", pindex->nHeight, pindex->nVersion, pindex->hashMerkleRoot.ToString(),
+        pindex->nTime, pindex->nBits, pindex->nNonce,
+        pindex->pprev ? pindex->pprev->GetBlockHash().ToString() : "-",
+        pindex->pnext ? pindex->pnext->GetBlockHash().ToString() : "-");
+}
+
+BOOST_AUTO_TEST_CASE(load_block_index_parallel_test)
+{
+    // A chain of headers, whose hashes are spread over the whole key space
+    const unsigned int nEntries = 64;
+    vector<CBlockHeader> vHeader(nEntries);
+    vector<uint256> vHash(nEntries);
+    set<unsigned char> setFirstBytes;
+    for (unsigned int i = 0; i < nEntries; i++) {
+        vHeader[i].nVersion = 1;
+        vHeader[i].hashPrevBlock = i > 0 ? vHash[i - 1] : uint256(0);
+        vHeader[i].hashMerkleRoot = GetRandHash();
+        vHeader[i].nTime = i;
+        vHeader[i].nBits = 0x1e0ffff0;
+        vHeader[i].nNonce = i;
+        vHash[i] = vHeader[i].GetHash();
+        setFirstBytes.insert(*vHash[i].begin() & 0xc0);
+    }
+    BOOST_REQUIRE_EQUAL(setFirstBytes.size(), 4U);
+
+    // Heights past the last PoW block, whose hashes are not checked against nBits
+    CBlockTreeDB blocktree(1 << 20, true);
+    for (unsigned int i = 0; i < nEntries; i++) {
+        CBlock block;
+        static_cast<CBlockHeader&>(block) = vHeader[i];
+        CBlockIndex index(block);
+        index.phashBlock = &vHash[i];
+        index.nHeight = Params().LAST_POW_BLOCK() + 1 + i;
+        CBlockIndex indexPrev;
+        if (i > 0) {
+            indexPrev.phashBlock = &vHash[i - 1];
+            index.pprev = &indexPrev;
+        }
+        CDiskBlockIndex diskindex(&index);
+        diskindex.hashNext = i + 1 < nEntries ? vHash[i + 1] : uint256(0);
+        BOOST_REQUIRE(blocktree.WriteBlockIndex(diskindex));
+    }
+
+    // A single thread reads the entries the way a single cursor did, four
+    // threads split them by the first byte of their hash
+    vector<string> vLoaded[2];
+    const int vThreads[] = {1, 4};
+    for (unsigned int n = 0; n < 2; n++) {
+        LOCK(cs_main);
+        BOOST_REQUIRE(blocktree.LoadBlockIndexGuts(vThreads[n]));
+        for (unsigned int i = 0; i < nEntries; i++) {
+            BlockMap::iterator mi = mapBlockIndex.find(vHash[i]);
+            BOOST_REQUIRE(mi != mapBlockIndex.end());
+            BOOST_CHECK(mi->second->GetBlockHash() == vHash[i]);
+            vLoaded[n].push_back(DescribeBlockIndex(mi->second));
+        }
+
+        if (n == 1) {
+            // The hashes taken from the keys match the headers
+            ThreadVerifyBlockIndexHashes();
+            BOOST_CHECK(!ShutdownRequested());
+
+            // A header that no longer matches its key shuts the node down
+            mapBlockIndex[vHash[nEntries / 2]]->nNonce++;
+            ThreadVerifyBlockIndexHashes();
+            BOOST_CHECK(ShutdownRequested());
+            fRequestShutdown = false;
+            strMiscWarning = "";
+        }
+
+        // Entries that are already known are not loaded again
+        for (unsigned int i = 0; i < nEntries; i++) {
+            BlockMap::iterator mi = mapBlockIndex.find(vHash[i]);
+            delete mi->second;
+            mapBlockIndex.erase(mi);
+        }
+    }
+    BOOST_CHECK(vLoaded[0] == vLoaded[1]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,528 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "main.h"
+#include "masternode-payments.h"
+#include "masternode-sync.h"
+#include "masternodedb.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "obfuscation.h"
+#include "random.h"
+#include "script/standard.h"
+#include "utiltime.h"
+#include "version.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+static CPubKey RandomPubKey()
+{
+    vector<unsigned char> vch(33);
+    GetRandBytes(&vch[0], vch.size());
+    vch[0] = 0x02;
+    return CPubKey(vch);
+}
+
+static void MakeMasternodes(vector<CMasternode>& vMasternodes, unsigned int nCount)
+{
+    vMasternodes.resize(nCount);
+    for (unsigned int i = 0; i < nCount; i++) {
+        vMasternodes[i].vin = CTxIn(COutPoint(GetRandHash(), i % 4));
+        vMasternodes[i].pubKeyMasternode = RandomPubKey();
+        vMasternodes[i].pubKeyCollateralAddress = RandomPubKey();
+        vMasternodes[i].sigTime = GetTime();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(masternode_registry_indexes)
+{
+    CMasternodeMan man;
+    vector<CMasternode> vMasternodes;
+    MakeMasternodes(vMasternodes, 3);
+    // the second masternode shares its collateral key with the first
+    vMasternodes[1].pubKeyCollateralAddress = vMasternodes[0].pubKeyCollateralAddress;
+    for (unsigned int i = 0; i < vMasternodes.size(); i++)
+        BOOST_CHECK(man.Add(vMasternodes[i]));
+    BOOST_CHECK(!man.Add(vMasternodes[0]));
+    BOOST_CHECK_EQUAL(man.size(), 3);
+
+    CMasternode* pmn = man.Find(vMasternodes[2].vin);
+    BOOST_REQUIRE(pmn != NULL);
+    BOOST_CHECK(man.Find(vMasternodes[2].pubKeyMasternode) == pmn);
+    BOOST_CHECK(man.Find(GetScriptForDestination(vMasternodes[2].pubKeyCollateralAddress.GetID())) == pmn);
+
+    // Only the pay to key hash script of the collateral key is a payee
+    BOOST_CHECK(man.Find(CScript() << ToByteVector(vMasternodes[2].pubKeyCollateralAddress) << OP_CHECKSIG) == NULL);
+
+    // A key change is found under the new key only, and the entry does not move
+    CPubKey pubKeyOld = pmn->pubKeyMasternode;
+    pmn->pubKeyMasternode = RandomPubKey();
+    man.UpdateMasternodeIndex(*pmn);
+    BOOST_CHECK(man.Find(pubKeyOld) == NULL);
+    BOOST_CHECK(man.Find(pmn->pubKeyMasternode) == pmn);
+    BOOST_CHECK(man.Find(vMasternodes[2].vin) == pmn);
+
+    // A shared payee is still found after one of its masternodes leaves
+    CScript payeeShared = GetScriptForDestination(vMasternodes[0].pubKeyCollateralAddress.GetID());
+    BOOST_CHECK(man.Find(payeeShared) != NULL);
+    man.Remove(vMasternodes[0].vin);
+    BOOST_CHECK(man.Find(vMasternodes[0].vin) == NULL);
+    BOOST_CHECK(man.Find(vMasternodes[0].pubKeyMasternode) == NULL);
+    BOOST_CHECK(man.Find(payeeShared) == man.Find(vMasternodes[1].vin));
+    BOOST_CHECK(man.Find(vMasternodes[2].vin) == pmn);
+
+    // A masternode that leaves and rejoins is found again
+    man.Remove(vMasternodes[2].vin);
+    BOOST_CHECK(man.Find(vMasternodes[2].vin) == NULL);
+    BOOST_CHECK(man.Add(vMasternodes[2]));
+    BOOST_CHECK(man.Find(vMasternodes[2].pubKeyMasternode) != NULL);
+
+    // The indexes are rebuilt when the registry is read back
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << man;
+    CMasternodeMan manRead;
+    ss >> manRead;
+    BOOST_CHECK_EQUAL(manRead.size(), 2);
+    BOOST_CHECK(manRead.Find(vMasternodes[1].pubKeyMasternode) != NULL);
+    BOOST_CHECK(manRead.Find(payeeShared) != NULL);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_state_flush_load)
+{
+    CMasternodeStateDB db(1 << 20, true);
+    CMasternodeMan man;
+    vector<CMasternode> vMasternodes;
+    MakeMasternodes(vMasternodes, 3);
+    for (unsigned int i = 0; i < vMasternodes.size(); i++)
+        man.Add(vMasternodes[i]);
+    BOOST_CHECK(man.Flush(db));
+
+    // Changes and removals are written by the next flush
+    man.Find(vMasternodes[0].vin)->sigTime++;
+    man.Remove(vMasternodes[1].vin);
+    BOOST_CHECK(man.Flush(db));
+
+    CMasternodeMan manRead;
+    BOOST_CHECK(manRead.Load(db));
+    BOOST_CHECK_EQUAL(manRead.size(), 2);
+    BOOST_CHECK(manRead.Find(vMasternodes[1].vin) == NULL);
+    BOOST_REQUIRE(manRead.Find(vMasternodes[0].vin) != NULL);
+    BOOST_CHECK_EQUAL(manRead.Find(vMasternodes[0].vin)->sigTime, vMasternodes[0].sigTime + 1);
+    BOOST_CHECK(manRead.Find(vMasternodes[2].pubKeyMasternode) != NULL);
+
+    // A database nothing was flushed to has no state to load
+    CMasternodeStateDB dbEmpty(1 << 20, true);
+    BOOST_CHECK(!manRead.Load(dbEmpty));
+}
+
+/** GetLastPaid as it was before the payee index, walking back over the chain */
+static int64_t GetLastPaidWalk(CMasternode& mn, int nEnabled)
+{
+    CScript mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mn.vin;
+    ss << mn.sigTime;
+    uint256 hash = ss.GetHash();
+    int64_t nOffset = hash.GetCompact(false) % 150;
+
+    const CBlockIndex* BlockReading = chainActive.Tip();
+    int nMnCount = nEnabled * 1.25;
+    int n = 0;
+    while (BlockReading && BlockReading->nHeight > 0) {
+        if (n >= nMnCount)
+            return 0;
+        n++;
+
+        if (masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)) {
+            if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2))
+                return BlockReading->nTime + nOffset;
+        }
+        BlockReading = BlockReading->pprev;
+    }
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE(masternode_last_paid)
+{
+    CBlockIndex* pindexTipOld = chainActive.Tip();
+
+    const int nMasternodes = 20;
+    const int nBlocks = nMasternodes * 2 + 10;
+    vector<uint256> vHashes(nBlocks);
+    vector<CBlockIndex> vIndex(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        vHashes[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].nTime = 1500000000 + i * 60;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+    }
+    chainActive.SetTip(&vIndex.back());
+    mapCacheBlockHashes.clear();
+
+    vector<CMasternode> vMasternodes;
+    MakeMasternodes(vMasternodes, nMasternodes);
+
+    // Each block of the last cycle has a winner with two votes, and some masternodes are never paid
+    int nPaid = nMasternodes * 9 / 10;
+    for (int nHeight = nBlocks - nMasternodes * 5 / 4; nHeight < nBlocks; nHeight++) {
+        CScript payee = GetScriptForDestination(vMasternodes[nHeight % nPaid].pubKeyCollateralAddress.GetID());
+        for (int nVote = 0; nVote < 2; nVote++) {
+            CMasternodePaymentWinner winner(CTxIn(COutPoint(GetRandHash(), 0)));
+            winner.nBlockHeight = nHeight;
+            winner.AddPayee(payee);
+            BOOST_CHECK(masternodePayments.AddWinningMasternode(winner));
+        }
+    }
+
+    // The payee index finds the same payments as the walk
+    int nUnpaid = 0;
+    for (int i = 0; i < nMasternodes; i++) {
+        int64_t nLastPaid = vMasternodes[i].GetLastPaid(nMasternodes);
+        BOOST_CHECK_EQUAL(nLastPaid, GetLastPaidWalk(vMasternodes[i], nMasternodes));
+        if (nLastPaid == 0)
+            nUnpaid++;
+    }
+    BOOST_CHECK_EQUAL(nUnpaid, nMasternodes - nPaid);
+
+    masternodePayments.Clear();
+    mapCacheBlockHashes.clear();
+    chainActive.SetTip(pindexTipOld);
+}
+
+/** The range of ranks GetMasternodeRank gave before the rank tables: one past the masternodes
+ *  with a higher score, up to the ones with the same score, which were in no particular order */
+static pair<int, int> GetMasternodeRankRange(vector<CMasternode>& vMasternodes, const CMasternode& mn, int64_t nBlockHeight)
+{
+    int64_t nScore = CMasternode(mn).CalculateScore(1, nBlockHeight).GetCompact(false);
+    int nHigher = 0, nEqual = 0;
+    BOOST_FOREACH (CMasternode& mnOther, vMasternodes) {
+        int64_t nScoreOther = mnOther.CalculateScore(1, nBlockHeight).GetCompact(false);
+        if (nScoreOther > nScore)
+            nHigher++;
+        else if (nScoreOther == nScore)
+            nEqual++;
+    }
+    return make_pair(nHigher + 1, nHigher + nEqual);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_rank_order)
+{
+    CBlockIndex* pindexTipOld = chainActive.Tip();
+
+    const int nBlocks = 20;
+    vector<uint256> vHashes(nBlocks);
+    vector<CBlockIndex> vIndex(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        vHashes[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+    }
+    chainActive.SetTip(&vIndex.back());
+    mapCacheBlockHashes.clear();
+
+    CMasternodeMan man;
+    vector<CMasternode> vMasternodes;
+    MakeMasternodes(vMasternodes, 64);
+    for (unsigned int i = 0; i < vMasternodes.size(); i++) {
+        vMasternodes[i].sigTime = GetAdjustedTime() - 10000;
+        BOOST_CHECK(man.Add(vMasternodes[i]));
+    }
+
+    for (int nPass = 0; nPass < 3; nPass++) {
+        // Scores cached for the blocks are kept for the masternodes that stay,
+        // and the ones that join are scored, on the score queue once they are
+        // many
+        if (nPass > 0) {
+            man.Remove(vMasternodes.back().vin);
+            vMasternodes.pop_back();
+            vector<CMasternode> vJoined;
+            MakeMasternodes(vJoined, nPass == 1 ? 8 : MN_PARALLEL_SCORE_MIN);
+            for (unsigned int i = 0; i < vJoined.size(); i++) {
+                vJoined[i].sigTime = GetAdjustedTime() - 10000;
+                BOOST_CHECK(man.Add(vJoined[i]));
+                vMasternodes.push_back(vJoined[i]);
+            }
+        }
+
+        for (int64_t nHeight = nBlocks - 5; nHeight <= nBlocks; nHeight++) {
+            for (unsigned int i = 0; i < vMasternodes.size(); i += (nPass == 2 ? 50 : 1)) {
+                pair<int, int> range = GetMasternodeRankRange(vMasternodes, vMasternodes[i], nHeight);
+                int nRank = man.GetMasternodeRank(vMasternodes[i].vin, nHeight, 0, false);
+                BOOST_CHECK(nRank >= range.first && nRank <= range.second);
+            }
+        }
+    }
+
+    mapCacheBlockHashes.clear();
+    chainActive.SetTip(pindexTipOld);
+}
+
+static void SignMessages(vector<CSignedMessage>& vMessages, unsigned int nCount)
+{
+    vector<CKey> vKeys(10);
+    for (unsigned int i = 0; i < vKeys.size(); i++)
+        vKeys[i].MakeNewKey(true);
+
+    string errorMessage;
+    vMessages.resize(nCount);
+    for (unsigned int i = 0; i < nCount; i++) {
+        const CKey& key = vKeys[i % vKeys.size()];
+        vMessages[i].pubkey = key.GetPubKey();
+        vMessages[i].strMessage = GetRandHash().ToString() + boost::lexical_cast<string>(i);
+        BOOST_CHECK(obfuScationSigner.SignMessage(vMessages[i].strMessage, errorMessage, vMessages[i].vchSig, key));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(masternode_message_signatures)
+{
+    vector<CSignedMessage> vMessages;
+    SignMessages(vMessages, 2);
+    string errorMessage;
+
+    // A cached key is still compared with the key of the masternode
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(obfuScationSigner.VerifyMessage(vMessages[0].pubkey, vMessages[0].vchSig, vMessages[0].strMessage, errorMessage));
+        BOOST_CHECK(!obfuScationSigner.VerifyMessage(vMessages[1].pubkey, vMessages[0].vchSig, vMessages[0].strMessage, errorMessage));
+    }
+
+    // The signature of one message does not verify another
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(vMessages[0].pubkey, vMessages[0].vchSig, vMessages[1].strMessage, errorMessage));
+
+    // A signature no key can be recovered from
+    vector<unsigned char> vchSigBad(65, 0);
+    BOOST_CHECK(!obfuScationSigner.VerifyMessage(vMessages[0].pubkey, vchSigBad, vMessages[0].strMessage, errorMessage));
+
+    // Batches give the same results on worker threads
+    vector<CSignedMessage> vBatch;
+    SignMessages(vBatch, OBFUSCATION_PARALLEL_VERIFY_MIN * 2);
+    vBatch[5].strMessage += "x";
+    vBatch[9].vchSig = vchSigBad;
+    vector<char> vValid;
+    BOOST_CHECK_EQUAL(obfuScationSigner.VerifyMessages(vBatch, vValid), (int)vBatch.size() - 2);
+    BOOST_REQUIRE_EQUAL(vValid.size(), vBatch.size());
+    for (unsigned int i = 0; i < vBatch.size(); i++) {
+        BOOST_CHECK_EQUAL((bool)vValid[i], i != 5 && i != 9);
+        BOOST_CHECK_EQUAL(obfuScationSigner.VerifyMessage(vBatch[i].pubkey, vBatch[i].vchSig, vBatch[i].strMessage, errorMessage), i != 5 && i != 9);
+    }
+}
+
+static const int SYNC_PEER_COUNT = 5;
+
+static void AddPeers(vector<CNode*>& vPeers)
+{
+    LOCK(cs_vNodes);
+    for (int i = 0; i < SYNC_PEER_COUNT; i++) {
+        CAddress addr(CService(CNetAddr("10.0.0." + boost::lexical_cast<std::string>(i + 1)), 18333));
+        CNode* pnode = new CNode(INVALID_SOCKET, addr, "", true);
+        pnode->nVersion = PROTOCOL_VERSION;
+        vNodes.push_back(pnode);
+        vPeers.push_back(pnode);
+    }
+}
+
+static void RemovePeers(vector<CNode*>& vPeers)
+{
+    LOCK(cs_vNodes);
+    BOOST_FOREACH (CNode* pnode, vPeers) {
+        vNodes.erase(std::find(vNodes.begin(), vNodes.end(), pnode));
+        delete pnode;
+    }
+    vPeers.clear();
+}
+
+/** The peers have no socket, so the first message sent to one disconnects it */
+static void KeepConnected(vector<CNode*>& vPeers)
+{
+    BOOST_FOREACH (CNode* pnode, vPeers)
+        pnode->fDisconnect = false;
+}
+
+static int CountAsked(const vector<CNode*>& vPeers, const std::string& strRequest)
+{
+    int nAsked = 0;
+    BOOST_FOREACH (CNode* pnode, vPeers) {
+        if (pnode->HasFulfilledRequest(strRequest))
+            nAsked++;
+    }
+    return nAsked;
+}
+
+static void SendCount(CNode* pnode, int nItemID, int nCount)
+{
+    std::string strCommand = "ssc";
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << nItemID << nCount;
+    masternodeSync.ProcessMessage(pnode, strCommand, ss);
+}
+
+/** An item arriving in a message of its own, which is checked against the sync after it is processed */
+static void SendItem(CNode* pnode)
+{
+    std::string strCommand = "mvote";
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    masternodeSync.ProcessMessage(pnode, strCommand, ss);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_sync_parallel_peers)
+{
+    const int nListCount = 100;
+    const int nBudgetCount = 1000;
+
+    // the blockchain is synced when its tip is recent
+    int64_t nNow = chainActive.Tip()->GetBlockTime() + 60;
+    SetMockTime(nNow);
+    BOOST_REQUIRE(masternodeSync.IsBlockchainSynced());
+
+    vector<CNode*> vPeers;
+    AddPeers(vPeers);
+    masternodeSync.Reset();
+    masternodeSync.GetNextAsset();
+    masternodeSync.GetNextAsset();
+    BOOST_REQUIRE_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+
+    masternodeSync.RequestAsset();
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), MASTERNODE_SYNC_PEERS);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "mnsync"), MASTERNODE_SYNC_PEERS);
+
+    // every peer announces the whole list, which counts once
+    vector<uint256> vList;
+    for (int i = 0; i < nListCount; i++)
+        vList.push_back(GetRandHash());
+    SendCount(vPeers[0], MASTERNODE_SYNC_LIST, nListCount);
+    SendCount(vPeers[1], MASTERNODE_SYNC_LIST, nListCount);
+    for (int nPeer = 0; nPeer < 2; nPeer++) {
+        BOOST_FOREACH (const uint256& hash, vList) {
+            masternodeSync.AddedMasternodeList(hash);
+            SendItem(vPeers[nPeer]);
+        }
+    }
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_LIST);
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), 1);
+
+    // the last count completes the list, and the winners are asked for straight away
+    KeepConnected(vPeers);
+    SendCount(vPeers[2], MASTERNODE_SYNC_LIST, nListCount);
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_MNW);
+    BOOST_CHECK(masternodeSync.GetAssetDurations().count(MASTERNODE_SYNC_LIST));
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), MASTERNODE_SYNC_PEERS);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "mnwsync"), MASTERNODE_SYNC_PEERS);
+
+    // peers that do not answer are replaced by the ones left
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 2 + 1);
+    KeepConnected(vPeers);
+    masternodeSync.Process();
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), SYNC_PEER_COUNT - MASTERNODE_SYNC_PEERS);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "mnwsync"), SYNC_PEER_COUNT);
+
+    // nobody answers, and without payment enforcement the sync moves on
+    SetMockTime(nNow + MASTERNODE_SYNC_TIMEOUT * 6);
+    KeepConnected(vPeers);
+    masternodeSync.Process();
+    BOOST_CHECK_EQUAL(masternodeSync.RequestedMasternodeAssets, MASTERNODE_SYNC_BUDGET);
+    BOOST_CHECK_EQUAL(CountAsked(vPeers, "busync"), MASTERNODE_SYNC_PEERS);
+
+    // the budget comes in two counts per peer
+    vector<uint256> vBudget;
+    for (int i = 0; i < nBudgetCount; i++)
+        vBudget.push_back(GetRandHash());
+    for (int nPeer = 0; nPeer < MASTERNODE_SYNC_PEERS; nPeer++) {
+        SendCount(vPeers[nPeer], MASTERNODE_SYNC_BUDGET_PROP, nBudgetCount / 2);
+        SendCount(vPeers[nPeer], MASTERNODE_SYNC_BUDGET_FIN, nBudgetCount / 2);
+    }
+    BOOST_CHECK_EQUAL(masternodeSync.CountPendingPeers(), 0);
+
+    int nItems = 0;
+    for (int nPeer = 0; nPeer < MASTERNODE_SYNC_PEERS && masternodeSync.RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET; nPeer++) {
+        for (int i = 0; i < nBudgetCount && masternodeSync.RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET; i++) {
+            masternodeSync.AddedBudgetItem(vBudget[(i * 7919 + nPeer) % nBudgetCount]);
+            SendItem(vPeers[nPeer]);
+            nItems++;
+        }
+    }
+
+    // complete with the last distinct item, before the other peers' copies
+    BOOST_CHECK_EQUAL(nItems, nBudgetCount);
+    BOOST_CHECK(masternodeSync.IsSynced());
+    BOOST_CHECK_EQUAL(masternodeSync.GetAssetDurations().size(), (size_t)4);
+
+    RemovePeers(vPeers);
+    masternodeSync.Reset();
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_gossip_filter)
+{
+    CRollingBloomFilter filter(100, GOSSIP_FILTER_FP_RATE, GetRand(1000));
+    vector<uint256> vHashes;
+    for (int i = 0; i < 300; i++) {
+        vHashes.push_back(GetRandHash());
+        filter.insert(vHashes.back());
+    }
+    // the last hundred are always remembered
+    for (int i = 200; i < 300; i++)
+        BOOST_CHECK(filter.contains(vHashes[i]));
+    filter.clear();
+    BOOST_CHECK(!filter.contains(vHashes.back()));
+
+    gossipFilter.SetSize(DEFAULT_GOSSIP_FILTER_SIZE);
+    uint256 hash = GetRandHash();
+    CInv invVote(MSG_BUDGET_VOTE, hash);
+    gossipFilter.insert(invVote);
+    BOOST_CHECK(gossipFilter.contains(invVote));
+
+    // each type has its own filter, and only pings and votes are filtered
+    BOOST_CHECK(!gossipFilter.contains(CInv(MSG_BUDGET_FINALIZED_VOTE, hash)));
+    gossipFilter.insert(CInv(MSG_SPORK, hash));
+    BOOST_CHECK(!gossipFilter.contains(CInv(MSG_SPORK, hash)));
+    gossipFilter.insert(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
+    BOOST_CHECK(!gossipFilter.contains(CInv(MSG_MASTERNODE_ANNOUNCE, hash)));
+    gossipFilter.insert(CInv(MSG_TX, hash));
+    BOOST_CHECK(!gossipFilter.contains(CInv(MSG_TX, hash)));
+
+    // the store keeps the newest pings, the evicted ones are still seen
+    gossipFilter.SetMaxSeen(100);
+    map<uint256, CMasternodePing> mapSeen;
+    vector<uint256> vPings;
+    for (int i = 0; i < 150; i++) {
+        CMasternodePing mnp;
+        mnp.sigTime = 1000 + i;
+        vPings.push_back(GetRandHash());
+        mapSeen.insert(make_pair(vPings.back(), mnp));
+        gossipFilter.Limit(mapSeen, MSG_MASTERNODE_PING, &CMasternodePing::sigTime);
+        BOOST_CHECK(mapSeen.size() <= 100);
+        BOOST_CHECK(mapSeen.count(vPings.back()));
+    }
+    for (int i = 0; i < 150; i++)
+        BOOST_CHECK(mapSeen.count(vPings[i]) || gossipFilter.contains(CInv(MSG_MASTERNODE_PING, vPings[i])));
+    BOOST_CHECK(!mapSeen.count(vPings.front()));
+
+    gossipFilter.clear(MSG_MASTERNODE_PING);
+    BOOST_CHECK(!gossipFilter.contains(CInv(MSG_MASTERNODE_PING, vPings.front())));
+    BOOST_CHECK(gossipFilter.contains(invVote));
+
+    // relaying does not fill the filter
+    CInv invRelayed(MSG_BUDGET_VOTE, GetRandHash());
+    RelayInv(invRelayed);
+    BOOST_CHECK(!gossipFilter.contains(invRelayed));
+
+    gossipFilter.SetMaxSeen(DEFAULT_MAX_GOSSIP_SEEN);
+    gossipFilter.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,13 +4,36 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
+#include "key.h"
+#include "keystore.h"
 #include "main.h"
+#include "miner.h"
+#include "net.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
 #include "txmempool.h"
+#include "txprevalidator.h"
 #include "util.h"
+#include "utiltime.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <list>
 
+// The orphans kept by main.cpp
+struct COrphanTx {
+    CTransaction tx;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
+};
+extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern void EraseOrphansFor(NodeId peer);
+
 BOOST_AUTO_TEST_SUITE(mempool_tests)
 
 BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
@@ -60,17 +83,17 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     BOOST_CHECK_EQUAL(removed.size(), 0);
 
     // Just the parent:
-    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1, 0));
     testPool.remove(txParent, removed, true);
     BOOST_CHECK_EQUAL(removed.size(), 1);
     removed.clear();
     
     // Parent, children, grandchildren:
-    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1, 0));
     for (int i = 0; i < 3; i++)
     {
-        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1));
-        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1));
+        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1, 0));
+        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1, 0));
     }
     // Remove Child[0], GrandChild[0] should be removed:
     testPool.remove(txChild[0], removed, true);
@@ -90,8 +113,8 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     // Add children and grandchildren, but NOT the parent (simulate the parent being in a block)
     for (int i = 0; i < 3; i++)
     {
-        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1));
-        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1));
+        testPool.addUnchecked(txChild[i].GetHash(), CTxMemPoolEntry(txChild[i], 0, 0, 0.0, 1, 0));
+        testPool.addUnchecked(txGrandChild[i].GetHash(), CTxMemPoolEntry(txGrandChild[i], 0, 0, 0.0, 1, 0));
     }
     // Now remove the parent, as might happen if a block-re-org occurs but the parent cannot be
     // put into the mempool (maybe because it is non-standard):
@@ -101,4 +124,419 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolDescendantTrackingTest)
+{
+    // Chain of three transactions: parent -> child -> grandchild
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 22000LL;
+
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild.GetHash();
+    txGrandChild.vin[0].prevout.n = 0;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 11000LL;
+
+    CTxMemPool pool(CFeeRate(0));
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 1000LL, 0, 0.0, 1, 0));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 2000LL, 0, 0.0, 1, 0));
+    pool.addUnchecked(txGrandChild.GetHash(), CTxMemPoolEntry(txGrandChild, 3000LL, 0, 0.0, 1, 0));
+
+    CTxMemPool::txiter it = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 3);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 6000LL);
+    it = pool.mapTx.find(txChild.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 5000LL);
+
+    // Fee deltas propagate to the ancestors' descendant state
+    pool.PrioritiseTransaction(txGrandChild.GetHash(), txGrandChild.GetHash().ToString(), 0.0, 500LL);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithDescendants(), 6500LL);
+
+    // Removing the grandchild (e.g. because it was mined) updates the ancestors
+    std::list<CTransaction> removed;
+    pool.remove(txGrandChild, removed, false);
+    it = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 2);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), 3000LL);
+    BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), it->GetTxSize() + pool.mapTx.find(txChild.GetHash())->GetTxSize());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorTrackingTest)
+{
+    // Low fee parent -> high fee child, plus an unrelated medium fee transaction
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 22000LL;
+
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].scriptSig = CScript() << OP_12;
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_12 << OP_EQUAL;
+    txOther.vout[0].nValue = 11000LL;
+
+    CTxMemPool pool(CFeeRate(0));
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0LL, 0, 0.0, 1, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 20000LL, 0, 0.0, 1, 2));
+    pool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 5000LL, 0, 0.0, 1, 1));
+
+    CTxMemPool::txiter parentIt = pool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter childIt = pool.mapTx.find(txChild.GetHash());
+    BOOST_CHECK_EQUAL(parentIt->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(childIt->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(childIt->GetModFeesWithAncestors(), 20000LL);
+    BOOST_CHECK_EQUAL(childIt->GetSizeWithAncestors(), parentIt->GetTxSize() + childIt->GetTxSize());
+    BOOST_CHECK_EQUAL(childIt->GetSigOpCountWithAncestors(), 3);
+
+    // The child pays for its parent, so its package sorts first by ancestor score
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = pool.mapTx.get<ancestor_score>().begin();
+    BOOST_CHECK(mi->GetTx().GetHash() == txChild.GetHash());
+    ++mi;
+    BOOST_CHECK(mi->GetTx().GetHash() == txOther.GetHash());
+
+    // Fee deltas propagate to the descendants' ancestor state
+    pool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, 1000LL);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txChild.GetHash())->GetModFeesWithAncestors(), 21000LL);
+
+    // Mining the parent leaves the child with no in-mempool ancestors
+    std::vector<CTransaction> vtx;
+    vtx.push_back(txParent);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 2, conflicts);
+    childIt = pool.mapTx.find(txChild.GetHash());
+    BOOST_CHECK_EQUAL(childIt->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(childIt->GetModFeesWithAncestors(), 20000LL);
+    BOOST_CHECK_EQUAL(childIt->GetSizeWithAncestors(), childIt->GetTxSize());
+    BOOST_CHECK_EQUAL(childIt->GetSigOpCountWithAncestors(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), CTxMemPoolEntry(tx1, 10000LL, 0, 10.0, 1, 0));
+
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), CTxMemPoolEntry(tx2, 5000LL, 0, 10.0, 1, 0));
+
+    BOOST_CHECK(pool.DynamicMemoryUsage() > 0);
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), 0);
+
+    pool.TrimToSize(pool.DynamicMemoryUsage()); // should do nothing
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+
+    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 4); // should remove the lower-feerate transaction
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.exists(tx2.GetHash()));
+
+    // The rolling minimum fee now covers the evicted transaction
+    CFeeRate evicted(5000LL, ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK(pool.GetMinFee(1) > evicted);
+
+    // Everything that entered before the cutoff is expired
+    BOOST_CHECK_EQUAL(pool.Expire(1), 1);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolBlockSelectionTest)
+{
+    // Independent transactions and chains of unconfirmed descendants
+    CTxMemPool pool(CFeeRate(1000));
+    seed_insecure_rand(true);
+    std::vector<uint256> vParents;
+    unsigned int nChainLength = 0;
+    for (unsigned int i = 0; i < 1000; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        if (!vParents.empty() && nChainLength < DEFAULT_ANCESTOR_LIMIT - 1 && insecure_rand() % 4 == 0) {
+            tx.vin[0].prevout = COutPoint(vParents.back(), 0);
+            nChainLength++;
+        } else {
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            nChainLength = 0;
+        }
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx.vout[1].nValue = i;
+
+        uint256 hash = tx.GetHash();
+        pool.addUnchecked(hash, CTxMemPoolEntry(tx, 1000 + insecure_rand() % 100000, GetTime(), 0.0, 1, GetLegacySigOpCount(tx)));
+        vParents.push_back(hash);
+    }
+
+    LOCK(pool.cs);
+    std::vector<CTxMemPool::txiter> vSelected;
+    SelectMempoolTransactions(pool, 2, DEFAULT_BLOCK_MAX_SIZE, DEFAULT_BLOCK_PRIORITY_SIZE, DEFAULT_BLOCK_MIN_SIZE, vSelected);
+
+    // The selection is valid as block order: every in-mempool parent is
+    // selected before its children, and the block size is respected
+    CTxMemPool::setEntries setSelected;
+    uint64_t nTotalSize = 0;
+    BOOST_FOREACH (CTxMemPool::txiter it, vSelected) {
+        BOOST_FOREACH (CTxMemPool::txiter parent, pool.GetMemPoolParents(it)) {
+            BOOST_CHECK(setSelected.count(parent));
+        }
+        BOOST_CHECK(setSelected.insert(it).second);
+        nTotalSize += it->GetTxSize();
+    }
+    BOOST_CHECK(nTotalSize < DEFAULT_BLOCK_MAX_SIZE);
+    BOOST_CHECK(!vSelected.empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPreValidationTest)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // Chains of a parent and a child, relayed in that order
+    std::vector<CTransaction> vRelayed;
+    std::vector<COutPoint> vFunding;
+    {
+        LOCK(cs_main);
+        for (unsigned int i = 0; i < 50; i++) {
+            CMutableTransaction txFrom;
+            txFrom.vin.resize(1);
+            txFrom.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            txFrom.vout.resize(1);
+            txFrom.vout[0].scriptPubKey = scriptPubKey;
+            txFrom.vout[0].nValue = COIN;
+            AddCoins(*pcoinsTip, txFrom, 1);
+            vFunding.push_back(COutPoint(txFrom.GetHash(), 0));
+
+            CMutableTransaction txParent;
+            txParent.vin.resize(1);
+            txParent.vin[0].prevout = vFunding.back();
+            txParent.vout.resize(1);
+            txParent.vout[0].scriptPubKey = scriptPubKey;
+            txParent.vout[0].nValue = COIN - CENT;
+            BOOST_REQUIRE(SignSignature(keystore, txFrom, txParent, 0));
+            vRelayed.push_back(txParent);
+
+            CMutableTransaction txChild;
+            txChild.vin.resize(1);
+            txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+            txChild.vout.resize(1);
+            txChild.vout[0].scriptPubKey = scriptPubKey;
+            txChild.vout[0].nValue = COIN - 2 * CENT;
+            BOOST_REQUIRE(SignSignature(keystore, txParent, txChild, 0));
+            vRelayed.push_back(txChild);
+        }
+    }
+
+    // The scripts of a parent are checked outside cs_main, and a bad signature fails them
+    bool fScriptsChecked = false;
+    BOOST_CHECK(PreValidateTransaction(vRelayed[0], fScriptsChecked));
+    BOOST_CHECK(fScriptsChecked);
+    CMutableTransaction txBad = vRelayed[0];
+    txBad.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << ToByteVector(key.GetPubKey());
+    BOOST_CHECK(!PreValidateTransaction(txBad, fScriptsChecked));
+    BOOST_CHECK(!fScriptsChecked);
+
+    CAddress addr;
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+    boost::thread_group threadGroup;
+    CTxPreValidator preValidator;
+    preValidator.Start(threadGroup, 4);
+
+    size_t nPoolSize = mempool.size();
+    BOOST_FOREACH (const CTransaction& tx, vRelayed)
+        BOOST_CHECK(preValidator.Submit(tx, &dummyNode, "tx", false));
+    int64_t nDeadline = GetTimeMillis() + 60 * 1000;
+    while (mempool.size() < nPoolSize + vRelayed.size() && GetTimeMillis() < nDeadline)
+        MilliSleep(1);
+
+    // Every child was processed after its parent, so none was taken for an orphan
+    BOOST_CHECK_EQUAL(mempool.size(), nPoolSize + vRelayed.size());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mapOrphanTransactions.empty());
+    }
+
+    preValidator.Stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    BOOST_CHECK_EQUAL(dummyNode.GetRefCount(), 0);
+
+    LOCK(cs_main);
+    BOOST_FOREACH (const COutPoint& prevout, vFunding)
+        pcoinsTip->SpendCoin(prevout);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPreValidationQueueFullTest)
+{
+    std::vector<CTransaction> vRelayed;
+    for (unsigned int i = 0; i < 3; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = COIN;
+        vRelayed.push_back(tx);
+    }
+
+    CAddress addr;
+    CNode dummyNode(INVALID_SOCKET, addr, "", true);
+    boost::thread_group threadGroup;
+    CTxPreValidator preValidator;
+    preValidator.Start(threadGroup, 1, 1);
+
+    {
+        // The worker takes the first transaction and waits for cs_main,
+        // the second one fills the queue
+        LOCK(cs_main);
+        BOOST_CHECK(preValidator.Submit(vRelayed[0], &dummyNode, "tx", false));
+        int64_t nDeadline = GetTimeMillis() + 60 * 1000;
+        while (preValidator.QueueSize() > 0 && GetTimeMillis() < nDeadline)
+            MilliSleep(1);
+        BOOST_CHECK(preValidator.Submit(vRelayed[1], &dummyNode, "tx", false));
+
+        // The message handler does not wait for room but processes the third itself
+        BOOST_CHECK(!preValidator.Submit(vRelayed[2], &dummyNode, "tx", false));
+        BOOST_CHECK_EQUAL(preValidator.QueueSize(), 1U);
+    }
+
+    preValidator.Stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    BOOST_CHECK_EQUAL(dummyNode.GetRefCount(), 0);
+
+    // The first one may have been taken for an orphan before the workers stopped
+    LOCK(cs_main);
+    EraseOrphansFor(dummyNode.GetId());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPersistTest)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // Two unrelated spends, one of them accepted two hours ago
+    std::vector<CTransaction> vSpends;
+    std::vector<COutPoint> vFunding;
+    {
+        LOCK(cs_main);
+        for (unsigned int i = 0; i < 2; i++) {
+            CMutableTransaction txFrom;
+            txFrom.vin.resize(1);
+            txFrom.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            txFrom.vout.resize(1);
+            txFrom.vout[0].scriptPubKey = scriptPubKey;
+            txFrom.vout[0].nValue = COIN;
+            AddCoins(*pcoinsTip, txFrom, 1);
+            vFunding.push_back(COutPoint(txFrom.GetHash(), 0));
+
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = vFunding.back();
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            tx.vout[0].nValue = COIN - CENT;
+            BOOST_REQUIRE(SignSignature(keystore, txFrom, tx, 0));
+            vSpends.push_back(tx);
+        }
+
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPoolWithTime(mempool, state, vSpends[0], true, NULL, GetTime() - 2 * 60 * 60));
+        BOOST_CHECK(AcceptToMemoryPoolWithTime(mempool, state, vSpends[1], true, NULL, GetTime()));
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+
+    // A fee delta on a pooled transaction and one on a transaction that is not known yet
+    uint256 hashPending = GetRandHash();
+    mempool.PrioritiseTransaction(vSpends[1].GetHash(), vSpends[1].GetHash().ToString(), 100.0, 5000);
+    mempool.PrioritiseTransaction(hashPending, hashPending.ToString(), 0.0, 7000);
+
+    BOOST_CHECK(DumpMempool());
+    BOOST_CHECK(boost::filesystem::exists(GetDataDir() / "mempool.dat"));
+
+    mempool.clear();
+    mempool.ClearPrioritisation(vSpends[1].GetHash());
+    mempool.ClearPrioritisation(hashPending);
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // With a one hour expiry the older transaction is not loaded again
+    mapArgs["-mempoolexpiry"] = "1";
+    BOOST_CHECK(LoadMempool());
+    mapArgs.erase("-mempoolexpiry");
+
+    BOOST_CHECK(!mempool.exists(vSpends[0].GetHash()));
+    BOOST_CHECK(mempool.exists(vSpends[1].GetHash()));
+    {
+        LOCK(mempool.cs);
+        CTxMemPool::txiter it = mempool.mapTx.find(vSpends[1].GetHash());
+        BOOST_REQUIRE(it != mempool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetModifiedFee(), CENT + 5000);
+        BOOST_CHECK_EQUAL(mempool.mapDeltas[vSpends[1].GetHash()].first, 100.0);
+        BOOST_CHECK_EQUAL(mempool.mapDeltas[hashPending].second, 7000);
+    }
+
+    // A file of another version is not loaded
+    {
+        CAutoFile file(fopen((GetDataDir() / "mempool.dat").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        file << (uint64_t)0;
+    }
+    mempool.clear();
+    BOOST_CHECK(!LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    boost::filesystem::remove(GetDataDir() / "mempool.dat");
+    mempool.ClearPrioritisation(vSpends[1].GetHash());
+    mempool.ClearPrioritisation(hashPending);
+    LOCK(cs_main);
+    BOOST_FOREACH (const COutPoint& prevout, vFunding)
+        pcoinsTip->SpendCoin(prevout);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
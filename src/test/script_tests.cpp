@@ -11,6 +11,8 @@
 #include "main.h"
 #include "script/script.h"
 #include "script/script_error.h"
+#include "script/sigcache.h"
+#include "script/sigcachetable.h"
 #include "script/sign.h"
 #include "util.h"
 
@@ -971,4 +973,45 @@ BOOST_AUTO_TEST_CASE(script_IsPushOnly_on_invalid_scripts)
     BOOST_CHECK(!CScript(direct, direct+sizeof(direct)).IsPushOnly());
 }
 
+BOOST_AUTO_TEST_CASE(script_sigcache)
+{
+    InitSignatureCache();
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 vHash[2];
+    vector<unsigned char> vchSig[2];
+    for (int i = 0; i < 2; i++) {
+        vHash[i] = GetRandHash();
+        BOOST_REQUIRE(key.Sign(vHash[i], vchSig[i]));
+    }
+    CachingTransactionSignatureChecker checkerStore(NULL, 0, true);
+    CachingTransactionSignatureChecker checkerBlock(NULL, 0, false);
+
+    // A signature for another hash is not taken from the cache
+    BOOST_CHECK(checkerStore.VerifySignature(vchSig[0], key.GetPubKey(), vHash[0]));
+    BOOST_CHECK(!checkerStore.VerifySignature(vchSig[0], key.GetPubKey(), vHash[1]));
+
+    // Found while connecting a block, the entry is removed, which the
+    // result does not show
+    BOOST_CHECK(checkerBlock.VerifySignature(vchSig[0], key.GetPubKey(), vHash[0]));
+    BOOST_CHECK(checkerBlock.VerifySignature(vchSig[0], key.GetPubKey(), vHash[0]));
+    BOOST_CHECK(checkerStore.VerifySignature(vchSig[1], key.GetPubKey(), vHash[1]));
+}
+
+BOOST_AUTO_TEST_CASE(script_sigcache_keeps_newest)
+{
+    // Filling a small table many times over makes inserts run out of room,
+    // which must drop an older entry, not the one just inserted
+    CSignatureCache signatureCache(64 << 10);
+    BOOST_REQUIRE(signatureCache.GetCapacity() > 0);
+    unsigned int nMissing = 0;
+    for (size_t i = 0; i < 4 * signatureCache.GetCapacity(); i++) {
+        uint256 entry = GetRandHash();
+        signatureCache.Set(entry);
+        if (!signatureCache.Get(entry, false))
+            nMissing++;
+    }
+    BOOST_CHECK_EQUAL(nMissing, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
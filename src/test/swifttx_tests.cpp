@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "primitives/transaction.h"
+#include "random.h"
+#include "swifttx.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(swifttx_tests)
+
+static CTransaction MakeLockedTx(const COutPoint& prevout1, const COutPoint& prevout2)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout1));
+    tx.vin.push_back(CTxIn(prevout2));
+    tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    return CTransaction(tx);
+}
+
+static void AddCompleteLock(const CTransaction& tx)
+{
+    swiftTxManager.AddLock(tx.GetHash(), 100);
+    swiftTxManager.AddLockRequest(tx);
+    swiftTxManager.LockInputs(tx);
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_conflicting_locks)
+{
+    swiftTxManager.Clear();
+    COutPoint prevout1(GetRandHash(), 0);
+    COutPoint prevout2(GetRandHash(), 1);
+    COutPoint prevout3(GetRandHash(), 0);
+    CTransaction tx1 = MakeLockedTx(prevout1, prevout2);
+    CTransaction tx2 = MakeLockedTx(prevout2, prevout3);
+
+    AddCompleteLock(tx1);
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLockedInputs(), 2);
+
+    uint256 txHashLocked;
+    BOOST_CHECK(!swiftTxManager.FindConflictingLock(tx1, txHashLocked));
+    BOOST_CHECK(swiftTxManager.FindConflictingLock(tx2, txHashLocked));
+    BOOST_CHECK(txHashLocked == tx1.GetHash());
+
+    // An input already locked stays with the first lock
+    swiftTxManager.AddLock(tx2.GetHash(), 100);
+    swiftTxManager.LockInputs(tx2);
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLockedInputs(), 3);
+    BOOST_CHECK(swiftTxManager.FindConflictingLock(tx2, txHashLocked));
+
+    // Two complete conflicting locks cancel out at the next clean up
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+    BOOST_CHECK(swiftTxManager.CheckForConflictingLocks(tx2));
+    SetMockTime(nNow + 1);
+    swiftTxManager.CleanTransactionLocksList();
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLocks(), 0);
+    BOOST_CHECK(!swiftTxManager.HaveLockRequest(tx1.GetHash()));
+    // the inputs are released with the lock request, which was only seen for tx1
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLockedInputs(), 1);
+    BOOST_CHECK(!swiftTxManager.FindConflictingLock(MakeLockedTx(prevout1, prevout2), txHashLocked));
+
+    SetMockTime(0);
+    swiftTxManager.Clear();
+}
+
+BOOST_AUTO_TEST_CASE(swifttx_locks_expire)
+{
+    swiftTxManager.Clear();
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+
+    vector<CTransaction> vLocked;
+    for (int i = 0; i < 100; i++) {
+        vLocked.push_back(MakeLockedTx(COutPoint(GetRandHash(), 0), COutPoint(GetRandHash(), 1)));
+        AddCompleteLock(vLocked.back());
+    }
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLockedInputs(), 200);
+
+    // A transaction spending an input of a lock conflicts with it
+    uint256 txHashLocked;
+    BOOST_CHECK(swiftTxManager.FindConflictingLock(MakeLockedTx(COutPoint(GetRandHash(), 0), vLocked[42].vin[1].prevout), txHashLocked));
+    BOOST_CHECK(txHashLocked == vLocked[42].GetHash());
+    BOOST_CHECK(!swiftTxManager.FindConflictingLock(MakeLockedTx(COutPoint(GetRandHash(), 0), COutPoint(GetRandHash(), 0)), txHashLocked));
+
+    // Clean ups before the locks expire keep them
+    SetMockTime(nNow + 60 * 60 - 1);
+    swiftTxManager.CleanTransactionLocksList();
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLocks(), (int)vLocked.size());
+
+    // every lock expires an hour after it was made
+    SetMockTime(nNow + 60 * 60 + 1);
+    swiftTxManager.CleanTransactionLocksList();
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLocks(), 0);
+    BOOST_CHECK(!swiftTxManager.HaveLockRequest(vLocked[0].GetHash()));
+    BOOST_CHECK_EQUAL(swiftTxManager.CountLockedInputs(), 0);
+
+    SetMockTime(0);
+    swiftTxManager.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
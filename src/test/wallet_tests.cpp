@@ -2,6 +2,8 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "main.h"
+#include "random.h"
 #include "wallet.h"
 
 #include <set>
@@ -305,4 +307,89 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+static const int DENOMINATE_TXS = 10;
+static const int DENOMINATE_OUTPUTS = 60;
+static const int MIX_INPUTS = 10;
+
+static CAmount DenominationOf(int i)
+{
+    return obfuScationDenominations[i % obfuScationDenominations.size()];
+}
+
+/** Outputs of all denominations, from an input that is not ours */
+static void AddDenominateTx(CWallet& walletMix, const CScript& scriptMine, vector<COutPoint>& vOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    for (int i = 0; i < DENOMINATE_OUTPUTS; i++)
+        tx.vout.push_back(CTxOut(DenominationOf(i), scriptMine));
+    CWalletTx wtx(&walletMix, tx);
+    LOCK2(cs_main, walletMix.cs_wallet);
+    BOOST_REQUIRE(walletMix.AddToWallet(wtx));
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        vOutputs.push_back(COutPoint(wtx.GetHash(), i));
+}
+
+/** Mixing sessions spending some of our outputs and as many of another wallet's */
+static void Mix(CWallet& walletMix, const CScript& scriptMine, const vector<COutPoint>& vInputs, vector<COutPoint>& vOutputs)
+{
+    CScript scriptOther = CScript() << OP_TRUE;
+    for (unsigned int n = 0; n + MIX_INPUTS <= vInputs.size(); n += MIX_INPUTS) {
+        CMutableTransaction tx;
+        for (unsigned int i = n; i < n + MIX_INPUTS; i++) {
+            tx.vin.push_back(CTxIn(vInputs[i]));
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+            CAmount nValue = walletMix.mapWallet[vInputs[i].hash].vout[vInputs[i].n].nValue;
+            tx.vout.push_back(CTxOut(nValue, scriptMine));
+            tx.vout.push_back(CTxOut(nValue, scriptOther));
+        }
+        CWalletTx wtx(&walletMix, tx);
+        LOCK2(cs_main, walletMix.cs_wallet);
+        BOOST_REQUIRE(walletMix.AddToWallet(wtx));
+        for (unsigned int i = 0; i < tx.vout.size(); i += 2)
+            vOutputs.push_back(COutPoint(wtx.GetHash(), i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(obfuscation_rounds_tests)
+{
+    vector<int64_t> vDenominationsSaved = obfuScationDenominations;
+    if (obfuScationDenominations.empty()) {
+        obfuScationDenominations.push_back((10000 * COIN) + 10000000);
+        obfuScationDenominations.push_back((1000 * COIN) + 1000000);
+        obfuScationDenominations.push_back((100 * COIN) + 100000);
+        obfuScationDenominations.push_back((10 * COIN) + 10000);
+        obfuScationDenominations.push_back((1 * COIN) + 1000);
+        obfuScationDenominations.push_back((.1 * COIN) + 100);
+    }
+
+    CWallet walletMix("wallet_denominations.dat");
+    bool fFirstRun;
+    BOOST_REQUIRE_EQUAL(walletMix.LoadWallet(fFirstRun), DB_LOAD_OK);
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_REQUIRE(walletMix.AddKeyPubKey(key, key.GetPubKey()));
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+
+    vector<COutPoint> vRound0, vRound1, vRound2;
+    for (int i = 0; i < DENOMINATE_TXS; i++)
+        AddDenominateTx(walletMix, scriptMine, vRound0);
+    BOOST_CHECK_EQUAL(walletMix.GetAverageAnonymizedRounds(), 0.0);
+
+    // the denomination buckets follow the mixing sessions as they come in
+    Mix(walletMix, scriptMine, vector<COutPoint>(vRound0.begin(), vRound0.begin() + vRound0.size() / 4), vRound1);
+    Mix(walletMix, scriptMine, vector<COutPoint>(vRound1.begin(), vRound1.begin() + vRound1.size() / 2), vRound2);
+    BOOST_CHECK_EQUAL(walletMix.GetInputObfuscationRounds(CTxIn(vRound0.back())), 0);
+    BOOST_CHECK_EQUAL(walletMix.GetInputObfuscationRounds(CTxIn(vRound1.back())), 1);
+    BOOST_CHECK_EQUAL(walletMix.GetInputObfuscationRounds(CTxIn(vRound2.back())), 2);
+
+    // a quarter of the outputs were mixed once, and half of those once more
+    int nUnspent0 = vRound0.size() - vRound1.size();
+    int nUnspent1 = vRound1.size() - vRound2.size();
+    double fExpected = (double)(nUnspent1 + 2 * vRound2.size()) / (nUnspent0 + nUnspent1 + vRound2.size());
+    BOOST_CHECK_CLOSE(walletMix.GetAverageAnonymizedRounds(), fExpected, 0.0001);
+
+    obfuScationDenominations = vDenominationsSaved;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
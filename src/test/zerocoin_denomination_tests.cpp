@@ -3,10 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amount.h"
+#include "chain.h"
 #include "chainparams.h"
 #include "coincontrol.h"
 #include "denomination_functions.h"
 #include "main.h"
+#include "streams.h"
 #include "txdb.h"
 #include "wallet.h"
 #include "walletdb.h"
@@ -493,4 +495,68 @@ BOOST_AUTO_TEST_CASE(zerocoin_spend_test99)
     nValueTarget += OneCoinAmount;
 }
 
+BOOST_AUTO_TEST_CASE(denomination_array_test)
+{
+    CDenominationArray<int64_t> supply;
+    BOOST_CHECK(supply.IsNull());
+    BOOST_CHECK_EQUAL(supply.DynamicMemoryUsage(), 0U);
+    supply.Set(ZQ_TEN, 0);
+    BOOST_CHECK_EQUAL(supply.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK_THROW(supply.Get(ZQ_ERROR), std::out_of_range);
+
+    supply.Add(ZQ_FIVE, 3);
+    supply.Add(ZQ_FIVE_THOUSAND, 1);
+    BOOST_CHECK(!supply.IsNull());
+    BOOST_CHECK_EQUAL(supply.Get(ZQ_FIVE), 3);
+    BOOST_CHECK_EQUAL(supply.Get(ZQ_FIVE_THOUSAND), 1);
+    BOOST_CHECK_EQUAL(supply.Get(ZQ_ONE), 0);
+
+    // Copies share the values until one of them is modified
+    CDenominationArray<int64_t> supplyNext = supply;
+    BOOST_CHECK(supplyNext.SharesWith(supply));
+    supplyNext.Add(ZQ_FIVE, -1);
+    BOOST_CHECK(!supplyNext.SharesWith(supply));
+    BOOST_CHECK_EQUAL(supply.Get(ZQ_FIVE), 3);
+    BOOST_CHECK_EQUAL(supplyNext.Get(ZQ_FIVE), 2);
+    BOOST_CHECK(!(supplyNext == supply));
+    supplyNext.Add(ZQ_FIVE, 1);
+    BOOST_CHECK(supplyNext == supply);
+}
+
+BOOST_AUTO_TEST_CASE(disk_block_index_zerocoin_serialization_test)
+{
+    // The block index stores the zerocoin fields as a supply map and a list
+    // of minted denominations, which must survive a round trip.
+    CBlockIndex index;
+    index.nVersion = 4;
+    index.vZerocoinSupply.Set(ZQ_ONE, 10);
+    index.vZerocoinSupply.Set(ZQ_ONE_HUNDRED, 2);
+    index.vZerocoinMints.Add(ZQ_ONE, 1);
+    index.vZerocoinMints.Add(ZQ_ONE, 1);
+    index.vZerocoinMints.Add(ZQ_FIFTY, 1);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+
+    // Same layout as the std::map and std::vector previously stored in CBlockIndex
+    std::map<CoinDenomination, int64_t> mapSupply;
+    BOOST_FOREACH (CoinDenomination denom, zerocoinDenomList)
+        mapSupply[denom] = index.vZerocoinSupply.Get(denom);
+    std::vector<CoinDenomination> vMints;
+    vMints.push_back(ZQ_ONE);
+    vMints.push_back(ZQ_ONE);
+    vMints.push_back(ZQ_FIFTY);
+    CDataStream ssExpected(SER_DISK, CLIENT_VERSION);
+    ssExpected << mapSupply << vMints;
+    BOOST_CHECK(std::equal(ssExpected.begin(), ssExpected.end(), ss.end() - ssExpected.size()));
+
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.vZerocoinSupply == index.vZerocoinSupply);
+    BOOST_CHECK(diskindex.vZerocoinMints == index.vZerocoinMints);
+    BOOST_CHECK(diskindex.MintedDenomination(ZQ_FIFTY));
+    BOOST_CHECK(!diskindex.MintedDenomination(ZQ_FIVE));
+    BOOST_CHECK_EQUAL(diskindex.GetZerocoinSupply(), 12 * COIN + 200 * COIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
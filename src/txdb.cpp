@@ -6,75 +6,265 @@
 
 #include "txdb.h"
 
+#include "init.h"
 #include "main.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "utxostats.h"
 #include "accumulators.h"
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
 using namespace libzerocoin;
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+static const char DB_COIN = 'C';
+static const char DB_COINS = 'c';
+static const char DB_BEST_BLOCK = 'B';
+static const char DB_UTXO_STATS = 'S';
+
+//! Size of the batches in which the chainstate is converted to per output records
+static const size_t COINS_UPGRADE_BATCH_SIZE = 16 << 20;
+
+namespace
 {
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
-}
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(key);
+        READWRITE(outpoint->hash);
+        READWRITE(VARINT(outpoint->n));
+    }
+};
+
+/**
+ * The per transaction record the chainstate used to store, with the outputs
+ * of a transaction that are still unspent. Only read, to convert old
+ * chainstates to per output records.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nCode)
+ * - unspentness bitvector, for vout[2] and further; least significant byte first
+ * - the non-spent CTxOuts (via CTxOutCompressor)
+ * - VARINT(nHeight)
+ *
+ * The nCode value consists of:
+ * - bit 1: IsCoinBase()
+ * - bit 2: IsCoinStake()
+ * - bit 4: vout[0] is not spent
+ * - bit 8: vout[1] is not spent
+ * - The higher bits encode N, the number of non-zero bytes in the following bitvector.
+ *   - In case both bit 4 and bit 8 are unset, they encode N-1, as there must be at
+ *     least one non-spent output).
+ */
+class CCoins
+{
+public:
+    bool fCoinBase;
+    bool fCoinStake;
+    std::vector<CTxOut> vout;
+    int nHeight;
+
+    CCoins() : fCoinBase(false), fCoinStake(false), nHeight(0) {}
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned int nCode = 0;
+        // version
+        int nVersionDummy = 0;
+        ::Unserialize(s, VARINT(nVersionDummy), nType, nVersion);
+        // header code
+        ::Unserialize(s, VARINT(nCode), nType, nVersion);
+        fCoinBase = nCode & 1;
+        fCoinStake = (nCode & 2) != 0;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 4) != 0;
+        vAvail[1] = (nCode & 8) != 0;
+        unsigned int nMaskCode = (nCode / 16) + ((nCode & 12) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail, nType, nVersion);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])), nType, nVersion);
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight), nType, nVersion);
+    }
+};
+} // anon namespace
 
 void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
 {
-    batch.Write('B', hash);
+    batch.Write(DB_BEST_BLOCK, hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, GetLevelDBProfile("chainstate"))
 {
 }
 
-bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
+bool CCoinsViewDB::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
-    return db.Read(make_pair('c', txid), coins);
+    return db.Read(CoinEntry(&outpoint), coin);
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256& txid) const
+bool CCoinsViewDB::HaveCoin(const COutPoint& outpoint) const
 {
-    return db.Exists(make_pair('c', txid));
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
 {
     uint256 hashBestChain;
-    if (!db.Read('B', hashBestChain))
+    if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256(0);
     return hashBestChain;
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    bool fOk = WriteCoins(mapCoins, hashBlock);
+    mapCoins.clear();
+    return fOk;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock, const CUtxoStats* pstats, size_t* pnBytes)
 {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    size_t erased = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent()) {
+                batch.Erase(entry);
+                erased++;
+            } else {
+                batch.Write(entry, it->second.coin);
+            }
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
+    if (pstats != NULL && pstats->hashBlock == hashBlock)
+        batch.Write(DB_UTXO_STATS, *pstats);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed coins (%u spent, out of %u, %u bytes) to coin database...\n", (unsigned int)changed, (unsigned int)erased, (unsigned int)count, (unsigned int)batch.SizeEstimate());
+    if (pnBytes)
+        *pnBytes = batch.SizeEstimate();
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+bool CCoinsViewDB::ReadUtxoStats(CUtxoStats& stats) const
+{
+    return db.Read(DB_UTXO_STATS, stats);
+}
+
+bool CCoinsViewDB::Upgrade()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COINS;
+    pcursor->Seek(ssKeySet.str());
+    if (!pcursor->Valid() || pcursor->key()[0] != DB_COINS)
+        return true;
+
+    int64_t nStart = GetTimeMillis();
+    LogPrintf("Upgrading coin database to per output records...\n");
+    uiInterface.ShowProgress(_("Upgrading coin database..."), 0);
+    size_t nTransactions = 0, nCoins = 0, nBatchSize = 0;
+    int nReportDone = 0;
+    CLevelDBBatch batch;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            break;
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey[0] != DB_COINS)
+            break;
+        try {
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txid;
+            ssKey >> chType >> txid;
+
+            // The keys are ordered by txid, whose first byte tells how far we got
+            int nPercentageDone = (int)(*txid.begin() * 100.0 / 256.0);
+            if (nPercentageDone > nReportDone) {
+                uiInterface.ShowProgress(_("Upgrading coin database..."), nPercentageDone);
+                nReportDone = nPercentageDone;
+            }
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins old_coins;
+            ssValue >> old_coins;
+
+            COutPoint outpoint(txid, 0);
+            for (size_t i = 0; i < old_coins.vout.size(); ++i) {
+                if (!old_coins.vout[i].IsNull() && !old_coins.vout[i].scriptPubKey.IsUnspendable()) {
+                    Coin newcoin(old_coins.vout[i], old_coins.nHeight, old_coins.fCoinBase, old_coins.fCoinStake);
+                    outpoint.n = i;
+                    CoinEntry entry(&outpoint);
+                    batch.Write(entry, newcoin);
+                    nBatchSize += ::GetSerializeSize(entry, SER_DISK, CLIENT_VERSION) + ::GetSerializeSize(newcoin, SER_DISK, CLIENT_VERSION);
+                    nCoins++;
+                }
+            }
+            batch.Erase(make_pair(DB_COINS, txid));
+            nBatchSize += slKey.size();
+            nTransactions++;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        // Every batch moves its records atomically, so an interrupted
+        // upgrade continues where it stopped on the next start.
+        if (nBatchSize > COINS_UPGRADE_BATCH_SIZE) {
+            if (!db.WriteBatch(batch))
+                return error("%s : failed to write coin database batch", __func__);
+            batch = CLevelDBBatch();
+            nBatchSize = 0;
+        }
+        pcursor->Next();
+    }
+    if (!db.WriteBatch(batch))
+        return error("%s : failed to write coin database batch", __func__);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Upgraded %u transactions to %u coins in %dms%s\n", nTransactions, nCoins, GetTimeMillis() - nStart,
+        ShutdownRequested() ? ", interrupted" : "");
+    return !ShutdownRequested();
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, GetLevelDBProfile("blockindex"))
 {
 }
 
@@ -83,6 +273,22 @@ bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
     return Write(make_pair('b', blockindex.GetBlockHash()), blockindex);
 }
 
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo, size_t* pnBytes)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it = fileInfo.begin(); it != fileInfo.end(); it++) {
+        batch.Write(make_pair('f', it->first), *it->second);
+    }
+    if (!fileInfo.empty())
+        batch.Write('l', nLastFile);
+    for (std::vector<const CBlockIndex*>::const_iterator it = blockinfo.begin(); it != blockinfo.end(); it++) {
+        batch.Write(make_pair('b', (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    }
+    if (pnBytes)
+        *pnBytes = batch.SizeEstimate();
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::WriteBlockFileInfo(int nFile, const CBlockFileInfo& info)
 {
     return Write(make_pair('f', nFile), info);
@@ -117,57 +323,91 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
+static void ApplyStats(CCoinsStats& stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.nHeight);
+    ss << (outputs.begin()->second.fCoinBase ? 'c' : (outputs.begin()->second.fCoinStake ? 's' : 'n'));
+    stats.nTransactions++;
+    for (std::map<uint32_t, Coin>::const_iterator it = outputs.begin(); it != outputs.end(); ++it) {
+        ss << VARINT(it->first + 1);
+        ss << it->second.out;
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += it->second.out.nValue;
+    }
+    ss << VARINT(0);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+
+    // The iterator reads a snapshot of the database, so read the best block
+    // through it as well; the coins may be flushed while they are scanned.
+    CDataStream ssKeyBest(SER_DISK, CLIENT_VERSION);
+    ssKeyBest << DB_BEST_BLOCK;
+    std::string strKeyBest = ssKeyBest.str();
+    pcursor->Seek(strKeyBest);
+    stats.hashBlock = 0;
+    if (pcursor->Valid() && pcursor->key() == leveldb::Slice(strKeyBest)) {
+        try {
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> stats.hashBlock;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COIN;
+    pcursor->Seek(ssKeySet.str());
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
+    CUtxoStats utxo;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() == 0 || slKey[0] != DB_COIN)
+                break;
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+            COutPoint key;
+            CoinEntry entry(&key);
+            ssKey >> entry;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            Coin coin;
+            ssValue >> coin;
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                outputs.clear();
             }
+            prevkey = key.hash;
+            outputs[key.n] = coin;
+            utxo.AddCoin(key, coin);
+            stats.nSerializedSize += slKey.size() + slValue.size();
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
+    if (!outputs.empty())
+        ApplyStats(stats, ss, prevkey, outputs);
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+        stats.nHeight = mi == mapBlockIndex.end() ? 0 : mi->second->nHeight;
+    }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    stats.muhash = utxo.muhash;
     return true;
 }
 
@@ -208,86 +448,161 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+namespace
 {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+/** A block index entry read from disk that still has to be linked into mapBlockIndex */
+struct CBlockIndexDiskEntry {
+    uint256 hash;
+    uint256 hashPrev;
+    uint256 hashNext;
+    CBlockIndex* pindex;
+};
 
-    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair('b', uint256(0));
-    pcursor->Seek(ssKeySet.str());
+/**
+ * Deserialize the block index entries whose hash starts with a byte in
+ * [nBegin, nEnd). The hash is taken from the database key instead of being
+ * recomputed from the header, which would cost one XEVAN hash per block.
+ */
+void ReadBlockIndexRange(CBlockTreeDB* pdb, unsigned int nBegin, unsigned int nEnd, std::vector<CBlockIndexDiskEntry>* pvEntries, std::string* pstrError)
+{
+    try {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(pdb->NewIterator());
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
+        uint256 hashStart;
+        *hashStart.begin() = nBegin;
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << make_pair('b', hashStart);
+        pcursor->Seek(ssKeySet.str());
+
+        while (pcursor->Valid()) {
             leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() < 2 || slKey.data()[0] != 'b' || (unsigned char)slKey.data()[1] >= nEnd)
+                break;
+
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-                
-                if ( pindexNew->nHeight <= Params().LAST_POW_BLOCK() ) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork for block %d failed: %s", pindexNew->nHeight, pindexNew->ToString());
-                }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
+            CBlockIndexDiskEntry entry;
+            ssKey >> chType >> entry.hash;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = new CBlockIndex();
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            pindexNew->vZerocoinSupply = diskindex.vZerocoinSupply;
+            pindexNew->vZerocoinMints = diskindex.vZerocoinMints;
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+            entry.hashPrev = diskindex.hashPrev;
+            entry.hashNext = diskindex.hashNext;
+            entry.pindex = pindexNew;
+            pvEntries->push_back(entry);
 
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+            pcursor->Next();
+        }
+    } catch (std::exception& e) {
+        *pstrError = e.what();
+    }
+}
+} // anon namespace
+
+bool CBlockTreeDB::LoadBlockIndexGuts(int nThreads)
+{
+    int64_t nStart = GetTimeMillis();
+
+    // Deserialize the entries in parallel, each thread covering a range of
+    // the key space. Concatenating the results in thread order gives the
+    // entries in key order, as a single cursor would have returned them.
+    if (nThreads <= 0)
+        nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<std::vector<CBlockIndexDiskEntry> > vRanges(nThreads);
+    std::vector<std::string> vErrors(nThreads);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&ReadBlockIndexRange, this, i * 256 / nThreads, (i + 1) * 256 / nThreads, &vRanges[i], &vErrors[i]));
+    threadGroup.join_all();
+
+    size_t nEntries = 0;
+    std::string strError;
+    for (int i = 0; i < nThreads; i++) {
+        nEntries += vRanges[i].size();
+        if (strError.empty())
+            strError = vErrors[i];
+    }
+    if (!strError.empty()) {
+        for (int i = 0; i < nThreads; i++) {
+            BOOST_FOREACH (CBlockIndexDiskEntry& entry, vRanges[i])
+                delete entry.pindex;
+        }
+        return error("%s : Deserialize or I/O error - %s", __func__, strError);
+    }
+
+    // Insert all entries before linking them, so that the links below find
+    // their targets instead of creating placeholders.
+    mapBlockIndex.reserve(mapBlockIndex.size() + nEntries);
+    for (int i = 0; i < nThreads; i++) {
+        BOOST_FOREACH (CBlockIndexDiskEntry& entry, vRanges[i]) {
+            std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(make_pair(entry.hash, entry.pindex));
+            if (!ret.second) {
+                delete entry.pindex;
+                entry.pindex = ret.first->second;
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            entry.pindex->phashBlock = &ret.first->first;
+        }
+    }
+
+    // Load mapBlockIndex
+    std::set<uint256> setCheckpointsLoaded;
+    for (int i = 0; i < nThreads; i++) {
+        BOOST_FOREACH (const CBlockIndexDiskEntry& entry, vRanges[i]) {
+            boost::this_thread::interruption_point();
+            CBlockIndex* pindexNew = entry.pindex;
+            pindexNew->pprev = InsertBlockIndex(entry.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(entry.hashNext);
+
+            if ( pindexNew->nHeight <= Params().LAST_POW_BLOCK() ) {
+                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
+                    return error("LoadBlockIndex() : CheckProofOfWork for block %d failed: %s", pindexNew->nHeight, pindexNew->ToString());
+            }
+            // ppcoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+
+            //populate accumulator checksum map in memory, once per checkpoint
+            if(pindexNew->nAccumulatorCheckpoint != 0 && setCheckpointsLoaded.insert(pindexNew->nAccumulatorCheckpoint).second)
+                LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
         }
     }
 
+    LogPrintf("%s: loaded %u block index entries using %d threads in %dms\n", __func__, nEntries, nThreads, GetTimeMillis() - nStart);
     return true;
 }
 
-CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
+CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe, GetLevelDBProfile("zerocoin"))
 {
 }
 
@@ -16,7 +16,7 @@
 #include <utility>
 #include <vector>
 
-class CCoins;
+class CUtxoStats;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -25,6 +25,8 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! maximum number of threads used to read the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -35,11 +37,24 @@ protected:
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool GetCoins(const uint256& txid, CCoins& coins) const;
-    bool HaveCoins(const uint256& txid) const;
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    //! Write the dirty entries of mapCoins without modifying it, so that
+    //! other threads can keep reading it. The UTXO set statistics of
+    //! hashBlock, if given, go into the same batch. pnBytes receives the
+    //! batch size.
+    bool WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock, const CUtxoStats* pstats = NULL, size_t* pnBytes = NULL);
+
+    //! The UTXO set statistics written last; check their block against the best block
+    bool ReadUtxoStats(CUtxoStats& stats) const;
+
+    //! Convert the per transaction records of older versions to per output
+    //! records. Returns false if interrupted or on error.
+    bool Upgrade();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -54,6 +69,8 @@ private:
 
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    //! Write block file information and index entries in one synced batch
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo, size_t* pnBytes = NULL);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool WriteBlockFileInfo(int nFile, const CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
@@ -66,7 +83,8 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
-    bool LoadBlockIndexGuts();
+    //! Load the block index using nThreads threads, 0 for one per core up to MAX_BLOCK_INDEX_LOAD_THREADS
+    bool LoadBlockIndexGuts(int nThreads = 0);
 };
 
 class CZerocoinDB : public CLevelDBWrapper
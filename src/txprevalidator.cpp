@@ -0,0 +1,207 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txprevalidator.h"
+
+#include "main.h"
+#include "net.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+CTxPreValidator txPreValidator;
+
+bool PreValidateTransaction(const CTransaction& tx, bool& fScriptsChecked)
+{
+    fScriptsChecked = false;
+    if (tx.IsCoinBase() || tx.IsCoinStake())
+        return false;
+
+    if (tx.ContainsZerocoins() && !VerifyZerocoinProofs(tx))
+        return false;
+
+    // Zerocoin spends have no scripts to check
+    if (tx.IsZerocoinSpend())
+        return true;
+
+    if (mempool.exists(tx.GetHash()))
+        return true;
+
+    // Take a snapshot of the spent outputs. This is the only part that needs
+    // cs_main, and it is short compared to the script checks below.
+    std::vector<CScriptCheck> vChecks;
+    std::vector<CScriptCheck> vMandatoryChecks;
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (pcoinsTip == NULL)
+            return true;
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        Coin coin;
+        vChecks.reserve(tx.vin.size());
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const COutPoint& prevout = tx.vin[i].prevout;
+            // Missing and spent inputs are reported by AcceptToMemoryPool
+            if (!viewMemPool.GetCoin(prevout, coin) || !coin.IsAvailable())
+                return true;
+
+            // the same checks as AcceptToMemoryPool, which skips them when these pass
+            CScriptCheck check(coin.out, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true);
+            vChecks.push_back(CScriptCheck());
+            check.swap(vChecks.back());
+            CScriptCheck checkMandatory(coin.out, tx, i, MANDATORY_SCRIPT_VERIFY_FLAGS, true);
+            vMandatoryChecks.push_back(CScriptCheck());
+            checkMandatory.swap(vMandatoryChecks.back());
+        }
+    }
+
+    BOOST_FOREACH (CScriptCheck& check, vChecks) {
+        if (!check())
+            return false;
+    }
+    BOOST_FOREACH (CScriptCheck& check, vMandatoryChecks) {
+        if (!check())
+            return false;
+    }
+    fScriptsChecked = true;
+    return true;
+}
+
+CTxPreValidator::CTxPreValidator() : nNextSequence(0), nNextProcess(0), nMaxQueue(MAX_PREVALIDATION_QUEUE), fRunning(false)
+{
+}
+
+void CTxPreValidator::Start(boost::thread_group& threadGroup, int nThreads, unsigned int nMaxQueueIn)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nMaxQueue = nMaxQueueIn;
+        fRunning = nThreads > 0;
+    }
+
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "txprevalid",
+            boost::function<void()>(boost::bind(&CTxPreValidator::Thread, this))));
+}
+
+void CTxPreValidator::Stop()
+{
+    std::deque<CJob> queueDropped;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = false;
+        queueDropped.swap(queue);
+        condWorker.notify_all();
+        condProcess.notify_all();
+    }
+
+    LOCK(cs_vNodes);
+    BOOST_FOREACH (CJob& job, queueDropped) {
+        if (job.pfrom)
+            job.pfrom->Release();
+    }
+}
+
+bool CTxPreValidator::Submit(const CTransaction& tx, CNode* pfrom, const std::string& strCommand, bool ignoreFees)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fRunning || queue.size() >= nMaxQueue)
+        return false;
+
+    CJob job;
+    job.tx = tx;
+    {
+        LOCK(cs_vNodes);
+        job.pfrom = pfrom->AddRef();
+    }
+    job.strCommand = strCommand;
+    job.ignoreFees = ignoreFees;
+    job.nSequence = nNextSequence++;
+    queue.push_back(job);
+    condWorker.notify_one();
+    return true;
+}
+
+bool CTxPreValidator::SubmitOrphan(const CTransaction& tx, const boost::shared_ptr<std::set<NodeId> >& psetMisbehaving)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fRunning || queue.size() >= nMaxQueue)
+        return false;
+
+    CJob job;
+    job.tx = tx;
+    job.nSequence = nNextSequence++;
+    job.psetMisbehaving = psetMisbehaving;
+    queue.push_back(job);
+    condWorker.notify_one();
+    return true;
+}
+
+size_t CTxPreValidator::QueueSize()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+void CTxPreValidator::Thread()
+{
+    while (true) {
+        CJob job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fRunning && queue.empty())
+                condWorker.wait(lock);
+            if (!fRunning)
+                return;
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        bool fScriptsChecked = false;
+        try {
+            if (!PreValidateTransaction(job.tx, fScriptsChecked))
+                LogPrint("mempool", "%s: %s failed pre-validation\n", __func__, job.tx.GetHash().ToString());
+        } catch (std::exception& e) {
+            PrintExceptionContinue(&e, "CTxPreValidator::Thread()");
+        }
+
+        // Wait for the transactions queued earlier, which may be parents of this one
+        bool fProcess;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fRunning && nNextProcess != job.nSequence)
+                condProcess.wait(lock);
+            fProcess = fRunning;
+        }
+
+        if (fProcess) {
+            try {
+                // The transaction is accepted or rejected exactly as if it had
+                // been processed inline, the scripts are just not run twice.
+                if (job.pfrom)
+                    ProcessTransaction(job.pfrom, job.tx, job.strCommand, job.ignoreFees, fScriptsChecked);
+                else
+                    ProcessOrphanTransaction(job.tx.GetHash(), fScriptsChecked, job.psetMisbehaving);
+            } catch (std::exception& e) {
+                PrintExceptionContinue(&e, "CTxPreValidator::Thread()");
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nNextProcess++;
+            condProcess.notify_all();
+        }
+
+        if (job.pfrom) {
+            LOCK(cs_vNodes);
+            job.pfrom->Release();
+        }
+
+        if (!fProcess)
+            return;
+    }
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXPREVALIDATOR_H
+#define BITCOIN_TXPREVALIDATOR_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+
+#include <deque>
+#include <set>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace boost
+{
+class thread_group;
+} // namespace boost
+
+/** Default for -prevalidationthreads, 0 disables the pre-validation stage */
+static const int DEFAULT_PREVALIDATION_THREADS = 2;
+/** Maximum number of pre-validation threads */
+static const int MAX_PREVALIDATION_THREADS = 16;
+/** Maximum number of relayed transactions waiting for a pre-validation thread */
+static const unsigned int MAX_PREVALIDATION_QUEUE = 1000;
+
+/**
+ * Run the part of transaction validation that does not need cs_main to be
+ * held: zerocoin proof verification, which fills the zerocoin proof cache,
+ * and script verification against a snapshot of the spent coins. An
+ * outpoint always names the same output, so when fScriptsChecked is set the
+ * AcceptToMemoryPool call that follows skips the scripts and only does the
+ * other checks under cs_main.
+ *
+ * This never changes whether a transaction is accepted. It returns false if
+ * one of the checks failed, and true if they passed or could not be done
+ * (e.g. because of missing inputs), in which case fScriptsChecked is false.
+ */
+bool PreValidateTransaction(const CTransaction& tx, bool& fScriptsChecked);
+
+/**
+ * Pool of worker threads that pre-validate transactions relayed to us before
+ * handing them to ProcessTransaction, so that a flood of transactions no
+ * longer has all of its scripts checked while cs_main is held. The checks
+ * run in parallel, but the transactions are handed over one at a time in
+ * the order they were queued, so those of a peer are accepted in the order
+ * it sent them as long as the queue does not fill up. Orphans whose parents
+ * arrive are reconsidered the same way, through ProcessOrphanTransaction.
+ */
+class CTxPreValidator
+{
+private:
+    struct CJob {
+        CTransaction tx;
+        //! Peer that relayed the transaction, NULL for orphans being reconsidered
+        CNode* pfrom;
+        std::string strCommand;
+        bool ignoreFees;
+        //! Position of the job in the order transactions are handed to ProcessTransaction
+        uint64_t nSequence;
+        //! For orphans, the peers punished while resolving the orphans of the same parent
+        boost::shared_ptr<std::set<NodeId> > psetMisbehaving;
+
+        CJob() : pfrom(NULL), ignoreFees(false), nSequence(0) {}
+    };
+
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Worker threads block on this until the transactions queued before theirs were processed
+    boost::condition_variable condProcess;
+
+    //! Transactions waiting to be pre-validated
+    std::deque<CJob> queue;
+
+    //! Sequence of the next job queued
+    uint64_t nNextSequence;
+
+    //! Sequence of the next job to process
+    uint64_t nNextProcess;
+
+    //! Number of queued transactions at which Submit starts refusing work
+    unsigned int nMaxQueue;
+
+    //! Whether the worker threads are accepting work
+    bool fRunning;
+
+    void Thread();
+
+public:
+    CTxPreValidator();
+
+    //! Create nThreads worker threads in threadGroup
+    void Start(boost::thread_group& threadGroup, int nThreads, unsigned int nMaxQueueIn = MAX_PREVALIDATION_QUEUE);
+
+    //! Stop accepting work and drop the transactions that are still queued
+    void Stop();
+
+    /**
+     * Queue a transaction received from pfrom. This is called from the
+     * message handler thread, so it does not wait for room: it returns false
+     * if the workers are not running or the queue is full, in which case the
+     * caller should process the transaction itself. A child that gets ahead
+     * of its queued parent that way goes to the orphan pool, and is
+     * reconsidered once the parent is accepted.
+     */
+    bool Submit(const CTransaction& tx, CNode* pfrom, const std::string& strCommand, bool ignoreFees);
+
+    /**
+     * Queue an orphan for reconsideration after one of its parents was
+     * accepted. This is called with cs_main held, so it does not wait for
+     * room. Returns false if the caller should reconsider it itself.
+     * psetMisbehaving is shared with the other orphans of the same parent
+     * and only used under cs_main.
+     */
+    bool SubmitOrphan(const CTransaction& tx, const boost::shared_ptr<std::set<NodeId> >& psetMisbehaving);
+
+    size_t QueueSize();
+};
+
+extern CTxPreValidator txPreValidator;
+
+#endif // BITCOIN_TXPREVALIDATOR_H
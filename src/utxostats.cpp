@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxostats.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+
+CUtxoStatsTracker utxoStats;
+
+namespace
+{
+//! Size of the coin database key of an outpoint: 'C', txid and VARINT(n)
+int64_t GetCoinKeySize(const COutPoint& outpoint)
+{
+    uint32_t n = outpoint.n;
+    return 1 + sizeof(uint256) + ::GetSerializeSize(VARINT(n), SER_DISK, CLIENT_VERSION);
+}
+
+//! The MuHash element of a coin is its outpoint followed by the coin, as serialized on disk
+CDataStream GetCoinElement(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << outpoint << coin;
+    return ss;
+}
+} // anon namespace
+
+CUtxoStats::CUtxoStats(const CCoinsStats& stats) : hashBlock(stats.hashBlock),
+                                                   nTransactionOutputs(stats.nTransactionOutputs),
+                                                   nTotalAmount(stats.nTotalAmount),
+                                                   nSerializedSize(stats.nSerializedSize),
+                                                   muhash(stats.muhash)
+{
+}
+
+void CUtxoStats::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = GetCoinElement(outpoint, coin);
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs++;
+    nTotalAmount += coin.out.nValue;
+    nSerializedSize += GetCoinKeySize(outpoint) + ::GetSerializeSize(coin, SER_DISK, CLIENT_VERSION);
+}
+
+void CUtxoStats::RemoveCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = GetCoinElement(outpoint, coin);
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs--;
+    nTotalAmount -= coin.out.nValue;
+    nSerializedSize -= GetCoinKeySize(outpoint) + ::GetSerializeSize(coin, SER_DISK, CLIENT_VERSION);
+}
+
+void CUtxoStats::Apply(const CUtxoStats& delta)
+{
+    hashBlock = delta.hashBlock;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nTotalAmount += delta.nTotalAmount;
+    nSerializedSize += delta.nSerializedSize;
+    muhash *= delta.muhash;
+}
+
+bool CUtxoStats::Matches(const CUtxoStats& other) const
+{
+    return nTransactionOutputs == other.nTransactionOutputs &&
+           nTotalAmount == other.nTotalAmount &&
+           nSerializedSize == other.nSerializedSize &&
+           muhash.Finalize() == other.muhash.Finalize();
+}
+
+bool CUtxoStatsTracker::Get(CUtxoStats& statsOut) const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (!fValid)
+        return false;
+    statsOut = stats;
+    return true;
+}
+
+void CUtxoStatsTracker::Set(const CUtxoStats& statsIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    stats = statsIn;
+    fValid = true;
+}
+
+void CUtxoStatsTracker::Apply(const CUtxoStats& delta)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (fValid)
+        stats.Apply(delta);
+    if (fScanning)
+        vScanLog.push_back(delta);
+}
+
+void CUtxoStatsTracker::StartScan(const uint256& hashTip)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fScanning = true;
+    hashScanStart = hashTip;
+    vScanLog.clear();
+}
+
+void CUtxoStatsTracker::AbortScan()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fScanning = false;
+    vScanLog.clear();
+}
+
+bool CUtxoStatsTracker::FinishScan(const CUtxoStats& statsScan, bool& fMismatch)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fMismatch = false;
+    if (!fScanning)
+        return false;
+    fScanning = false;
+
+    // The database may have been flushed again while it was scanned, so
+    // start after the last change that led to the scanned block. If a block
+    // was disconnected and connected again in the meantime, the set at both
+    // points is the same.
+    std::vector<CUtxoStats> vLog;
+    vLog.swap(vScanLog);
+    size_t nStart = vLog.size();
+    while (nStart > 0 && vLog[nStart - 1].hashBlock != statsScan.hashBlock)
+        nStart--;
+    if (nStart == 0 && statsScan.hashBlock != hashScanStart)
+        return false;
+
+    CUtxoStats statsTip = statsScan;
+    for (size_t i = nStart; i < vLog.size(); i++)
+        statsTip.Apply(vLog[i]);
+
+    if (fValid)
+        fMismatch = statsTip.hashBlock != stats.hashBlock || !statsTip.Matches(stats);
+    stats = statsTip;
+    fValid = true;
+    return true;
+}
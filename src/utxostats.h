@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Xuez developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSTATS_H
+#define BITCOIN_UTXOSTATS_H
+
+#include "amount.h"
+#include "muhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+class COutPoint;
+class Coin;
+struct CCoinsStats;
+
+/** Default for -checkutxostats */
+static const bool DEFAULT_CHECK_UTXO_STATS = false;
+
+/**
+ * Statistics of the unspent output set that are updated coin by coin: the
+ * aggregates gettxoutsetinfo reports and a MuHash of the set.
+ *
+ * The same class holds the changes a block makes, with negative counts for
+ * blocks that spend more than they create, so it can be applied to the
+ * statistics of the previous block.
+ */
+class CUtxoStats
+{
+public:
+    //! Block the statistics are for
+    uint256 hashBlock;
+    int64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    //! Size of the coin database records, keys included
+    int64_t nSerializedSize;
+    CMuHash3072 muhash;
+
+    CUtxoStats() : hashBlock(0), nTransactionOutputs(0), nTotalAmount(0), nSerializedSize(0) {}
+    //! Take over the statistics of a scan of the coin database
+    explicit CUtxoStats(const CCoinsStats& stats);
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void RemoveCoin(const COutPoint& outpoint, const Coin& coin);
+
+    //! Apply the changes of a block, and move to that block
+    void Apply(const CUtxoStats& delta);
+
+    //! Whether the same set is described, regardless of the block
+    bool Matches(const CUtxoStats& other) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+        READWRITE(nSerializedSize);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * The statistics of the active chain's unspent output set.
+ *
+ * They are only valid once they have been loaded from the coin database or
+ * computed by a scan of it. Such a scan runs in the background while blocks
+ * keep being connected, so the changes of those blocks are logged and
+ * applied to the result of the scan when it is done.
+ */
+class CUtxoStatsTracker
+{
+private:
+    mutable boost::mutex cs;
+    CUtxoStats stats;
+    bool fValid;
+
+    //! Whether a scan is running, and the changes since it started
+    bool fScanning;
+    uint256 hashScanStart;
+    std::vector<CUtxoStats> vScanLog;
+
+public:
+    CUtxoStatsTracker() : fValid(false), fScanning(false), hashScanStart(0) {}
+
+    //! Returns false if the statistics are not known yet
+    bool Get(CUtxoStats& statsOut) const;
+    void Set(const CUtxoStats& statsIn);
+
+    //! Apply the changes of a block connected to or disconnected from the tip
+    void Apply(const CUtxoStats& delta);
+
+    //! Start logging changes; the coin database must be at hashTip
+    void StartScan(const uint256& hashTip);
+    void AbortScan();
+
+    /**
+     * Bring the statistics of a scan up to the tip with the logged changes and
+     * take them over. fMismatch is set when they differ from the incremental
+     * ones. Returns false if the scanned block is not in the log.
+     */
+    bool FinishScan(const CUtxoStats& statsScan, bool& fMismatch);
+};
+
+extern CUtxoStatsTracker utxoStats;
+
+#endif // BITCOIN_UTXOSTATS_H
@@ -746,6 +746,14 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
+        // Move the denominated coins it creates and spends to their buckets
+        if (fDenominatedCoinsIndexed) {
+            for (unsigned int i = 0; i < wtx.vout.size(); i++)
+                UpdateDenominatedCoin(COutPoint(hash, i));
+            BOOST_FOREACH (const CTxIn& txin, wtx.vin)
+                UpdateDenominatedCoin(txin.prevout);
+        }
+
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -785,6 +793,20 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     LOCK2(cs_main, cs_wallet);
+
+    // A transaction conflicting with one of ours, connected or disconnected,
+    // changes whether the coins ours spends are spent, for a failed mix too
+    if (fDenominatedCoinsIndexed && !tx.IsZerocoinSpend()) {
+        uint256 hash = tx.GetHash();
+        BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+            pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(txin.prevout);
+            for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+                if (it->second != hash)
+                    fDenominatedCoinsIndexed = false;
+            }
+        }
+    }
+
     if (!AddToWalletIfInvolvingMe(tx, pblock, true))
         return; // Not one of ours
 
@@ -803,8 +825,12 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            // the rounds of the outputs spending it may change, count them again
+            mapObfuscationRounds.clear();
+            fDenominatedCoinsIndexed = false;
+        }
     }
     return;
 }
@@ -847,8 +873,6 @@ CAmount CWallet::GetDebit(const CTxIn& txin, const isminefilter& filter) const
 // Recursively determine the rounds of a given input (How deep is the Obfuscation chain for a given input)
 int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
-
     if (rounds >= 16) return 15; // 16 rounds max
 
     uint256 hash = in.prevout.hash;
@@ -856,17 +880,10 @@ int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
 
     const CWalletTx* wtx = GetWalletTx(hash);
     if (wtx != NULL) {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        // not known yet, let's add it
-        if (mdwi == mDenomWtxes.end()) {
-            LogPrint("obfuscation", "GetInputObfuscationRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        }
-        // found and it's not an initial value, just return it
-        else if (mDenomWtxes[hash].vout[nout].nRounds != -10) {
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
-
+        // found, just return it
+        std::map<COutPoint, int>::const_iterator mi = mapObfuscationRounds.find(in.prevout);
+        if (mi != mapObfuscationRounds.end())
+            return mi->second;
 
         // bounds check
         if (nout >= wtx->vout.size()) {
@@ -875,18 +892,19 @@ int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
             return -4;
         }
 
-        if (pwalletMain->IsCollateralAmount(wtx->vout[nout].nValue)) {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+        int& nRounds = mapObfuscationRounds[in.prevout];
+        if (IsCollateralAmount(wtx->vout[nout].nValue)) {
+            nRounds = -3;
+            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRounds);
+            return nRounds;
         }
 
         //make sure the final output is non-denominate
         if (/*rounds == 0 && */ !IsDenominatedAmount(wtx->vout[nout].nValue)) //NOT DENOM
         {
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            nRounds = -2;
+            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRounds);
+            return nRounds;
         }
 
         bool fAllDenoms = true;
@@ -895,9 +913,9 @@ int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
         }
         // this one is denominated but there is another non-denominated output found in the same tx
         if (!fAllDenoms) {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            nRounds = 0;
+            LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRounds);
+            return nRounds;
         }
 
         int nShortest = -10; // an initial value, should be no way to get this by calculations
@@ -913,11 +931,11 @@ int CWallet::GetRealInputObfuscationRounds(CTxIn in, int rounds) const
                 }
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
-                                                             :
-                                                             0; // too bad, we are the fist one in that chain
-        LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        nRounds = fDenomFound ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
+                                :
+                                0; // too bad, we are the fist one in that chain
+        LogPrint("obfuscation", "GetInputObfuscationRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRounds);
+        return nRounds;
     }
 
     return rounds - 1;
@@ -967,6 +985,48 @@ bool CWallet::IsDenominatedAmount(CAmount nInputAmount) const
     return false;
 }
 
+void CWallet::UpdateDenominatedCoin(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
+    if (mi == mapWallet.end() || outpoint.n >= mi->second.vout.size())
+        return;
+
+    const CTxOut& out = mi->second.vout[outpoint.n];
+    if (!IsDenominatedAmount(out.nValue))
+        return;
+    isminetype mine = IsMine(out);
+    if (mine == ISMINE_NO || mine == ISMINE_WATCH_ONLY)
+        return;
+
+    int nRounds = GetRealInputObfuscationRounds(CTxIn(outpoint.hash, outpoint.n), 0);
+    if (!IsSpent(outpoint.hash, outpoint.n)) {
+        mapDenominatedCoins[out.nValue][nRounds].insert(outpoint);
+        return;
+    }
+
+    DenominatedCoinMap::iterator itDenom = mapDenominatedCoins.find(out.nValue);
+    if (itDenom == mapDenominatedCoins.end())
+        return;
+    std::map<int, std::set<COutPoint> >::iterator itRounds = itDenom->second.find(nRounds);
+    if (itRounds == itDenom->second.end())
+        return;
+    itRounds->second.erase(outpoint);
+    if (itRounds->second.empty())
+        itDenom->second.erase(itRounds);
+}
+
+void CWallet::IndexDenominatedCoins() const
+{
+    AssertLockHeld(cs_wallet);
+    mapDenominatedCoins.clear();
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        for (unsigned int i = 0; i < it->second.vout.size(); i++)
+            UpdateDenominatedCoin(COutPoint(it->first, i));
+    }
+    fDenominatedCoinsIndexed = true;
+}
+
 bool CWallet::IsChange(const CTxOut& txout) const
 {
     // TODO: fix handling of 'change' outputs. The assumption is that any
@@ -1208,8 +1268,8 @@ void CWalletTx::RelayWalletTransaction(std::string strCommand)
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if (strCommand == "ix") {
-                mapTxLockReq.insert(make_pair(hash, (CTransaction) * this));
-                CreateNewLock(((CTransaction) * this));
+                swiftTxManager.AddLockRequest((CTransaction) * this);
+                swiftTxManager.CreateNewLock(((CTransaction) * this));
                 RelayTransactionLockReq((CTransaction) * this, true);
             } else {
                 RelayTransaction((CTransaction) * this);
@@ -1454,19 +1514,20 @@ double CWallet::GetAverageAnonymizedRounds() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
-
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                CTxIn vin = CTxIn(hash, i);
-
-                if (IsSpent(hash, i) || IsMine(pcoin->vout[i]) != ISMINE_SPENDABLE || !IsDenominated(vin)) continue;
-
-                int rounds = GetInputObfuscationRounds(vin);
-                fTotal += (float)rounds;
-                fCount += 1;
+        if (!fDenominatedCoinsIndexed)
+            IndexDenominatedCoins();
+
+        for (DenominatedCoinMap::const_iterator itDenom = mapDenominatedCoins.begin(); itDenom != mapDenominatedCoins.end(); ++itDenom) {
+            std::map<int, std::set<COutPoint> >::const_iterator itRounds;
+            for (itRounds = itDenom->second.begin(); itRounds != itDenom->second.end(); ++itRounds) {
+                int rounds = std::min(itRounds->first, nZeromintPercentage);
+                BOOST_FOREACH (const COutPoint& outpoint, itRounds->second) {
+                    const CWalletTx& wtx = mapWallet.find(outpoint.hash)->second;
+                    if (IsSpent(outpoint.hash, outpoint.n) || IsMine(wtx.vout[outpoint.n]) != ISMINE_SPENDABLE) continue;
+
+                    fTotal += (float)rounds;
+                    fCount += 1;
+                }
             }
         }
     }
@@ -1486,19 +1547,20 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-
-            uint256 hash = (*it).first;
-
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                CTxIn vin = CTxIn(hash, i);
-
-                if (IsSpent(hash, i) || IsMine(pcoin->vout[i]) != ISMINE_SPENDABLE || !IsDenominated(vin)) continue;
-                if (pcoin->GetDepthInMainChain() < 0) continue;
-
-                int rounds = GetInputObfuscationRounds(vin);
-                nTotal += pcoin->vout[i].nValue * rounds / nZeromintPercentage;
+        if (!fDenominatedCoinsIndexed)
+            IndexDenominatedCoins();
+
+        for (DenominatedCoinMap::const_iterator itDenom = mapDenominatedCoins.begin(); itDenom != mapDenominatedCoins.end(); ++itDenom) {
+            std::map<int, std::set<COutPoint> >::const_iterator itRounds;
+            for (itRounds = itDenom->second.begin(); itRounds != itDenom->second.end(); ++itRounds) {
+                int rounds = std::min(itRounds->first, nZeromintPercentage);
+                BOOST_FOREACH (const COutPoint& outpoint, itRounds->second) {
+                    const CWalletTx& wtx = mapWallet.find(outpoint.hash)->second;
+                    if (IsSpent(outpoint.hash, outpoint.n) || IsMine(wtx.vout[outpoint.n]) != ISMINE_SPENDABLE) continue;
+                    if (wtx.GetDepthInMainChain() < 0) continue;
+
+                    nTotal += itDenom->first * rounds / nZeromintPercentage;
+                }
             }
         }
     }
@@ -1592,6 +1654,30 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     return nTotal;
 }
 
+bool CWallet::IsAvailableTx(const CWalletTx* pcoin, bool fOnlyConfirmed, bool fUseIX, int& nDepth) const
+{
+    if (!CheckFinalTx(*pcoin))
+        return false;
+
+    if (fOnlyConfirmed && !pcoin->IsTrusted())
+        return false;
+
+    if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
+        return false;
+
+    nDepth = pcoin->GetDepthInMainChain(false);
+    // do not use IX for inputs that have less then 6 blockchain confirmations
+    if (fUseIX && nDepth < 6)
+        return false;
+
+    // We should not consider coins which aren't at least in our mempool
+    // It's possible for these to be conflicted via ancestors which we may never be able to detect
+    if (nDepth == 0 && !pcoin->InMempool())
+        return false;
+
+    return true;
+}
+
 /**
  * populate vCoins with vector of available COutputs.
  */
@@ -1605,23 +1691,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             const uint256& wtxid = it->first;
             const CWalletTx* pcoin = &(*it).second;
 
-            if (!CheckFinalTx(*pcoin))
-                continue;
-
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
-
-            if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
-                continue;
-
-            int nDepth = pcoin->GetDepthInMainChain(false);
-            // do not use IX for inputs that have less then 6 blockchain confirmations
-            if (fUseIX && nDepth < 6)
-                continue;
-
-            // We should not consider coins which aren't at least in our mempool
-            // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool())
+            int nDepth;
+            if (!IsAvailableTx(pcoin, fOnlyConfirmed, fUseIX, nDepth))
                 continue;
 
             for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
@@ -1672,6 +1743,44 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
     }
 }
 
+void CWallet::AvailableDenominatedCoins(vector<COutput>& vCoins, int nDenom, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const
+{
+    vCoins.clear();
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        if (!fDenominatedCoinsIndexed)
+            IndexDenominatedCoins();
+
+        for (unsigned int i = 0; i < obfuScationDenominations.size(); i++) {
+            if (!(nDenom & (1 << i))) continue;
+            DenominatedCoinMap::const_iterator itDenom = mapDenominatedCoins.find(obfuScationDenominations[i]);
+            if (itDenom == mapDenominatedCoins.end()) continue;
+
+            std::map<int, std::set<COutPoint> >::const_iterator itRounds;
+            for (itRounds = itDenom->second.begin(); itRounds != itDenom->second.end(); ++itRounds) {
+                // respect current settings, as GetInputObfuscationRounds does
+                int rounds = std::min(itRounds->first, nZeromintPercentage);
+                if (rounds >= nObfuscationRoundsMax) continue;
+                if (rounds < nObfuscationRoundsMin) continue;
+
+                BOOST_FOREACH (const COutPoint& outpoint, itRounds->second) {
+                    const CWalletTx* pcoin = &mapWallet.find(outpoint.hash)->second;
+                    int nDepth;
+                    if (!IsAvailableTx(pcoin, true, false, nDepth))
+                        continue;
+                    if (IsSpent(outpoint.hash, outpoint.n) || IsLockedCoin(outpoint.hash, outpoint.n))
+                        continue;
+
+                    isminetype mine = IsMine(pcoin->vout[outpoint.n]);
+                    bool fIsSpendable = (mine & ISMINE_SPENDABLE) != ISMINE_NO || (mine & ISMINE_MULTISIG) != ISMINE_NO;
+                    vCoins.emplace_back(COutput(pcoin, outpoint.n, nDepth, fIsSpendable));
+                }
+            }
+        }
+    }
+}
+
 map<CBitcoinAddress, vector<COutput> > CWallet::AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue)
 {
     vector<COutput> vCoins;
@@ -1982,7 +2091,7 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount
 
     vCoinsRet2.clear();
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, ONLY_DENOMINATED);
+    AvailableDenominatedCoins(vCoins, nDenom, nObfuscationRoundsMin, nObfuscationRoundsMax);
 
     std::random_shuffle(vCoins.rbegin(), vCoins.rend());
 
@@ -2018,10 +2127,6 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount
 
             CTxIn vin = CTxIn(out.tx->GetHash(), out.i);
 
-            int rounds = GetInputObfuscationRounds(vin);
-            if (rounds >= nObfuscationRoundsMax) continue;
-            if (rounds < nObfuscationRoundsMin) continue;
-
             if (fFound10000 && fFound1000 && fFound100 && fFound10 && fFound1 && fFoundDot1) { //if fulfilled
                 //we can return this for submission
                 if (nValueRet >= nValueMin) {
@@ -2087,7 +2192,10 @@ bool CWallet::SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<
     nValueRet = 0;
 
     vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, coinControl, nObfuscationRoundsMin < 0 ? ONLY_NONDENOMINATED_NOT10000IFMN : ONLY_DENOMINATED);
+    if (nObfuscationRoundsMin < 0)
+        AvailableCoins(vCoins, true, coinControl, false, ONLY_NONDENOMINATED_NOT10000IFMN);
+    else
+        AvailableDenominatedCoins(vCoins, (1 << obfuScationDenominations.size()) - 1, nObfuscationRoundsMin, nObfuscationRoundsMax);
 
     set<pair<const CWalletTx*, unsigned int> > setCoinsRet2;
 
@@ -3977,12 +4085,7 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if (!fEnableSwiftTX) return -1;
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return (*i).second.CountSignatures();
-    }
-
-    return -1;
+    return swiftTxManager.GetLockSignatures(GetHash());
 }
 
 bool CMerkleTx::IsTransactionLockTimedOut() const
@@ -3990,12 +4093,7 @@ bool CMerkleTx::IsTransactionLockTimedOut() const
     if (!fEnableSwiftTX) return 0;
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return GetTime() > (*i).second.nTimeout;
-    }
-
-    return false;
+    return swiftTxManager.IsLockTimedOut(GetHash());
 }
 
 bool CWallet::CreateZerocoinMintTransaction(const CAmount nValue, CMutableTransaction& txNew, vector<CZerocoinMint>& vMints, CReserveKey* reservekey, int64_t& nFeeRet, std::string& strFailReason, const CCoinControl* coinControl, const bool isZCSpendChange)
@@ -187,6 +187,22 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Obfuscation rounds of our outputs, each worked out once, and our unspent denominated
+     * outputs bucketed by denomination and rounds, so that mixing picks its inputs without
+     * walking the whole wallet. The buckets are filled the first time they are needed, once
+     * all the transactions are loaded, then kept up to date as transactions are added.
+     */
+    typedef std::map<CAmount, std::map<int, std::set<COutPoint> > > DenominatedCoinMap;
+    mutable std::map<COutPoint, int> mapObfuscationRounds;
+    mutable DenominatedCoinMap mapDenominatedCoins;
+    mutable bool fDenominatedCoinsIndexed;
+    void UpdateDenominatedCoin(const COutPoint& outpoint) const;
+    void IndexDenominatedCoins() const;
+
+    //! whether the outputs of a wallet transaction can be spent yet, and its depth
+    bool IsAvailableTx(const CWalletTx* pcoin, bool fOnlyConfirmed, bool fUseIX, int& nDepth) const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
@@ -285,6 +301,7 @@ public:
         nTimeFirstKey = 0;
         fWalletUnlockAnonymizeOnly = false;
         fBackupMints = false;
+        fDenominatedCoinsIndexed = false;
 
         // Stake Settings
         nHashDrift = 45;
@@ -350,6 +367,8 @@ public:
     }
 
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed = true, const CCoinControl* coinControl = NULL, bool fIncludeZeroValue = false, AvailableCoinsType nCoinType = ALL_COINS, bool fUseIX = false) const;
+    //! confirmed denominated coins of the denominations in nDenom, one bit per obfuScationDenominations entry, with rounds in [min, max)
+    void AvailableDenominatedCoins(std::vector<COutput>& vCoins, int nDenom, int nObfuscationRoundsMin, int nObfuscationRoundsMax) const;
     std::map<CBitcoinAddress, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 